@@ -0,0 +1,157 @@
+/***************************************************************************//**
+ * @file    vdFrame.h
+ *
+ * @brief   Frames of the SPI protocol between IOS and the WiFi-VirtDisk
+ *          client (ESP8266).
+ *
+ *          The same file is used by both sketches and the server and has
+ *          no Arduino dependencies, so the protocol logic can be tested on
+ *          a host.
+ *
+ *          Every command frame ends with an additive checksum, all bytes of
+ *          the frame including the checksum add up to 0.
+ *
+ *          The data itself is protected end to end by a CRC-16 of every 32
+ *          byte segment. The server calculates it when reading a sector, the
+ *          client forwards it and IOS checks it. For writing, IOS calculates
+ *          it and the client and the server check it.
+ *
+ *          A segment read (VD_CMD_RD_SEGMENT) returns a whole 32 byte IOS
+ *          segment in one transfer. The data fills the complete HSPI buffer,
+ *          the CRC-16 of the data is sent in the status register instead.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef VDFRAME_H
+#define VDFRAME_H
+
+/****************************************************************** Includes **/
+#include <stdint.h>
+
+
+/******************************************************************* Defines **/
+#define VD_FRAME_SIZE       32    // Size of the HSPI data buffer
+#define VD_SEGMENT_SIZE     32    // Size of an IOS segment (readSD() / writeSD())
+#define VD_SEGMENTS         16    // Segments of a 512 byte sector
+
+// Segment read request: command, sequence bit, checksum
+#define VD_RD_SEGMENT_LEN   3
+
+// Write confirmation: command, length, CRC-16 of the segment (low, high), checksum
+#define VD_WR_NEXT_LEN      5
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Calculates the checksum byte that is appended to a frame.
+ *
+ * @param   frame   The frame without checksum.
+ * @param   len     Length of the frame without checksum.
+ *
+ * @return  Checksum byte, the sum of all bytes and the checksum is 0.
+ ******************************************************************************/
+static inline uint8_t vdFrameChecksum( const uint8_t* frame, uint8_t len )
+{
+  uint8_t checksum = 0xFF;
+
+  while( len-- ) { checksum += *frame++; }
+
+  return (uint8_t)~checksum;
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks the checksum of a received frame.
+ *
+ * @param   frame   The frame including the checksum.
+ * @param   len     Length of the frame including the checksum.
+ *
+ * @return  1 if the checksum is correct, otherwise 0.
+ ******************************************************************************/
+static inline uint8_t vdFrameValid( const uint8_t* frame, uint8_t len )
+{
+  uint8_t checksum = 0;
+
+  while( len-- ) { checksum += *frame++; }
+
+  return checksum == 0;
+}
+
+
+// CRC-16/XMODEM (polynomial 0x1021, initial value 0) as in libdsk/crc16.c.
+// The table has one entry per nibble, small enough for the RAM of the AVR.
+static const uint16_t vdCrc16Table[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/***************************************************************************//**
+ * @brief   Adds one byte to a CRC-16.
+ ******************************************************************************/
+static inline uint16_t vdCrc16Update( uint16_t crc, uint8_t data )
+{
+  crc = (uint16_t)( ( crc << 4 ) ^ vdCrc16Table[( ( crc >> 12 ) ^ ( data >> 4 ) ) & 0x0F] );
+  crc = (uint16_t)( ( crc << 4 ) ^ vdCrc16Table[( ( crc >> 12 ) ^ data ) & 0x0F] );
+
+  return crc;
+}
+
+
+/***************************************************************************//**
+ * @brief   CRC-16 over a data block, e.g. one segment of a sector.
+ ******************************************************************************/
+static inline uint16_t vdCrc16( const uint8_t* data, uint16_t len )
+{
+  uint16_t crc = 0;
+
+  while( len-- ) { crc = vdCrc16Update( crc, *data++ ); }
+
+  return crc;
+}
+
+
+/***************************************************************************//**
+ * @brief   Builds a segment read request.
+ *
+ * @param   frame     Receives the request, VD_RD_SEGMENT_LEN bytes.
+ * @param   cmd       Command code (VD_CMD_RD_SEGMENT).
+ * @param   seq       Sequence bit, toggled after every received segment.
+ *                    The same bit again requests the previous segment.
+ *
+ * @return  Length of the request.
+ ******************************************************************************/
+static inline uint8_t vdBuildRdSegment( uint8_t* frame, uint8_t cmd, uint8_t seq )
+{
+  frame[0] = cmd;
+  frame[1] = seq;
+  frame[2] = vdFrameChecksum( frame, 2 );
+
+  return VD_RD_SEGMENT_LEN;
+}
+
+
+/***************************************************************************//**
+ * @brief   Builds a write confirmation, the receiver takes over the data.
+ *
+ * @param   frame     Receives the confirmation, VD_WR_NEXT_LEN bytes.
+ * @param   cmd       Command code (VD_CMD_WR_NEXT).
+ * @param   len       Number of bytes written, 0 to finalize.
+ * @param   crc       CRC-16 of the written segment.
+ *
+ * @return  Length of the confirmation.
+ ******************************************************************************/
+static inline uint8_t vdBuildWrNext( uint8_t* frame, uint8_t cmd, uint8_t len, uint16_t crc )
+{
+  frame[0] = cmd;
+  frame[1] = len;
+  frame[2] = (uint8_t)( crc & 0xFF );
+  frame[3] = (uint8_t)( crc >> 8 );
+  frame[4] = vdFrameChecksum( frame, 4 );
+
+  return VD_WR_NEXT_LEN;
+}
+
+
+#endif
@@ -11,6 +11,7 @@
 #include "virtDisk.h"
 #include "Arduino.h"
 #include "pffArduino.h"
+#include "vdFrame.h"
 
 
 /******************************************************************* Defines **/
@@ -18,6 +19,10 @@
 
 #define MAX_ATTEMPTS (uint8_t)4
 
+// Pause between frames sent without waiting for the status, so the
+// ESP8266 can take the previous frame out of the HSPI buffer
+#define VD_FRAME_GAP_US 50
+
 typedef enum
 {
   SRV_CONNECTED = 0x01,
@@ -30,6 +35,8 @@ typedef enum
 /********************************************************** Global Variables **/
 vdStatus_t vdStatus;
 uint8_t    vdChecksum;
+uint8_t    vdRdSeq;     // Sequence bit of the next segment read
+uint8_t    vdDiskChanged = 0;
 // uint8_t bytesSent;
 
 
@@ -149,6 +156,7 @@ FRESULT vd_status( uint8_t* wifiStatus, uint8_t* srvStatus )
       {
         *wifiStatus = vdStatus.cmd_status;
         *srvStatus  = vdStatus.cmd_data;
+        vdDiskChanged |= vdStatus.free;   // Disk change notifications of the server
 
         // WiFi-Status: WL_CONNECTED = 3
         if( ( vdStatus.cmd_status != WL_CONNECTED ) && ( ( vdStatus.cmd_data & SRV_CONNECTED ) != SRV_CONNECTED ) )
@@ -251,6 +259,9 @@ FRESULT vd_open (
   uint8_t attempts = 0;
 
 
+  // A new file starts with a new segment sequence
+  vdRdSeq = 0;
+
   // VD_CMD_SEL_FILE
   do 
   {
@@ -305,131 +316,99 @@ FRESULT vd_open (
 
 FRESULT vd_read (
 	void* buff, /* Pointer to the read buffer (NULL:Forward data to the stream)*/
-	UINT btr,		/* Number of bytes to read */
+	UINT btr,		/* Number of bytes to read (one segment, VD_SEGMENT_SIZE) */
 	UINT* br		/* Pointer to number of bytes read */
 )
 {
-  uint8_t status   = FR_OK;
-  uint8_t offset   = 0;
+  uint8_t status   = FR_DISK_ERR;
   uint8_t attempts = 0;
+  uint8_t frame[VD_RD_SEGMENT_LEN];
+  uint8_t len;
 
-  byte dataLen = 0;
+  byte dataLen;
   byte *buf = (byte*)buff;
 
-  // VD_CMD_RD_FILE (32 Bytes)
-  // 2x 16 Bytes
+  // VD_CMD_RD_SEGMENT (32 Bytes)
+  // The whole segment is read in one transfer. The sequence bit tells the
+  // ESP8266 whether the previous segment was received, a repeated request
+  // returns the same segment again.
   do 
   {
     attempts++;
 
+    len = vdBuildRdSegment( frame, VD_CMD_RD_SEGMENT, vdRdSeq );
+
     SELECT();                   // Enable CS
     xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
     xmit_spi( 0x00 );
-
-    vdChecksum = 0xFF;
-    xmit_spi( VD_CMD_RD_FILE ); // Byte 1: Send command
-    vdChecksum += VD_CMD_RD_FILE;
-    xmit_spi( offset );         // Byte 2: Send offset
-    vdChecksum += offset;
-    xmit_spi( 16 );             // Byte 3: Send number of bytes to read
-    vdChecksum += 16;
-    xmit_spi( ~vdChecksum );    // Byte 4: Send checksum
+    for( byte i = 0; i < len; i++ )
+    {
+      xmit_spi( frame[i] );     // Byte 1: Command, Byte 2: Sequence bit, Byte 3: Checksum
+    }
     DESELECT();                 // Disable CS
 
     int8_t spiStat = waitReady_spi( true, "R " );
-    if( ( vdStatus.cmd_status == 0 ) && ( spiStat == 0 ) )
+    if( spiStat == SPISLAVE_READ_ERR )
+    {
+      break;                      // The ESP8266 got no data from the server
+    }
+    if( spiStat == 0 )
     {
-      // dataLen += vdStatus.cmd_data;  // Read data length
+      dataLen = vdStatus.cmd_data;                // Valid bytes of the segment
+      if( dataLen > btr ) { dataLen = btr; }
 
-      // Serial.printf( " Status: %d ", vdStatus.cmd_status );
-      // Serial.printf( "dataLen: %d\n\r", vdStatus.cmd_data );
-      // Serial.printf( "dataLen: %d - Data:\n\r", vdStatus.cmd_data );
+      // The CRC-16 of the server covers the whole segment, including padding
+      uint16_t crc = 0;
 
       SELECT();                   // Enable CS
       xmit_spi( SPI_RD_DATA );    // ESP8266 Prefix-Bytes - Read Data
       xmit_spi( 0x00 );
-
-      vdChecksum = 0;
-      vdChecksum += rcv_spi();    // Byte 1: Receive command
-
-      byte i;
-      for( i = 0; ( (i < vdStatus.cmd_data) && (i < btr) ); i++ )
+      for( byte i = 0; i < VD_FRAME_SIZE; i++ )
       {
-        buf[(offset*16)+i] = rcv_spi();       // Byte 2+n: Read data (n=vdStatus.cmd_data)
-        vdChecksum += buf[(offset*16)+i];
-
-        // Serial.printf( "\n\r%i:%i - 0x%02X - 0x%02X", offset, i, buf[(offset*16)+i], vdChecksum );
+        byte data = rcv_spi();    // Byte 1-32: Segment data
+        crc = vdCrc16Update( crc, data );
+        if( i < dataLen ) { buf[i] = data; }
       }
-      vdChecksum += rcv_spi();    // Byte 3+n: Read checksum
-      // Serial.printf( "\n\rChecksum 0x%02X", vdChecksum );
       DESELECT();                 // Disable CS
 
-      if( vdChecksum == 0 )
+      // CRC of the data is sent in the status register (command status: low byte, free: high byte)
+      if( crc == ( ( (uint16_t)vdStatus.free << 8 ) | vdStatus.cmd_status ) )
       {
-        dataLen += vdStatus.cmd_data;  // Read data length
-        
-        offset++;
-        if( offset > 1 )
-        {
-          *br = dataLen;
-
-          // Serial.println();
-          status = vdStatus.cmd_status;
-        }
-      }
-      // else
-      // {
-      //   Serial.printf( "\n\rRead Checksum Error - %02X - %i\n\r", vdChecksum, offset );
-      // }
-    }
-    else 
-    {
-      if( attempts > (2*MAX_ATTEMPTS) )
-      {
-        status = FR_DISK_ERR;   // FR_NO_FILE;
+        *br = dataLen;
+        vdRdSeq ^= 1;
+        status = FR_OK;
         break;
       }
     }
 
-    // if( attempts > 2 ) { Serial.printf( "Read attempt #%i, Offset %i\n\r", attempts, offset ); }
+    // if( attempts > 2 ) { Serial.printf( "Read attempt #%i\n\r", attempts ); }
 
-  } while( offset < 2 );
+  } while( attempts <= (2*MAX_ATTEMPTS) );
 
-  if( status == FR_OK )
-  {
-    attempts = 0;
-    do
-    {
-      // Finalize the read and set the read pointer
-      SELECT();                   // Enable CS
-      xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
-      xmit_spi( 0x00 );
-
-      vdChecksum = 0xFF;
-      xmit_spi( VD_CMD_RD_NEXT ); // Byte 1: Send command
-      vdChecksum += VD_CMD_RD_NEXT;
-      xmit_spi( dataLen );        // Byte 2: Send data length
-      vdChecksum += dataLen;
-      xmit_spi( ~vdChecksum );    // Byte 3: Send checksum
-      DESELECT();                 // Disable CS
+  return (FRESULT)status;
+}
 
-      int8_t spiStat = waitReady_spi( true, "RN " );
-      if( ( vdStatus.cmd_status == 0 ) && ( spiStat == 0 ) )
-      {
-        // Error handling??
 
-        break;
-      }
-      else
-      {
-        attempts++;
-      }
-    } while( attempts <= MAX_ATTEMPTS );
+/***************************************************************************//**
+ * @brief   Sends VD_CMD_WR_NEXT, the ESP8266 takes over the written bytes.
+ *          Does not wait for the status.
+ *
+ * @param   dataLen Number of bytes written since the last VD_CMD_WR_NEXT.
+ * @param   crc     CRC-16 of the written segment.
+ ******************************************************************************/
+static void vd_sendWrNext( byte dataLen, uint16_t crc )
+{
+  uint8_t frame[VD_WR_NEXT_LEN];
+  uint8_t len = vdBuildWrNext( frame, VD_CMD_WR_NEXT, dataLen, crc );
 
-    if( attempts > MAX_ATTEMPTS ) { status = FR_DISK_ERR; }
+  SELECT();                   // Enable CS
+  xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
+  xmit_spi( 0x00 );
+  for( byte i = 0; i < len; i++ )
+  {
+    xmit_spi( frame[i] );     // Command, data length, CRC-16 (low, high), checksum
   }
-
-  return (FRESULT)status;
+  DESELECT();                 // Disable CS
 }
 
 
@@ -440,7 +419,7 @@ FRESULT vd_write (
 )
 {
   uint8_t status   = FR_OK;
-  uint8_t offset   = 0;
+  uint8_t offset;
   uint8_t attempts = 0;
 
   byte dataLen = 0;
@@ -451,102 +430,85 @@ FRESULT vd_write (
   {		
     // Serial.println( "Finalize" );
     *bw = 0;
+
+    do
+    {
+      vd_sendWrNext( dataLen, 0 );
+
+      int8_t spiStat = waitReady_spi( true, "WN " );
+      if( ( vdStatus.cmd_status == 0 ) && ( spiStat == 0 ) )
+      {
+        // Error handling??
+
+        break;
+      }
+      else
+      {
+        attempts++;
+      }
+    } while( attempts <= MAX_ATTEMPTS );
+
+    if( attempts > MAX_ATTEMPTS ) { status = FR_DISK_ERR; }
   }
   else 
   {
     // VD_CMD_WR_FILE (32 Bytes)
-    // 2x 16 Bytes
+    // 2x 16 Bytes and VD_CMD_WR_NEXT, sent without waiting in between. The
+    // ESP8266 queues the frames, its status after the last frame also
+    // reports a checksum error of the previous ones.
     do 
     {
       attempts++;
 
-      SELECT();                   // Enable CS
-      xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
-      xmit_spi( 0x00 );
-
-      vdChecksum = 0xFF;
-      xmit_spi( VD_CMD_WR_FILE ); // Byte 1: Send command
-      vdChecksum += VD_CMD_WR_FILE;
-      xmit_spi( offset );         // Byte 2: Send offset
-      vdChecksum += offset;
-      xmit_spi( 16 );             // Byte 3: Send number of bytes to write
-      vdChecksum += 16;
-
-      // Send data
-      byte i;
-      for( byte i = 0; i < 16; i++ )
-      {
-        xmit_spi( buf[(offset*16)+i] );       // Byte 4+n: Write data (n=16)
-        vdChecksum += buf[(offset*16)+i];
-        
-        // Serial.printf( "\n\r%i:%i - 0x%02X - 0x%02X", offset, i, buf[(offset*16)+i], vdChecksum );
-      }
-
-      xmit_spi( ~vdChecksum );    // Byte 5+n: Send checksum
-      DESELECT();                 // Disable CS
-    
-      int8_t spiStat = waitReady_spi( true, "W " );
-      if( ( vdStatus.cmd_status == 0 ) && ( spiStat == 0 ) )
-      {
-        // Serial.printf( " Status: %d ", vdStatus.cmd_status );
-        // Serial.printf( "dataLen: %d\n\r", vdStatus.cmd_data );
-        // Serial.printf( "dataLen: %d - Data:\n\r", vdStatus.cmd_data );
-        
-        dataLen += 16;
-
-        offset++;
-        if( offset > 1 )
-        {
-          *bw = dataLen;
-        }
-      }
-      else
+      for( offset = 0; offset < 2; offset++ )
       {
-        if( attempts > (2*MAX_ATTEMPTS) )
+        SELECT();                   // Enable CS
+        xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
+        xmit_spi( 0x00 );
+
+        vdChecksum = 0xFF;
+        xmit_spi( VD_CMD_WR_FILE ); // Byte 1: Send command
+        vdChecksum += VD_CMD_WR_FILE;
+        xmit_spi( offset );         // Byte 2: Send offset
+        vdChecksum += offset;
+        xmit_spi( 16 );             // Byte 3: Send number of bytes to write
+        vdChecksum += 16;
+
+        // Send data
+        for( byte i = 0; i < 16; i++ )
         {
-          status = FR_DISK_ERR;   // FR_NO_FILE;
-          break;
+          xmit_spi( buf[(offset*16)+i] );       // Byte 4+n: Write data (n=16)
+          vdChecksum += buf[(offset*16)+i];
         }
-      }
 
-      if( attempts > 2 ) { Serial.printf( "Write attempt #%i, Offset %i\n\r", attempts, offset ); }
+        xmit_spi( ~vdChecksum );    // Byte 5+n: Send checksum
+        DESELECT();                 // Disable CS
 
-    } while( offset < 2 );
-  }
-
-  // Finalize here
-  if( status == FR_OK )
-  {
-    attempts = 0;
-    do
-    {
-      // Finalize the read and set the read pointer
-      SELECT();                   // Enable CS
-      xmit_spi( SPI_WR_DATA );    // ESP8266 Prefix-Bytes - Write Data
-      xmit_spi( 0x00 );
+        delayMicroseconds( VD_FRAME_GAP_US );
+      }
 
-      vdChecksum = 0xFF;
-      xmit_spi( VD_CMD_WR_NEXT ); // Byte 1: Send command
-      vdChecksum += VD_CMD_WR_NEXT;
-      xmit_spi( dataLen );        // Byte 2: Send data length
-      vdChecksum += dataLen;
-      xmit_spi( ~vdChecksum );    // Byte 3: Send checksum
-      DESELECT();                 // Disable CS
+      dataLen = 32;
+      vd_sendWrNext( dataLen, vdCrc16( buf, dataLen ) );
 
-      int8_t spiStat = waitReady_spi( true, "WN " );
+      int8_t spiStat = waitReady_spi( true, "W " );
       if( ( vdStatus.cmd_status == 0 ) && ( spiStat == 0 ) )
       {
-        // Error handling??
-
+        *bw = dataLen;
         break;
       }
-      else
+      if( spiStat == 0 )
       {
-        attempts++;
+        // The sector was rejected by the server, the data of the previous
+        // segments is gone, so only IOS can repeat the whole sector
+        attempts = 2*MAX_ATTEMPTS + 1;
+        break;
       }
-    } while( attempts <= MAX_ATTEMPTS );
 
-    if( attempts > MAX_ATTEMPTS ) { status = FR_DISK_ERR; }
+      if( attempts > 2 ) { Serial.printf( "Write attempt #%i\n\r", attempts ); }
+
+    } while( attempts <= (2*MAX_ATTEMPTS) );
+
+    if( attempts > (2*MAX_ATTEMPTS) ) { status = FR_DISK_ERR; }
   }
 
   return (FRESULT)status;
@@ -561,6 +523,9 @@ FRESULT vd_lseek (
   uint8_t attempts = 0;
 
 
+  // The segment sequence starts again at the new position
+  vdRdSeq = 0;
+
   // VD_CMD_SEEK_FILE
   do 
   {
@@ -29,7 +29,8 @@ enum
 {
     SPISLAVE_READY,
     SPISLAVE_BUSY,
-    SPISLAVE_CHKSUM_ERR
+    SPISLAVE_CHKSUM_ERR,
+    SPISLAVE_READ_ERR       // VD_CMD_RD_SEGMENT: no data from the server
 };
 
 #pragma pack(1)
@@ -62,6 +63,7 @@ enum vdCommands
   VD_CMD_SEL_TR_SEC,
   VD_CMD_RD_SECTOR,
   VD_CMD_WR_SECTOR,
+  VD_CMD_RD_SEGMENT,
   VD_CMD_COUNT
 };
 
@@ -75,6 +77,7 @@ enum vdStatus
   VD_STATUS_TR_SEC_ERROR,
   VD_STATUS_SEC_RD_ERROR,
   VD_STATUS_SEC_WR_ERROR,
+  VD_STATUS_CHKSUM_ERROR,
   VD_STATUS_COUNT
 };
 
@@ -93,6 +96,9 @@ typedef enum {
 } wl_status_t;
 
 /********************************************************** Global Variables **/
+// Emulated disks changed on the server, one bit per disk. Set by vd_status(),
+// the user of a cached disk clears its bit after dropping the cache.
+extern uint8_t vdDiskChanged;
 
 /******************************************************* Functions / Methods **/
 uint8_t rdStatus_spi( void );
@@ -15,9 +15,8 @@
 /******************************************************************* Defines **/
 
 /********************************************************** Global Variables **/
-volatile bool spiDataRcvd = false;
 volatile bool spiDataSent = true;
-uint8_t*      spiDataBuf;
+spiRing_t     spiRxRing;        // Received frames, filled by SPIOnData()
 
 // volatile uint32_t spiSlaveStatus;
 volatile uint32_t spiMasterStatus;
@@ -44,7 +43,7 @@ void IRAM_ATTR SPIOnStatusSent( void )
 
 
 /***************************************************************************//**
- * @brief   Data received from the master.
+ * @brief   Data received from the master, runs in the SPI interrupt.
  *
  * @param   data  Pointer to the data buffer.
  * @param   len   Length of the data in buffer.
@@ -52,13 +51,10 @@ void IRAM_ATTR SPIOnStatusSent( void )
 void IRAM_ATTR SPIOnData( uint8_t* data, size_t len )
 {
   SPISlave.setStatus( SPISLAVE_BUSY );
-  
-  uint32_t savedPS = noInterrupts();  // cli();
 
-  spiDataBuf = data;
-  spiDataRcvd = true;
-
-  xt_wsr_ps(savedPS);  // sei();
+  // The data buffer is reused by the next transfer, keep a copy.
+  // A full ring drops the frame, the master gets no answer and retries.
+  spiRingPush( &spiRxRing, data, len );
 
   // Serial.println( "SPIOnData" );
 }
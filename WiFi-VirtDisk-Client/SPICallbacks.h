@@ -11,6 +11,7 @@
 
 /****************************************************************** Includes **/
 #include "Arduino.h"
+#include "spiRing.h"
 
 
 /******************************************************************* Defines **/
@@ -19,7 +20,8 @@ enum
 {
     SPISLAVE_READY,
     SPISLAVE_BUSY,
-    SPISLAVE_CHKSUM_ERR
+    SPISLAVE_CHKSUM_ERR,
+    SPISLAVE_READ_ERR       // VD_CMD_RD_SEGMENT: no data from the server
 };
 
 #define SPI_STATUS_RESET 0x00000000
@@ -41,7 +43,7 @@ enum
 
 
 /********************************************************** Global Variables **/
-extern uint8_t* spiDataBuf;
+extern spiRing_t spiRxRing;
 
 
 /******************************************************* Functions / Methods **/
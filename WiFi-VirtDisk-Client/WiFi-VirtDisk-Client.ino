@@ -263,6 +263,8 @@ void setup( void )
   {
     Serial.print( F("Connected to WiFi-VirtDisk Server (") );
     Serial.printf( "%s:%d).\n", vdConfig.vdServer, atoi(vdConfig.vdPort) );
+
+    vdWireNegotiate();
   }
   else
   {
@@ -286,7 +288,6 @@ void setup( void )
   SPISlave.setStatus( vdStatus.rawStatus );
 }
 
-extern bool     spiDataRcvd;
 #define RECONNECT_TIME 5000
 
 /***************************************************************************//**
@@ -305,7 +306,7 @@ void loop( void )
   wifiStatus = WiFi.status();
 
   // Process SPI command
-  if( spiDataRcvd )
+  if( spiRingFront( &spiRxRing ) != nullptr )
   {
     vdProcessCmd( wifiStatus );
   }
@@ -338,6 +339,8 @@ void loop( void )
       if( tcpClient.connect( vdConfig.vdServer, vdPort ) )
       {
         DBG_PRINTLN( "Reconnected to Server" );
+
+        vdWireNegotiate();    // A new connection starts with full packets
       } 
       else 
       {
@@ -365,7 +368,7 @@ void loop( void )
         // Serial.println( F("DebugClient read data") );
 
         char dbgBuffer[10];
-        dbgClient.read( dbgBuffer, sizeof(dbgBuffer) );
+        int  dbgLen = dbgClient.read( (uint8_t*)dbgBuffer, sizeof(dbgBuffer) );
         
         Serial.printf( "Debug command from Server: %c\n\r", dbgBuffer[0] );
 
@@ -389,6 +392,18 @@ void loop( void )
             digitalWrite( Z80_USER_PIN, LOW );
           break;
 
+          case 'N':
+            // Disk change notification, generations of the emulated disks
+            if( dbgLen == sizeof(dbgBuffer) )
+            {
+              vdDiskNotify( (const uint8_t*)dbgBuffer );
+            }
+            else
+            {
+              vdDiskInvalidate();   // Incomplete, assume all disks changed
+            }
+          break;
+
           default:
           break;
         }
@@ -396,6 +411,12 @@ void loop( void )
     }
     else
     {
+      // Changes of the disks are not notified without the debug connection
+      if( ( tcpSrvStatus & DBG_SRV_CONNECTED ) == DBG_SRV_CONNECTED )
+      {
+        vdDiskInvalidate();
+      }
+
       tcpSrvStatus &= ~DBG_SRV_CONNECTED;
       tcpSrvStatus |= DBG_SRV_DISCONNECTED;
 
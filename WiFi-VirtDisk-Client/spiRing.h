@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file    spiRing.h
+ *
+ * @brief   Ring buffer of received SPI frames.
+ *
+ *          The SPI interrupt (single producer) copies every 32 byte frame
+ *          into the ring, the main loop (single consumer) takes them out.
+ *          Each side only writes its own index, so no lock is needed.
+ *          The file has no Arduino dependencies and also compiles on a host.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef SPIRING_H
+#define SPIRING_H
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+
+
+/******************************************************************* Defines **/
+#define SPI_RING_FRAME_SIZE   32      // Size of the HSPI data buffer
+#define SPI_RING_FRAMES       8       // Number of frames, must be a power of 2
+
+// The producer runs in the SPI interrupt and must be in IRAM on the ESP8266
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+typedef struct
+{
+  std::atomic<uint8_t> head;          // Next frame to write, only changed by the producer
+  std::atomic<uint8_t> tail;          // Next frame to read, only changed by the consumer
+  uint32_t             overruns;      // Frames lost because the ring was full
+  uint8_t              frame[SPI_RING_FRAMES][SPI_RING_FRAME_SIZE];
+} spiRing_t;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Empties the ring. Must not be called while the producer is active.
+ ******************************************************************************/
+static inline void spiRingReset( spiRing_t* ring )
+{
+  ring->head.store( 0, std::memory_order_relaxed );
+  ring->tail.store( 0, std::memory_order_relaxed );
+  ring->overruns = 0;
+}
+
+
+/***************************************************************************//**
+ * @brief   Copies a frame into the ring (producer side).
+ *
+ * @param   data  Received data, shorter frames are filled with zeros.
+ * @param   len   Length of the data.
+ *
+ * @return  false if the ring is full and the frame was dropped.
+ ******************************************************************************/
+static inline bool IRAM_ATTR spiRingPush( spiRing_t* ring, const uint8_t* data, size_t len )
+{
+  uint8_t head = ring->head.load( std::memory_order_relaxed );
+
+  if( (uint8_t)( head - ring->tail.load( std::memory_order_acquire ) ) == SPI_RING_FRAMES )
+  {
+    ring->overruns++;
+    return false;
+  }
+
+  uint8_t* frame = ring->frame[head & ( SPI_RING_FRAMES - 1 )];
+  if( len > SPI_RING_FRAME_SIZE ) { len = SPI_RING_FRAME_SIZE; }
+  memcpy( frame, data, len );
+  memset( frame + len, 0, SPI_RING_FRAME_SIZE - len );
+
+  // Publish the frame after its data is complete
+  ring->head.store( head + 1, std::memory_order_release );
+
+  return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the oldest frame without removing it (consumer side).
+ *
+ * @return  Pointer to the frame, nullptr if the ring is empty.
+ ******************************************************************************/
+static inline const uint8_t* spiRingFront( spiRing_t* ring )
+{
+  uint8_t tail = ring->tail.load( std::memory_order_relaxed );
+
+  if( tail == ring->head.load( std::memory_order_acquire ) )
+  {
+    return nullptr;
+  }
+
+  return ring->frame[tail & ( SPI_RING_FRAMES - 1 )];
+}
+
+
+/***************************************************************************//**
+ * @brief   Removes the oldest frame, its slot can be reused by the producer.
+ ******************************************************************************/
+static inline void spiRingPop( spiRing_t* ring )
+{
+  ring->tail.store( ring->tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+
+#endif
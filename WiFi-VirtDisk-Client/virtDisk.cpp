@@ -12,23 +12,38 @@
 #include "virtDisk.hpp"
 #include "SPISlave.h"
 #include "SPICallbacks.h"
+#include "vdFrame.h"
+#include "vdWire.h"
 
 
 /******************************************************************* Defines **/
+#define VD_TCP_ATTEMPTS 3   // Transfers of a sector with a CRC error
 
 /********************************************************** Global Variables **/
 vdData_t   vdData;
 vdPacket_t vd;
+vdPacket_t vdAnswer;    // Answer of the server to a write, keeps the packet for a repetition
 vdStatus_t vdStatus;
 
 extern WiFiClient tcpClient;   // WiFi Client for communication
 extern uint8_t    wifiStatus;
 extern uint8_t    tcpSrvStatus;
 
-extern bool     spiDataRcvd;
 extern bool     spiDataSent;
 uint8_t         sendBuf[32];
 
+// Segment reads (VD_CMD_RD_SEGMENT)
+uint8_t         rdSeq  = 0xFF;  // Sequence bit of the last request, 0xFF: none since select / seek
+uint8_t         rdSent = 0;     // Bytes of the last segment sent
+
+// Disk change notifications of the server (debug connection)
+uint16_t        vdDiskGen[VD_DISKS];  // Last generation of every emulated disk
+uint8_t         vdDiskChanged = 0;    // Disks changed since the last VD_CMD_STATUS, one bit per disk
+
+// Compact frames of the TCP connection (vdWire.h)
+uint8_t         vdWireEnc = 0;        // Negotiated encodings (VD_WIRE_...), 0: full packets
+uint8_t         vdWireBuf[VD_WIRE_MAX_LEN];
+
 // uint32_t lastSeek;  // Debug
 
 
@@ -45,6 +60,41 @@ void dumpSpiPacket( uint8_t* data )
 #endif
 }
 
+/***************************************************************************//**
+ * @brief   Takes the generations of a disk change notification ('N') and
+ *          marks the disks that changed. They are reported to IOS with the
+ *          next VD_CMD_STATUS.
+ *
+ * @param   frame   The notification: 'N', then the 16 bit generation of every
+ *                  disk, low byte first.
+ ******************************************************************************/
+void vdDiskNotify( const uint8_t* frame )
+{
+  for( uint8_t disk = 0; disk < VD_DISKS; disk++ )
+  {
+    uint16_t gen = frame[1 + disk * 2] | ( (uint16_t)frame[2 + disk * 2] << 8 );
+
+    if( gen != vdDiskGen[disk] )
+    {
+      vdDiskGen[disk] = gen;
+      vdDiskChanged |= ( 1 << disk );
+    }
+  }
+
+  DBG_PRINTF( "Disk change notification: %02X\n", vdDiskChanged );
+}
+
+
+/***************************************************************************//**
+ * @brief   Marks all disks as changed, e.g. while no notification can be
+ *          received because the debug connection is lost.
+ ******************************************************************************/
+void vdDiskInvalidate( void )
+{
+  vdDiskChanged = ( 1 << VD_DISKS ) - 1;
+}
+
+
 /***************************************************************************//**
  * @brief   Wait for complete TCP packet.
  ******************************************************************************/
@@ -57,7 +107,7 @@ bool waitForTcpData( void )
   while( loop < 500 )
   {
     dataCnt = tcpClient.available();
-    if( dataCnt == 536 )
+    if( dataCnt == sizeof(vdPacket_t) )
     {
       retVal = true;
       break;
@@ -74,6 +124,170 @@ bool waitForTcpData( void )
 }
 
 
+/***************************************************************************//**
+ * @brief   Sends a packet to the server, as compact frame if negotiated.
+ *
+ * @param   packet      The packet.
+ * @param   withData    true if the data buffer is sent (write).
+ ******************************************************************************/
+void vdTcpSend( vdPacket_t* packet, bool withData )
+{
+  if( vdWireEnc & VD_WIRE_COMPACT )
+  {
+    tcpClient.write( vdWireBuf, vdWirePack( (uint8_t*)packet->rawData, withData, vdWireEnc, vdWireBuf ) );
+  }
+  else
+  {
+    tcpClient.write( packet->rawData, sizeof(packet->rawData) );
+  }
+  tcpClient.flush();
+}
+
+
+/***************************************************************************//**
+ * @brief   Receives the answer of the server, as compact frame if negotiated.
+ *          Waits as long as waitForTcpData().
+ *
+ * @return  true if the answer was received, otherwise false.
+ ******************************************************************************/
+bool vdTcpReceive( vdPacket_t* packet )
+{
+  uint16_t len = 0;
+  uint16_t frameLen = VD_WIRE_HEAD_LEN;
+  uint16_t loop = 0;
+  int      dataCnt;
+
+
+  if( !( vdWireEnc & VD_WIRE_COMPACT ) )
+  {
+    if( !waitForTcpData() ) { return false; }
+
+    tcpClient.read( packet->rawData, sizeof(packet->rawData) );
+    return true;
+  }
+
+  // First the head with the length of the frame, then the rest
+  while( loop < 500 )
+  {
+    dataCnt = tcpClient.available();
+    if( dataCnt > 0 )
+    {
+      len += tcpClient.read( vdWireBuf + len, min( dataCnt, (int)( frameLen - len ) ) );
+
+      if( ( frameLen == VD_WIRE_HEAD_LEN ) && ( len == VD_WIRE_HEAD_LEN ) )
+      {
+        frameLen = vdWireFrameLen( vdWireBuf, len );
+        if( frameLen == 0 ) { return false; }
+      }
+
+      if( len == frameLen )
+      {
+        return vdWireUnpack( vdWireBuf, (uint8_t*)packet->rawData );
+      }
+      continue;
+    }
+
+    loop++;
+    delayMicroseconds(500);
+  }
+
+  return false;
+}
+
+
+/***************************************************************************//**
+ * @brief   Offers the compact frames to the server after the connect. An
+ *          older server does not answer VD_CMD_ENCODING, then the full
+ *          packets are kept.
+ ******************************************************************************/
+void vdWireNegotiate( void )
+{
+  vdWireEnc = 0;
+
+  vd.packet.cmd     = VD_CMD_ENCODING;
+  vd.packet.data[0] = VD_WIRE_ALL;
+  vdTcpSend( &vd, false );
+
+  if( vdTcpReceive( &vd ) && ( vd.packet.status == VD_STATUS_OK ) && ( vd.packet.data[0] & VD_WIRE_COMPACT ) )
+  {
+    vdWireEnc = vd.packet.data[0];
+  }
+
+  DBG_PRINTF( "Wire encoding: %02X\n", vdWireEnc );
+}
+
+
+
+/***************************************************************************//**
+ * @brief   Reads the next data block of the selected file from the server.
+ *
+ * @return  true if data was received, otherwise false.
+ ******************************************************************************/
+bool vdFetchData( void )
+{
+  uint8_t seg;
+
+
+  for( uint8_t attempt = 0; attempt < VD_TCP_ATTEMPTS; attempt++ )
+  {
+    // No data - Fill packet for server
+    vd.packet.cmd = VD_CMD_RD_FILE;
+    memcpy( vd.packet.filename, vdData.filename, sizeof(vd.packet.filename) );
+
+    // Send data to server
+    vdTcpSend( &vd, false );
+
+    // Receive data from server
+    if( !vdTcpReceive( &vd ) )
+    {
+      break;
+    }
+
+    DBGA_PRINTLN( "Answer PC: WifiClient read data" );
+
+    if( vd.packet.status != VD_STATUS_OK )
+    {
+      DBGA_PRINTLN( "Answer PC: WifiClient Error" );
+      break;
+    }
+
+    // Check the CRC of every segment calculated by the server
+    for( seg = 0; seg < VD_SEGMENTS; seg++ )
+    {
+      if( vdCrc16( vd.packet.data + seg * VD_SEGMENT_SIZE, VD_SEGMENT_SIZE ) != vd.packet.segCrc[seg] ) { break; }
+    }
+
+    if( seg == VD_SEGMENTS )
+    {
+      DBGA_PRINTLN( "Answer PC: WifiClient read data - Status OK" );
+
+      // Copy data to local buffer
+      memcpy( vdData.data, vd.packet.data, sizeof(vdData.data) );
+      memcpy( vdData.segCrc, vd.packet.segCrc, sizeof(vdData.segCrc) );
+      vdData.dataLen = vd.packet.dataLen;
+      vdData.filePos = 0;
+
+      return true;
+    }
+
+    DBGA_PRINTLN( "Answer PC: WifiClient read data - CRC error" );
+
+    // Go back to the start of the data and read it again, the server
+    // returns the offset of the data in fileOffset
+    vd.packet.cmd = VD_CMD_SEEK_FILE;
+    memcpy( vd.packet.filename, vdData.filename, sizeof(vd.packet.filename) );
+
+    vdTcpSend( &vd, false );
+
+    if( !vdTcpReceive( &vd ) )
+    {
+      break;
+    }
+  }
+
+  return false;
+}
+
 
 /***************************************************************************//**
  * @brief   Process the client command.
@@ -89,12 +303,18 @@ void vdProcessCmd( uint8_t wifiStatus )
   uint8_t         numOfBytes;
   uint8_t         offset;
   uint8_t         i;
+  const uint8_t*  frame;      // Oldest received SPI frame
+  uint16_t        crc;        // CRC-16 of a segment
+  static bool     chksumErr = false;  // Checksum error of a frame processed while more were queued
+  static bool     wrChksumErr = false;  // Checksum error of VD_CMD_WR_FILE since the last VD_CMD_WR_NEXT
 
 
-  if( spiDataRcvd )
+  frame = spiRingFront( &spiRxRing );
+  if( frame != nullptr )
   {
-    // Copy data from spi input buffer to local buffer
-    memcpy( dataBuf, spiDataBuf, 32 );
+    // Copy data from spi input ring to local buffer and free the slot
+    memcpy( dataBuf, frame, 32 );
+    spiRingPop( &spiRxRing );
 
     // Get command
     cmd = (vdCommands)(dataBuf[0]);
@@ -123,6 +343,8 @@ void vdProcessCmd( uint8_t wifiStatus )
 
           vdStatus.cmd_status = wifiStatus;
           vdStatus.cmd_data   = tcpSrvStatus;
+          vdStatus.free       = vdDiskChanged;  // Reported once, IOS keeps the bits
+          vdDiskChanged       = 0;
 
           // if( ( ( wifiStatus != 3 ) || ( tcpSrvStatus != 0) ) )
           // {
@@ -172,22 +394,21 @@ void vdProcessCmd( uint8_t wifiStatus )
           memcpy( vdData.filename, dataBuf + 1, sizeof(vdData.filename) );
           vdData.filePos = 0;
           vdData.dataLen = 0;
+          rdSeq  = 0xFF;
+          rdSent = 0;
 
           // Fill packet for server
           vd.packet.cmd = VD_CMD_SEL_FILE;
           memcpy( vd.packet.filename, vdData.filename, sizeof(vd.packet.filename) );
 
           // Send data to server
-          tcpClient.write( vd.rawData, sizeof(vd.rawData) );
-          tcpClient.flush();
+          vdTcpSend( &vd, false );
 
           // Receive data from server
-          if( waitForTcpData() )
+          if( vdTcpReceive( &vd ) )
           {
             DBGA_PRINTLN( "Answer PC: WifiClient select file" );
 
-            tcpClient.read( vd.rawData, sizeof(vd.rawData) );
-
             // Serial.printf( "Status from Server: %i\n", vd.packet.status );
 
             vdStatus.cmd_status = 0;
@@ -240,37 +461,7 @@ void vdProcessCmd( uint8_t wifiStatus )
 
             DBGA_PRINTLN( "Request data from the PC server" );
 
-            // No data - Fill packet for server
-            vd.packet.cmd = VD_CMD_RD_FILE;
-            memcpy( vd.packet.filename, vdData.filename, sizeof(vd.packet.filename) );
-
-            // Send data to server
-            tcpClient.write( vd.rawData, sizeof(vd.rawData) );
-            tcpClient.flush();
-
-            // Receive data from server
-            if( waitForTcpData() )
-            {
-              DBGA_PRINTLN( "Answer PC: WifiClient read data" );
-
-              tcpClient.read( vd.rawData, sizeof(vd.rawData) );
-
-              // Serial.printf( "Status from Server: %i\n", vd.packet.status );
-
-              if( vd.packet.status == VD_STATUS_OK )
-              {
-                DBGA_PRINTLN( "Answer PC: WifiClient read data - Status OK" );
-
-                // Copy data to local buffer
-                memcpy( vdData.data, vd.packet.data, sizeof(vdData.data) );
-                vdData.dataLen = vd.packet.dataLen;
-                vdData.filePos = 0;
-              }
-              else
-              {
-                DBGA_PRINTLN( "Answer PC: WifiClient Error" );
-              }
-            }
+            vdFetchData();
           }
 
           // Clear spi send buffer
@@ -447,6 +638,7 @@ void vdProcessCmd( uint8_t wifiStatus )
         else
         {
           vdStatus.status = SPISLAVE_CHKSUM_ERR;  // Checksum error
+          wrChksumErr     = true;
 
           DBGA_PRINTF( "Checksum Error: %02X\n\r", checksum );
         }
@@ -525,12 +717,24 @@ void vdProcessCmd( uint8_t wifiStatus )
         // Init checksum
         checksum = cmd;
 
-        // Calculate checksum
-        checksum += numOfBytes;
-        checksum += dataBuf[2];
+        // Checksum of the frame and CRC-16 of the written segment
+        crc = (uint16_t)dataBuf[2] | ( (uint16_t)dataBuf[3] << 8 );
+        if( !vdFrameValid( dataBuf, VD_WR_NEXT_LEN ) ) { checksum = 0xFF; }
+        else if( ( numOfBytes != 0 ) &&
+                 ( ( vdData.filePos + numOfBytes > (int)sizeof(vdData.data) ) ||
+                   ( vdCrc16( vdData.data + vdData.filePos, numOfBytes ) != crc ) ) ) { checksum = 0xFF; }
+        else { checksum = 0; }
+
+        // A VD_CMD_WR_FILE frame before had a checksum error, the master
+        // sends the data again, so the position must not move.
+        if( wrChksumErr ) { checksum = 0xFF; }
+        wrChksumErr = false;
 
         if( checksum == 0 )
         {
+          // Keep the CRC for the server, which checks it again
+          if( numOfBytes != 0 ) { vdData.segCrc[vdData.filePos / VD_SEGMENT_SIZE] = crc; }
+
           vdData.filePos += numOfBytes;
           vdData.dataLen += numOfBytes;
 
@@ -543,6 +747,7 @@ void vdProcessCmd( uint8_t wifiStatus )
 
             // Copy data to packet buffer
             memcpy( vd.packet.data, vdData.data, sizeof(vd.packet.data) );
+            memcpy( vd.packet.segCrc, vdData.segCrc, sizeof(vd.packet.segCrc) );
             vd.packet.dataLen = vdData.dataLen;
             vdData.filePos = 0;
 
@@ -561,24 +766,31 @@ void vdProcessCmd( uint8_t wifiStatus )
 
             DBGA_PRINTLN( "WifiClient write data" );
 
-            // Send data to server
-            tcpClient.write( vd.rawData, sizeof(vd.rawData) );
-            tcpClient.flush();
-
-            // Receive data from server - dummy read
-            if( waitForTcpData() )
+            // The server rejects data with a wrong CRC, then send it again
+            vdStatus.cmd_status = 1;  // Error
+            for( i = 0; i < VD_TCP_ATTEMPTS; i++ )
             {
-              tcpClient.read( vd.rawData, sizeof(vd.rawData) );
+              // Send data to server
+              vdTcpSend( &vd, true );
+
+              // Receive data from server - status only
+              if( !vdTcpReceive( &vdAnswer ) ) { break; }
 
-              if( vd.packet.status == VD_STATUS_OK )
+              if( vdAnswer.packet.status != VD_STATUS_CHKSUM_ERROR )
               {
-                DBGA_PRINTLN( "WifiClient write data - Status OK" );
+                if( vdAnswer.packet.status == VD_STATUS_OK )
+                {
+                  DBGA_PRINTLN( "WifiClient write data - Status OK" );
+
+                  vdStatus.cmd_status = 0;
+                }
+                break;
               }
+
+              DBGA_PRINTLN( "WifiClient write data - CRC error" );
             }
 
             vdData.dataLen = 0;
-
-            vdStatus.cmd_status = 0;
           }
         }
         else
@@ -594,6 +806,81 @@ void vdProcessCmd( uint8_t wifiStatus )
         SPISlave.setStatus( vdStatus.rawStatus );
       break;
 
+      case VD_CMD_RD_SEGMENT:
+        DBGA_PRINTLN( "VD_CMD_RD_SEGMENT" );
+
+        vdStatus.rawStatus = SPI_STATUS_RESET;
+
+        // Debug
+        DBGS_PRINT( "Recv. from Z80: " );
+        dumpSpiPacket( dataBuf );
+
+        numOfBytes = 0;
+
+        if( vdFrameValid( dataBuf, VD_RD_SEGMENT_LEN ) )
+        {
+          // A new sequence bit confirms the previous segment, the same one repeats it
+          if( dataBuf[1] != rdSeq )
+          {
+            vdData.filePos += rdSent;
+            rdSent = 0;
+            rdSeq  = dataBuf[1];
+          }
+
+          // Buffer empty or completely read?
+          if( ( vdData.filePos >= vdData.dataLen ) || ( vdData.filePos >= (int)sizeof(vdData.data) ) )
+          {
+            DBG_PRINTLN( "VD_CMD_RD_SEGMENT - Request data from the PC server" );
+
+            vdData.dataLen = 0;
+            if( !vdFetchData() )
+            {
+              // Nothing valid in the buffer, the next request fetches again
+              vdData.filePos = 0;
+              vdStatus.status = SPISLAVE_READ_ERR;
+
+              DBGA_PRINTLN( "VD_CMD_RD_SEGMENT - Read error" );
+            }
+          }
+
+          // Prepare the whole segment, the CRC-16 is sent in the status register
+          memset( sendBuf, 0, sizeof(sendBuf) );
+          if( vdData.filePos < vdData.dataLen )
+          {
+            numOfBytes = (uint8_t)min( (int)( vdData.dataLen - vdData.filePos ), (int)VD_SEGMENT_SIZE );
+            memcpy( sendBuf, vdData.data + vdData.filePos, numOfBytes );
+          }
+          rdSent = numOfBytes;
+
+          // CRC-16 of the server, if the segment is one of its segments
+          if( ( numOfBytes != 0 ) && ( ( vdData.filePos % VD_SEGMENT_SIZE ) == 0 ) ) { crc = vdData.segCrc[vdData.filePos / VD_SEGMENT_SIZE]; }
+          else { crc = vdCrc16( sendBuf, VD_SEGMENT_SIZE ); }
+
+          DBGS_PRINT( "Sent to Z80   : " );
+          dumpSpiPacket( sendBuf );   // Debug
+
+          // Set data buffer
+          savedPS = noInterrupts();             // cli();
+          SPISlave.setData( sendBuf, sizeof(sendBuf) );
+          xt_wsr_ps(savedPS);                   // sei();
+
+          vdStatus.cmd_status = (uint8_t)( crc & 0xFF );   // CRC-16 low byte
+          vdStatus.free       = (uint8_t)( crc >> 8 );     // CRC-16 high byte
+        }
+        else
+        {
+          vdStatus.status = SPISLAVE_CHKSUM_ERR;  // Checksum error
+
+          DBGA_PRINTLN( "Checksum Error" );
+        }
+
+        prevCmd = VD_CMD_NONE;
+
+        // Set status and command status
+        vdStatus.cmd_data = numOfBytes;   // Set number of bytes
+        SPISlave.setStatus( vdStatus.rawStatus );
+      break;
+
       case VD_CMD_SEEK_FILE:
         DBGS_PRINTLN( "VD_CMD_SEEK_FILE" );
 
@@ -626,17 +913,14 @@ void vdProcessCmd( uint8_t wifiStatus )
           vd.packet.fileOffset = fileOffset;
 
           // Send data to server
-          tcpClient.write( vd.rawData, sizeof(vd.rawData) );
-          tcpClient.flush();
+          vdTcpSend( &vd, false );
 
           // Receive data from server
           // if( tcpClient.available() )
-          if( waitForTcpData() )
+          if( vdTcpReceive( &vd ) )
           {
             DBGA_PRINTLN( "WifiClient seek file" );
 
-            tcpClient.read( vd.rawData, sizeof(vd.rawData) );
-
             // Serial.printf( "Status from Server: %i\n", vd.packet.status );
 
             vdStatus.cmd_status = 0;
@@ -656,6 +940,8 @@ void vdProcessCmd( uint8_t wifiStatus )
         }
 
         vdData.dataLen = 0;   // New for VD_CMD_WR_FILE
+        rdSeq  = 0xFF;        // Segment reads start again
+        rdSent = 0;
         prevCmd = VD_CMD_NONE;
 
         // Set status and command status
@@ -683,6 +969,26 @@ void vdProcessCmd( uint8_t wifiStatus )
       break;
     }
 
-    spiDataRcvd = false;
+    // The master may send the next frames without waiting for the status.
+    // Only the status of the last frame is seen, so keep a checksum error.
+    if( vdStatus.status == SPISLAVE_CHKSUM_ERR )
+    {
+      chksumErr = true;
+    }
+    if( chksumErr && ( spiRingFront( &spiRxRing ) == nullptr ) )
+    {
+      vdStatus.status = SPISLAVE_CHKSUM_ERR;
+      SPISlave.setStatus( vdStatus.rawStatus );
+    }
+    // Checked after setting the status, a frame received meanwhile must not see it
+    if( spiRingFront( &spiRxRing ) != nullptr )
+    {
+      // More frames queued, the master has to wait for them
+      SPISlave.setStatus( SPISLAVE_BUSY );
+    }
+    else
+    {
+      chksumErr = false;
+    }
   }
 }
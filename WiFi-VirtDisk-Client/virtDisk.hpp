@@ -18,6 +18,8 @@
 
 
 /******************************************************************* Defines **/
+#define VD_DISKS  4   // Emulated disks with change notifications of the server
+
 #pragma pack(1)
 typedef struct
 {
@@ -30,6 +32,7 @@ typedef struct
     uint8_t     sector;         // Sector of the track
     uint8_t     data[512];      // Data buffer
     uint16_t    dataLen;        // Length of the valid data in buffer
+    uint16_t    segCrc[16];     // CRC-16 of every 32 byte segment of data
 } vdPacketInt_t;
 #pragma pack()
 
@@ -71,6 +74,8 @@ enum vdCommands
     VD_CMD_SEL_TR_SEC,
     VD_CMD_RD_SECTOR,
     VD_CMD_WR_SECTOR,
+    VD_CMD_RD_SEGMENT,
+    VD_CMD_ENCODING,
     VD_CMD_COUNT
 };
 
@@ -94,6 +99,7 @@ typedef struct
     int         filePos;        
     uint8_t     data[512];      // Data buffer
     uint16_t    dataLen;        // Length of the valid data in buffer
+    uint16_t    segCrc[16];     // CRC-16 of every 32 byte segment of data
 } vdData_t;
 
 
@@ -101,7 +107,13 @@ typedef struct
 
 /******************************************************* Functions / Methods **/
 bool waitForTcpData( void );
+void vdTcpSend( vdPacket_t* packet, bool withData );
+bool vdTcpReceive( vdPacket_t* packet );
+void vdWireNegotiate( void );
+bool vdFetchData( void );
 void vdProcessCmd( uint8_t wifiStatus );
+void vdDiskNotify( const uint8_t* frame );
+void vdDiskInvalidate( void );
 
 
 #endif
@@ -15,12 +15,17 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <vector>
+#include <memory>
+#include <sstream>
+#include <cstring>
 #include <filesystem>
 
 #if defined(__linux__)
 #include <unistd.h>
 #include <poll.h>
+#include <netinet/tcp.h>
 #include <termios.h>
 #endif
 
@@ -44,6 +49,16 @@
 #include "message.h"
 #include "input.h"
 #include "virtDisk.hpp"
+#include "vdWire.h"
+#include "rpcServer.hpp"
+#include "imageTool.hpp"
+#include "diskCheck.hpp"
+#include "diskNotify.hpp"
+#include "diskOverlay.hpp"
+#include "diskSnapshot.hpp"
+#include "serverStats.hpp"
+#include "vdTrace.hpp"
+#include "tlsServer.hpp"
 #include "version.h"
 
 
@@ -52,6 +67,15 @@
 // #define LOG_PRINTER = [](const std::string& strLogMsg) { std::cout << strLogMsg << std::endl; }
 auto LogPrinter = [](const std::string& strLogMsg) { std::cout << strLogMsg << std::endl; };
 
+// IPv6 address in brackets, see getClientIP()
+#define CLIENT_IP_LEN   ( INET6_ADDRSTRLEN + 2 )
+
+// Interval for checking the debug connection for commands of the client
+#define DBG_POLL_MS     50
+
+// Receive timeouts (100 ms) until the rest of a compact frame must be there
+#define WIRE_RCV_TIMEOUTS   10
+
 
 /********************************************************** Global Variables **/
 bool gSrvRunning = true;
@@ -67,11 +91,22 @@ bool gDbgDataReady = false;
 // Configuration data
 std::string serverPort    = "12345";    // WiFi-VirtDisk Portnummer
 std::string dbgServerPort = "12346";    // Debug Server Portnummer
+std::string rpcServerPort = "12347";    // LibDsk RPC Server Portnummer
+std::string statsServerPort = "12348";  // Statistik Server Portnummer
+std::vector<std::string> bindAddress = { "" };  // Lokale Adressen der Server, leer = alle (IPv6 und IPv4)
+std::vector<std::string> rpcBindAddress = { "127.0.0.1" };  // Lokale Adressen des RPC Servers, nur localhost, leer = alle
+std::string traceFile     = "";         // Trace der VirtDisk Kommandos, leer = aus
+std::string tlsCertFile   = "";         // TLS Zertifikat, leer = unverschluesselt
+std::string tlsKeyFile    = "";         // TLS Schluessel
+std::string tlsMinVersion = "1.2";      // Niedrigste TLS Version, BearSSL im ESP8266 kann kein 1.3
+std::string overlayPath   = "";         // Verzeichnis der Overlays, leer = <exeDir>/overlays
+bool        wireEncoding  = true;       // Kompakte Pakete und Kompression der Daten, wenn der Client es anbietet
 std::string filePath      = "D:/Projekte/WiFi-VirtDisk/WiFi-VirtDisk-Server/testData/files/";
 
 std::vector<std::string> diskEmuPath;
 std::vector<std::string> diskEmuFilename;
 std::vector<std::string> diskEmuFormat;
+std::vector<bool>        diskEmuShared;
 
 std::string defaultDiskEmuPath      = "D:/Projekte/WiFi-VirtDisk/WiFi-VirtDisk-Server/testData/disk/";
 std::string defaultDiskEmuFilename  = "DS0N00.DSK";
@@ -81,7 +116,46 @@ extern vdData_t vdData;
 extern struct cpmSuperBlock drive;
 
 
+// Command line arguments
+struct vdArgs : public argparse::Args
+{
+    std::optional<std::vector<std::string>>& pack   = kwarg( "pack", "Pack <directory> into the raw disk image <image> and exit" ).multi_argument();
+    std::optional<std::vector<std::string>>& unpack = kwarg( "unpack", "Unpack the disk image <image> into <directory> and exit" ).multi_argument();
+    std::optional<std::vector<std::string>>& store  = kwarg( "store", "Import the disk images <image...> into the deduplicating image store <directory> and exit" ).multi_argument();
+    std::string& format = kwarg( "format", "Disk format for --pack, --unpack and --store" ).set_default( defaultDiskEmuFormat );
+    std::string& type   = kwarg( "type", "LibDsk driver of the disk images for --unpack and --store, \"auto\" detects it for --store" ).set_default( "raw" );
+    std::optional<std::string>& trace = kwarg( "trace", "Write a trace of all VirtDisk commands to <file>" );
+};
+
+
 /******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Splits a comma separated list of addresses from the configuration
+ *          file. An empty list means all interfaces.
+ *
+ * @param   list        The value from the configuration file, nullptr keeps
+ *                      the default.
+ * @param   addresses   Receives the addresses.
+ ******************************************************************************/
+static void readAddressList( const char* list, std::vector<std::string>& addresses )
+{
+    if( list != nullptr )
+    {
+        std::stringstream entries( list );
+        std::string       address;
+
+        addresses.clear();
+        while( std::getline( entries, address, ',' ) )
+        {
+            address.erase( 0, address.find_first_not_of( " \t" ) );
+            address.erase( address.find_last_not_of( " \t" ) + 1 );
+            if( !address.empty() ) { addresses.push_back( address ); }
+        }
+        if( addresses.empty() ) { addresses.push_back( "" ); }
+    }
+}
+
+
 /***************************************************************************//**
  * @brief   Reads the configuration file and sets the global variables.
  *
@@ -115,9 +189,18 @@ bool readConfig( void )
         {
             serverPort = serverPortIni;
             dbgServerPort = std::to_string(std::stoi(serverPort) + 1);  // Use the next port number
-            message( MsgType::INFO, "Server port: " + serverPort + ", Debug Server port: " + dbgServerPort );
+            rpcServerPort = std::to_string(std::stoi(serverPort) + 2);
+            statsServerPort = std::to_string(std::stoi(serverPort) + 3);
+            message( MsgType::INFO, "Server port: " + serverPort + ", Debug Server port: " + dbgServerPort + ", RPC Server port: " + rpcServerPort +
+                                    ", Stats Server port: " + statsServerPort );
         }
 
+        // Get bind addresses from configuration file, separated by commas
+        readAddressList( vdIni.GetValue( "WiFi-VirtDisk", "bindAddress", nullptr ), bindAddress );
+
+        // The RPC Server has no authentication, it only listens on localhost unless configured otherwise
+        readAddressList( vdIni.GetValue( "WiFi-VirtDisk", "rpcBindAddress", nullptr ), rpcBindAddress );
+
         // Get file path from configuration file
         const char* filePathIni = vdIni.GetValue( "WiFi-VirtDisk", "filePath", filePath.c_str() );
         if( filePathIni != nullptr )
@@ -126,6 +209,25 @@ bool readConfig( void )
             message( MsgType::INFO, "File path: " + filePath );
         }
 
+        // Get trace file from configuration file, the trace starts with the server
+        const char* traceFileIni = vdIni.GetValue( "WiFi-VirtDisk", "traceFile", traceFile.c_str() );
+        if( traceFileIni != nullptr )
+        {
+            traceFile = traceFileIni;
+            if( !traceFile.empty() ) { message( MsgType::INFO, "Trace file: " + traceFile ); }
+        }
+
+        // Get directory of the overlays of the shared disks from configuration file
+        overlayPath = vdIni.GetValue( "WiFi-VirtDisk", "overlayPath", overlayPath.c_str() );
+
+        // Get TLS certificate and key from configuration file, TLS is used if both are set
+        tlsCertFile   = vdIni.GetValue( "WiFi-VirtDisk", "tlsCertFile", tlsCertFile.c_str() );
+        tlsKeyFile    = vdIni.GetValue( "WiFi-VirtDisk", "tlsKeyFile", tlsKeyFile.c_str() );
+        tlsMinVersion = vdIni.GetValue( "WiFi-VirtDisk", "tlsMinVersion", tlsMinVersion.c_str() );
+
+        // Get if compact frames are offered to the clients, see vdWire.h
+        wireEncoding = vdIni.GetBoolValue( "WiFi-VirtDisk", "wireEncoding", wireEncoding );
+
         // Get number of emulated disks and parameters from configuration file
         int diskNum = 0;
         do
@@ -139,14 +241,18 @@ bool readConfig( void )
             const char* diskEmuPathIni = vdIni.GetValue( section.c_str(), "diskEmuPath", nullptr );
             // Get disk format from configuration file
             const char* diskEmuFormatIni = vdIni.GetValue( section.c_str(), "diskEmuFormat", nullptr );
+            // Shared read-only image with an overlay for every client
+            bool diskEmuSharedIni = vdIni.GetBoolValue( section.c_str(), "diskEmuShared", false );
 
             if( diskEmuFilenameIni != nullptr && diskEmuPathIni != nullptr && diskEmuFormatIni != nullptr )
             {
                 diskEmuFilename.push_back( std::string(diskEmuFilenameIni) );
                 diskEmuPath.push_back( std::string(diskEmuPathIni) );
                 diskEmuFormat.push_back( std::string(diskEmuFormatIni) );
+                diskEmuShared.push_back( diskEmuSharedIni );
 
-                message( MsgType::INFO, "Emulated disk " + std::to_string(diskNum) + ": " + diskEmuFilename.back() + " (" + diskEmuFormat.back() + ")\r\n" +
+                message( MsgType::INFO, "Emulated disk " + std::to_string(diskNum) + ": " + diskEmuFilename.back() + " (" + diskEmuFormat.back() + ")" +
+                                        ( diskEmuShared.back() ? ", shared with overlays" : "" ) + "\r\n" +
                                         "                       " + diskEmuPath.back() );
                 // message( MsgType::INFO, "           Path: " + diskEmuPath.back() );
             }
@@ -168,34 +274,222 @@ bool readConfig( void )
 
 
 /***************************************************************************//**
- * @brief   Returns the client IP address of the given socket.
+ * @brief   Returns the client IP address of the given socket. An IPv6 address
+ *          is put in brackets, an IPv4 client of a dual-stack server is
+ *          returned as IPv4 address.
  *
  * @param   clientSocket    The current client socket.
- * @param   clientIP        The character array for the IP address.
+ * @param   clientIP        The character array for the IP address, at least
+ *                          CLIENT_IP_LEN characters.
  * @param   clientPort      The integer for the client port.
  *
  * @return  true if the IP address could be resolved, otherwise false.
  ******************************************************************************/
 bool getClientIP( ASocket::Socket clientSocket, char* clientIP, int* clientPort )
 {
-    struct sockaddr_in clientAddress;
-    socklen_t          clientAddressLength = sizeof(clientAddress);
-    int                nativeSocket        = static_cast<int>(clientSocket);  // Cast ASocket::Socket to a native socket descriptor
-    bool               retVal              = false;
+    struct sockaddr_storage clientAddress;
+    socklen_t               clientAddressLength = sizeof(clientAddress);
+    bool                    retVal              = false;
 
 
     // Get client address
-    if( getpeername( nativeSocket, (struct sockaddr*)&clientAddress, &clientAddressLength ) == 0 )
+    if( getpeername( clientSocket, (struct sockaddr*)&clientAddress, &clientAddressLength ) == 0 )
     {
-        inet_ntop( AF_INET, &clientAddress.sin_addr, clientIP, INET_ADDRSTRLEN) ;
-        *clientPort = ntohs( clientAddress.sin_port );
-        retVal = true;
+        if( clientAddress.ss_family == AF_INET6 )
+        {
+            struct sockaddr_in6* address6 = (struct sockaddr_in6*)&clientAddress;
+            struct in_addr       address4;
+
+            if( IN6_IS_ADDR_V4MAPPED( &address6->sin6_addr ) )
+            {
+                memcpy( &address4, &address6->sin6_addr.s6_addr[12], sizeof(address4) );
+                inet_ntop( AF_INET, &address4, clientIP, CLIENT_IP_LEN );
+            }
+            else
+            {
+                clientIP[0] = '[';
+                inet_ntop( AF_INET6, &address6->sin6_addr, clientIP + 1, CLIENT_IP_LEN - 2 );
+                strcat( clientIP, "]" );
+            }
+            *clientPort = ntohs( address6->sin6_port );
+            retVal = true;
+        }
+        else if( clientAddress.ss_family == AF_INET )
+        {
+            struct sockaddr_in* address4 = (struct sockaddr_in*)&clientAddress;
+
+            inet_ntop( AF_INET, &address4->sin_addr, clientIP, CLIENT_IP_LEN );
+            *clientPort = ntohs( address4->sin_port );
+            retVal = true;
+        }
     }
 
     return retVal;
 }
 
 
+/***************************************************************************//**
+ * @brief   Creates a server for every bind address and starts listening.
+ *
+ * @param   servers     Receives the servers.
+ * @param   port        Port of the servers.
+ * @param   name        Name of the servers for the messages.
+ * @param   addresses   Local addresses of the servers, "" for all interfaces.
+ *
+ * @return  true if all servers are listening, otherwise false.
+ ******************************************************************************/
+bool createServers( std::vector<std::unique_ptr<CTCPServer>>& servers, const std::string& port, const std::string& name,
+                    const std::vector<std::string>& addresses = bindAddress )
+{
+    for( const auto& address : addresses )
+    {
+        std::string where = ( address.empty() ? "all interfaces" : address ) + ", port " + port;
+
+        try
+        {
+            servers.push_back( std::make_unique<CTCPServer>( LogPrinter, port, (ASocket::SettingsFlag)0, address ) );
+        }
+        catch( const std::exception& e )
+        {
+            message( MsgType::ERR, "Error creating " + name + " (" + where + "): " + std::string(e.what()) );
+            return false;
+        }
+
+        if( !servers.back()->Bind() )
+        {
+            message( MsgType::ERR, "Error creating " + name + " (" + where + "): " + std::string(strerror( errno )) );
+            return false;
+        }
+
+        message( MsgType::INFO, name + " started, listening on " + where );
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Waits for an incoming connection on any of the servers.
+ *
+ * @param   groups  The servers of all ports.
+ * @param   msec    Maximum waiting time in milliseconds.
+ *
+ * @return  The server with an incoming connection, nullptr if none.
+ ******************************************************************************/
+CTCPServer* waitForConnection( const std::vector<std::vector<std::unique_ptr<CTCPServer>>*>& groups, size_t msec )
+{
+    std::vector<CTCPServer*>      servers;
+    std::vector<ASocket::Socket>  sockets;
+    size_t                        index;
+
+
+    for( const auto* group : groups )
+    {
+        for( const auto& server : *group )
+        {
+            servers.push_back( server.get() );
+            sockets.push_back( server->GetListenSocket() );
+        }
+    }
+
+    if( ASocket::SelectSockets( sockets.data(), sockets.size(), msec, index ) == 1 )
+    {
+        return servers[index];
+    }
+
+    return nullptr;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the server is one of the servers.
+ ******************************************************************************/
+bool isServerOf( const CTCPServer* server, const std::vector<std::unique_ptr<CTCPServer>>& servers )
+{
+    for( const auto& candidate : servers )
+    {
+        if( candidate.get() == server )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/***************************************************************************//**
+ * @brief   Receives and executes a command of the debug client. The commands
+ *          are 10 bytes like the commands of the server:
+ *          'K' <disk> takes a snapshot, 'B' <disk> rolls back to the snapshot,
+ *          'X' <disk> drops the snapshot, <disk> is the index of the emulated disk or 0xFF for all disks.
+ *          The answer is the command, the disk and the status (0 = OK).
+ *
+ * @param   conn        The debug connection.
+ * @param   clientInfo  IP address and port of the client for the log.
+ *
+ * @return  false if the client closed the connection, otherwise true.
+ ******************************************************************************/
+bool dbgClientCmd( tlConn_t& conn, const std::string& clientInfo )
+{
+    char   buffer[10] = {};
+    int    bytesReceived = tlReceive( conn, buffer, sizeof(buffer) );
+    size_t disk;
+    bool   ok;
+
+
+    if( bytesReceived == 0 )
+    {
+        message( MsgType::INFO, "Debug client disconnected (" + clientInfo + ")" );
+        return false;
+    }
+    if( bytesReceived < 2 )
+    {
+        return true;
+    }
+
+    disk = ( (uint8_t)buffer[1] == 0xFF ) ? SN_ALL_DISKS : (uint8_t)buffer[1];
+
+    switch( buffer[0] )
+    {
+        case 'K':
+            message( MsgType::INFO, "Debug client: snapshot of " + ( disk == SN_ALL_DISKS ? std::string("all disks") : "disk " + std::to_string(disk) ) );
+            {
+                std::lock_guard<std::mutex> lock( gDskMutex );
+                ok = snCreate( disk );
+            }
+        break;
+
+        case 'B':
+            message( MsgType::INFO, "Debug client: rollback of " + ( disk == SN_ALL_DISKS ? std::string("all disks") : "disk " + std::to_string(disk) ) );
+            {
+                std::lock_guard<std::mutex> lock( gDskMutex );
+                ok = snRollback( disk );
+            }
+        break;
+
+        case 'X':
+            message( MsgType::INFO, "Debug client: drop the snapshot of " + ( disk == SN_ALL_DISKS ? std::string("all disks") : "disk " + std::to_string(disk) ) );
+            {
+                std::lock_guard<std::mutex> lock( gDskMutex );
+                ok = snDrop( disk );
+            }
+        break;
+
+        default:
+            message( MsgType::WARN, "Debug client: unknown command '" + std::string(1, buffer[0]) + "'" );
+            ok = false;
+        break;
+    }
+
+    buffer[2] = ok ? 0 : 1;
+    buffer[3] = '\0';
+    tlSend( conn, buffer, sizeof(buffer) );
+
+    return true;
+}
+
+
 /***************************************************************************//**
  * @brief   Process the debug client request.
  *
@@ -207,8 +501,8 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
 {
     const int BUFFER_SIZE = 10;
     char buffer[BUFFER_SIZE] = {};
-    int bytesReceived;
-    int ret;
+    uint16_t generation[DN_DISKS];
+    tlConn_t conn = { clientSocket, server, nullptr };
 
 
     int flag = 1;
@@ -216,14 +510,23 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
 
     server->SetRcvTimeout( clientSocket, 100 );
 
+    if( !tlAccept( conn, clientInfo ) )
+    {
+        server->Disconnect( clientSocket );
+        return;
+    }
+
+    // Only wait shortly for a command of the client, see dbgClientCmd()
+    server->SetRcvTimeout( clientSocket, DBG_POLL_MS );
+
     while( gSrvRunning )
     {
         std::unique_lock<std::mutex> lock( gMutex);
 
-        // The thread sleeps here until gDbgDataReady is true.
-        // gCv.wait releases the lock while it sleeps,
+        // The thread sleeps here until gDbgDataReady is true or DBG_POLL_MS
+        // have passed. gCv.wait_for releases the lock while it sleeps,
         // and locks it again before waking up.
-        gCv.wait(lock, [] { return gDbgDataReady; });
+        bool ready = gCv.wait_for( lock, std::chrono::milliseconds( DBG_POLL_MS ), [] { return gDbgDataReady; } );
 
         if( ( gCloseDbgSocket != INVALID_SOCKET ) && ( gCloseDbgSocket == clientSocket ) )
         {
@@ -232,6 +535,16 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
             break;
         }
 
+        if( !ready )
+        {
+            lock.unlock();
+            if( !dbgClientCmd( conn, clientInfo ) )
+            {
+                break;
+            }
+            continue;
+        }
+
         switch( gDbgCmd )
         {
             case 'R':
@@ -239,7 +552,7 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
                 message( MsgType::INFO, "Resetting the Z80-MBC2" );
                 buffer[0] = 'R';
                 buffer[1] = '\0';
-                server->Send( clientSocket, buffer, sizeof(buffer) );
+                tlSend( conn, buffer, sizeof(buffer) );
                 gDbgCmd = ' ';
             break;
 
@@ -248,7 +561,22 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
                 message( MsgType::INFO, "Press user button and reset of the Z80-MBC2" );
                 buffer[0] = 'U';
                 buffer[1] = '\0';
-                server->Send( clientSocket, buffer, sizeof(buffer) );
+                tlSend( conn, buffer, sizeof(buffer) );
+                gDbgCmd = ' ';
+            break;
+
+            case 'N':
+                // Generations of the emulated disks, 16 bit little endian each.
+                // The client drops cached data of the disks that changed.
+                dnTakeNotify( generation );
+                buffer[0] = 'N';
+                for( int disk = 0; disk < DN_DISKS; disk++ )
+                {
+                    buffer[1 + disk * 2] = (char)( generation[disk] & 0xFF );
+                    buffer[2 + disk * 2] = (char)( generation[disk] >> 8 );
+                }
+                buffer[1 + DN_DISKS * 2] = '\0';
+                tlSend( conn, buffer, sizeof(buffer) );
                 gDbgCmd = ' ';
             break;
 
@@ -261,7 +589,56 @@ void handleDbgClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
     }
 
     // Close connection to client
-    server->Disconnect( clientSocket );
+    tlDisconnect( conn );
+}
+
+
+/***************************************************************************//**
+ * @brief   Receives a complete compact frame of the client (see vdWire.h).
+ *
+ * @param   conn    Connection to the client.
+ * @param   frame   Receives the frame, VD_WIRE_MAX_LEN bytes.
+ *
+ * @return  Length of the frame, -1 if nothing was received, 0 if the
+ *          connection is closed or the frame is invalid.
+ ******************************************************************************/
+static int receiveFrame( tlConn_t& conn, uint8_t* frame )
+{
+    int len      = 0;
+    int frameLen = VD_WIRE_HEAD_LEN;
+    int timeouts = 0;
+    int ret;
+
+
+    while( len < frameLen )
+    {
+        ret = tlReceive( conn, (char*)frame + len, frameLen - len );
+        if( ret == 0 ) { return 0; }
+        if( ret < 0 )
+        {
+            if( len == 0 ) { return -1; }
+            if( ++timeouts >= WIRE_RCV_TIMEOUTS )
+            {
+                message( MsgType::ERR, "Incomplete compact frame" );
+                return 0;
+            }
+            continue;
+        }
+
+        // The head has the length of the rest
+        if( ( len < VD_WIRE_HEAD_LEN ) && ( len + ret >= VD_WIRE_HEAD_LEN ) )
+        {
+            frameLen = vdWireFrameLen( frame, VD_WIRE_HEAD_LEN );
+            if( frameLen == 0 )
+            {
+                message( MsgType::ERR, "Invalid compact frame" );
+                return 0;
+            }
+        }
+        len += ret;
+    }
+
+    return len;
 }
 
 
@@ -278,12 +655,28 @@ void handleTcpClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
     char buffer[BUFFER_SIZE] = {};
     int bytesReceived;
     int ret;
+    int session = stSessionStart( clientInfo );
+    std::string clientIP = clientInfo.substr( 0, clientInfo.rfind( ':' ) );    // Identifies the overlays
+    uint64_t lastSent = 0;      // Time of the last answer, for the gap until the next packet
+    uint64_t start;
+    tlConn_t conn = { clientSocket, server, nullptr };
+    uint8_t  wireEnc = 0;       // Negotiated compact frames (VD_WIRE_...), 0: full packets
+    uint8_t  frame[VD_WIRE_MAX_LEN];
+    int      sendLen;
+    uint8_t  cmd;
 
     int flag = 1;
     setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
 
     server->SetRcvTimeout( clientSocket, 100 );
 
+    if( !tlAccept( conn, clientInfo ) )
+    {
+        server->Disconnect( clientSocket );
+        stSessionEnd( session );
+        return;
+    }
+
     while( gSrvRunning )
     {
         if( ( gCloseTcpSocket != INVALID_SOCKET ) && ( gCloseTcpSocket == clientSocket ) )
@@ -293,22 +686,77 @@ void handleTcpClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
             break;
         }
 
-        bytesReceived = server->Receive( clientSocket, buffer, BUFFER_SIZE, false );
+        if( wireEnc != 0 )
+        {
+            bytesReceived = receiveFrame( conn, frame );
+            if( ( bytesReceived > 0 ) && !vdWireUnpack( frame, (uint8_t*)buffer ) )
+            {
+                message( MsgType::ERR, "Invalid data of a compact frame (" + clientInfo + ")" );
+                break;
+            }
+        }
+        else
+        {
+            bytesReceived = tlReceive( conn, buffer, BUFFER_SIZE );
+        }
 
         if( bytesReceived > 0 )
         {
             //std::cout << "Bytes received from ESP8266: " << bytesReceived << std::endl;
 
-            ret = vdProcessCmd( buffer );
+            start = stNow();
+            if( lastSent != 0 ) { stRecordPhase( ST_PHASE_GAP, start - lastSent ); }
+
+            {
+                stQueueEnter();
+                std::lock_guard<std::mutex> lock( gDskMutex );
+                stQueueLeave();
+                stRecordPhase( ST_PHASE_LOCK_WAIT, stNow() - start );
+
+                // Position before the command and the offset of a seek, the answer overwrites the packet
+                cmd = ((vdPacket_t*)buffer)->packet.cmd;
+                uint32_t offset = ( cmd == VD_CMD_SEEK_FILE ) ? ((vdPacket_t*)buffer)->packet.fileOffset :
+                                  ( cmd == VD_CMD_SEL_FILE )  ? 0 : (uint32_t)vdData.filePos;
+
+                ovSetClient( clientIP );
+
+                start = stNow();
+                ret = vdProcessCmd( buffer );
+                trRecord( session, cmd, (uint8_t)((vdPacket_t*)buffer)->packet.status, vdData.filename, offset, stNow() - start );
+            }
             if( ret == 0 )
             {
                 //std::cout << "Sending response to ESP8266: " << sizeof(vdPacket_t) << std::endl;
 
-                server->Send( clientSocket, buffer, sizeof(vdPacket_t) );
+                start = stNow();
+                if( wireEnc != 0 )
+                {
+                    // Only the answer of a read has data
+                    sendLen = vdWirePack( (uint8_t*)buffer,
+                                          ( cmd == VD_CMD_RD_FILE ) && ( ((vdPacket_t*)buffer)->packet.status == VD_STATUS_OK ),
+                                          wireEnc, frame );
+                    tlSend( conn, (char*)frame, sendLen );
+                }
+                else
+                {
+                    sendLen = sizeof(vdPacket_t);
+                    tlSend( conn, buffer, sendLen );
+                }
+                lastSent = stNow();
+                stRecordPhase( ST_PHASE_SEND, lastSent - start );
+                stSessionCount( session, bytesReceived, sendLen );
+
+                // Compact frames from the next packet on
+                if( cmd == VD_CMD_ENCODING )
+                {
+                    wireEnc = ((vdPacket_t*)buffer)->packet.data[0];
+                }
             }
             else
             {
                 //std::cout << "Error processing command from ESP8266" << std::endl;
+                lastSent = 0;
+                stSessionCount( session, bytesReceived, 0 );
             }
         }
         else if( bytesReceived == 0 )
@@ -322,7 +770,14 @@ void handleTcpClient( ASocket::Socket clientSocket, CTCPServer* server, std::str
     }
 
     // Close connection to client
-    server->Disconnect( clientSocket );
+    tlDisconnect( conn );
+    stSessionEnd( session );
+
+    // The overlay of the client survives a crash of the server
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+        ovSave( true );
+    }
 }
 
 
@@ -340,13 +795,22 @@ int main( int argc, char* argv[] )
 {
     std::vector<std::thread> tcpClientThreads;
     std::vector<std::thread> dbgClientThreads;
+    std::vector<std::thread> rpcClientThreads;
+    std::vector<std::unique_ptr<CTCPServer>> tcpServers;
+    std::vector<std::unique_ptr<CTCPServer>> dbgServers;
+    std::vector<std::unique_ptr<CTCPServer>> rpcServers;
+    std::vector<std::unique_ptr<CTCPServer>> statsServers;
+    CTCPServer* server;
     ASocket::Socket tcpClient;
     ASocket::Socket oldTcpClient = INVALID_SOCKET;
     ASocket::Socket dbgClient;
     ASocket::Socket oldDbgClient = INVALID_SOCKET;
+    ASocket::Socket rpcClient;
+    ASocket::Socket statsClient;
 
     int    key;
     bool   isSpecial;
+    auto   ovSaved = std::chrono::steady_clock::now();
 
 
     // Print status message
@@ -359,48 +823,113 @@ int main( int argc, char* argv[] )
     std::cout << "'H' for help, 'Q' for quit" << std::endl << std::endl;
     if( isColorTerm() ) { std::cout << COLOR_NORM; }
 
+    // Convert between a host directory and a disk image or fill an image store, without serving
+    vdArgs args = argparse::parse<vdArgs>( argc, argv );
+    if( args.pack.has_value() )
+    {
+        if( args.pack->size() != 2 )
+        {
+            message( MsgType::ERR, "Usage: --pack <directory> <image>" );
+            return 1;
+        }
+        return itPackDirectory( args.pack->at(0), args.pack->at(1), args.format ) ? 0 : 1;
+    }
+    if( args.unpack.has_value() )
+    {
+        if( args.unpack->size() != 2 )
+        {
+            message( MsgType::ERR, "Usage: --unpack <image> <directory>" );
+            return 1;
+        }
+        return itUnpackImage( args.unpack->at(0), args.unpack->at(1), args.format, args.type ) ? 0 : 1;
+    }
+    if( args.store.has_value() )
+    {
+        if( args.store->size() < 2 )
+        {
+            message( MsgType::ERR, "Usage: --store <directory> <image...>" );
+            return 1;
+        }
+        return itStoreImages( args.store->at(0), std::vector<std::string>( args.store->begin() + 1, args.store->end() ),
+                              args.format, args.type ) ? 0 : 1;
+    }
+
     // Read configuration file
     readConfig();
 
+    // Trace of the VirtDisk commands, the command line overrides the configuration file
+    if( args.trace.has_value() ) { traceFile = *args.trace; }
+    if( !traceFile.empty() )     { trStart( traceFile ); }
+
+    // Encryption of the VirtDisk and debug connections, never fall back to cleartext
+    if( !tlsCertFile.empty() || !tlsKeyFile.empty() )
+    {
+        if( !tlInit( tlsCertFile, tlsKeyFile, tlsMinVersion ) )
+        {
+            return 1;
+        }
+        message( MsgType::WARN, "The WiFi-VirtDisk Client (ESP8266) has no TLS, it cannot connect to this server" );
+    }
+
+    // Check the file systems of all emulated disks
+    dcCheckAllDisks( false );
+
+    // Overlays of the shared disks from the last run
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+        ovLoad();
+    }
+
     // // Test function
     // test();
     // return 0;
 
 
     // Create WiFi-VirtDisk Server
-    CTCPServer tcpServer( LogPrinter, serverPort, (ASocket::SettingsFlag)0 );
-    try
+    if( !createServers( tcpServers, serverPort, "WiFi-VirtDisk Server" ) )
     {
-        message( MsgType::INFO, "WiFi-VirtDisk Server started, listening on port " + serverPort );
+        return 1;
     }
-    catch( const std::exception& e)
+
+
+    // Create Debug Server
+    if( !createServers( dbgServers, dbgServerPort, "Debug Server" ) )
     {
-        message( MsgType::ERR, "Error creating WiFi-VirtDisk server: " + std::string(e.what()) );
         return 1;
     }
+    if( isColorTerm() ) { std::cout << COLOR_GREEN; }
+    std::cout << "'R' for reset the Z80-MBC2, 'U' for user button and reset" << std::endl << std::endl;
+    if( isColorTerm() ) { std::cout << COLOR_NORM; }
 
 
-    // Create Debug Server
-    CTCPServer dbgServer( LogPrinter, dbgServerPort, (ASocket::SettingsFlag)0 );
-    try
+    // Create LibDsk RPC Server
+    if( !createServers( rpcServers, rpcServerPort, "RPC Server", rpcBindAddress ) )
     {
-        message( MsgType::INFO, "Debug Server started, listening on port " + dbgServerPort );
-        if( isColorTerm() ) { std::cout << COLOR_GREEN; }
-        std::cout << "'R' for reset the Z80-MBC2, 'U' for user button and reset" << std::endl << std::endl;
-        if( isColorTerm() ) { std::cout << COLOR_NORM; }
+        return 1;
     }
-    catch( const std::exception& e)
+    if( isColorTerm() ) { std::cout << COLOR_GREEN; }
+    std::cout << "Open the disk images with LibDsk as 'tcp:<address>:" << rpcServerPort << ",<image>'" << std::endl << std::endl;
+    if( isColorTerm() ) { std::cout << COLOR_NORM; }
+
+
+    // Create Stats Server
+    if( !createServers( statsServers, statsServerPort, "Stats Server" ) )
     {
-        message( MsgType::ERR, "Error creating Debug server: " + std::string(e.what()) );
         return 1;
     }
+    if( isColorTerm() ) { std::cout << COLOR_GREEN; }
+    std::cout << "'S' for statistics, Prometheus text on 'http://<host>:" << statsServerPort << "/metrics'" << std::endl << std::endl;
+    if( isColorTerm() ) { std::cout << COLOR_NORM; }
 
 
     // Main loop of server
     while( gSrvRunning )
     {
-        // WiFi-VirtDisk - Wait for incomming connection, timeout 250ms
-        if( tcpServer.Listen( tcpClient, 250 ) )
+        // Wait for an incomming connection on any server, timeout 250ms
+        server = waitForConnection( { &tcpServers, &dbgServers, &rpcServers, &statsServers }, 250 );
+
+        // WiFi-VirtDisk
+        if( isServerOf( server, tcpServers ) && server->Listen( tcpClient, 1 ) )
         {
             if( oldTcpClient == INVALID_SOCKET )
             {
@@ -414,7 +943,7 @@ int main( int argc, char* argv[] )
 
             std::string clientInfo = "IP could not be resolved";
             MsgType ipMsg = MsgType::WARN;
-            char clientIP[INET_ADDRSTRLEN] = {0};
+            char clientIP[CLIENT_IP_LEN] = {0};
             int  clientPort = 0;
             if( getClientIP( tcpClient, clientIP, &clientPort ) )
             {
@@ -425,12 +954,12 @@ int main( int argc, char* argv[] )
 
             // Start new thread for client connection handling
             message( MsgType::INFO, "Client thread created" );
-            tcpClientThreads.emplace_back( handleTcpClient, tcpClient, &tcpServer, clientInfo );
+            tcpClientThreads.emplace_back( handleTcpClient, tcpClient, server, clientInfo );
         }
 
 
-        // Debug Server - Wait for incomming connection, timeout 250ms
-        if( dbgServer.Listen( dbgClient, 250 ) )
+        // Debug Server
+        if( isServerOf( server, dbgServers ) && server->Listen( dbgClient, 1 ) )
         {
             if( oldDbgClient == INVALID_SOCKET )
             {
@@ -446,7 +975,7 @@ int main( int argc, char* argv[] )
 
             std::string clientInfo = "IP could not be resolved";
             MsgType ipMsg = MsgType::WARN;
-            char clientIP[INET_ADDRSTRLEN] = {0};
+            char clientIP[CLIENT_IP_LEN] = {0};
             int  clientPort = 0;
             if( getClientIP( dbgClient, clientIP, &clientPort ) )
             {
@@ -457,7 +986,68 @@ int main( int argc, char* argv[] )
 
             // Start new thread for client connection handling
             message( MsgType::INFO, "Debug Client thread created" );
-            dbgClientThreads.emplace_back( handleDbgClient, dbgClient, &dbgServer, clientInfo );
+            dbgClientThreads.emplace_back( handleDbgClient, dbgClient, server, clientInfo );
+
+            // The new client gets the current generations of the disks
+            dnRequestNotify();
+        }
+
+
+        // RPC Server, several clients may be connected at the same time
+        if( isServerOf( server, rpcServers ) && server->Listen( rpcClient, 1 ) )
+        {
+            std::string clientInfo = "IP could not be resolved";
+            MsgType ipMsg = MsgType::WARN;
+            char clientIP[CLIENT_IP_LEN] = {0};
+            int  clientPort = 0;
+            if( getClientIP( rpcClient, clientIP, &clientPort ) )
+            {
+                clientInfo = std::string(clientIP) + ":" + std::to_string(clientPort);
+                ipMsg = MsgType::INFO;
+            }
+            message( ipMsg, "Client connected to RPC Server (" + clientInfo + ")" );
+
+            // Start new thread for client connection handling
+            rpcClientThreads.emplace_back( rpcHandleClient, rpcClient, server, clientInfo );
+        }
+
+
+        // Stats Server, every client is served on a short-lived thread
+        if( isServerOf( server, statsServers ) && server->Listen( statsClient, 1 ) )
+        {
+            stStartClient( statsClient, server );
+        }
+
+
+        // Disk change notifications, sent over the debug connection
+        dnPollHostChanges();
+        if( dnNotifyPending() )
+        {
+            bool notify = false;
+
+            // A pending debug command is sent first
+            {
+                std::lock_guard<std::mutex> lock( gMutex);
+                if( gDbgCmd == ' ' )
+                {
+                    gDbgCmd = 'N';
+                    gDbgDataReady = true;
+                    notify = true;
+                }
+            } // Mutex is automatically released here
+
+            // Wake up all sleeping debug threads while a replaced connection
+            // is still open, the others go back to sleep
+            if( notify ) { gCv.notify_all(); }
+        }
+
+
+        // Changed overlays of the shared disks, also for boards that stay connected
+        if( std::chrono::steady_clock::now() - ovSaved >= std::chrono::seconds( OV_SAVE_INTERVAL ) )
+        {
+            std::lock_guard<std::mutex> lock( gDskMutex );
+            ovSave( true );
+            ovSaved = std::chrono::steady_clock::now();
         }
 
 
@@ -475,7 +1065,10 @@ int main( int argc, char* argv[] )
                     case 'H':
                         if( isColorTerm() ) { std::cout << COLOR_GREEN; }
                         std::cout << "'H' for help, 'Q' for quit" << std::endl;
-                        std::cout << "'L' for re-load the disk image" << std::endl;
+                        std::cout << "'L' for re-load the disk image, 'S' for statistics, 'T' for start/stop the trace" << std::endl;
+                        std::cout << "'C' for check the changed disk images, 'F' for check all disk images" << std::endl;
+                        std::cout << "'O' for the overlays and snapshots, 'D' for discard and 'W' for write the overlay of the client to the image" << std::endl;
+                        std::cout << "'K' for a snapshot of all disks, 'B' for back to the snapshot, 'X' for drop the snapshot" << std::endl;
                         std::cout << "'R' for reset the Z80-MBC2, 'U' for user button and reset" << std::endl << std::endl;
                         if( isColorTerm() ) { std::cout << COLOR_NORM; }
                     break;
@@ -521,13 +1114,97 @@ int main( int argc, char* argv[] )
                         // Re-load the disk image
                         message( MsgType::INFO, "Key stroke: 'L'" );
 
-                        if( vdReloadDiskImage() == true )
+                        // Scope for the lock, the RPC clients use the same disk image
                         {
-                            message( MsgType::INFO, "Disk image re-loaded successfully" );
+                            std::lock_guard<std::mutex> lock( gDskMutex );
+                            if( vdReloadDiskImage() == true )
+                            {
+                                message( MsgType::INFO, "Disk image re-loaded successfully" );
+                            }
+                            else
+                            {
+                                message( MsgType::ERR, "Failed to re-load disk image" );
+                            }
+                        } // Mutex is automatically released here
+                    break;
+
+                    case 'S':
+                        // Print the statistics
+                        message( MsgType::INFO, "Key stroke: 'S'" );
+                        stPrint();
+                    break;
+
+                    case 'T':
+                        // Start or stop the trace of the VirtDisk commands
+                        message( MsgType::INFO, "Key stroke: 'T'" );
+
+                        if( trActive() )
+                        {
+                            trStop();
+                        }
+                        else
+                        {
+                            trStart( traceFile.empty() ? getExeDir() + "/WiFi-VirtDisk.trace" : traceFile );
+                        }
+                    break;
+
+                    case 'O':
+                        // Print the shared disks and the overlays
+                        message( MsgType::INFO, "Key stroke: 'O'" );
+                        ovPrint();
+                        snPrint();
+                    break;
+
+                    case 'K':
+                    case 'B':
+                    case 'X':
+                        // Take a snapshot of all emulated disks, roll them back or drop it
+                        message( MsgType::INFO, "Key stroke: '" + std::string(1, (char)toupper(key)) + "'" );
+
+                        // Scope for the lock, the client and the RPC clients use the same disk images
+                        {
+                            std::lock_guard<std::mutex> lock( gDskMutex );
+                            if( toupper(key) == 'K' )      { snCreate( SN_ALL_DISKS ); }
+                            else if( toupper(key) == 'B' ) { snRollback( SN_ALL_DISKS ); }
+                            else                           { snDrop( SN_ALL_DISKS ); }
+                        } // Mutex is automatically released here
+                    break;
+
+                    case 'D':
+                    case 'W':
+                        // Discard the overlay of the current client or write it to the image
+                        message( MsgType::INFO, "Key stroke: '" + std::string(1, (char)toupper(key)) + "'" );
+
+                        // Scope for the lock, the client and the RPC clients use the same disk images
+                        {
+                            std::lock_guard<std::mutex> lock( gDskMutex );
+                            std::string client = ovGetClient();
+
+                            if( client.empty() )
+                            {
+                                message( MsgType::WARN, "No client connected yet" );
+                            }
+                            else
+                            {
+                                if( toupper(key) == 'D' ) { ovDiscard( client ); }
+                                else                      { ovCommit( client ); }
+                                ovSave();
+                            }
+                        } // Mutex is automatically released here
+                    break;
+
+                    case 'C':
+                    case 'F':
+                        // Check the file systems, 'C' skips unchanged disk images
+                        message( MsgType::INFO, "Key stroke: '" + std::string(1, (char)toupper(key)) + "'" );
+
+                        if( dcCheckAllDisks( toupper(key) == 'F' ) == true )
+                        {
+                            message( MsgType::INFO, "All disk images are clean" );
                         }
                         else
                         {
-                            message( MsgType::ERR, "Failed to re-load disk image" );
+                            message( MsgType::ERR, "Errors found on disk images" );
                         }
                     break;
 
@@ -547,8 +1224,14 @@ int main( int argc, char* argv[] )
         message( MsgType::INFO, "File closed" );
     }
 
+    // Close the trace file
+    trStop();
+
     // Close eumlated disk drive
-    Device_close( &drive.dev );
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+        vdCloseDiskImage();
+    }
 
 
     // Wait for all client threads are terminated.
@@ -558,6 +1241,24 @@ int main( int argc, char* argv[] )
         thread.join();
     }
 
+    // Save the overlays of the shared disks for the next run
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+        ovSave();
+    }
+
+
+    // Wait for the stats clients, they use the stats servers
+    stJoinClients( true );
+
+
+    // Wait for all RPC client threads, they release their disk images
+    message( MsgType::INFO, "Waiting for all RPC client threads to stop." );
+    for( auto& thread : rpcClientThreads )
+    {
+        thread.join();
+    }
+
 
     // Close debug connection to client
     message( MsgType::INFO, "Waiting for all debug client threads to stop." );
@@ -569,6 +1270,9 @@ int main( int argc, char* argv[] )
     }
 
 
+    // Free the TLS context, all connections are closed
+    tlCleanup();
+
     message( MsgType::INFO, "Server shutdown" );
     std::cout << std::endl;
 
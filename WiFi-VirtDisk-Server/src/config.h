@@ -11,6 +11,7 @@
 #undef HAVE_WINDOWS_H
 #undef HAVE_WINIOCTL_H
 #define HAVE_DIRENT_H 1
+#define HAVE_SYS_SOCKET_H 1
 #endif
 #define HAVE_LIBDSK_H 1
 // #undef  HAVE_LIBDSK_H
@@ -184,6 +184,8 @@ int main(int argc, char *argv[])
     fprintf(stderr,"%s: cannot read superblock (%s)\n",cmd,boo);
     exit(1);
   }
+  /* batch copy: write the directory once when unmounting */
+  super.delaySync=1;
   /*}}}*/
   if (readcpm) /* copy from CP/M to UNIX */ /*{{{*/
   {
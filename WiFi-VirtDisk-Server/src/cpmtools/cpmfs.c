@@ -250,13 +250,14 @@ static void unix2ds_time(time_t now, struct dsEntry *entry)
 
 /* allocation vector bitmap functions */
 /* alvInit            -- init allocation vector                  */ /*{{{*/
-static void alvInit(const struct cpmSuperBlock *d)
+static void alvInit(struct cpmSuperBlock *d)
 {
   int i,j,offset,block;
 
   assert(d!=(const struct cpmSuperBlock*)0);
   /* clean bitmap */ /*{{{*/
   memset(d->alv,0,d->alvSize*sizeof(int));
+  d->alvNext=0;
   /*}}}*/
   /* mark directory blocks as used */ /*{{{*/
   /* A directory may cover more blocks than an int may hold bits,
@@ -289,6 +290,8 @@ static void alvInit(const struct cpmSuperBlock *d)
 #endif
           offset=block/INTBITS;
           d->alv[offset]|=(1<<block%INTBITS);
+          /* continue allocating behind the last used block */
+          if (block>=d->alvNext) d->alvNext=block+1;
         }
       }
     }
@@ -296,35 +299,63 @@ static void alvInit(const struct cpmSuperBlock *d)
   /*}}}*/
 }
 /*}}}*/
+/* lowestBit          -- index of the lowest set bit             */ /*{{{*/
+static int lowestBit(unsigned int bits)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(bits);
+#else
+  int n;
+
+  for (n=0; (bits&1)==0; ++n) bits>>=1;
+  return n;
+#endif
+}
+/*}}}*/
 /* allocBlock         -- allocate a new disk block               */ /*{{{*/
-static int allocBlock(const struct cpmSuperBlock *drive)
+/* The hint is the preferred block, usually the one following the
+ * previous block of the file, so files are laid out contiguously and
+ * can be transferred in multi-sector runs.  Without a hint, or if the
+ * hinted block is taken, the search continues where the last one
+ * stopped (next fit) and tests a whole int of the bitmap at a time.
+ */
+static int allocBlock(struct cpmSuperBlock *drive, int hint)
 {
-  int i,j,bits,block;
+  int i,n,words,start,block;
+  unsigned int bits;
 
   assert(drive!=(const struct cpmSuperBlock*)0);
-  for (i=0; i<drive->alvSize; ++i)
+  if (hint>0 && hint<drive->size && (drive->alv[hint/INTBITS]&(1U<<(hint%INTBITS)))==0) block=hint;
+  else
   {
-    for (j=0,bits=drive->alv[i]; j<INTBITS; ++j)
+    words=(drive->size+INTBITS-1)/INTBITS;
+    if (words>drive->alvSize) words=drive->alvSize;
+    start=drive->alvNext<drive->size ? drive->alvNext : 0;
+    block=-1;
+    /* first word from the cursor on, then all words, wrapping around */
+    for (n=0; n<=words && block==-1; ++n)
     {
-      if ((bits&1)==0)
+      i=(start/INTBITS+n)%words;
+      bits=~(unsigned int)drive->alv[i];
+      if (n==0) bits&=~0U<<(start%INTBITS);
+      if (bits)
       {
-        block=i*INTBITS+j;
-        if (block>=drive->size)
-        {
-          boo="device full";
-          return -1;
-        }
-#ifdef CPMFS_DEBUG
-        fprintf(stderr,"allocBlock: allocate data block %d\n",block);
-#endif
-        drive->alv[i] |= (1<<j);
-        return block;
+        block=i*INTBITS+lowestBit(bits);
+        if (block>=drive->size) block=-1;
       }
-      bits >>= 1;
+    }
+    if (block==-1)
+    {
+      boo="device full";
+      return -1;
     }
   }
-  boo="device full";
-  return -1;
+#ifdef CPMFS_DEBUG
+  fprintf(stderr,"allocBlock: allocate data block %d\n",block);
+#endif
+  drive->alv[block/INTBITS]|=(1U<<(block%INTBITS));
+  drive->alvNext=block+1;
+  return block;
 }
 /*}}}*/
 
@@ -341,7 +372,7 @@ static int bootOffset(const struct cpmSuperBlock *d)
 /* readBlock          -- read a (partial) block                  */ /*{{{*/
 static int readBlock(const struct cpmSuperBlock *d, int blockno, char *buffer, int start, int end)
 {
-  int sect, track, counter;
+  int sect, track, counter, run;
 
   assert(d);
   assert(blockno>=0);
@@ -358,24 +389,27 @@ static int readBlock(const struct cpmSuperBlock *d, int blockno, char *buffer, i
   if (end<0) end=d->blksiz/d->secLength-1;
   sect =(blockno*(d->blksiz/d->secLength)+ bootOffset(d))%d->sectrk;
   track=(blockno*(d->blksiz/d->secLength)+ bootOffset(d))/d->sectrk;
-  for (counter=0; counter<=end; ++counter)
+  for (counter=0; counter<=end; counter+=run)
   {
     char const *err;
 
     assert(d->skewtab[sect]>=0);
     assert(d->skewtab[sect]<d->sectrk);
+    run=1;
     if (counter>=start)
     {
+      /* sectors that are physically adjacent on this track go in one request */
+      while (counter+run<=end && sect+run<d->sectrk && d->skewtab[sect+run]==d->skewtab[sect]+run) ++run;
 #ifdef CPMFS_DEBUG
-      fprintf(stderr,"readBlock: read sector %d/%d\n",d->skewtab[sect],track);
+      fprintf(stderr,"readBlock: read sectors %d+%d/%d\n",d->skewtab[sect],run,track);
 #endif
-      if ((err=Device_readSector(&d->dev,track,d->skewtab[sect],buffer+(d->secLength*counter))))
+      if ((err=Device_readSectors(&d->dev,track,d->skewtab[sect],run,buffer+(d->secLength*counter))))
       {
         boo=err;
         return -1;
       }
     }
-    ++sect;
+    sect+=run;
     if (sect>=d->sectrk)
     {
       sect = 0;
@@ -388,7 +422,7 @@ static int readBlock(const struct cpmSuperBlock *d, int blockno, char *buffer, i
 /* writeBlock         -- write a (partial) block                 */ /*{{{*/
 static int writeBlock(const struct cpmSuperBlock *d, int blockno, char const *buffer, int start, int end)
 {
-  int sect, track, counter;
+  int sect, track, counter, run;
 
   assert(blockno>=0);
   assert(blockno<d->size);
@@ -400,16 +434,21 @@ static int writeBlock(const struct cpmSuperBlock *d, int blockno, char const *bu
   if (end < 0) end=d->blksiz/d->secLength-1;
   sect  = (blockno*(d->blksiz/d->secLength) + bootOffset(d)) % d->sectrk;
   track = (blockno*(d->blksiz/d->secLength) + bootOffset(d)) / d->sectrk;
-  for (counter = 0; counter<=end; ++counter)
+  for (counter = 0; counter<=end; counter+=run)
   {
     char const *err;
 
-    if (counter>=start && (err=Device_writeSector(&d->dev,track,d->skewtab[sect],buffer+(d->secLength*counter))))
+    run=1;
+    if (counter>=start)
     {
-      boo=err;
-      return -1;
+      while (counter+run<=end && sect+run<d->sectrk && d->skewtab[sect+run]==d->skewtab[sect]+run) ++run;
+      if ((err=Device_writeSectors(&d->dev,track,d->skewtab[sect],run,buffer+(d->secLength*counter))))
+      {
+        boo=err;
+        return -1;
+      }
     }
-    ++sect;
+    sect+=run;
     if (sect>=d->sectrk)
     {
       sect=0;
@@ -421,18 +460,92 @@ static int writeBlock(const struct cpmSuperBlock *d, int blockno, char const *bu
 /*}}}*/
 
 /* directory management */
+/* dirtyEntry         -- mark directory sector of an entry dirty */ /*{{{*/
+static void dirtyEntry(struct cpmSuperBlock *sb, int entry)
+{
+  int sector;
+
+  sector=(entry*32)/sb->secLength;
+  sb->dirtySectors[sector/INTBITS]|=(1<<(sector%INTBITS));
+  sb->dirtyDirectory=1;
+}
+/*}}}*/
+/* autoSync           -- write back directory unless delayed     */ /*{{{*/
+static int autoSync(struct cpmSuperBlock *sb)
+{
+  if (sb->delaySync || sb->dev.opened==0) return 0;
+  return cpmSync(sb);
+}
+/*}}}*/
+
+/* directory name hash */
+/* All entries of the same user and file name are chained in one hash
+ * bucket, in directory order.  The chains are updated by every function
+ * that changes the user or name of an entry, so name lookups only look
+ * at the extents of files whose names hash alike.
+ */
+/* dirhashKey         -- hash bucket of a user and file name     */ /*{{{*/
+static int dirhashKey(const struct cpmSuperBlock *sb, int user, char const *name, char const *ext)
+{
+  unsigned int h=2166136261U;
+  int i;
+
+  h=(h^(unsigned char)user)*16777619U;
+  for (i=0; i<8; ++i) h=(h^(name[i]&0x7f))*16777619U;
+  for (i=0; i<3; ++i) h=(h^(ext[i]&0x7f))*16777619U;
+  return (int)(h&sb->dirHashMask);
+}
+/*}}}*/
+/* dirhashInsert      -- add a directory entry to its hash chain */ /*{{{*/
+static void dirhashInsert(struct cpmSuperBlock *sb, int entry)
+{
+  const struct PhysDirectoryEntry *ent=&sb->dir[entry];
+  int *link;
+
+  if (((unsigned char)ent->status)>(sb->type&CPMFS_HI_USER ? 31 : 15)) return;
+  link=&sb->dirHash[dirhashKey(sb,ent->status,ent->name,ent->ext)];
+  while (*link!=-1 && *link<entry) link=&sb->dirNext[*link];
+  sb->dirNext[entry]=*link;
+  *link=entry;
+}
+/*}}}*/
+/* dirhashRemove      -- remove a directory entry from its chain */ /*{{{*/
+/* Must be called before the user or name of the entry is changed. */
+static void dirhashRemove(struct cpmSuperBlock *sb, int entry)
+{
+  const struct PhysDirectoryEntry *ent=&sb->dir[entry];
+  int *link;
+
+  if (((unsigned char)ent->status)>(sb->type&CPMFS_HI_USER ? 31 : 15)) return;
+  link=&sb->dirHash[dirhashKey(sb,ent->status,ent->name,ent->ext)];
+  while (*link!=-1 && *link!=entry) link=&sb->dirNext[*link];
+  if (*link==entry) *link=sb->dirNext[entry];
+}
+/*}}}*/
+/* dirhashBuild       -- hash all entries of the directory       */ /*{{{*/
+static void dirhashBuild(struct cpmSuperBlock *sb)
+{
+  int i;
+
+  for (i=0; i<=sb->dirHashMask; ++i) sb->dirHash[i]=-1;
+  for (i=0; i<sb->maxdir; ++i) dirhashInsert(sb,i);
+}
+/*}}}*/
+
 /* findFileExtent     -- find first/next extent for a file       */ /*{{{*/
 static int findFileExtent(const struct cpmSuperBlock *sb, int user, char const *name, char const *ext, int start, int extno)
 {
+  int i;
+
   boo="file already exists";
-  for (; start<sb->maxdir; ++start)
+  for (i=sb->dirHash[dirhashKey(sb,user,name,ext)]; i!=-1; i=sb->dirNext[i])
   {
     if
     (
-      ((unsigned char)sb->dir[start].status)<=(sb->type&CPMFS_HI_USER ? 31 : 15)
-      && (extno==-1 || (EXTENT(sb->dir[start].extnol,sb->dir[start].extnoh)/sb->extents)==(extno/sb->extents))
-      && isMatching(user,name,ext,sb->dir[start].status,sb->dir[start].name,sb->dir[start].ext)
-    ) return start;
+      i>=start
+      && (extno==-1 || (EXTENT(sb->dir[i].extnol,sb->dir[i].extnoh)/sb->extents)==(extno/sb->extents))
+      && isMatching(user,name,ext,sb->dir[i].status,sb->dir[i].name,sb->dir[i].ext)
+    ) return i;
   }
   boo="file not found";
   return -1;
@@ -448,6 +561,71 @@ static int findFreeExtent(const struct cpmSuperBlock *drive)
   return -1;
 }
 /*}}}*/
+/* extentBlock        -- get block pointer of an extent          */ /*{{{*/
+static int extentBlock(const struct cpmSuperBlock *sb, int extent, int ptr)
+{
+  if (sb->size>256) return (unsigned char)sb->dir[extent].pointers[2*ptr]+(((unsigned char)sb->dir[extent].pointers[2*ptr+1])<<8);
+  else return (unsigned char)sb->dir[extent].pointers[ptr];
+}
+/*}}}*/
+/* setExtentBlock     -- set block pointer of an extent          */ /*{{{*/
+static void setExtentBlock(const struct cpmSuperBlock *sb, int extent, int ptr, int block)
+{
+  if (sb->size>256)
+  {
+    sb->dir[extent].pointers[2*ptr]=block&0xff;
+    sb->dir[extent].pointers[2*ptr+1]=(block>>8)&0xff;
+  }
+  else sb->dir[extent].pointers[ptr]=block&0xff;
+}
+/*}}}*/
+
+/* extent index of open files */
+/* extidxBuild        -- map physical extents of a file to entries */ /*{{{*/
+/* Instead of searching the whole directory whenever a read or write
+ * crosses an extent boundary, the directory entry of each physical
+ * extent is looked up once when the file is opened.
+ */
+static int extidxBuild(struct cpmFile *file)
+{
+  const struct cpmSuperBlock *sb=file->ino->sb;
+  const struct PhysDirectoryEntry *ent=&sb->dir[file->ino->ino];
+  int i,phys;
+
+  file->extidxLen=(EXTENT(0x1f,0x3f)+1)/sb->extents;
+  if ((file->extidx=malloc(file->extidxLen*sizeof(int)))==(int*)0)
+  {
+    boo=strerror(errno);
+    return -1;
+  }
+  for (i=0; i<file->extidxLen; ++i) file->extidx[i]=-1;
+  for (i=sb->dirHash[dirhashKey(sb,ent->status,ent->name,ent->ext)]; i!=-1; i=sb->dirNext[i])
+  {
+    if (isMatching(ent->status,ent->name,ent->ext,sb->dir[i].status,sb->dir[i].name,sb->dir[i].ext))
+    {
+      phys=EXTENT(sb->dir[i].extnol,sb->dir[i].extnoh)/sb->extents;
+      /* like findFileExtent, the first matching entry wins */
+      if (file->extidx[phys]==-1) file->extidx[phys]=i;
+    }
+  }
+  return 0;
+}
+/*}}}*/
+/* extidxFind         -- find directory entry of a logical extent */ /*{{{*/
+static int extidxFind(const struct cpmFile *file, int extno)
+{
+  const struct cpmSuperBlock *sb=file->ino->sb;
+  int phys=extno/sb->extents;
+
+  if (file->extidx==(int*)0) return findFileExtent(sb,sb->dir[file->ino->ino].status,sb->dir[file->ino->ino].name,sb->dir[file->ino->ino].ext,0,extno);
+  if (phys>=file->extidxLen || file->extidx[phys]==-1)
+  {
+    boo="file not found";
+    return -1;
+  }
+  return file->extidx[phys];
+}
+/*}}}*/
 /* updateTimeStamps   -- convert time stamps to CP/M format      */ /*{{{*/
 static void updateTimeStamps(const struct cpmInode *ino, int extent)
 {
@@ -462,7 +640,7 @@ static void updateTimeStamps(const struct cpmInode *ino, int extent)
   unix2cpm_time(ino->mtime,&u_days,&u_hour,&u_min);
   if ((ino->sb->type&CPMFS_CPM3_DATES) && (date=ino->sb->dir+(extent|3))->status==0x21)
   {
-    ino->sb->dirtyDirectory=1;
+    dirtyEntry(ino->sb,extent|3);
     switch (extent&3)
     {
       case 0: /* first entry */ /*{{{*/
@@ -1113,6 +1291,32 @@ int cpmReadSuper(struct cpmSuperBlock *d, struct cpmInode *root, char const *for
     return -1;
   }
   /*}}}*/
+  /* allocate dirty bitmap of directory sectors */ /*{{{*/
+  {
+    int sectors;
+
+    sectors=((d->maxdir*32+d->blksiz-1)/d->blksiz)*(d->blksiz/d->secLength);
+    if ((d->dirtySectors=calloc((sectors+INTBITS-1)/INTBITS,sizeof(int)))==(int*)0)
+    {
+      boo=strerror(errno);
+      return -1;
+    }
+    d->delaySync=0;
+  }
+  /*}}}*/
+  /* allocate directory name hash */ /*{{{*/
+  {
+    int buckets;
+
+    for (buckets=16; buckets<d->maxdir; buckets*=2);
+    d->dirHashMask=buckets-1;
+    if ((d->dirHash=malloc(buckets*sizeof(int)))==(int*)0 || (d->dirNext=malloc(d->maxdir*sizeof(int)))==(int*)0)
+    {
+      boo=strerror(errno);
+      return -1;
+    }
+  }
+  /*}}}*/
   if (d->dev.opened==0) /* create empty directory in core */ /*{{{*/
   {
     memset(d->dir,0xe5,d->maxdir*32);
@@ -1132,6 +1336,7 @@ int cpmReadSuper(struct cpmSuperBlock *d, struct cpmInode *root, char const *for
   }
   /*}}}*/
   alvInit(d);
+  dirhashBuild(d);
   if (d->type&CPMFS_CPM3_OTHER) /* read additional superblock information */ /*{{{*/
   {
     int i;
@@ -1264,15 +1469,28 @@ int cpmSync(struct cpmSuperBlock *sb)
 {
   if (sb->dirtyDirectory)
   {
-    int i,blocks,entry;
+    int i,blocks,secsPerBlock,sectors,sec,run,all;
 
     blocks=(sb->maxdir*32+sb->blksiz-1)/sb->blksiz;
-    entry=0;
+    secsPerBlock=sb->blksiz/sb->secLength;
+    sectors=blocks*secsPerBlock;
+    /* Only the sectors with changed entries are written. Callers that
+     * raise dirtyDirectory themselves get the whole directory written.
+     */
+    for (all=1,i=0; i<(sectors+INTBITS-1)/INTBITS; ++i) if (sb->dirtySectors[i]) all=0;
+#define DIRTY(sec) (all || (sb->dirtySectors[(sec)/INTBITS]&(1<<((sec)%INTBITS))))
     for (i=0; i<blocks; ++i)
     {
-      if (writeBlock(sb,i,(char*)(sb->dir+entry),0,-1)==-1) return -1;
-      entry+=(sb->blksiz/32);
+      for (sec=0; sec<secsPerBlock; sec+=run)
+      {
+        run=1;
+        if (!DIRTY(i*secsPerBlock+sec)) continue;
+        while (sec+run<secsPerBlock && DIRTY(i*secsPerBlock+sec+run)) ++run;
+        if (writeBlock(sb,i,((char*)sb->dir)+i*sb->blksiz,sec,sec+run-1)==-1) return -1;
+      }
     }
+#undef DIRTY
+    memset(sb->dirtySectors,0,((sectors+INTBITS-1)/INTBITS)*sizeof(int));
     sb->dirtyDirectory=0;
   }
   if (sb->type&CPMFS_DS_DATES) syncDs(sb);
@@ -1291,6 +1509,9 @@ int cpmUmount(struct cpmSuperBlock *sb)
   free(sb->alv);
   free(sb->skewtab);
   free(sb->dir);
+  free(sb->dirtySectors);
+  free(sb->dirHash);
+  free(sb->dirNext);
   if (sb->passwdLength) free(sb->passwd);
   if (err_sync==-1) return err_sync;
   if (err_close)
@@ -1494,14 +1715,14 @@ int cpmUnlink(const struct cpmInode *dir, char const *fname)
   drive=dir->sb;
   if (splitFilename(fname,dir->sb->type,name,extension,&user)==-1) return -1;
   if ((extent=findFileExtent(drive,user,name,extension,0,-1))==-1) return -1;
-  drive->dirtyDirectory=1;
-  drive->dir[extent].status=(char)0xe5;
   do
   {
+    dirhashRemove(drive,extent);
     drive->dir[extent].status=(char)0xe5;
+    dirtyEntry(drive,extent);
   } while ((extent=findFileExtent(drive,user,name,extension,extent+1,-1))>=0);
   alvInit(drive);
-  return 0;
+  return autoSync(drive);
 }
 /*}}}*/
 /* cpmRename          -- rename                                  */ /*{{{*/
@@ -1530,12 +1751,14 @@ int cpmRename(const struct cpmInode *dir, char const *old, char const *new)
   }
   do
   {
-    drive->dirtyDirectory=1;
+    dirtyEntry(drive,extent);
+    dirhashRemove(drive,extent);
     drive->dir[extent].status=newuser;
     memcpy7(drive->dir[extent].name, newname, 8);
     memcpy7(drive->dir[extent].ext, newext, 3);
+    dirhashInsert(drive,extent);
   } while ((extent=findFileExtent(drive,olduser,oldname,oldext,extent+1,-1))!=-1);
-  return 0;
+  return autoSync(drive);
 }
 /*}}}*/
 /* cpmOpendir         -- opendir                                 */ /*{{{*/
@@ -1549,6 +1772,8 @@ int cpmOpendir(struct cpmInode *dir, struct cpmFile *dirp)
   dirp->ino=dir;
   dirp->pos=0;
   dirp->mode=O_RDONLY;
+  dirp->extidx=(int*)0;
+  dirp->extidxLen=0;
   return 0;
 }
 /*}}}*/
@@ -1625,7 +1850,7 @@ int cpmReaddir(struct cpmFile *dir, struct cpmDirent *ent)
       if ((cur=dir->ino->sb->dir+(dir->pos-RESERVED_ENTRIES))->status>=0 && cur->status<=(dir->ino->sb->type&CPMFS_HI_USER ? 31 : 15))
       {
         /* determine first extent for the current file */ /*{{{*/
-        for (i=0; i<dir->ino->sb->maxdir; ++i) if (i!=(dir->pos-RESERVED_ENTRIES))
+        for (i=dir->ino->sb->dirHash[dirhashKey(dir->ino->sb,cur->status,cur->name,cur->ext)]; i!=-1; i=dir->ino->sb->dirNext[i]) if (i!=(dir->pos-RESERVED_ENTRIES))
         {
           if (isMatching(cur->status,cur->name,cur->ext,dir->ino->sb->dir[i].status,dir->ino->sb->dir[i].name,dir->ino->sb->dir[i].ext) && EXTENT(cur->extnol,cur->extnoh)>EXTENT(dir->ino->sb->dir[i].extnol,dir->ino->sb->dir[i].extnoh)) first=i;
         }
@@ -1675,6 +1900,9 @@ void cpmStat(const struct cpmInode *ino, struct cpmStat *buf)
 /* cpmOpen            -- open                                    */ /*{{{*/
 int cpmOpen(struct cpmInode *ino, struct cpmFile *file, mode_t mode)
 {
+  /* cpmClose must be safe even if the open fails */
+  file->extidx=(int*)0;
+  file->extidxLen=0;
   if (S_ISREG(ino->mode))
   {
     if ((mode&O_WRONLY) && (ino->mode&0222)==0)
@@ -1685,6 +1913,7 @@ int cpmOpen(struct cpmInode *ino, struct cpmFile *file, mode_t mode)
     file->pos=0;
     file->ino=ino;
     file->mode=mode;
+    if (ino->ino<(ino_t)ino->sb->maxdir) return extidxBuild(file);
     return 0;
   }
   else
@@ -1697,7 +1926,7 @@ int cpmOpen(struct cpmInode *ino, struct cpmFile *file, mode_t mode)
 /* cpmRead            -- read                                    */ /*{{{*/
 ssize_t cpmRead(struct cpmFile *file, char *buf, size_t count)
 {
-  int findext=1,findblock=1,extent=-1,block=-1,extentno=-1,got=0,nextblockpos=-1,nextextpos=-1;
+  int got=0;
   struct cpmSuperBlock const *sb=file->ino->sb;
   int blocksize=sb->blksiz;
   int extcap;
@@ -1726,65 +1955,67 @@ ssize_t cpmRead(struct cpmFile *file, char *buf, size_t count)
     return count;
   }
   /*}}}*/
-  else while (count>0 && file->pos<file->ino->size)
+  else while (count>0 && file->pos<file->ino->size) /* one block or a run of blocks per pass */ /*{{{*/
   {
     char buffer[16384];
-
-    if (findext)
+    int extent,ptr,block,blockpos,run;
+    size_t chunk;
+
+    blockpos=file->pos%blocksize;
+    chunk=blocksize-blockpos;
+    if (chunk>count) chunk=count;
+    if ((off_t)chunk>file->ino->size-file->pos) chunk=file->ino->size-file->pos;
+    ptr=(file->pos%extcap)/blocksize;
+    if ((extent=extidxFind(file,file->pos/16384))==-1) block=0;
+    else block=extentBlock(sb,extent,ptr);
+    if (block==0) /* missing extent or unallocated block read as zeroes */ /*{{{*/
     {
-      extentno=file->pos/16384;
-      extent=findFileExtent(sb,sb->dir[file->ino->ino].status,sb->dir[file->ino->ino].name,sb->dir[file->ino->ino].ext,0,extentno);
-      nextextpos=(file->pos/extcap)*extcap+extcap;
-      findext=0;
-      findblock=1;
+      memset(buf,0,chunk);
     }
-    if (findblock)
+    /*}}}*/
+    else if (block<sb->dirblks) /*{{{*/
     {
-      if (extent!=-1)
+      boo="Attempting to access block before beginning of data";
+      if (got==0) got=-1;
+      break;
+    }
+    /*}}}*/
+    else if (blockpos==0 && chunk==(size_t)blocksize) /* whole blocks go straight to the caller */ /*{{{*/
+    {
+      /* blocks that follow each other on disk are read in one go */
+      run=1;
+      while
+      (
+        ptr+run<extcap/blocksize
+        && block+run<sb->size
+        && (size_t)(run+1)*blocksize<=count
+        && file->pos+(off_t)(run+1)*blocksize<=file->ino->size
+        && extentBlock(sb,extent,ptr+run)==block+run
+      ) ++run;
+      if (readBlock(sb,block,buf,0,run*(blocksize/sb->secLength)-1)==-1)
       {
-        int ptr;
-
-        ptr=(file->pos%extcap)/blocksize;
-        if (sb->size>256) ptr*=2;
-        block=(unsigned char)sb->dir[extent].pointers[ptr];
-        if (sb->size>256) block+=((unsigned char)sb->dir[extent].pointers[ptr+1])<<8;
-        if (block==0)
-        {
-          memset(buffer,0,blocksize);
-        }
-        else
-        {
-          int start,end;
-
-          start=(file->pos%blocksize)
-               /sb->secLength;
-          end=((file->pos%blocksize+(off_t)count)>blocksize ? blocksize-1 : (int)(file->pos%blocksize+count-1))
-              /sb->secLength;
-          if (block<sb->dirblks)
-          {
-            boo="Attempting to access block before beginning of data";
-            if (got==0) got=-1;
-            break;
-          }
-          if (readBlock(sb,block,buffer,start,end)==-1)
-          {
-            if (got==0) got=-1;
-            break;
-          }
-        }
+        if (got==0) got=-1;
+        break;
       }
-      nextblockpos=(file->pos/blocksize)*blocksize+blocksize;
-      findblock=0;
+      chunk=(size_t)run*blocksize;
     }
-    if (file->pos<nextblockpos)
+    /*}}}*/
+    else /* partial block */ /*{{{*/
     {
-      if (extent==-1) *buf++='\0'; else *buf++=buffer[file->pos%blocksize];
-      ++file->pos;
-      ++got;
-      --count;
+      if (readBlock(sb,block,buffer,blockpos/sb->secLength,(int)(blockpos+chunk-1)/sb->secLength)==-1)
+      {
+        if (got==0) got=-1;
+        break;
+      }
+      memcpy(buf,buffer+blockpos,chunk);
     }
-    else if (file->pos==nextextpos) findext=1; else findblock=1;
+    /*}}}*/
+    buf+=chunk;
+    file->pos+=chunk;
+    got+=chunk;
+    count-=chunk;
   }
+  /*}}}*/
 #ifdef CPMFS_DEBUG
   fprintf(stderr,"cpmRead: read %d bytes, now at position %ld\n",got,(long)file->pos);
 #endif
@@ -1794,137 +2025,145 @@ ssize_t cpmRead(struct cpmFile *file, char *buf, size_t count)
 /* cpmWrite           -- write                                   */ /*{{{*/
 ssize_t cpmWrite(struct cpmFile *file, char const *buf, size_t count)
 {
-  int findext=1,findblock=-1,extent=-1,extentno=-1,got=0,nextblockpos=-1,nextextpos=-1;
-  int blocksize=file->ino->sb->blksiz;
+  struct cpmSuperBlock *sb=file->ino->sb;
+  int blocksize=sb->blksiz;
+  int secsPerBlock=blocksize/sb->secLength;
   int extcap;
-  int block=-1,start=-1,end=-1,ptr=-1,last=-1;
+  int got=0;
   char buffer[16384];
 
-  extcap=(file->ino->sb->size<=256 ? 16 : 8)*blocksize;
-  if (extcap>16384) extcap=16384*file->ino->sb->extents;
+  extcap=(sb->size<=256 ? 16 : 8)*blocksize;
+  if (extcap>16384) extcap=16384*sb->extents;
   while (count>0)
   {
-    if (findext) /*{{{*/
+    int extentno,extent,ptr,block,blockpos,start,end,run,last,newblock=0;
+    size_t chunk;
+
+    extentno=file->pos/16384;
+    if ((extent=extidxFind(file,extentno))==-1) /* add a new extent */ /*{{{*/
+    {
+      if ((extent=findFreeExtent(sb))==-1) return (got==0 ? -1 : got);
+      sb->dir[extent]=sb->dir[file->ino->ino];
+      memset(sb->dir[extent].pointers,0,16);
+      sb->dir[extent].extnol=EXTENTL(extentno);
+      sb->dir[extent].extnoh=EXTENTH(extentno);
+      sb->dir[extent].blkcnt=0;
+      sb->dir[extent].lrc=0;
+      dirhashInsert(sb,extent);
+      if (file->extidx && extentno/sb->extents<file->extidxLen) file->extidx[extentno/sb->extents]=extent;
+      time(&file->ino->ctime);
+      updateTimeStamps(file->ino,extent);
+      updateDsStamps(file->ino,extent);
+    }
+    /*}}}*/
+    ptr=(file->pos%extcap)/blocksize;
+    blockpos=file->pos%blocksize;
+    chunk=blocksize-blockpos;
+    if (chunk>count) chunk=count;
+    if ((block=extentBlock(sb,extent,ptr))==0) /* allocate new block */ /*{{{*/
+    {
+      if ((block=allocBlock(sb,ptr>0 ? extentBlock(sb,extent,ptr-1)+1 : -1))==-1) return (got==0 ? -1 : got);
+      setExtentBlock(sb,extent,ptr,block);
+      newblock=1;
+      time(&file->ino->ctime);
+      updateTimeStamps(file->ino,extent);
+      updateDsStamps(file->ino,extent);
+    }
+    /*}}}*/
+    dirtyEntry(sb,extent);
+    if (blockpos==0 && chunk==(size_t)blocksize) /* whole blocks come straight from the caller */ /*{{{*/
     {
-      extentno=file->pos/16384;
-      extent=findFileExtent(file->ino->sb,file->ino->sb->dir[file->ino->ino].status,file->ino->sb->dir[file->ino->ino].name,file->ino->sb->dir[file->ino->ino].ext,0,extentno);
-      nextextpos=(file->pos/extcap)*extcap+extcap;
-      if (extent==-1)
+      /* Blocks that follow each other on disk are written in one go.
+       * A block is only allocated ahead if it will be filled
+       * completely, so it never needs to be wiped.
+       */
+      run=1;
+      while (ptr+run<extcap/blocksize && (size_t)(run+1)*blocksize<=count)
       {
-        if ((extent=findFreeExtent(file->ino->sb))==-1) return (got==0 ? -1 : got);
-        file->ino->sb->dir[extent]=file->ino->sb->dir[file->ino->ino];
-        memset(file->ino->sb->dir[extent].pointers,0,16);
-        file->ino->sb->dir[extent].extnol=EXTENTL(extentno);
-        file->ino->sb->dir[extent].extnoh=EXTENTH(extentno);
-        file->ino->sb->dir[extent].blkcnt=0;
-        file->ino->sb->dir[extent].lrc=0;
-        time(&file->ino->ctime);
-        updateTimeStamps(file->ino,extent);
-        updateDsStamps(file->ino,extent);
+        int next=extentBlock(sb,extent,ptr+run);
+
+        if (next==0)
+        {
+          if ((next=allocBlock(sb,block+run))==-1) break;
+          setExtentBlock(sb,extent,ptr+run,next);
+        }
+        if (next!=block+run) break;
+        ++run;
       }
-      findext=0;
-      findblock=1;
+      if (writeBlock(sb,block,buf,0,run*secsPerBlock-1)==-1) return (got==0 ? -1 : got);
+      chunk=(size_t)run*blocksize;
     }
     /*}}}*/
-    if (findblock) /*{{{*/
+    else /* partial block */ /*{{{*/
     {
-      ptr=(file->pos%extcap)/blocksize;
-      if (file->ino->sb->size>256) ptr*=2;
-      block=(unsigned char)file->ino->sb->dir[extent].pointers[ptr];
-      if (file->ino->sb->size>256) block+=((unsigned char)file->ino->sb->dir[extent].pointers[ptr+1])<<8;
-      if (block==0) /* allocate new block, set start/end to cover it */ /*{{{*/
+      if (newblock)
       {
-        if ((block=allocBlock(file->ino->sb))==-1) return (got==0 ? -1 : got);
-        file->ino->sb->dir[extent].pointers[ptr]=block&0xff;
-        if (file->ino->sb->size>256) file->ino->sb->dir[extent].pointers[ptr+1]=(block>>8)&0xff;
-        start=0;
-        /* By setting end to the end of the block and not the end
-         * of the currently written data, the whole block gets
-         * wiped from the disk, which is slow, but convenient in
-         * case of sparse files.
+        /* By writing the whole block and not only the sectors
+         * with data, the block gets wiped from the disk, which is
+         * slow, but convenient in case of sparse files.
          */
-        end=(blocksize-1)/file->ino->sb->secLength;
         memset(buffer,0,blocksize);
-        time(&file->ino->ctime);
-        updateTimeStamps(file->ino,extent);
-        updateDsStamps(file->ino,extent);
+        start=0;
+        end=secsPerBlock-1;
       }
-      /*}}}*/
-      else /* read existing block and set start/end to cover modified parts */ /*{{{*/
+      else /* read the sectors that are only partially modified */
       {
-        start=(file->pos%blocksize)/file->ino->sb->secLength;
-        end=((int)(file->pos%blocksize+count)>=blocksize ? blocksize-1 : (int)(file->pos%blocksize+count-1))/file->ino->sb->secLength;
-        if (file->pos%file->ino->sb->secLength)
+        start=blockpos/sb->secLength;
+        end=(int)(blockpos+chunk-1)/sb->secLength;
+        if ((blockpos%sb->secLength) || (start==end && (blockpos+chunk)%sb->secLength))
         {
-          if (readBlock(file->ino->sb,block,buffer,start,start)==-1)
-          {
-            if (got==0) got=-1;
-            break;
-          }
+          if (readBlock(sb,block,buffer,start,start)==-1) return (got==0 ? -1 : got);
         }
-        if (end!=start && (int)(file->pos%blocksize+count)<blocksize && (file->pos+count)%file->ino->sb->secLength)
+        if (end!=start && (blockpos+chunk)%sb->secLength)
         {
-          if (readBlock(file->ino->sb,block,buffer,end,end)==-1)
-          {
-            if (got==0) got=-1;
-            break;
-          }
+          if (readBlock(sb,block,buffer,end,end)==-1) return (got==0 ? -1 : got);
         }
       }
-      /*}}}*/
-      nextblockpos=(file->pos/blocksize)*blocksize+blocksize;
-      findblock=0;
+      memcpy(buffer+blockpos,buf,chunk);
+      if (writeBlock(sb,block,buffer,start,end)==-1) return (got==0 ? -1 : got);
     }
     /*}}}*/
-    /* fill block and write it */ /*{{{*/
-    file->ino->sb->dirtyDirectory=1;
-    while (file->pos!=nextblockpos && count)
-    {
-      buffer[file->pos%blocksize]=*buf++;
-      ++file->pos;
-      if (file->ino->size<file->pos) file->ino->size=file->pos;
-      ++got;
-      --count;
-    }
-    /* In case the data only fills part of a sector, the rest is
-     * still initialized: A new block was cleared and the boundaries
-     * of an existing block were read.
-     */
-
-    (void)writeBlock(file->ino->sb,block,buffer,start,end);
+    buf+=chunk;
+    file->pos+=chunk;
+    if (file->ino->size<file->pos) file->ino->size=file->pos;
+    got+=chunk;
+    count-=chunk;
+    /* update extent size */ /*{{{*/
     time(&file->ino->mtime);
-    if (file->ino->sb->size<=256) for (last=15; last>=0; --last)
+    if (sb->size<=256) for (last=15; last>=0; --last)
     {
-      if (file->ino->sb->dir[extent].pointers[last])
+      if (sb->dir[extent].pointers[last])
       {
         break;
       }
     }
     else for (last=14; last>0; last-=2)
     {
-      if (file->ino->sb->dir[extent].pointers[last] || file->ino->sb->dir[extent].pointers[last+1])
+      if (sb->dir[extent].pointers[last] || sb->dir[extent].pointers[last+1])
       {
         last/=2;
         break;
       }
     }
+    /* The entry gets the last logical extent written, also when one call
+     * fills several of them (cpmtools 2.23 kept the first one).
+     */
+    extentno=(file->pos-1)/16384;
     if (last>0) extentno+=(last*blocksize)/extcap;
-    file->ino->sb->dir[extent].extnol=EXTENTL(extentno);
-    file->ino->sb->dir[extent].extnoh=EXTENTH(extentno);
-    file->ino->sb->dir[extent].blkcnt=((file->pos-1)%16384)/128+1;
-    if (file->ino->sb->type & CPMFS_EXACT_SIZE)
+    sb->dir[extent].extnol=EXTENTL(extentno);
+    sb->dir[extent].extnoh=EXTENTH(extentno);
+    sb->dir[extent].blkcnt=((file->pos-1)%16384)/128+1;
+    if (sb->type & CPMFS_EXACT_SIZE)
     {
-      file->ino->sb->dir[extent].lrc = (128 - (file->pos%128)) & 0x7F;
+      sb->dir[extent].lrc = (128 - (file->pos%128)) & 0x7F;
     }
     else
     {
-      file->ino->sb->dir[extent].lrc=file->pos%128;
+      sb->dir[extent].lrc=file->pos%128;
     }
     updateTimeStamps(file->ino,extent);
     updateDsStamps(file->ino,extent);
     /*}}}*/
-    if (file->pos==nextextpos) findext=1;
-    else if (file->pos==nextblockpos) findblock=1;
   }
   return got;
 }
@@ -1932,6 +2171,10 @@ ssize_t cpmWrite(struct cpmFile *file, char const *buf, size_t count)
 /* cpmClose           -- close                                   */ /*{{{*/
 int cpmClose(struct cpmFile *file)
 {
+  if (file->extidx) free(file->extidx);
+  file->extidx=(int*)0;
+  file->extidxLen=0;
+  if (file->mode&(O_WRONLY|O_RDWR)) return autoSync(file->ino->sb);
   return 0;
 }
 /*}}}*/
@@ -1957,11 +2200,12 @@ int cpmCreat(struct cpmInode *dir, char const *fname, struct cpmInode *ino, mode
   drive=dir->sb;
   if ((extent=findFreeExtent(dir->sb))==-1) return -1;
   ent=dir->sb->dir+extent;
-  drive->dirtyDirectory=1;
+  dirtyEntry(drive,extent);
   memset(ent,0,32);
   ent->status=user;
   memcpy(ent->name,name,8);
   memcpy(ent->ext,extension,3);
+  dirhashInsert(drive,extent);
   ino->ino=extent;
   ino->mode=s_ifreg|mode;
   ino->size=0;
@@ -1972,7 +2216,7 @@ int cpmCreat(struct cpmInode *dir, char const *fname, struct cpmInode *ino, mode
   ino->sb=dir->sb;
   updateTimeStamps(ino,extent);
   updateDsStamps(ino,extent);
-  return 0;
+  return autoSync(drive);
 }
 /*}}}*/
 
@@ -1996,7 +2240,6 @@ int cpmAttrSet(struct cpmInode *ino, cpm_attr_t attrib)
   drive  = ino->sb;
   extent = ino->ino;
 
-  drive->dirtyDirectory=1;
   /* Strip off existing attribute bits */
   memcpy7(name,      drive->dir[extent].name, 8);
   memcpy7(extension, drive->dir[extent].ext,  3);
@@ -2013,6 +2256,7 @@ int cpmAttrSet(struct cpmInode *ino, cpm_attr_t attrib)
 
   do
   {
+    dirtyEntry(drive,extent);
     memcpy(drive->dir[extent].name, name, 8);
     memcpy(drive->dir[extent].ext, extension, 3);
   } while ((extent=findFileExtent(drive, user,name,extension,extent+1,-1))!=-1);
@@ -2022,7 +2266,7 @@ int cpmAttrSet(struct cpmInode *ino, cpm_attr_t attrib)
   if (attrib&CPM_ATTR_RO) ino->mode&=~(S_IWUSR|S_IWGRP|S_IWOTH);
   else ino->mode|=(S_IWUSR|S_IWGRP|S_IWOTH);
 
-  return 0;
+  return autoSync(drive);
 }
 /*}}}*/
 /* cpmChmod           -- set CP/M r/o & sys                      */ /*{{{*/
@@ -2043,5 +2287,6 @@ void cpmUtime(struct cpmInode *ino, struct utimbuf *times)
   time(&ino->ctime);
   updateTimeStamps(ino,ino->ino);
   updateDsStamps(ino,ino->ino);
+  autoSync(ino->sb);
 }
 /*}}}*/
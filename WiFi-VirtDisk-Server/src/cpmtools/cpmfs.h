@@ -39,6 +39,8 @@ struct cpmFile
   mode_t mode;
   off_t pos;
   struct cpmInode *ino;
+  int *extidx;    /* directory entry of each physical extent, -1 if none */
+  int extidxLen;
 };
 
 struct cpmDirent
@@ -116,6 +118,7 @@ struct cpmSuperBlock
   struct PhysDirectoryEntry *dir;
   int alvSize;
   int *alv;
+  int alvNext; /* block where allocBlock continues searching */
   int cnotatime;
   char *label;
   size_t labelLength;
@@ -123,6 +126,11 @@ struct cpmSuperBlock
   size_t passwdLength;
   struct cpmInode *root;
   int dirtyDirectory;
+  int *dirtySectors;  /* bitmap of directory sectors to write back */
+  int delaySync;      /* 1: directory is only written by cpmSync() */
+  int *dirHash;       /* first entry of each name hash chain, or -1 */
+  int *dirNext;       /* next entry in the same chain, or -1 */
+  int dirHashMask;    /* number of hash buckets - 1 */
   struct dsDate *ds;
   int dirtyDs;
 };
@@ -28,9 +28,14 @@ struct Device
 };
 
 const char *Device_open(struct Device *self, const char *filename, int mode, const char *deviceOpts);
+#ifdef HAVE_LIBDSK_H
+const char *Device_attach(struct Device *self, DSK_PDRIVER driver, const char *deviceOpts);
+#endif
 const char *Device_setGeometry(struct Device *self, int secLength, int sectrk, int tracks, off_t offset, const char *libdskGeometry);
 const char *Device_close(struct Device *self);
 const char *Device_readSector(const struct Device *self, int track, int sector, char *buf);
 const char *Device_writeSector(const struct Device *self, int track, int sector, const char *buf);
+const char *Device_readSectors(const struct Device *self, int track, int sector, int count, char *buf);
+const char *Device_writeSectors(const struct Device *self, int track, int sector, int count, const char *buf);
 
 #endif
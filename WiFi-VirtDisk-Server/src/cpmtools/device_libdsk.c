@@ -68,6 +68,18 @@ const char *Device_open(struct Device *this, const char *filename, int mode, con
   return NULL;
 }
 /*}}}*/
+/* Device_attach         -- Use a driver that is already open       */ /*{{{*/
+const char *Device_attach(struct Device *this, DSK_PDRIVER driver, const char *deviceOpts)
+{
+  const char *format = (deviceOpts == NULL) ? NULL : strchr(deviceOpts, ',');
+
+  this->dev = driver;
+  this->opened = 1;
+  if (format) return lookupFormat(&this->geom, format + 1);
+  dsk_getgeom(this->dev, &this->geom);
+  return NULL;
+}
+/*}}}*/
 /* Device_setGeometry    -- Set disk geometry                       */ /*{{{*/
 const char *Device_setGeometry(struct Device *this, int secLength, int sectrk, int tracks, off_t offset, const char *libdskGeometry)
 {
@@ -129,3 +141,19 @@ const char *Device_writeSector(const struct Device *this, int track, int sector,
   return (e?dsk_strerror(e):(const char*)0);
 }
 /*}}}*/
+/* Device_readSectors    -- read consecutive sectors of one track    */ /*{{{*/
+const char *Device_readSectors(const struct Device *this, int track, int sector, int count, char *buf)
+{
+  dsk_err_t e;
+  e = dsk_lmread(this->dev, &this->geom, buf, (track * this->sectrk) + sector + this->offset/this->secLength, count);
+  return (e?dsk_strerror(e):(const char*)0);
+}
+/*}}}*/
+/* Device_writeSectors   -- write consecutive sectors of one track   */ /*{{{*/
+const char *Device_writeSectors(const struct Device *this, int track, int sector, int count, const char *buf)
+{
+  dsk_err_t e;
+  e = dsk_lmwrite(this->dev, &this->geom, buf, (track * this->sectrk) + sector + this->offset/this->secLength, count);
+  return (e?dsk_strerror(e):(const char*)0);
+}
+/*}}}*/
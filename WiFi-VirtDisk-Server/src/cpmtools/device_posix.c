@@ -84,3 +84,48 @@ const char *Device_writeSector(const struct Device *this, int track, int sector,
   return strerror(errno);
 }
 /*}}}*/
+/* Device_readSectors    -- read consecutive sectors of one track    */ /*{{{*/
+const char *Device_readSectors(const struct Device *this, int track, int sector, int count, char *buf)
+{
+  int res;
+  int len;
+
+  assert(this);
+  assert(sector>=0);
+  assert(count>0);
+  assert(sector+count<=this->sectrk);
+  assert(track>=0);
+  assert(track<this->tracks);
+  assert(buf);
+  len=count*this->secLength;
+  if (lseek(this->fd,(off_t)(((sector+track*this->sectrk)*this->secLength)+this->offset),SEEK_SET)==-1)
+  {
+    return strerror(errno);
+  }
+  if ((res=read(this->fd, buf, len)) != len)
+  {
+    if (res==-1) return strerror(errno);
+    memset(buf+res,0,len-res); /* hit end of disk image */
+  }
+  return (const char*)0;
+}
+/*}}}*/
+/* Device_writeSectors   -- write consecutive sectors of one track   */ /*{{{*/
+const char *Device_writeSectors(const struct Device *this, int track, int sector, int count, const char *buf)
+{
+  int len;
+
+  assert(sector>=0);
+  assert(count>0);
+  assert(sector+count<=this->sectrk);
+  assert(track>=0);
+  assert(track<this->tracks);
+  len=count*this->secLength;
+  if (lseek(this->fd,(off_t)(((sector+track*this->sectrk)*this->secLength)+this->offset),SEEK_SET)==-1)
+  {
+    return strerror(errno);
+  }
+  if (write(this->fd, buf, len) == len) return (const char*)0;
+  return strerror(errno);
+}
+/*}}}*/
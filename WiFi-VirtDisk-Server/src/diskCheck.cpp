@@ -0,0 +1,437 @@
+/***************************************************************************//**
+ * @file    diskCheck.cpp
+ *
+ * @brief   Consistency check of the CP/M file systems of the emulated disks.
+ *
+ *          The checks are the read-only part of fsck.cpm. Only reading the
+ *          directory goes through LibDsk and holds gDskMutex, the checks run
+ *          on a copy of it. So all disks are checked in parallel, one worker
+ *          thread per disk up to the number of CPU cores. Crosslinked blocks
+ *          and duplicate extents are found with one pass over the directory
+ *          instead of comparing every entry with every other one.
+ *
+ *          The result of every disk is kept together with a fingerprint of
+ *          the image (size and modification time of the image file or of all
+ *          files of a rcpmfs directory). Unchanged disks are not read again.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+#include "cpmtools/cpmdir.h"
+
+// LibDsk
+#include <stddef.h>      // Needed for libdisk.h
+#include <libdsk.h>
+
+#include "diskCheck.hpp"
+#include "rpcServer.hpp"
+#include "imageTool.hpp"
+#include "serverStats.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+namespace fs = std::filesystem;
+
+// The parts of the super block the checks need
+typedef struct
+{
+    int     maxdir;     // Number of directory entries
+    int     size;       // Number of blocks
+    int     dirblks;    // Blocks of the directory
+    int     extents;    // Logical extents per directory entry
+    int     blksiz;     // Block size
+    int     type;       // CPMFS_* flags
+} dcLayout_t;
+
+typedef struct
+{
+    std::string fingerprint;
+    dcResult_t  result;
+} dcCacheEntry_t;
+
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuPath;
+extern std::vector<std::string> diskEmuFilename;
+extern std::vector<std::string> diskEmuFormat;
+
+// Results of previous checks, by path of the image
+static std::map<std::string, dcCacheEntry_t> dcCache;
+static std::mutex dcCacheMutex;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns a fingerprint that changes whenever the image changes.
+ *          For a rcpmfs directory all files of the directory are included.
+ *
+ * @param   path    The image file or rcpmfs directory.
+ *
+ * @return  The fingerprint, empty if the image cannot be examined.
+ ******************************************************************************/
+std::string dcFingerprint( const std::string& path )
+{
+    std::error_code          ec;
+    std::vector<std::string> parts;
+    std::string              fingerprint;
+
+
+    if( fs::is_directory( path, ec ) )
+    {
+        for( const auto& entry : fs::directory_iterator( path, ec ) )
+        {
+            std::error_code entryEc;
+            auto size  = entry.is_regular_file( entryEc ) ? entry.file_size( entryEc ) : 0;
+            auto mtime = entry.last_write_time( entryEc ).time_since_epoch().count();
+
+            parts.push_back( entry.path().filename().string() + ":" + std::to_string(size) + ":" + std::to_string(mtime) );
+        }
+        if( ec ) { return ""; }
+        std::sort( parts.begin(), parts.end() );
+    }
+    else
+    {
+        auto size  = fs::file_size( path, ec );
+        if( ec ) { return ""; }
+        auto mtime = fs::last_write_time( path, ec ).time_since_epoch().count();
+        if( ec ) { return ""; }
+
+        parts.push_back( std::to_string(size) + ":" + std::to_string(mtime) );
+    }
+
+    for( const auto& part : parts )
+    {
+        fingerprint += part + ";";
+    }
+
+    return fingerprint;
+}
+
+
+/***************************************************************************//**
+ * @brief   Formats the name of a directory entry like "0:NAME.EXT".
+ ******************************************************************************/
+static std::string dcEntryName( const struct PhysDirectoryEntry* dir )
+{
+    std::string name = std::to_string( (unsigned char)dir->status ) + ":";
+
+    for( int i = 0; ( i < 8 ) && ( ( dir->name[i] & 0x7f ) != ' ' ); i++ ) { name += (char)( dir->name[i] & 0x7f ); }
+    name += '.';
+    for( int i = 0; ( i < 3 ) && ( ( dir->ext[i] & 0x7f ) != ' ' ); i++ ) { name += (char)( dir->ext[i] & 0x7f ); }
+
+    return name;
+}
+
+
+/***************************************************************************//**
+ * @brief   Adds an error or warning to the result.
+ ******************************************************************************/
+static void dcReport( dcResult_t& result, bool isError, int extent, const struct PhysDirectoryEntry* dir, const std::string& what )
+{
+    if( isError ) { result.errors++; } else { result.warnings++; }
+
+    result.messages.push_back( std::string( isError ? "Error: " : "Warning: " ) + what +
+                               " (extent=" + std::to_string(extent) + ", name=\"" + dcEntryName( dir ) + "\")" );
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks a copy of the directory. The checks follow fsck.cpm.
+ *
+ * @param   layout  Parameters of the file system.
+ * @param   dirs    All directory entries.
+ * @param   result  Receives errors, warnings and statistics.
+ ******************************************************************************/
+static void dcCheckDirectory( const dcLayout_t& layout, const std::vector<struct PhysDirectoryEntry>& dirs, dcResult_t& result )
+{
+    int maxUser = ( layout.type & CPMFS_HI_USER ) ? 31 : 15;
+
+    // Owner of every block, -1 for free blocks
+    std::vector<int> owner( layout.size, -1 );
+    // First entry of every (user, name, extent), to find duplicate extents
+    std::unordered_map<std::string, int> extents;
+
+    result.errors      = 0;
+    result.warnings    = 0;
+    result.files       = 0;
+    result.usedBlocks  = layout.dirblks;
+    result.totalBlocks = layout.size;
+    result.messages.clear();
+
+    for( int extent = 0; extent < layout.maxdir; extent++ )
+    {
+        const struct PhysDirectoryEntry* dir = &dirs[extent];
+        unsigned char status = (unsigned char)dir->status;
+        bool bad = false;
+
+        if( status == 0xe5 )
+        {
+            continue;
+        }
+        if( status > maxUser )
+        {
+            // Passwords, disc label and time stamps of CP/M 3
+            if( ( ( layout.type & CPMFS_CPM3_OTHER ) && ( status >= 16 ) && ( status <= 32 ) ) ||
+                ( ( layout.type & CPMFS_CPM3_DATES ) && ( status == 0x21 ) ) )
+            {
+                continue;
+            }
+            dcReport( result, true, extent, dir, "Bad status 0x" + std::string(1, "0123456789abcdef"[status >> 4]) +
+                                                 std::string(1, "0123456789abcdef"[status & 0xf]) );
+            continue;
+        }
+        result.files++;
+
+        // Name and extension
+        for( int i = 0; ( i < 8 ) && !bad; i++ )
+        {
+            int c = dir->name[i] & 0x7f;
+            if( !ISFILECHAR( i, c ) || islower( c ) ) { dcReport( result, true, extent, dir, "Bad name" ); bad = true; }
+        }
+        for( int i = 0; ( i < 3 ) && !bad; i++ )
+        {
+            int c = dir->ext[i] & 0x7f;
+            if( !ISFILECHAR( 1, c ) || islower( c ) ) { dcReport( result, true, extent, dir, "Bad name" ); bad = true; }
+        }
+
+        // Extent number and last record byte count
+        if( ( dir->extnol & 0xff ) > 0x1f ) { dcReport( result, true, extent, dir, "Bad lower bits of extent number" ); }
+        if( ( dir->extnoh & 0xff ) > 0x3f ) { dcReport( result, true, extent, dir, "Bad higher bits of extent number" ); }
+        if( ( dir->lrc & 0xff ) > 128 )     { dcReport( result, true, extent, dir, "Bad last record byte count" ); }
+
+        // Block numbers, every block may belong to one entry only
+        for( int i = 0; i < 16; i++ )
+        {
+            int block = dir->pointers[i] & 0xff;
+            if( layout.size > 256 ) { block += ( dir->pointers[++i] & 0xff ) << 8; }
+            if( block == 0 ) { continue; }
+
+            if( ( block < layout.dirblks ) || ( block >= layout.size ) )
+            {
+                dcReport( result, true, extent, dir, "Bad block number " + std::to_string(block) );
+            }
+            else if( owner[block] != -1 )
+            {
+                dcReport( result, true, extent, dir, "Multiple allocated block " + std::to_string(block) +
+                                                     " (also extent " + std::to_string(owner[block]) + ")" );
+            }
+            else
+            {
+                owner[block] = extent;
+                result.usedBlocks++;
+            }
+        }
+
+        // Record count against the blocks of the logical extent
+        {
+            int min  = ( ( dir->extnol & 0xff ) % layout.extents ) * 16 / layout.extents;
+            int max  = ( ( ( dir->extnol & 0xff ) % layout.extents ) + 1 ) * 16 / layout.extents;
+            int used = 0;
+
+            for( int i = min; i < max; i++ )
+            {
+                if( dir->pointers[i] || ( ( layout.size > 256 ) && dir->pointers[i+1] ) ) { used++; }
+                if( layout.size > 256 ) { i++; }
+            }
+            if( ( ( (unsigned char)dir->blkcnt ) * 128 + layout.blksiz - 1 ) / layout.blksiz != used )
+            {
+                dcReport( result, true, extent, dir, "Bad record count" );
+            }
+        }
+
+        // Duplicate extents
+        {
+            std::string key( 1, (char)status );
+            for( int i = 0; i < 8; i++ ) { key += (char)( dir->name[i] & 0x7f ); }
+            for( int i = 0; i < 3; i++ ) { key += (char)( dir->ext[i] & 0x7f ); }
+            key += std::to_string( EXTENT( dir->extnol, dir->extnoh ) );
+
+            auto found = extents.emplace( key, extent );
+            if( !found.second )
+            {
+                dcReport( result, true, extent, dir, "Duplicate extent (also extent " + std::to_string(found.first->second) + ")" );
+            }
+        }
+
+        // Oversized .COM files
+        if( ( ( ( EXTENT( dir->extnol, dir->extnoh ) == 3 ) && ( (unsigned char)dir->blkcnt >= 126 ) ) || ( EXTENT( dir->extnol, dir->extnoh ) >= 4 ) ) &&
+            ( ( dir->ext[0] & 0x7f ) == 'C' ) && ( ( dir->ext[1] & 0x7f ) == 'O' ) && ( ( dir->ext[2] & 0x7f ) == 'M' ) )
+        {
+            dcReport( result, false, extent, dir, "Oversized .COM file" );
+        }
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks the CP/M file system of one disk image. Unchanged images
+ *          are not read again, the result of the previous check is returned.
+ *
+ * @param   path    The image file or rcpmfs directory.
+ * @param   format  Name of the disk format, e.g. "z80mbc2-d0".
+ * @param   result  Receives errors, warnings and statistics.
+ *
+ * @return  true if the image could be checked, otherwise false.
+ ******************************************************************************/
+bool dcCheckImage( const std::string& path, const std::string& format, dcResult_t& result )
+{
+    struct cpmSuperBlock                    super;
+    struct cpmInode                         root;
+    dcLayout_t                              layout;
+    std::vector<struct PhysDirectoryEntry>  dirs;
+    std::error_code                         ec;
+    std::string                             devopts;
+    std::string                             fingerprint = dcFingerprint( path );
+    const char                             *errStr;
+
+
+    // Unchanged since the last check?
+    if( !fingerprint.empty() )
+    {
+        std::lock_guard<std::mutex> lock( dcCacheMutex );
+        auto cached = dcCache.find( path );
+        if( ( cached != dcCache.end() ) && ( cached->second.fingerprint == fingerprint ) )
+        {
+            result = cached->second.result;
+            result.cached = true;
+            stCountCache( ST_CACHE_DISK_CHECK, true );
+            return true;
+        }
+    }
+    stCountCache( ST_CACHE_DISK_CHECK, false );
+
+    devopts = std::string( fs::is_directory( path, ec ) ? "rcpmfs," : ( itIsStoreImage( path ) ? IT_STORE_TYPE "," : "raw," ) ) + format;
+
+    // Copy the directory, LibDsk is only used while holding the mutex
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+
+        errStr = Device_open( &super.dev, path.c_str(), O_RDONLY, devopts.c_str() );
+        if( errStr != NULL )
+        {
+            result.messages.assign( 1, "Cannot open image (" + std::string(errStr) + ")" );
+            return false;
+        }
+        if( cpmReadSuper( &super, &root, format.c_str(), 0 ) == -1 )
+        {
+            result.messages.assign( 1, "Cannot read superblock (" + std::string(boo) + ")" );
+            Device_close( &super.dev );
+            return false;
+        }
+
+        layout.maxdir  = super.maxdir;
+        layout.size    = super.size;
+        layout.dirblks = super.dirblks;
+        layout.extents = super.extents;
+        layout.blksiz  = super.blksiz;
+        layout.type    = super.type;
+        dirs.assign( super.dir, super.dir + super.maxdir );
+
+        cpmUmount( &super );
+    }
+
+    dcCheckDirectory( layout, dirs, result );
+    result.cached = false;
+
+    if( !fingerprint.empty() )
+    {
+        std::lock_guard<std::mutex> lock( dcCacheMutex );
+        dcCache[path] = { fingerprint, result };
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks all configured emulated disks on a pool of worker threads
+ *          and prints the results.
+ *
+ * @param   force   true to check unchanged disks again.
+ *
+ * @return  true if all disks are clean, otherwise false.
+ ******************************************************************************/
+bool dcCheckAllDisks( bool force )
+{
+    size_t                   disks   = diskEmuPath.size();
+    std::vector<dcResult_t>  results( disks );
+    std::vector<char>        checked( disks, 0 );
+    std::vector<std::thread> workers;
+    std::atomic<size_t>      next( 0 );
+    size_t                   threads = std::max( 1u, std::thread::hardware_concurrency() );
+    bool                     retVal  = true;
+
+
+    if( disks == 0 )
+    {
+        return true;
+    }
+
+    if( force )
+    {
+        std::lock_guard<std::mutex> lock( dcCacheMutex );
+        dcCache.clear();
+    }
+
+    // Every worker takes the next unchecked disk until all are done
+    for( size_t t = 0; t < std::min( threads, disks ); t++ )
+    {
+        workers.emplace_back( [&]()
+        {
+            for( size_t i = next++; i < disks; i = next++ )
+            {
+                checked[i] = dcCheckImage( diskEmuPath[i], diskEmuFormat[i], results[i] ) ? 1 : 0;
+            }
+        } );
+    }
+    for( auto& worker : workers )
+    {
+        worker.join();
+    }
+
+    for( size_t i = 0; i < disks; i++ )
+    {
+        const dcResult_t& result = results[i];
+        std::string disk = "Disk check " + diskEmuFilename[i] + ": ";
+
+        if( !checked[i] )
+        {
+            message( MsgType::ERR, disk + ( result.messages.empty() ? "failed" : result.messages.front() ) );
+            retVal = false;
+            continue;
+        }
+
+        for( const auto& msg : result.messages )
+        {
+            message( msg.compare( 0, 5, "Error" ) == 0 ? MsgType::ERR : MsgType::WARN, disk + msg );
+        }
+
+        message( result.errors ? MsgType::ERR : MsgType::INFO,
+                 disk + ( result.errors ? std::to_string(result.errors) + " errors, " : "clean, " ) +
+                 std::to_string(result.files) + " extents, " +
+                 std::to_string(result.usedBlocks) + "/" + std::to_string(result.totalBlocks) + " blocks" +
+                 ( result.cached ? " (unchanged)" : "" ) );
+
+        if( result.errors ) { retVal = false; }
+    }
+
+    return retVal;
+}
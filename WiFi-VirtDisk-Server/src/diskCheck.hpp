@@ -0,0 +1,38 @@
+/***************************************************************************//**
+ * @file    diskCheck.hpp
+ *
+ * @brief   Consistency check of the CP/M file systems of the emulated disks.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef DISKCHECK_HPP
+#define DISKCHECK_HPP
+
+/****************************************************************** Includes **/
+#include <string>
+#include <vector>
+
+
+/******************************************************************* Defines **/
+typedef struct
+{
+    int                         errors;         // Number of errors found
+    int                         warnings;       // Number of warnings found
+    int                         files;          // Number of used directory entries
+    int                         usedBlocks;     // Blocks used by directory and files
+    int                         totalBlocks;    // Blocks of the file system
+    bool                        cached;         // Image unchanged, result of a previous check
+    std::vector<std::string>    messages;       // Description of every error and warning
+} dcResult_t;
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+bool dcCheckImage( const std::string& path, const std::string& format, dcResult_t& result );
+bool dcCheckAllDisks( bool force );
+std::string dcFingerprint( const std::string& path );
+
+
+#endif
@@ -0,0 +1,245 @@
+/***************************************************************************//**
+ * @file    diskNotify.cpp
+ *
+ * @brief   Generation counters of the emulated disks, sent to the client
+ *          when a disk changes.
+ *
+ *          Every emulated disk has a 16 bit generation counter. It is counted
+ *          up when the disk image is re-loaded, when an RPC client writes to
+ *          it and when the image file or a file of the rcpmfs directory
+ *          changes on the host. The last one also catches the writes of the
+ *          client itself, so a client cache has to be write-through.
+ *
+ *          The counters start with a time based value, so a restarted server
+ *          does not repeat the generations of the previous run.
+ *
+ *          The generations are sent to the client over the debug connection
+ *          ('N' command), see handleDbgClient().
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <filesystem>
+
+#include "diskNotify.hpp"
+#include "diskCheck.hpp"
+#include "diskOverlay.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+#define DN_POLL_MS  1000    // Interval for checking the disks on the host
+
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuPath;
+extern std::vector<std::string> diskEmuFilename;
+
+static std::mutex dnMutex;
+static uint16_t   dnGeneration[DN_DISKS];
+static bool       dnSeeded  = false;
+static bool       dnPending = false;
+
+// Last fingerprint of every disk, only used by the main thread
+static std::vector<std::string> dnFingerprint;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Sets the start value of the counters. The caller has to hold
+ *          dnMutex.
+ ******************************************************************************/
+static void dnSeed( void )
+{
+    if( !dnSeeded )
+    {
+        uint16_t seed = (uint16_t)std::time( nullptr );
+
+        for( int disk = 0; disk < DN_DISKS; disk++ )
+        {
+            dnGeneration[disk] = seed;
+        }
+        dnSeeded = true;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Counts up the generation of an emulated disk and requests a
+ *          notification of the client.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ * @param   reason  Reason of the change for the log.
+ ******************************************************************************/
+void dnDiskChanged( size_t disk, const std::string& reason )
+{
+    uint16_t generation;
+    bool     wasPending;
+
+
+    // The base cache of a shared disk holds the old image
+    ovBaseChanged( disk );
+
+    if( ( disk >= DN_DISKS ) || ( disk >= diskEmuFilename.size() ) )
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( dnMutex );
+        dnSeed();
+        generation = ++dnGeneration[disk];
+        wasPending = dnPending;
+        dnPending  = true;
+    }
+
+    // Only the first change until the notification is logged, not every sector
+    if( !wasPending )
+    {
+        message( MsgType::INFO, "Disk change " + diskEmuFilename[disk] + ": " + reason +
+                                ", generation " + std::to_string(generation) );
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the canonical form of an image path, the path itself if it
+ *          cannot be resolved.
+ ******************************************************************************/
+static std::filesystem::path dnCanonical( const std::string& path )
+{
+    std::error_code       ec;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical( path, ec );
+
+    return ec ? std::filesystem::path( path ) : canonical;
+}
+
+
+/***************************************************************************//**
+ * @brief   Counts up the generation of the emulated disk that uses the image.
+ *          Nothing happens if the image is not an emulated disk.
+ *
+ * @param   path    The image file or rcpmfs directory.
+ * @param   reason  Reason of the change for the log.
+ ******************************************************************************/
+void dnImageChanged( const std::string& path, const std::string& reason )
+{
+    std::filesystem::path image = dnCanonical( path );
+
+
+    for( size_t disk = 0; disk < diskEmuPath.size(); disk++ )
+    {
+        if( dnCanonical( diskEmuPath[disk] ) == image )
+        {
+            dnDiskChanged( disk, reason );
+        }
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the index of the emulated disk that uses the image, -1 if
+ *          the image is not an emulated disk.
+ *
+ * @param   path    The image file or rcpmfs directory.
+ ******************************************************************************/
+int dnImageDisk( const std::string& path )
+{
+    std::filesystem::path image = dnCanonical( path );
+
+
+    for( size_t disk = 0; disk < diskEmuPath.size(); disk++ )
+    {
+        if( dnCanonical( diskEmuPath[disk] ) == image )
+        {
+            return (int)disk;
+        }
+    }
+
+    return -1;
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks if the images of the emulated disks changed on the host.
+ *          Called in the main loop, checks at most every DN_POLL_MS.
+ ******************************************************************************/
+void dnPollHostChanges( void )
+{
+    static auto lastPoll = std::chrono::steady_clock::now() - std::chrono::milliseconds( DN_POLL_MS );
+    auto        now      = std::chrono::steady_clock::now();
+    size_t      disks    = std::min( diskEmuPath.size(), (size_t)DN_DISKS );
+    bool        first    = dnFingerprint.empty();
+
+
+    if( now - lastPoll < std::chrono::milliseconds( DN_POLL_MS ) )
+    {
+        return;
+    }
+    lastPoll = now;
+
+    dnFingerprint.resize( disks );
+
+    for( size_t disk = 0; disk < disks; disk++ )
+    {
+        std::string fingerprint = dcFingerprint( diskEmuPath[disk] );
+
+        // The first poll only takes the current state
+        if( !first && ( fingerprint != dnFingerprint[disk] ) )
+        {
+            dnDiskChanged( disk, "changed on the host" );
+        }
+        dnFingerprint[disk] = fingerprint;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Requests a notification without a change, e.g. for a newly
+ *          connected client.
+ ******************************************************************************/
+void dnRequestNotify( void )
+{
+    std::lock_guard<std::mutex> lock( dnMutex );
+
+    dnPending = true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the client has to be notified.
+ ******************************************************************************/
+bool dnNotifyPending( void )
+{
+    std::lock_guard<std::mutex> lock( dnMutex );
+
+    return dnPending;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the current generations and clears the pending
+ *          notification.
+ *
+ * @param   generation  Receives the generations of DN_DISKS disks.
+ ******************************************************************************/
+void dnTakeNotify( uint16_t* generation )
+{
+    std::lock_guard<std::mutex> lock( dnMutex );
+
+    dnSeed();
+    for( int disk = 0; disk < DN_DISKS; disk++ )
+    {
+        generation[disk] = dnGeneration[disk];
+    }
+    dnPending = false;
+}
@@ -0,0 +1,34 @@
+/***************************************************************************//**
+ * @file    diskNotify.hpp
+ *
+ * @brief   Generation counters of the emulated disks, sent to the client
+ *          when a disk changes.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef DISKNOTIFY_HPP
+#define DISKNOTIFY_HPP
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <string>
+
+
+/******************************************************************* Defines **/
+#define DN_DISKS    4   // Emulated disks with a generation counter
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+void dnDiskChanged( size_t disk, const std::string& reason );
+void dnImageChanged( const std::string& path, const std::string& reason );
+int  dnImageDisk( const std::string& path );
+void dnPollHostChanges( void );
+void dnRequestNotify( void );
+bool dnNotifyPending( void );
+void dnTakeNotify( uint16_t* generation );
+
+
+#endif
@@ -0,0 +1,810 @@
+/***************************************************************************//**
+ * @file    diskOverlay.cpp
+ *
+ * @brief   Shared read-only disk images with a copy-on-write overlay for
+ *          every client.
+ *
+ *          An emulated disk with diskEmuShared=1 is never written by a
+ *          VirtDisk client. The sectors of the image are read once into a
+ *          base cache, shared by all clients. A written sector goes to the
+ *          overlay of the client and is read back from there, so every board
+ *          sees its own changes on top of the common image. Twenty boards
+ *          booting the same image only need the image once plus the sectors
+ *          each of them changed.
+ *
+ *          The clients are identified by their IP address, a board that
+ *          reconnects gets its overlay back. An overlay can be discarded
+ *          (the board starts again with the clean image) or committed to the
+ *          image. The overlays are saved in overlayPath when a client
+ *          disconnects, every OV_SAVE_INTERVAL seconds and when the server
+ *          stops, and loaded again at the start.
+ *
+ *          A snapshot of a shared disk (see diskSnapshot.cpp) keeps a copy of
+ *          the overlays of all clients, the rollback puts them back.
+ *
+ *          The base cache is dropped when the image changes, see
+ *          dnDiskChanged(). Disks without diskEmuShared are read and written
+ *          directly by LibDsk as before.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+
+#include "diskOverlay.hpp"
+#include "diskNotify.hpp"
+#include "diskSnapshot.hpp"
+#include "virtDisk.hpp"
+#include "helper.h"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+// A sector of an overlay, seq is the order of the last write
+typedef struct
+{
+    uint64_t                             seq;
+    std::array<uint8_t, OV_SECTOR_SIZE>  data;
+} ovSector_t;
+
+typedef std::unordered_map<dsk_lsect_t, ovSector_t> ovSectors_t;
+
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuPath;
+extern std::vector<std::string> diskEmuFilename;
+extern std::vector<bool>        diskEmuShared;
+extern std::string              overlayPath;
+
+static std::mutex  ovMutex;
+static std::string ovClient;                                    // Client of the current command
+static uint64_t    ovSeq = 0;                                   // Counter of the writes
+static std::vector<ovSectors_t> ovBase;                         // Base cache of every disk
+static std::map<std::string, std::vector<ovSectors_t>> ovOverlay; // Overlays of every client and disk
+static std::map<size_t, std::map<std::string, ovSectors_t>> ovSnapshots; // Overlays of every disk at its snapshot
+static bool        ovChanged = false;                           // Overlays changed since the last ovSave()
+static std::set<std::filesystem::path> ovFiles;                 // Files written by ovSave() or loaded by ovLoad()
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns true if the emulated disk is shared with overlays.
+ ******************************************************************************/
+static bool ovIsShared( size_t disk )
+{
+    return ( disk < diskEmuShared.size() ) && diskEmuShared[disk];
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the overlay of a client and a disk, nullptr if the client
+ *          has not written to the disk. The caller has to hold ovMutex.
+ ******************************************************************************/
+static ovSectors_t* ovFind( const std::string& client, size_t disk )
+{
+    auto it = ovOverlay.find( client );
+
+    if( ( it == ovOverlay.end() ) || ( disk >= it->second.size() ) || it->second[disk].empty() )
+    {
+        return nullptr;
+    }
+
+    return &it->second[disk];
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the overlay of a client and a disk, created if needed.
+ *          The caller has to hold ovMutex.
+ ******************************************************************************/
+static ovSectors_t& ovCreate( const std::string& client, size_t disk )
+{
+    std::vector<ovSectors_t>& disks = ovOverlay[client];
+
+    if( disk >= disks.size() ) { disks.resize( disk + 1 ); }
+
+    return disks[disk];
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the sectors of an overlay in the order of the last write.
+ ******************************************************************************/
+static std::vector<std::pair<dsk_lsect_t, const ovSector_t*>> ovOrdered( const ovSectors_t& sectors )
+{
+    std::vector<std::pair<dsk_lsect_t, const ovSector_t*>> ordered;
+
+
+    ordered.reserve( sectors.size() );
+    for( const auto& sector : sectors )
+    {
+        ordered.emplace_back( sector.first, &sector.second );
+    }
+    std::sort( ordered.begin(), ordered.end(),
+               []( const auto& a, const auto& b ) { return a.second->seq < b.second->seq; } );
+
+    return ordered;
+}
+
+
+/***************************************************************************//**
+ * @brief   Converts a 32 bit value between host order and the little endian
+ *          order of the overlay files, both ways.
+ ******************************************************************************/
+static uint32_t ovLE32( uint32_t value )
+{
+    uint8_t bytes[4];
+
+
+    memcpy( bytes, &value, sizeof(bytes) );
+
+    return (uint32_t)bytes[0] | ( (uint32_t)bytes[1] << 8 ) | ( (uint32_t)bytes[2] << 16 ) | ( (uint32_t)bytes[3] << 24 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the number of sectors of an emulated disk, 0 if the image
+ *          cannot be opened. The caller has to hold gDskMutex.
+ ******************************************************************************/
+static dsk_lsect_t ovDiskSectors( size_t disk )
+{
+    struct Device  tempDev = {};
+    struct Device* dev     = nullptr;
+    dsk_lsect_t    sectors;
+
+
+    if( vdOpenEmuDisk( disk, &tempDev, &dev ) != NULL )
+    {
+        return 0;
+    }
+    sectors = (dsk_lsect_t)dev->geom.dg_cylinders * dev->geom.dg_heads * dev->geom.dg_sectors;
+    vdCloseEmuDisk( &tempDev, dev );
+
+    return sectors;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the directory of the overlay files.
+ ******************************************************************************/
+static std::filesystem::path ovDirectory( void )
+{
+    return overlayPath.empty() ? std::filesystem::path( getExeDir() ) / "overlays" : std::filesystem::path( overlayPath );
+}
+
+
+/***************************************************************************//**
+ * @brief   Sets the client of the following commands.
+ *
+ * @param   client  IP address of the client without the port.
+ ******************************************************************************/
+void ovSetClient( const std::string& client )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+
+    ovClient = client;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the current or last client.
+ ******************************************************************************/
+std::string ovGetClient( void )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+
+    return ovClient;
+}
+
+
+/***************************************************************************//**
+ * @brief   Reads a sector of an emulated disk like dsk_lread(). A shared disk
+ *          is read from the overlay of the client, from the base cache or
+ *          from the image, in this order.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ * @param   dev     LibDsk driver of the opened image.
+ * @param   geom    Geometry of the image.
+ * @param   data    Buffer for OV_SECTOR_SIZE bytes.
+ * @param   sector  Logical sector number.
+ *
+ * @return  DSK_ERR_OK on success, otherwise the LibDsk error.
+ ******************************************************************************/
+dsk_err_t ovRead( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, void* data, dsk_lsect_t sector )
+{
+    if( !ovIsShared( disk ) )
+    {
+        return dsk_lread( dev, geom, data, sector );
+    }
+
+    std::lock_guard<std::mutex> lock( ovMutex );
+    ovSectors_t* overlay = ovFind( ovClient, disk );
+
+    if( overlay != nullptr )
+    {
+        auto it = overlay->find( sector );
+        if( it != overlay->end() )
+        {
+            memcpy( data, it->second.data.data(), OV_SECTOR_SIZE );
+            return DSK_ERR_OK;
+        }
+    }
+
+    if( disk >= ovBase.size() ) { ovBase.resize( disk + 1 ); }
+
+    auto it = ovBase[disk].find( sector );
+    if( it != ovBase[disk].end() )
+    {
+        memcpy( data, it->second.data.data(), OV_SECTOR_SIZE );
+        return DSK_ERR_OK;
+    }
+
+    dsk_err_t err = dsk_lread( dev, geom, data, sector );
+    if( err == DSK_ERR_OK )
+    {
+        memcpy( ovBase[disk][sector].data.data(), data, OV_SECTOR_SIZE );
+    }
+
+    return err;
+}
+
+
+/***************************************************************************//**
+ * @brief   Writes a sector of an emulated disk like dsk_lwrite(). A shared
+ *          disk is not changed, the sector is written to the overlay of the
+ *          client.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ * @param   dev     LibDsk driver of the opened image.
+ * @param   geom    Geometry of the image.
+ * @param   data    OV_SECTOR_SIZE bytes of the sector.
+ * @param   sector  Logical sector number.
+ *
+ * @return  DSK_ERR_OK on success, otherwise the LibDsk error.
+ ******************************************************************************/
+dsk_err_t ovWrite( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, const void* data, dsk_lsect_t sector )
+{
+    if( !ovIsShared( disk ) )
+    {
+        if( !snBeforeWrite( disk, dev, geom, sector ) )
+        {
+            return DSK_ERR_RDONLY;
+        }
+        return dsk_lwrite( dev, geom, data, sector );
+    }
+
+    // Same errors as a write to the image
+    if( ( dev == nullptr ) || ( geom == nullptr ) )
+    {
+        return DSK_ERR_BADPTR;
+    }
+    if( sector >= (dsk_lsect_t)geom->dg_cylinders * geom->dg_heads * geom->dg_sectors )
+    {
+        return DSK_ERR_BADPARM;
+    }
+
+    std::lock_guard<std::mutex> lock( ovMutex );
+    ovSector_t& entry = ovCreate( ovClient, disk )[sector];
+
+    entry.seq = ++ovSeq;
+    memcpy( entry.data.data(), data, OV_SECTOR_SIZE );
+    ovChanged = true;
+
+    return DSK_ERR_OK;
+}
+
+
+/***************************************************************************//**
+ * @brief   Discards all overlays of a client, the client sees the shared
+ *          images again.
+ *
+ * @param   client  IP address of the client.
+ *
+ * @return  Number of discarded sectors.
+ ******************************************************************************/
+size_t ovDiscard( const std::string& client )
+{
+    std::vector<ovSectors_t> disks;
+    size_t                   sectors = 0;
+
+
+    {
+        std::lock_guard<std::mutex> lock( ovMutex );
+        auto it = ovOverlay.find( client );
+
+        if( it == ovOverlay.end() )
+        {
+            return 0;
+        }
+        disks = std::move( it->second );
+        ovOverlay.erase( it );
+        ovChanged = true;
+    }
+
+    for( size_t disk = 0; disk < disks.size(); disk++ )
+    {
+        if( !disks[disk].empty() )
+        {
+            sectors += disks[disk].size();
+            dnDiskChanged( disk, "overlay of " + client + " discarded" );
+        }
+    }
+
+    message( MsgType::INFO, "Overlay of " + client + " discarded, " + std::to_string(sectors) + " sectors" );
+
+    return sectors;
+}
+
+
+/***************************************************************************//**
+ * @brief   Writes all overlays of a client to the images and discards them.
+ *          The images are written in the order of the last writes of the
+ *          client. An overlay that cannot be written is kept.
+ *
+ * @param   client  IP address of the client.
+ *
+ * @return  Number of written sectors.
+ ******************************************************************************/
+size_t ovCommit( const std::string& client )
+{
+    std::vector<ovSectors_t> disks;
+    size_t                   total = 0;
+
+
+    {
+        std::lock_guard<std::mutex> lock( ovMutex );
+        auto it = ovOverlay.find( client );
+
+        if( it == ovOverlay.end() )
+        {
+            return 0;
+        }
+        disks = it->second;
+    }
+
+    for( size_t disk = 0; ( disk < disks.size() ) && ( disk < diskEmuPath.size() ); disk++ )
+    {
+        struct Device  tempDev = {};
+        struct Device* dev     = nullptr;
+        const char*    errStr  = NULL;
+        dsk_err_t      err     = DSK_ERR_OK;
+        size_t         written = 0;
+
+
+        if( disks[disk].empty() )
+        {
+            continue;
+        }
+
+        errStr = vdOpenEmuDisk( disk, &tempDev, &dev );
+        if( errStr != NULL )
+        {
+            message( MsgType::ERR, "Cannot open " + diskEmuPath[disk] + " for the overlay of " + client + " (" + std::string(errStr) + ")" );
+            continue;
+        }
+
+        for( const auto& sector : ovOrdered( disks[disk] ) )
+        {
+            err = snBeforeWrite( disk, dev->dev, &dev->geom, sector.first ) ? DSK_ERR_OK : DSK_ERR_RDONLY;
+            if( err == DSK_ERR_OK )
+            {
+                err = dsk_lwrite( dev->dev, &dev->geom, sector.second->data.data(), sector.first );
+            }
+            if( err != DSK_ERR_OK )
+            {
+                message( MsgType::ERR, "Error writing sector " + std::to_string(sector.first) + " of the overlay of " + client +
+                                       " to " + diskEmuFilename[disk] + ": " + std::string(dsk_strerror(err)) );
+                break;
+            }
+            written++;
+        }
+
+        errStr = vdCloseEmuDisk( &tempDev, dev );
+        if( errStr != NULL )
+        {
+            message( MsgType::ERR, "Cannot close " + diskEmuPath[disk] + " (" + std::string(errStr) + ")" );
+            err = DSK_ERR_SYSERR;
+        }
+
+        if( err == DSK_ERR_OK )
+        {
+            std::lock_guard<std::mutex> lock( ovMutex );
+            auto it = ovOverlay.find( client );
+
+            if( ( it != ovOverlay.end() ) && ( disk < it->second.size() ) )
+            {
+                it->second[disk].clear();
+                ovChanged = true;
+            }
+        }
+
+        total += written;
+        message( MsgType::INFO, "Overlay of " + client + " committed to " + diskEmuFilename[disk] + ", " +
+                                std::to_string(written) + " of " + std::to_string(disks[disk].size()) + " sectors" );
+
+        // Also drops the base cache of the disk
+        dnDiskChanged( disk, "overlay of " + client + " committed" );
+    }
+
+    // Remove a client without overlays
+    {
+        std::lock_guard<std::mutex> lock( ovMutex );
+        auto it = ovOverlay.find( client );
+
+        if( ( it != ovOverlay.end() ) &&
+            std::all_of( it->second.begin(), it->second.end(), []( const ovSectors_t& sectors ) { return sectors.empty(); } ) )
+        {
+            ovOverlay.erase( it );
+        }
+    }
+
+    return total;
+}
+
+
+/***************************************************************************//**
+ * @brief   Saves all overlays to the overlay directory, one file for every
+ *          client and disk. The files of overlays that were discarded or
+ *          committed since are removed, files that ovLoad() skipped are
+ *          kept.
+ *
+ * @param   changedOnly     Only save if an overlay changed since the last
+ *                          save.
+ *
+ * @return  true if all overlays were saved, otherwise false.
+ ******************************************************************************/
+bool ovSave( bool changedOnly )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+    std::filesystem::path       dir = ovDirectory();
+    std::error_code             ec;
+    bool                        retVal = true;
+    size_t                      files  = 0;
+
+
+    if( changedOnly && !ovChanged )
+    {
+        return true;
+    }
+
+    std::set<std::filesystem::path> saved;
+
+    for( const auto& client : ovOverlay )
+    {
+        for( size_t disk = 0; ( disk < client.second.size() ) && ( disk < diskEmuFilename.size() ); disk++ )
+        {
+            const ovSectors_t& sectors = client.second[disk];
+            ovHeader_t         header  = {};
+            std::string        name    = client.first;
+
+
+            if( sectors.empty() )
+            {
+                continue;
+            }
+
+            if( files == 0 )
+            {
+                std::filesystem::create_directories( dir, ec );
+            }
+
+            // File name "<disk>@<client>.ovl", the client is also in the header
+            std::replace_if( name.begin(), name.end(), []( char c ) { return !isalnum( (unsigned char)c ) && ( c != '.' ); }, '_' );
+            std::filesystem::path path = dir / ( diskEmuFilename[disk] + "@" + name + OV_FILE_EXT );
+            std::ofstream         file( path, std::ios::out | std::ios::binary | std::ios::trunc );
+
+            saved.insert( path );
+            memcpy( header.magic, OV_MAGIC, sizeof(header.magic) );
+            header.version = OV_VERSION;
+            header.sectors = ovLE32( (uint32_t)sectors.size() );
+            strncpy( header.client, client.first.c_str(), sizeof(header.client) - 1 );
+            strncpy( header.disk, diskEmuFilename[disk].c_str(), sizeof(header.disk) - 1 );
+            file.write( (const char*)&header, sizeof(header) );
+
+            for( const auto& sector : ovOrdered( sectors ) )
+            {
+                uint32_t number = ovLE32( (uint32_t)sector.first );
+
+                file.write( (const char*)&number, sizeof(number) );
+                file.write( (const char*)sector.second->data.data(), OV_SECTOR_SIZE );
+            }
+
+            file.close();
+            if( !file )
+            {
+                message( MsgType::ERR, "Cannot write overlay file: " + path.string() );
+                retVal = false;
+                continue;
+            }
+            files++;
+        }
+    }
+
+    // Remove the files of discarded and committed overlays, the files of
+    // unknown disks that ovLoad() skipped are not in ovFiles
+    for( const auto& path : ovFiles )
+    {
+        if( saved.count( path ) == 0 )
+        {
+            std::filesystem::remove( path, ec );
+        }
+    }
+    ovFiles = std::move( saved );
+
+    // Saved again with the next change after an error
+    ovChanged = !retVal;
+
+    if( files > 0 )
+    {
+        message( MsgType::INFO, "Overlays saved: " + std::to_string(files) + " files in " + dir.string() );
+    }
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Loads the overlays saved by ovSave(). Files of unknown disks are
+ *          skipped, so are sectors past the end of the disk. The caller has
+ *          to hold gDskMutex.
+ *
+ * @return  true if all overlay files were loaded, otherwise false.
+ ******************************************************************************/
+bool ovLoad( void )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+    std::filesystem::path       dir = ovDirectory();
+    std::error_code             ec;
+    bool                        retVal = true;
+    size_t                      files  = 0;
+    std::map<size_t, dsk_lsect_t> diskSectors;
+
+
+    if( !std::filesystem::is_directory( dir, ec ) )
+    {
+        return true;
+    }
+
+    for( const auto& entry : std::filesystem::directory_iterator( dir, ec ) )
+    {
+        std::ifstream file( entry.path(), std::ios::in | std::ios::binary );
+        ovHeader_t    header = {};
+
+
+        if( entry.path().extension() != OV_FILE_EXT )
+        {
+            continue;
+        }
+
+        if( !file.read( (char*)&header, sizeof(header) ) ||
+            ( memcmp( header.magic, OV_MAGIC, sizeof(header.magic) ) != 0 ) || ( header.version != OV_VERSION ) )
+        {
+            message( MsgType::ERR, "Invalid overlay file: " + entry.path().string() );
+            retVal = false;
+            continue;
+        }
+
+        header.client[sizeof(header.client) - 1] = '\0';
+        header.disk[sizeof(header.disk) - 1]     = '\0';
+
+        auto it = std::find( diskEmuFilename.begin(), diskEmuFilename.end(), std::string(header.disk) );
+        if( it == diskEmuFilename.end() )
+        {
+            message( MsgType::WARN, "Overlay file of an unknown disk skipped: " + entry.path().string() );
+            continue;
+        }
+
+        size_t disk = it - diskEmuFilename.begin();
+
+        // The geometry of every disk is read once
+        if( diskSectors.count( disk ) == 0 )
+        {
+            diskSectors[disk] = ovDiskSectors( disk );
+        }
+        if( diskSectors[disk] == 0 )
+        {
+            message( MsgType::ERR, "Overlay file skipped, cannot open " + diskEmuPath[disk] + ": " + entry.path().string() );
+            retVal = false;
+            continue;
+        }
+
+        ovSectors_t& sectors = ovCreate( header.client, disk );
+        uint32_t     outside = 0;
+
+        header.sectors = ovLE32( header.sectors );
+        for( uint32_t i = 0; i < header.sectors; i++ )
+        {
+            uint32_t    number;
+            ovSector_t  sector;
+
+            if( !file.read( (char*)&number, sizeof(number) ) || !file.read( (char*)sector.data.data(), OV_SECTOR_SIZE ) )
+            {
+                message( MsgType::ERR, "Overlay file truncated: " + entry.path().string() );
+                retVal = false;
+                break;
+            }
+            number = ovLE32( number );
+            if( number >= diskSectors[disk] )
+            {
+                outside++;
+                continue;
+            }
+            sector.seq       = ++ovSeq;
+            sectors[number]  = sector;
+        }
+
+        if( outside > 0 )
+        {
+            message( MsgType::ERR, std::to_string(outside) + " sectors past the end of " + header.disk + " skipped: " + entry.path().string() );
+            retVal = false;
+        }
+
+        if( !ovIsShared( disk ) )
+        {
+            message( MsgType::WARN, "Overlay of " + std::string(header.client) + " loaded, but " + header.disk + " is not shared" );
+        }
+        ovFiles.insert( entry.path() );
+        files++;
+    }
+
+    if( files > 0 )
+    {
+        message( MsgType::INFO, "Overlays loaded: " + std::to_string(files) + " files from " + dir.string() );
+    }
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Keeps a copy of the overlays of all clients on a shared disk for
+ *          the snapshot of the disk. An older copy is replaced.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ ******************************************************************************/
+void ovSnapshot( size_t disk )
+{
+    if( !ovIsShared( disk ) )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( ovMutex );
+    auto&                       copy = ovSnapshots[disk];
+
+    copy.clear();
+    for( const auto& client : ovOverlay )
+    {
+        if( ( disk < client.second.size() ) && !client.second[disk].empty() )
+        {
+            copy[client.first] = client.second[disk];
+        }
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Puts back the overlays of a shared disk from its snapshot, the
+ *          overlays written since are discarded.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ *
+ * @return  Number of discarded and restored sectors, 0 if nothing changed.
+ ******************************************************************************/
+size_t ovRollback( size_t disk )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+    size_t                      sectors = 0;
+    auto                        snap    = ovSnapshots.find( disk );
+
+
+    if( !ovIsShared( disk ) || ( snap == ovSnapshots.end() ) )
+    {
+        return 0;
+    }
+
+    for( auto& client : ovOverlay )
+    {
+        if( disk < client.second.size() )
+        {
+            sectors += client.second[disk].size();
+            ovSectors_t().swap( client.second[disk] );
+        }
+    }
+
+    for( const auto& client : snap->second )
+    {
+        ovCreate( client.first, disk ) = client.second;
+        sectors += client.second.size();
+    }
+    ovChanged = true;
+
+    return sectors;
+}
+
+
+/***************************************************************************//**
+ * @brief   Drops the copy of the overlays kept for the snapshot of a disk.
+ ******************************************************************************/
+void ovSnapshotDrop( size_t disk )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+
+    ovSnapshots.erase( disk );
+}
+
+
+/***************************************************************************//**
+ * @brief   Drops the base cache of a disk after the image was changed.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ ******************************************************************************/
+void ovBaseChanged( size_t disk )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+
+    if( disk < ovBase.size() )
+    {
+        ovSectors_t().swap( ovBase[disk] );     // Also frees the buckets
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Prints the shared disks, their base caches and the overlays of all
+ *          clients.
+ ******************************************************************************/
+void ovPrint( void )
+{
+    std::lock_guard<std::mutex> lock( ovMutex );
+    size_t                      bytes = 0;
+
+
+    for( size_t disk = 0; disk < diskEmuFilename.size(); disk++ )
+    {
+        if( ovIsShared( disk ) )
+        {
+            size_t cached = ( disk < ovBase.size() ) ? ovBase[disk].size() : 0;
+
+            message( MsgType::INFO, "Shared disk " + diskEmuFilename[disk] + ": " + std::to_string(cached) +
+                                    " sectors cached (" + std::to_string(cached * OV_SECTOR_SIZE / 1024) + " KiB)" );
+            bytes += cached * OV_SECTOR_SIZE;
+        }
+    }
+
+    for( const auto& client : ovOverlay )
+    {
+        for( size_t disk = 0; ( disk < client.second.size() ) && ( disk < diskEmuFilename.size() ); disk++ )
+        {
+            size_t sectors = client.second[disk].size();
+
+            if( sectors > 0 )
+            {
+                message( MsgType::INFO, "Overlay " + client.first + ( client.first == ovClient ? " (current)" : "" ) + " on " +
+                                        diskEmuFilename[disk] + ": " + std::to_string(sectors) + " sectors (" +
+                                        std::to_string(sectors * OV_SECTOR_SIZE / 1024) + " KiB)" );
+                bytes += sectors * OV_SECTOR_SIZE;
+            }
+        }
+    }
+
+    message( MsgType::INFO, "Overlays: " + std::to_string(ovOverlay.size()) + " clients, " +
+                            std::to_string(bytes / 1024) + " KiB of sector data" );
+}
@@ -0,0 +1,69 @@
+/***************************************************************************//**
+ * @file    diskOverlay.hpp
+ *
+ * @brief   Shared read-only disk images with a copy-on-write overlay for
+ *          every client.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef DISKOVERLAY_HPP
+#define DISKOVERLAY_HPP
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <string>
+
+// LibDsk
+#include <stddef.h>      // Needed for libdisk.h
+#include <libdsk.h>
+
+
+/******************************************************************* Defines **/
+// An overlay file starts with an ovHeader_t, followed by ovHeader_t.sectors
+// records of a sector number (uint32_t) and the data of the sector, in the
+// order of the last write. All values are little endian, see ovLE32().
+#define OV_MAGIC        "VDOVERL"
+#define OV_VERSION      1
+#define OV_SECTOR_SIZE  512
+#define OV_CLIENT_LEN   48          // IPv6 address in brackets with terminating 0
+#define OV_DISK_LEN     16          // 8.3 name with terminating 0
+#define OV_FILE_EXT     ".ovl"
+#define OV_SAVE_INTERVAL 60         // Seconds between the saves of changed overlays
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char        magic[7];               // OV_MAGIC without the terminating 0
+    uint8_t     version;                // OV_VERSION
+    uint32_t    sectors;                // Number of sector records
+    char        client[OV_CLIENT_LEN];  // IP address of the client
+    char        disk[OV_DISK_LEN];      // File name of the emulated disk
+} ovHeader_t;
+#pragma pack(pop)
+
+static_assert( sizeof(ovHeader_t) == 76, "ovHeader_t must be 76 bytes" );
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+// The caller has to hold gDskMutex for the following functions
+void        ovSetClient( const std::string& client );
+std::string ovGetClient( void );
+dsk_err_t   ovRead( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, void* data, dsk_lsect_t sector );
+dsk_err_t   ovWrite( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, const void* data, dsk_lsect_t sector );
+size_t      ovDiscard( const std::string& client );
+size_t      ovCommit( const std::string& client );
+bool        ovSave( bool changedOnly = false );
+bool        ovLoad( void );
+
+void        ovSnapshot( size_t disk );
+size_t      ovRollback( size_t disk );
+void        ovSnapshotDrop( size_t disk );
+
+void        ovBaseChanged( size_t disk );
+void        ovPrint( void );
+
+
+#endif
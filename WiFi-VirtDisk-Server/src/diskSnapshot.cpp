@@ -0,0 +1,363 @@
+/***************************************************************************//**
+ * @file    diskSnapshot.cpp
+ *
+ * @brief   Snapshots of the emulated disks with rollback.
+ *
+ *          A snapshot is an undo log on top of the LibDsk driver of the disk:
+ *          before a sector is written the first time after the snapshot, its
+ *          old data is kept in memory. Taking a snapshot copies nothing, and
+ *          a snapshot only grows by the sectors that really change. The
+ *          rollback writes the kept sectors back in reverse order, so it
+ *          only costs the changed sectors, not the whole image.
+ *
+ *          The snapshot stays after the rollback, a board can be reset to the
+ *          same state again and again. Writes of the VirtDisk client, of the
+ *          committed overlays and of the RPC clients are covered. The
+ *          overlays of a shared disk are copied with the snapshot and put
+ *          back by the rollback, see ovSnapshot(). Changes of the files on
+ *          the host are not covered. The snapshots are not saved, they end
+ *          with the server.
+ *
+ *          A sector whose old data cannot be kept (other sector size, read
+ *          error) is not written while the disk has a snapshot, otherwise
+ *          the rollback would restore a mixed state.
+ *
+ *          Without a snapshot a write only checks snActiveDisks.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+
+#include "diskSnapshot.hpp"
+#include "diskNotify.hpp"
+#include "diskOverlay.hpp"
+#include "virtDisk.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+#define SN_SECTOR_SIZE  512
+
+// Old data of a sector, seq is the order of the first write
+typedef struct
+{
+    uint64_t                             seq;
+    DSK_GEOMETRY                         geom;
+    std::array<uint8_t, SN_SECTOR_SIZE>  data;
+} snSector_t;
+
+typedef struct
+{
+    bool                                         active;
+    std::time_t                                  created;
+    std::unordered_map<dsk_lsect_t, snSector_t>  sectors;
+} snSnapshot_t;
+
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuPath;
+extern std::vector<std::string> diskEmuFilename;
+
+std::atomic<int> snActiveDisks( 0 );
+
+static std::mutex                snMutex;
+static std::vector<snSnapshot_t> snDisks;
+static uint64_t                  snSeq = 0;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns the snapshot of a disk. The caller has to hold snMutex.
+ ******************************************************************************/
+static snSnapshot_t& snOf( size_t disk )
+{
+    if( disk >= snDisks.size() ) { snDisks.resize( disk + 1 ); }
+
+    return snDisks[disk];
+}
+
+
+/***************************************************************************//**
+ * @brief   Takes a snapshot of an emulated disk, an older snapshot of the disk
+ *          is replaced.
+ *
+ * @param   disk    Index of the emulated disk or SN_ALL_DISKS.
+ *
+ * @return  true on success, false if the disk does not exist.
+ ******************************************************************************/
+bool snCreate( size_t disk )
+{
+    if( disk == SN_ALL_DISKS )
+    {
+        bool retVal = !diskEmuFilename.empty();
+
+        for( size_t i = 0; i < diskEmuFilename.size(); i++ ) { retVal &= snCreate( i ); }
+        return retVal;
+    }
+
+    if( disk >= diskEmuFilename.size() )
+    {
+        message( MsgType::ERR, "Snapshot: no emulated disk " + std::to_string(disk) );
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( snMutex );
+        snSnapshot_t& snapshot = snOf( disk );
+
+        if( !snapshot.active ) { snActiveDisks++; }
+        snapshot.active  = true;
+        snapshot.created = std::time( nullptr );
+        snapshot.sectors.clear();
+    }
+
+    // The overlays of a shared disk are not in the image
+    ovSnapshot( disk );
+
+    message( MsgType::INFO, "Snapshot of " + diskEmuFilename[disk] + " taken" );
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Writes the sectors changed since the snapshot back to the image.
+ *          The snapshot stays active.
+ *
+ * @param   disk    Index of the emulated disk or SN_ALL_DISKS.
+ *
+ * @return  true on success, false if there is no snapshot or a sector could
+ *          not be written.
+ ******************************************************************************/
+bool snRollback( size_t disk )
+{
+    std::vector<std::pair<dsk_lsect_t, snSector_t>> sectors;
+    struct Device  tempDev = {};
+    struct Device* dev     = nullptr;
+    const char*    errStr;
+    dsk_err_t      err     = DSK_ERR_OK;
+    size_t         written = 0;
+    size_t         overlay;
+
+
+    if( disk == SN_ALL_DISKS )
+    {
+        bool retVal = true;
+        bool found  = false;
+
+        for( size_t i = 0; i < diskEmuFilename.size(); i++ )
+        {
+            bool active;
+            {
+                std::lock_guard<std::mutex> lock( snMutex );
+                active = ( i < snDisks.size() ) && snDisks[i].active;
+            }
+            if( active ) { retVal &= snRollback( i ); found = true; }
+        }
+        if( !found ) { message( MsgType::WARN, "Rollback: no snapshot taken" ); }
+        return retVal && found;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( snMutex );
+
+        if( ( disk >= snDisks.size() ) || !snDisks[disk].active || ( disk >= diskEmuPath.size() ) )
+        {
+            message( MsgType::WARN, "Rollback: no snapshot of disk " + std::to_string(disk) );
+            return false;
+        }
+
+        // Newest first, like an undo log
+        sectors.assign( snDisks[disk].sectors.begin(), snDisks[disk].sectors.end() );
+        std::sort( sectors.begin(), sectors.end(),
+                   []( const auto& a, const auto& b ) { return a.second.seq > b.second.seq; } );
+    }
+
+    if( !sectors.empty() )
+    {
+        errStr = vdOpenEmuDisk( disk, &tempDev, &dev );
+        if( errStr != NULL )
+        {
+            message( MsgType::ERR, "Rollback: cannot open " + diskEmuPath[disk] + " (" + std::string(errStr) + ")" );
+            return false;
+        }
+
+        for( const auto& sector : sectors )
+        {
+            err = dsk_lwrite( dev->dev, &sector.second.geom, sector.second.data.data(), sector.first );
+            if( err != DSK_ERR_OK )
+            {
+                message( MsgType::ERR, "Rollback: error writing sector " + std::to_string(sector.first) + " of " +
+                                       diskEmuFilename[disk] + ": " + std::string(dsk_strerror(err)) );
+                break;
+            }
+            written++;
+        }
+
+        errStr = vdCloseEmuDisk( &tempDev, dev );
+        if( errStr != NULL )
+        {
+            message( MsgType::ERR, "Rollback: cannot close " + diskEmuPath[disk] + " (" + std::string(errStr) + ")" );
+            err = DSK_ERR_SYSERR;
+        }
+
+    }
+
+    overlay = ovRollback( disk );
+
+    // The client and the base cache of a shared disk hold the newer data
+    if( !sectors.empty() || ( overlay > 0 ) )
+    {
+        dnDiskChanged( disk, "rolled back to the snapshot" );
+    }
+
+    message( MsgType::INFO, "Rollback of " + diskEmuFilename[disk] + ": " + std::to_string(written) + " of " +
+                            std::to_string(sectors.size()) + " sectors restored" +
+                            ( ( overlay > 0 ) ? ", " + std::to_string(overlay) + " overlay sectors rolled back" : "" ) );
+
+    return err == DSK_ERR_OK;
+}
+
+
+/***************************************************************************//**
+ * @brief   Drops the snapshot of an emulated disk.
+ *
+ * @param   disk    Index of the emulated disk or SN_ALL_DISKS.
+ *
+ * @return  true if a snapshot was dropped, otherwise false.
+ ******************************************************************************/
+bool snDrop( size_t disk )
+{
+    std::vector<size_t> dropped;
+
+
+    {
+        std::lock_guard<std::mutex> lock( snMutex );
+
+        for( size_t i = 0; i < snDisks.size(); i++ )
+        {
+            if( ( ( disk == SN_ALL_DISKS ) || ( disk == i ) ) && snDisks[i].active )
+            {
+                snDisks[i].active = false;
+                decltype(snDisks[i].sectors)().swap( snDisks[i].sectors );     // Also frees the buckets
+                snActiveDisks--;
+                dropped.push_back( i );
+            }
+        }
+    }
+
+    for( size_t i : dropped )
+    {
+        ovSnapshotDrop( i );
+        message( MsgType::INFO, "Snapshot of " + diskEmuFilename[i] + " dropped" );
+    }
+
+    if( dropped.empty() )
+    {
+        message( MsgType::WARN, "Drop: no snapshot taken" );
+    }
+
+    return !dropped.empty();
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the emulated disk has a snapshot.
+ ******************************************************************************/
+bool snActive( size_t disk )
+{
+    std::lock_guard<std::mutex> lock( snMutex );
+
+    return ( disk < snDisks.size() ) && snDisks[disk].active;
+}
+
+
+/***************************************************************************//**
+ * @brief   Keeps the old data of a sector, if the disk has a snapshot and the
+ *          sector was not written since the snapshot. See snBeforeWrite().
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ * @param   dev     LibDsk driver of the image.
+ * @param   geom    Geometry of the following write.
+ * @param   sector  Logical sector number.
+ *
+ * @return  false if the disk has a snapshot and the old data could not be
+ *          kept, otherwise true.
+ ******************************************************************************/
+bool snSave( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, dsk_lsect_t sector )
+{
+    std::lock_guard<std::mutex> lock( snMutex );
+    snSector_t                  saved;
+    dsk_err_t                   err;
+
+
+    if( ( disk >= snDisks.size() ) || !snDisks[disk].active || ( snDisks[disk].sectors.count( sector ) != 0 ) )
+    {
+        return true;
+    }
+
+    if( ( geom == nullptr ) || ( geom->dg_secsize != SN_SECTOR_SIZE ) )
+    {
+        message( MsgType::WARN, "Snapshot of " + diskEmuFilename[disk] + ": sector size not supported, write refused" );
+        return false;
+    }
+
+    err = dsk_lread( dev, geom, saved.data.data(), sector );
+    if( err != DSK_ERR_OK )
+    {
+        message( MsgType::WARN, "Snapshot of " + diskEmuFilename[disk] + ": cannot read sector " + std::to_string(sector) +
+                                " (" + std::string(dsk_strerror(err)) + "), write refused" );
+        return false;
+    }
+
+    saved.seq  = ++snSeq;
+    saved.geom = *geom;
+    snDisks[disk].sectors.emplace( sector, saved );
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Prints the snapshots and the number of changed sectors.
+ ******************************************************************************/
+void snPrint( void )
+{
+    std::lock_guard<std::mutex> lock( snMutex );
+    bool                        found = false;
+
+
+    for( size_t disk = 0; ( disk < snDisks.size() ) && ( disk < diskEmuFilename.size() ); disk++ )
+    {
+        if( snDisks[disk].active )
+        {
+            char created[20];
+
+            std::strftime( created, sizeof(created), "%Y-%m-%d %H:%M:%S", std::localtime( &snDisks[disk].created ) );
+            message( MsgType::INFO, "Snapshot of " + diskEmuFilename[disk] + " from " + created + ": " +
+                                    std::to_string(snDisks[disk].sectors.size()) + " sectors changed (" +
+                                    std::to_string(snDisks[disk].sectors.size() * SN_SECTOR_SIZE / 1024) + " KiB)" );
+            found = true;
+        }
+    }
+
+    if( !found )
+    {
+        message( MsgType::INFO, "No snapshots" );
+    }
+}
@@ -0,0 +1,61 @@
+/***************************************************************************//**
+ * @file    diskSnapshot.hpp
+ *
+ * @brief   Snapshots of the emulated disks with rollback.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef DISKSNAPSHOT_HPP
+#define DISKSNAPSHOT_HPP
+
+/****************************************************************** Includes **/
+#include <cstddef>
+#include <string>
+#include <atomic>
+
+// LibDsk
+#include <stddef.h>      // Needed for libdisk.h
+#include <libdsk.h>
+
+
+/******************************************************************* Defines **/
+#define SN_ALL_DISKS    ( (size_t)-1 )  // All emulated disks
+
+
+/********************************************************** Global Variables **/
+// Number of disks with a snapshot, checked before every write
+extern std::atomic<int> snActiveDisks;
+
+
+/******************************************************* Functions / Methods **/
+// The caller has to hold gDskMutex for the following functions
+bool   snCreate( size_t disk );
+bool   snRollback( size_t disk );
+bool   snDrop( size_t disk );
+bool   snActive( size_t disk );
+bool   snSave( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, dsk_lsect_t sector );
+
+void   snPrint( void );
+
+
+/***************************************************************************//**
+ * @brief   Keeps the old data of a sector for the rollback, before the sector
+ *          of an emulated disk is written. Only an atomic load without a
+ *          snapshot.
+ *
+ * @return  false if the old data could not be kept, the sector must not be
+ *          written then.
+ ******************************************************************************/
+static inline bool snBeforeWrite( size_t disk, DSK_PDRIVER dev, const DSK_GEOMETRY* geom, dsk_lsect_t sector )
+{
+    if( snActiveDisks.load( std::memory_order_relaxed ) != 0 )
+    {
+        return snSave( disk, dev, geom, sector );
+    }
+
+    return true;
+}
+
+
+#endif
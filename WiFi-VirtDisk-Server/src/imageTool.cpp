@@ -0,0 +1,599 @@
+/***************************************************************************//**
+ * @file    imageTool.cpp
+ *
+ * @brief   Converts between host directories (rcpmfs) and CP/M disk images,
+ *          and imports disk images into a deduplicating image store.
+ *
+ *          Both directions mount the image only once and copy every file
+ *          with a single cpmRead() / cpmWrite() call, so cpmfs transfers
+ *          whole runs of contiguous blocks. The directory is written back
+ *          once when the image is unmounted.
+ *
+ *          In a store all images share one file of distinct 512 byte
+ *          chunks. The system tracks and the empty (E5) blocks of similar
+ *          disks are stored only once. The images can be served like any
+ *          other image, the LibDsk driver "dedup" only loads their index.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <filesystem>
+
+#include <sys/stat.h>
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+
+// LibDsk
+#include <stddef.h>      // Needed for libdisk.h
+#include <libdsk.h>
+
+#include "imageTool.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+namespace fs = std::filesystem;
+
+#define IT_STORE_CHUNK  512             // Chunk size of the store, DEDUP_CHUNK of drvdedup.h
+#define IT_STORE_TMP    ".tmp"          // Image being imported, renamed when complete
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Maps the name of a file in a rcpmfs directory to a CP/M name.
+ *          Like libdsk, other user areas are stored as "nn..name.ext".
+ *
+ * @param   hostName    The file name without path.
+ * @param   cpmName     The name for cpmfs ("00name.ext").
+ *
+ * @return  true if the file can be stored on a CP/M disk, otherwise false.
+ ******************************************************************************/
+static bool itHostToCpmName( const std::string& hostName, std::string& cpmName )
+{
+    static const char badChars[] = " :;<>[]";
+    std::string name = hostName;
+    int user = 0;
+    size_t dot;
+
+
+    if( ( name.size() > 4 ) && isdigit( (unsigned char)name[0] ) && isdigit( (unsigned char)name[1] ) &&
+        ( name[2] == '.' ) && ( name[3] == '.' ) )
+    {
+        user = std::stoi( name.substr( 0, 2 ) );
+        name = name.substr( 4 );
+        if( user > 15 ) { return false; }
+    }
+
+    if( name.empty() || ( name[0] == '.' ) || ( name.find_first_of( badChars ) != std::string::npos ) )
+    {
+        return false;
+    }
+
+    dot = name.find( '.' );
+    if( dot == std::string::npos )
+    {
+        if( name.size() > 8 ) { return false; }
+    }
+    else if( ( dot > 8 ) || ( name.size() - dot - 1 > 3 ) || ( name.find( '.', dot + 1 ) != std::string::npos ) )
+    {
+        return false;
+    }
+
+    cpmName = ( user < 10 ? "0" : "" ) + std::to_string( user ) + name;
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Maps a cpmfs name ("00name.ext") to the name in a rcpmfs directory.
+ *
+ * @param   cpmName     The name returned by cpmglob().
+ *
+ * @return  The file name without path.
+ ******************************************************************************/
+static std::string itCpmToHostName( const std::string& cpmName )
+{
+    if( cpmName.compare( 0, 2, "00" ) == 0 )
+    {
+        return cpmName.substr( 2 );
+    }
+
+    return cpmName.substr( 0, 2 ) + ".." + cpmName.substr( 2 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Looks up the LibDsk geometry of the given format name.
+ *
+ * @param   format      Name of the format, e.g. "z80mbc2-d0".
+ * @param   geom        The geometry of the format.
+ *
+ * @return  true if the format is known, otherwise false.
+ ******************************************************************************/
+static bool itGetGeometry( const std::string& format, DSK_GEOMETRY* geom )
+{
+    dsk_format_t formatID = FMT_180K;
+    dsk_cchar_t  formatName;
+
+
+    while( dg_stdformat( NULL, formatID, &formatName, NULL ) == DSK_ERR_OK )
+    {
+        if( format == formatName )
+        {
+            return ( dg_stdformat( geom, formatID, NULL, NULL ) == DSK_ERR_OK );
+        }
+        formatID = (dsk_format_t)( formatID + 1 );
+    }
+
+    return false;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the number of sectors in front of the CP/M directory.
+ ******************************************************************************/
+static int itBootSectors( const struct cpmSuperBlock* super )
+{
+    return ( super->bootsec >= 0 ) ? super->bootsec : ( super->boottrk * super->sectrk );
+}
+
+
+/***************************************************************************//**
+ * @brief   Packs all files of a host directory into a new raw disk image.
+ *          An existing image is overwritten. The boot tracks are taken from
+ *          the boot file of the directory, if there is one.
+ *
+ * @param   dirPath     The host directory, as served with rcpmfs.
+ * @param   imagePath   The disk image to create.
+ * @param   format      Name of the disk format, e.g. "z80mbc2-d0".
+ *
+ * @return  true if all files were packed, otherwise false.
+ ******************************************************************************/
+bool itPackDirectory( const std::string& dirPath, const std::string& imagePath, const std::string& format )
+{
+    struct cpmSuperBlock     super;
+    struct cpmInode          root;
+    DSK_GEOMETRY             geom;
+    const char              *errStr;
+    std::error_code          ec;
+    std::vector<fs::path>    hostFiles;
+    std::vector<char>        buffer;
+    std::string              devopts = "raw," + format;
+    size_t                   packed  = 0;
+    bool                     retVal  = true;
+
+
+    if( !fs::is_directory( dirPath, ec ) )
+    {
+        message( MsgType::ERR, "Pack: Not a directory: " + dirPath );
+        return false;
+    }
+
+    if( !itGetGeometry( format, &geom ) )
+    {
+        message( MsgType::ERR, "Pack: Unknown disk format: " + format );
+        return false;
+    }
+
+    // Create an empty image, all sectors formatted with 0xE5
+    {
+        std::ofstream image( imagePath, std::ios::binary | std::ios::trunc );
+        std::vector<char> track( geom.dg_sectors * geom.dg_secsize, (char)0xE5 );
+
+        for( dsk_pcyl_t cyl = 0; image && ( cyl < geom.dg_cylinders * geom.dg_heads ); cyl++ )
+        {
+            image.write( track.data(), track.size() );
+        }
+        if( !image )
+        {
+            message( MsgType::ERR, "Pack: Cannot create " + imagePath );
+            return false;
+        }
+    }
+
+    // Mount the new image
+    errStr = Device_open( &super.dev, imagePath.c_str(), O_RDWR, devopts.c_str() );
+    if( errStr != NULL )
+    {
+        message( MsgType::ERR, "Pack: Cannot open " + imagePath + " (" + std::string(errStr) + ")" );
+        return false;
+    }
+    if( cpmReadSuper( &super, &root, format.c_str(), 0 ) == -1 )
+    {
+        message( MsgType::ERR, "Pack: Cannot read superblock (" + std::string(boo) + ")" );
+        Device_close( &super.dev );
+        return false;
+    }
+    super.delaySync = 1;    // Write the directory only once, when unmounting
+
+    // Copy the boot tracks
+    {
+        std::ifstream bootFile( fs::path( dirPath ) / IT_BOOTFILE, std::ios::binary );
+
+        if( bootFile )
+        {
+            int sectors = itBootSectors( &super );
+
+            buffer.assign( (size_t)sectors * super.secLength, (char)0xE5 );
+            bootFile.read( buffer.data(), buffer.size() );
+            for( int sec = 0; sec < sectors; sec++ )
+            {
+                errStr = Device_writeSector( &super.dev, sec / super.sectrk, sec % super.sectrk, buffer.data() + (size_t)sec * super.secLength );
+                if( errStr != NULL )
+                {
+                    message( MsgType::ERR, "Pack: Cannot write boot sector (" + std::string(errStr) + ")" );
+                    retVal = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Collect the files in a fixed order, so that the same directory gives the same image
+    for( const auto& entry : fs::directory_iterator( dirPath, ec ) )
+    {
+        if( entry.is_regular_file( ec ) && ( entry.path().filename().string()[0] != '.' ) )
+        {
+            hostFiles.push_back( entry.path() );
+        }
+    }
+    std::sort( hostFiles.begin(), hostFiles.end() );
+
+    for( const auto& hostFile : hostFiles )
+    {
+        std::string     cpmName;
+        struct cpmInode ino;
+        struct cpmFile  file;
+        struct stat     st;
+
+        if( !itHostToCpmName( hostFile.filename().string(), cpmName ) )
+        {
+            message( MsgType::WARN, "Pack: Skipping " + hostFile.filename().string() + " (no CP/M file name)" );
+            continue;
+        }
+
+        // Read the whole host file
+        std::ifstream in( hostFile, std::ios::binary | std::ios::ate );
+        if( !in || ( stat( hostFile.string().c_str(), &st ) != 0 ) )
+        {
+            message( MsgType::ERR, "Pack: Cannot read " + hostFile.string() );
+            retVal = false;
+            continue;
+        }
+        buffer.resize( (size_t)in.tellg() );
+        in.seekg( 0 );
+        in.read( buffer.data(), buffer.size() );
+
+        if( cpmCreat( &root, cpmName.c_str(), &ino, 0666 ) == -1 )
+        {
+            message( MsgType::ERR, "Pack: Cannot create " + cpmName + " (" + std::string(boo) + ")" );
+            retVal = false;
+            continue;
+        }
+
+        // One write for the whole file, cpmfs allocates the blocks in a row
+        if( ( cpmOpen( &ino, &file, O_WRONLY ) == -1 ) ||
+            ( cpmWrite( &file, buffer.data(), buffer.size() ) != (ssize_t)buffer.size() ) )
+        {
+            message( MsgType::ERR, "Pack: Cannot write " + cpmName + " (" + std::string(boo) + ")" );
+            cpmClose( &file );
+            retVal = false;
+            break;  // The disk is full
+        }
+        cpmClose( &file );
+
+        struct utimbuf times;
+        times.actime  = st.st_atime;
+        times.modtime = st.st_mtime;
+        cpmUtime( &ino, &times );
+
+        packed++;
+    }
+
+    if( cpmUmount( &super ) == -1 )
+    {
+        message( MsgType::ERR, "Pack: Cannot write directory (" + std::string(boo) + ")" );
+        retVal = false;
+    }
+
+    message( retVal ? MsgType::INFO : MsgType::WARN, "Pack: " + std::to_string(packed) + " of " + std::to_string(hostFiles.size()) +
+                                                     " files packed into " + imagePath );
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Unpacks all files of a disk image into a host directory, in the
+ *          layout of rcpmfs. The directory is created if needed, existing
+ *          files with the same names are overwritten.
+ *
+ * @param   imagePath   The disk image to unpack.
+ * @param   dirPath     The host directory.
+ * @param   format      Name of the disk format, e.g. "z80mbc2-d0".
+ * @param   type        LibDsk driver of the image, e.g. "raw".
+ *
+ * @return  true if all files were unpacked, otherwise false.
+ ******************************************************************************/
+bool itUnpackImage( const std::string& imagePath, const std::string& dirPath, const std::string& format, const std::string& type )
+{
+    struct cpmSuperBlock super;
+    struct cpmInode      root;
+    const char          *errStr;
+    std::error_code      ec;
+    std::vector<char>    buffer;
+    std::string          devopts = type + "," + format;
+    int                  gargc   = 0;
+    char               **gargv   = NULL;
+    int                  files    = 0;
+    int                  unpacked = 0;
+    bool                 retVal  = true;
+
+    static char starlit[2] = "*";
+    static char * const star[] = { starlit };
+
+
+    fs::create_directories( dirPath, ec );
+    if( !fs::is_directory( dirPath, ec ) )
+    {
+        message( MsgType::ERR, "Unpack: Cannot create directory " + dirPath );
+        return false;
+    }
+
+    errStr = Device_open( &super.dev, imagePath.c_str(), O_RDONLY, devopts.c_str() );
+    if( errStr != NULL )
+    {
+        message( MsgType::ERR, "Unpack: Cannot open " + imagePath + " (" + std::string(errStr) + ")" );
+        return false;
+    }
+    if( cpmReadSuper( &super, &root, format.c_str(), 0 ) == -1 )
+    {
+        message( MsgType::ERR, "Unpack: Cannot read superblock (" + std::string(boo) + ")" );
+        Device_close( &super.dev );
+        return false;
+    }
+
+    // Save the boot tracks
+    if( itBootSectors( &super ) > 0 )
+    {
+        int sectors = itBootSectors( &super );
+
+        buffer.resize( (size_t)sectors * super.secLength );
+        for( int sec = 0; ( sec < sectors ) && retVal; sec++ )
+        {
+            errStr = Device_readSector( &super.dev, sec / super.sectrk, sec % super.sectrk, buffer.data() + (size_t)sec * super.secLength );
+            if( errStr != NULL )
+            {
+                message( MsgType::ERR, "Unpack: Cannot read boot sector (" + std::string(errStr) + ")" );
+                retVal = false;
+            }
+        }
+
+        std::ofstream bootFile( fs::path( dirPath ) / IT_BOOTFILE, std::ios::binary | std::ios::trunc );
+        if( retVal && !bootFile.write( buffer.data(), buffer.size() ) )
+        {
+            message( MsgType::ERR, "Unpack: Cannot write " IT_BOOTFILE );
+            retVal = false;
+        }
+    }
+
+    cpmglob( 0, 1, star, &root, &gargc, &gargv );
+    for( int i = 0; i < gargc; i++ )
+    {
+        struct cpmInode ino;
+        struct cpmFile  file;
+        struct cpmStat  statbuf;
+        fs::path        hostFile = fs::path( dirPath ) / itCpmToHostName( gargv[i] );
+        ssize_t         got;
+
+        // Only regular files have the user number in front of their name
+        if( !isdigit( (unsigned char)gargv[i][0] ) || !isdigit( (unsigned char)gargv[i][1] ) )
+        {
+            continue;
+        }
+        files++;
+
+        if( cpmNamei( &root, gargv[i], &ino ) == -1 )
+        {
+            message( MsgType::ERR, "Unpack: Cannot open " + std::string(gargv[i]) + " (" + std::string(boo) + ")" );
+            retVal = false;
+            continue;
+        }
+        cpmStat( &ino, &statbuf );
+
+        // One read for the whole file
+        buffer.resize( (size_t)statbuf.size );
+        got = -1;
+        if( cpmOpen( &ino, &file, O_RDONLY ) == 0 )
+        {
+            got = cpmRead( &file, buffer.data(), buffer.size() );
+        }
+        cpmClose( &file );
+        if( got != (ssize_t)buffer.size() )
+        {
+            message( MsgType::ERR, "Unpack: Cannot read " + std::string(gargv[i]) + " (" + std::string(boo) + ")" );
+            retVal = false;
+            continue;
+        }
+
+        {
+            std::ofstream out( hostFile, std::ios::binary | std::ios::trunc );
+            if( !out.write( buffer.data(), buffer.size() ) )
+            {
+                message( MsgType::ERR, "Unpack: Cannot write " + hostFile.string() );
+                retVal = false;
+                continue;
+            }
+        }
+
+        if( ino.mtime )
+        {
+            struct utimbuf times;
+            times.actime  = ino.atime ? ino.atime : ino.mtime;
+            times.modtime = ino.mtime;
+            utime( hostFile.string().c_str(), &times );
+        }
+
+        unpacked++;
+    }
+    if( gargv != NULL )
+    {
+        cpmglobfree( gargv, gargc );
+    }
+
+    cpmUmount( &super );
+
+    message( retVal ? MsgType::INFO : MsgType::WARN, "Unpack: " + std::to_string(unpacked) + " of " + std::to_string(files) +
+                                                     " files unpacked into " + dirPath );
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Imports disk images into a deduplicating image store. Every image
+ *          becomes <store>/<name>.dsi, an existing one is overwritten once
+ *          the import is complete. An image whose name is already used by
+ *          another image of the same run (DISK.DSK and DISK.IMD) is refused.
+ *
+ * @param   storeDir    Directory of the store, created if needed.
+ * @param   images      The disk images to import.
+ * @param   format      Name of the disk format, for raw images and images
+ *                      without a geometry.
+ * @param   type        LibDsk driver of the images, "auto" to detect it.
+ *
+ * @return  true if all images were imported, otherwise false.
+ ******************************************************************************/
+bool itStoreImages( const std::string& storeDir, const std::vector<std::string>& images, const std::string& format, const std::string& type )
+{
+    std::error_code      ec;
+    std::vector<uint8_t> buffer;
+    std::map<std::string, std::string> storeNames;      // Lower case name of the .dsi -> imported image
+    uintmax_t            imported = 0;
+    uintmax_t            stored;
+    uintmax_t            indexes  = 0;
+    int                  chunks   = 0;
+    size_t               done     = 0;
+
+
+    fs::create_directories( storeDir, ec );
+    if( !fs::is_directory( storeDir, ec ) )
+    {
+        message( MsgType::ERR, "Store: Cannot create directory " + storeDir );
+        return false;
+    }
+
+    for( const auto& image : images )
+    {
+        DSK_PDRIVER  src = NULL;
+        DSK_PDRIVER  dst = NULL;
+        DSK_GEOMETRY geom;
+        dsk_err_t    err;
+        dsk_lsect_t  sectors;
+        fs::path     dstPath = fs::path( storeDir ) / ( fs::path( image ).stem().string() + IT_STORE_EXT );
+        fs::path     tmpPath = dstPath.string() + IT_STORE_TMP;
+        std::string  name    = dstPath.filename().string();
+
+        std::transform( name.begin(), name.end(), name.begin(), []( unsigned char c ) { return (char)std::tolower( c ); } );
+        auto used = storeNames.find( name );
+        if( used != storeNames.end() )
+        {
+            message( MsgType::ERR, "Store: " + image + " not imported, " + dstPath.string() + " is already the image of " + used->second );
+            continue;
+        }
+
+        err = dsk_open( &src, image.c_str(), ( type == "auto" ) ? NULL : type.c_str(), NULL );
+        if( err != DSK_ERR_OK )
+        {
+            message( MsgType::ERR, "Store: Cannot open " + image + " (" + std::string(dsk_strerror(err)) + ")" );
+            continue;
+        }
+
+        // A raw image has no geometry of its own
+        if( ( ( type == "raw" ) || ( dsk_getgeom( src, &geom ) != DSK_ERR_OK ) ) && !itGetGeometry( format, &geom ) )
+        {
+            message( MsgType::ERR, "Store: No geometry for " + image + ", unknown format " + format );
+            dsk_close( &src );
+            continue;
+        }
+
+        err = dsk_creat( &dst, tmpPath.string().c_str(), IT_STORE_TYPE, NULL );
+        if( err != DSK_ERR_OK )
+        {
+            message( MsgType::ERR, "Store: Cannot create " + tmpPath.string() + " (" + std::string(dsk_strerror(err)) + ")" );
+            dsk_close( &src );
+            fs::remove( tmpPath, ec );
+            continue;
+        }
+
+        sectors = (dsk_lsect_t)geom.dg_cylinders * geom.dg_heads * geom.dg_sectors;
+        buffer.resize( geom.dg_secsize );
+        for( dsk_lsect_t sec = 0; ( sec < sectors ) && ( err == DSK_ERR_OK ); sec++ )
+        {
+            err = dsk_lread( src, &geom, buffer.data(), sec );
+            if( err == DSK_ERR_OK )
+            {
+                err = dsk_lwrite( dst, &geom, buffer.data(), sec );
+            }
+        }
+        dsk_get_option( dst, "DEDUP:CHUNKS", &chunks );
+        dsk_close( &src );
+        if( ( dsk_close( &dst ) != DSK_ERR_OK ) || ( err != DSK_ERR_OK ) )
+        {
+            message( MsgType::ERR, "Store: Cannot import " + image + " (" + std::string(dsk_strerror(err)) + ")" );
+            fs::remove( tmpPath, ec );
+            continue;
+        }
+
+        // Only a complete image replaces an existing one
+        fs::rename( tmpPath, dstPath, ec );
+        if( ec )
+        {
+            message( MsgType::ERR, "Store: Cannot rename " + tmpPath.string() + " to " + dstPath.string() + " (" + ec.message() + ")" );
+            fs::remove( tmpPath, ec );
+            continue;
+        }
+
+        storeNames[name] = image;
+        imported += (uintmax_t)sectors * geom.dg_secsize;
+        indexes  += fs::file_size( dstPath, ec );
+        done++;
+    }
+
+    stored = (uintmax_t)chunks * IT_STORE_CHUNK + indexes;
+    message( ( done == images.size() ) ? MsgType::INFO : MsgType::WARN,
+             "Store: " + std::to_string(done) + " of " + std::to_string(images.size()) + " images imported into " + storeDir +
+             ", " + std::to_string(imported / 1024) + " KiB stored in " + std::to_string(stored / 1024) + " KiB, " +
+             std::to_string(chunks) + " chunks in the store" );
+
+    return done == images.size();
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the path is an image of a deduplicating image
+ *          store, which is opened with the LibDsk driver IT_STORE_TYPE.
+ ******************************************************************************/
+bool itIsStoreImage( const std::string& path )
+{
+    std::string ext = fs::path( path ).extension().string();
+
+
+    std::transform( ext.begin(), ext.end(), ext.begin(), []( unsigned char c ) { return (char)std::tolower( c ); } );
+
+    return ext == IT_STORE_EXT;
+}
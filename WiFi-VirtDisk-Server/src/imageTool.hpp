@@ -0,0 +1,36 @@
+/***************************************************************************//**
+ * @file    imageTool.hpp
+ *
+ * @brief   Converts between host directories (rcpmfs) and CP/M disk images,
+ *          and imports disk images into a deduplicating image store.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef IMAGETOOL_HPP
+#define IMAGETOOL_HPP
+
+/****************************************************************** Includes **/
+#include <string>
+#include <vector>
+
+
+/******************************************************************* Defines **/
+// Boot tracks of a rcpmfs directory, see libdsk/drvrcpm.c
+#define IT_BOOTFILE     ".libdsk.boot"
+
+// Image in a deduplicating image store, see libdsk/drvdedup.c
+#define IT_STORE_EXT    ".dsi"
+#define IT_STORE_TYPE   "dedup"
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+bool itPackDirectory( const std::string& dirPath, const std::string& imagePath, const std::string& format );
+bool itUnpackImage( const std::string& imagePath, const std::string& dirPath, const std::string& format, const std::string& type );
+bool itStoreImages( const std::string& storeDir, const std::vector<std::string>& images, const std::string& format, const std::string& type );
+bool itIsStoreImage( const std::string& path );
+
+
+#endif
@@ -13,6 +13,7 @@
 #include <conio.h>
 #else
 #include <stdio.h>
+#include <poll.h>
 #include <termios.h>
 #include <unistd.h>
 #endif
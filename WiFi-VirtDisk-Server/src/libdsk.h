@@ -361,6 +361,16 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_xread(DSK_PDRIVER self, const DSK_GEOMETRY
 			      dsk_pcyl_t cyl_expected, dsk_phead_t head_expected,
 			      dsk_psect_t sector, size_t sector_len,
 			      int *deleted);
+/* Read several consecutive sectors in one call. The physical version 
+ * reads 'count' sectors from one track, starting at 'sector'; the logical
+ * version may cross track boundaries. Drivers with a multi-sector entry
+ * point transfer each track run in one go, others one sector at a time. */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_pmread(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count);
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_lmread(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_lsect_t sector, unsigned count);
 /* Write a sector. There are three alternative versions:
  *  One that uses physical sectors
  *  One that uses logical sectors
@@ -378,6 +388,14 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_xwrite(DSK_PDRIVER self, const DSK_GEOMETRY
 			      dsk_pcyl_t cyl_expected, dsk_phead_t head_expected,
 			      dsk_psect_t sector, size_t sector_len,
 			      int deleted);
+/* Write several consecutive sectors in one call; see dsk_pmread() */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_pmwrite(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count);
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_lmwrite(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_lsect_t sector,
+			      unsigned count);
 
 /* Verify sector against memory buffer. There are three alternative versions:
  *  One that uses physical sectors
@@ -53,6 +53,7 @@ extern DRV_CLASS dc_dc42;	/* Apple DiskCopy 4.2 */
 extern DRV_CLASS dc_d88;	/* D88 disk image */
 extern DRV_CLASS dc_d64;	/* D64 disk image */
 extern DRV_CLASS dc_d64cpm;	/* D64 CP/M disk image */
+extern DRV_CLASS dc_dedup;	/* Deduplicating image store */
 #ifdef LINUXFLOPPY
 extern DRV_CLASS dc_linux;	/* Linux driver */
 #endif
@@ -160,6 +160,19 @@ typedef struct drv_class
 
 	/* Convert from LDBS format. */
 	dsk_err_t (*dc_from_ldbs)(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
+
+	/* Read 'count' consecutive physical sectors from one track, 
+	 * starting at 'sector'. Optional; if a driver does not provide
+	 * it, dsk_pmread() falls back to one dc_read per sector. */
+	dsk_err_t (*dc_mread)(DSK_DRIVER *self, const DSK_GEOMETRY *geom, 
+			      void *buf, dsk_pcyl_t cylinder, 
+			      dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count);
+	/* Write 'count' consecutive physical sectors to one track */
+	dsk_err_t (*dc_mwrite)(DSK_DRIVER *self, const DSK_GEOMETRY *geom, 
+			      const void *buf, dsk_pcyl_t cylinder, 
+			      dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count);
 } DRV_CLASS;
 
 /* Returns true of drv is an instance of dc. That is, either its driver class
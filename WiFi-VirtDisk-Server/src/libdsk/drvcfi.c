@@ -131,7 +131,7 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk,
 	dsk_pcyl_t cyl;
 	dsk_phead_t head;
 	unsigned char *secdata;
-	unsigned n, allsame;
+	unsigned allsame;
 	long fpos;
 	unsigned char clbuf[2];
 
@@ -221,11 +221,8 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk,
 		trkh->sector[sec].id_psh = dsk_get_psh(self->cfi_geom.dg_secsize);
 		trkh->sector[sec].datalen = self->cfi_geom.dg_secsize;
 
-		allsame = 1;
-		for (n = 0; n < self->cfi_geom.dg_secsize; n++)
-		{
-			if (secdata[n] != secdata[0]) { allsame = 0; break; }
-		}
+		allsame = dsk_simd_isfill(secdata, self->cfi_geom.dg_secsize,
+					secdata[0]);
 		if (allsame)
 		{
 			trkh->sector[sec].copies = 0;
@@ -0,0 +1,783 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2025  Welzel-Online                                    *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Deduplicating image store. All images in one directory share the chunk
+ * file DEDUP_DATA, which holds every distinct 512 byte chunk only once.
+ * An image file only holds a header and an index with the number of the
+ * chunk for every 512 bytes of the image:
+ *
+ *  0	"DEDUPDSK"
+ *  8	Version (2 bytes), chunk size (2 bytes)
+ * 12	Sidedness, heads, first sector, data rate (1 byte each)
+ * 16	Cylinders, sectors, sector size, recording mode (2 bytes each)
+ * 24	Read/write gap, format gap (1 byte each), reserved (2 bytes)
+ * 28	Number of index entries (4 bytes)
+ * 32	Index entries (4 bytes each), DEDUP_NONE if never written
+ *
+ * All values are little-endian. The geometry is the one of the first
+ * write or format. Like a raw image, the data is in logical sector order,
+ * so sectors of any size can be stored.
+ *
+ * Opening an image only loads its index; a read is one seek into the
+ * chunk file. The hash table of the chunks is only built for the first
+ * write into a store, from the hashes in DEDUP_HASH. A hash match is
+ * compared with the chunk, so a collision cannot mix up data.
+ *
+ * Chunks are never removed from the store, and only one process may write
+ * into a store at the same time. */
+
+#include <stdio.h>
+#include "libdsk.h"
+#include "ldbs.h"
+#include "drvi.h"
+#include "drvdedup.h"
+
+DRV_CLASS dc_dedup =
+{
+	sizeof(DEDUP_DSK_DRIVER),
+	NULL,		/* superclass */
+	"dedup\0DEDUP\0",
+	"Deduplicating image store",
+	dedup_open,	/* open */
+	dedup_creat,	/* create new */
+	dedup_close,	/* close */
+	dedup_read,	/* read sector, working from physical address */
+	dedup_write,	/* write sector, working from physical address */
+	dedup_format,	/* format track, physical */
+	dedup_getgeom,	/* Get geometry */
+	NULL,		/* sector ID */
+	dedup_xseek,	/* Seek to track */
+	dedup_status,	/* Get drive status */
+	NULL, 		/* xread */
+	NULL, 		/* xwrite */
+	NULL, 		/* tread */
+	NULL, 		/* xtread */
+	dedup_option_enum,	/* option_enum */
+	NULL,		/* option_set */
+	dedup_option_get,	/* option_get */
+	NULL,		/* trackids */
+	NULL,		/* rtread */
+	NULL,		/* export as LDBS */
+	NULL		/* import as LDBS */
+};
+
+#define CHECK_CLASS(s) \
+	if (s->dr_class != &dc_dedup) return DSK_ERR_BADPTR; \
+	ddself = (DEDUP_DSK_DRIVER *)s;
+
+/* All stores with an open image */
+static DEDUP_STORE *dedup_stores = NULL;
+
+
+/* Two independent 32-bit hashes (FNV-1a and DJB2) of a chunk */
+static void dedup_hash(const unsigned char *buf, unsigned long *h1,
+			unsigned long *h2)
+{
+	unsigned long a = 2166136261UL;
+	unsigned long b = 5381;
+	int n;
+
+	for (n = 0; n < DEDUP_CHUNK; n++)
+	{
+		a = ((a ^ buf[n]) * 16777619UL) & 0xFFFFFFFFUL;
+		b = ((b * 33) ^ buf[n]) & 0xFFFFFFFFUL;
+	}
+	*h1 = a;
+	*h2 = b;
+}
+
+
+static FILE *dedup_fopen(const char *dir, const char *name, int *readonly)
+{
+	char *path = dsk_malloc(strlen(dir) + strlen(name) + 2);
+	FILE *fp = NULL;
+
+	if (!path) return NULL;
+	sprintf(path, "%s/%s", dir, name);
+
+	if (!*readonly)
+	{
+		fp = fopen(path, "r+b");
+		if (!fp) fp = fopen(path, "w+b");
+	}
+	if (!fp)
+	{
+		fp = fopen(path, "rb");
+		if (fp) *readonly = 1;
+	}
+	dsk_free(path);
+	return fp;
+}
+
+
+/* Open the store of an image file, or share it if it is open already.
+ * If the store cannot be written, the image is read-only too. */
+static dsk_err_t dedup_store_open(const char *filename, int *readonly,
+				DEDUP_STORE **result)
+{
+	DEDUP_STORE *st;
+	const char *sep = strrchr(filename, '/');
+	const char *bsep = strrchr(filename, '\\');
+	size_t len;
+	long size;
+
+	if (bsep && (!sep || bsep > sep)) sep = bsep;
+	len = sep ? (size_t)(sep - filename) : 1;
+	if (sep == filename) len = 1;	/* Root directory */
+
+	for (st = dedup_stores; st; st = st->ds_next)
+	{
+		if (strlen(st->ds_dir) == len &&
+		    !memcmp(st->ds_dir, sep ? filename : ".", len))
+		{
+			if (st->ds_readonly) *readonly = 1;
+			++st->ds_refcount;
+			*result = st;
+			return DSK_ERR_OK;
+		}
+	}
+
+	st = dsk_malloc(sizeof(DEDUP_STORE));
+	if (!st) return DSK_ERR_NOMEM;
+	memset(st, 0, sizeof(DEDUP_STORE));
+	st->ds_dir = dsk_malloc(len + 1);
+	if (!st->ds_dir)
+	{
+		dsk_free(st);
+		return DSK_ERR_NOMEM;
+	}
+	memcpy(st->ds_dir, sep ? filename : ".", len);
+	st->ds_dir[len] = 0;
+	st->ds_readonly = *readonly;
+
+	st->ds_data = dedup_fopen(st->ds_dir, DEDUP_DATA, &st->ds_readonly);
+	if (st->ds_data)
+		st->ds_hash = dedup_fopen(st->ds_dir, DEDUP_HASH, &st->ds_readonly);
+	if (!st->ds_data || !st->ds_hash || fseek(st->ds_data, 0, SEEK_END) ||
+	    (size = ftell(st->ds_data)) < 0)
+	{
+		if (st->ds_data) fclose(st->ds_data);
+		if (st->ds_hash) fclose(st->ds_hash);
+		dsk_free(st->ds_dir);
+		dsk_free(st);
+		return DSK_ERR_SYSERR;
+	}
+	/* A chunk cut short by a crash is not part of the store */
+	st->ds_chunks = (unsigned long)size / DEDUP_CHUNK;
+	st->ds_refcount = 1;
+	*readonly = st->ds_readonly;
+	st->ds_next = dedup_stores;
+	dedup_stores = st;
+	*result = st;
+	return DSK_ERR_OK;
+}
+
+
+static dsk_err_t dedup_store_close(DEDUP_STORE *store)
+{
+	DEDUP_STORE **pst;
+	dsk_err_t err = DSK_ERR_OK;
+
+	if (--store->ds_refcount) return DSK_ERR_OK;
+
+	for (pst = &dedup_stores; *pst; pst = &(*pst)->ds_next)
+	{
+		if (*pst == store)
+		{
+			*pst = store->ds_next;
+			break;
+		}
+	}
+	if (fclose(store->ds_data) == EOF) err = DSK_ERR_SYSERR;
+	if (fclose(store->ds_hash) == EOF) err = DSK_ERR_SYSERR;
+	if (store->ds_table) dsk_free(store->ds_table);
+	dsk_free(store->ds_dir);
+	dsk_free(store);
+	return err;
+}
+
+
+static dsk_err_t dedup_store_get(DEDUP_STORE *store, unsigned long id,
+				unsigned char *buf)
+{
+	if (id >= store->ds_chunks) return DSK_ERR_CORRUPT;
+	if (fseek(store->ds_data, (long)id * DEDUP_CHUNK, SEEK_SET) ||
+	    fread(buf, 1, DEDUP_CHUNK, store->ds_data) < DEDUP_CHUNK)
+		return DSK_ERR_SYSERR;
+	return DSK_ERR_OK;
+}
+
+
+/* Put a chunk into the hash table, which has to have a free slot */
+static void dedup_table_add(DEDUP_STORE *store, unsigned long h1,
+			unsigned long h2, unsigned long id)
+{
+	unsigned long mask = store->ds_tabsize - 1;
+	unsigned long n = h1 & mask;
+
+	while (store->ds_table[n].ds_id != DEDUP_NONE) n = (n + 1) & mask;
+	store->ds_table[n].ds_hash1 = h1;
+	store->ds_table[n].ds_hash2 = h2;
+	store->ds_table[n].ds_id    = id;
+}
+
+
+/* Resize the hash table to hold at least 'chunks' chunks at half load */
+static dsk_err_t dedup_table_grow(DEDUP_STORE *store, unsigned long chunks)
+{
+	DEDUP_SLOT *old = store->ds_table;
+	unsigned long oldsize = store->ds_tabsize;
+	unsigned long size = 1024;
+	unsigned long n;
+
+	while (size < 2 * chunks) size *= 2;
+	if (size <= oldsize) return DSK_ERR_OK;
+
+	store->ds_table = dsk_malloc(size * sizeof(DEDUP_SLOT));
+	if (!store->ds_table)
+	{
+		store->ds_table = old;
+		return DSK_ERR_NOMEM;
+	}
+	store->ds_tabsize = size;
+	for (n = 0; n < size; n++) store->ds_table[n].ds_id = DEDUP_NONE;
+	for (n = 0; n < oldsize; n++)
+	{
+		if (old[n].ds_id != DEDUP_NONE)
+			dedup_table_add(store, old[n].ds_hash1,
+					old[n].ds_hash2, old[n].ds_id);
+	}
+	if (old) dsk_free(old);
+	return DSK_ERR_OK;
+}
+
+
+/* Build the hash table on the first write. Hashes missing in the hash
+ * file (after a crash) are calculated from the chunks. */
+static dsk_err_t dedup_store_load(DEDUP_STORE *store)
+{
+	unsigned char buf[DEDUP_CHUNK];
+	unsigned long id, h1, h2;
+	dsk_err_t err;
+
+	if (store->ds_tabsize) return DSK_ERR_OK;
+
+	err = dedup_table_grow(store, store->ds_chunks + 1);
+	if (err) return err;
+
+	if (fseek(store->ds_hash, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+	for (id = 0; id < store->ds_chunks; id++)
+	{
+		if (fread(buf, 1, 8, store->ds_hash) < 8) break;
+		dedup_table_add(store, ldbs_peek4(buf), ldbs_peek4(buf + 4), id);
+	}
+	for (; id < store->ds_chunks; id++)
+	{
+		err = dedup_store_get(store, id, buf);
+		if (err) return err;
+		dedup_hash(buf, &h1, &h2);
+		ldbs_poke4(buf, h1);
+		ldbs_poke4(buf + 4, h2);
+		if (fseek(store->ds_hash, (long)id * 8, SEEK_SET) ||
+		    fwrite(buf, 1, 8, store->ds_hash) < 8)
+			return DSK_ERR_SYSERR;
+		dedup_table_add(store, h1, h2, id);
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Find a chunk in the store, or append it */
+static dsk_err_t dedup_store_put(DEDUP_STORE *store, const unsigned char *buf,
+				unsigned long *id)
+{
+	unsigned char old[DEDUP_CHUNK];
+	unsigned char hash[8];
+	unsigned long h1, h2, n;
+	dsk_err_t err;
+
+	if (store->ds_readonly) return DSK_ERR_RDONLY;
+	err = dedup_store_load(store);
+	if (err) return err;
+
+	dedup_hash(buf, &h1, &h2);
+	for (n = h1 & (store->ds_tabsize - 1);
+	     store->ds_table[n].ds_id != DEDUP_NONE;
+	     n = (n + 1) & (store->ds_tabsize - 1))
+	{
+		if (store->ds_table[n].ds_hash1 != h1 ||
+		    store->ds_table[n].ds_hash2 != h2) continue;
+
+		err = dedup_store_get(store, store->ds_table[n].ds_id, old);
+		if (err) return err;
+		if (!memcmp(old, buf, DEDUP_CHUNK))
+		{
+			*id = store->ds_table[n].ds_id;
+			return DSK_ERR_OK;
+		}
+	}
+
+	/* New chunk. The data goes first, a hash without its chunk would be
+	 * taken for the next chunk. */
+	err = dedup_table_grow(store, store->ds_chunks + 1);
+	if (err) return err;
+	ldbs_poke4(hash, h1);
+	ldbs_poke4(hash + 4, h2);
+	if (fseek(store->ds_data, (long)store->ds_chunks * DEDUP_CHUNK, SEEK_SET) ||
+	    fwrite(buf, 1, DEDUP_CHUNK, store->ds_data) < DEDUP_CHUNK ||
+	    fflush(store->ds_data) ||
+	    fseek(store->ds_hash, (long)store->ds_chunks * 8, SEEK_SET) ||
+	    fwrite(hash, 1, 8, store->ds_hash) < 8)
+		return DSK_ERR_SYSERR;
+
+	*id = store->ds_chunks++;
+	dedup_table_add(store, h1, h2, *id);
+	return DSK_ERR_OK;
+}
+
+
+static dsk_err_t dedup_put_header(DEDUP_DSK_DRIVER *self)
+{
+	unsigned char hdr[DEDUP_HEADER];
+	const DSK_GEOMETRY *dg = &self->dd_geom;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, DEDUP_MAGIC, 8);
+	ldbs_poke2(hdr + 8, DEDUP_VERSION);
+	ldbs_poke2(hdr + 10, DEDUP_CHUNK);
+	if (self->dd_hasgeom)
+	{
+		hdr[12] = (unsigned char)dg->dg_sidedness;
+		hdr[13] = (unsigned char)dg->dg_heads;
+		hdr[14] = (unsigned char)dg->dg_secbase;
+		hdr[15] = (unsigned char)dg->dg_datarate;
+		ldbs_poke2(hdr + 16, (unsigned short)dg->dg_cylinders);
+		ldbs_poke2(hdr + 18, (unsigned short)dg->dg_sectors);
+		ldbs_poke2(hdr + 20, (unsigned short)dg->dg_secsize);
+		ldbs_poke2(hdr + 22, (unsigned short)dg->dg_fm);
+		hdr[24] = dg->dg_rwgap;
+		hdr[25] = dg->dg_fmtgap;
+	}
+	ldbs_poke4(hdr + 28, self->dd_count);
+
+	if (fseek(self->dd_fp, 0, SEEK_SET) ||
+	    fwrite(hdr, 1, sizeof(hdr), self->dd_fp) < sizeof(hdr))
+		return DSK_ERR_SYSERR;
+	return DSK_ERR_OK;
+}
+
+
+/* The first write or format sets the geometry of the image */
+static dsk_err_t dedup_set_geom(DEDUP_DSK_DRIVER *self, const DSK_GEOMETRY *geom)
+{
+	if (self->dd_hasgeom) return DSK_ERR_OK;
+	memcpy(&self->dd_geom, geom, sizeof(DSK_GEOMETRY));
+	self->dd_hasgeom = 1;
+	return dedup_put_header(self);
+}
+
+
+static dsk_err_t dedup_offset(const DSK_GEOMETRY *geom, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector,
+			unsigned long *offset)
+{
+	dsk_lsect_t lsect;
+	dsk_err_t err = dg_ps2ls(geom, cylinder, head, sector, &lsect);
+
+	if (err) return err;
+	*offset = (unsigned long)lsect * geom->dg_secsize;
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_open(DSK_DRIVER *self, const char *filename, DSK_REPORTFUNC diagfunc)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	unsigned char hdr[DEDUP_HEADER];
+	unsigned char entry[4];
+	unsigned long n;
+	dsk_err_t err;
+
+	/* Sanity check: Is this meant for our driver? */
+	CHECK_CLASS(self);
+
+	ddself->dd_fp = fopen(filename, "r+b");
+	if (!ddself->dd_fp)
+	{
+		ddself->dd_readonly = 1;
+		ddself->dd_fp = fopen(filename, "rb");
+	}
+	if (!ddself->dd_fp) return DSK_ERR_NOTME;
+
+	if (fread(hdr, 1, sizeof(hdr), ddself->dd_fp) < sizeof(hdr) ||
+	    memcmp(hdr, DEDUP_MAGIC, 8) ||
+	    ldbs_peek2(hdr + 8) != DEDUP_VERSION ||
+	    ldbs_peek2(hdr + 10) != DEDUP_CHUNK)
+	{
+		fclose(ddself->dd_fp);
+		ddself->dd_fp = NULL;
+		return DSK_ERR_NOTME;
+	}
+
+	ddself->dd_geom.dg_sidedness = (dsk_sides_t)hdr[12];
+	ddself->dd_geom.dg_heads     = hdr[13];
+	ddself->dd_geom.dg_secbase   = hdr[14];
+	ddself->dd_geom.dg_datarate  = (dsk_rate_t)hdr[15];
+	ddself->dd_geom.dg_cylinders = ldbs_peek2(hdr + 16);
+	ddself->dd_geom.dg_sectors   = ldbs_peek2(hdr + 18);
+	ddself->dd_geom.dg_secsize   = ldbs_peek2(hdr + 20);
+	ddself->dd_geom.dg_fm        = ldbs_peek2(hdr + 22);
+	ddself->dd_geom.dg_rwgap     = hdr[24];
+	ddself->dd_geom.dg_fmtgap    = hdr[25];
+	ddself->dd_geom.dg_nomulti   = 0;
+	ddself->dd_hasgeom = (ddself->dd_geom.dg_secsize != 0);
+	ddself->dd_count   = ldbs_peek4(hdr + 28);
+
+	/* The index is all that is kept in memory */
+	ddself->dd_index = dsk_malloc((ddself->dd_count + 1) * sizeof(unsigned long));
+	if (!ddself->dd_index) err = DSK_ERR_NOMEM;
+	else err = DSK_ERR_OK;
+	for (n = 0; !err && n < ddself->dd_count; n++)
+	{
+		if (fread(entry, 1, 4, ddself->dd_fp) < 4) err = DSK_ERR_CORRUPT;
+		else ddself->dd_index[n] = ldbs_peek4(entry);
+	}
+	if (!err) err = dedup_store_open(filename, &ddself->dd_readonly,
+					&ddself->dd_store);
+	if (err)
+	{
+		if (ddself->dd_index) dsk_free(ddself->dd_index);
+		ddself->dd_index = NULL;
+		fclose(ddself->dd_fp);
+		ddself->dd_fp = NULL;
+		return err;
+	}
+
+	diaghead(diagfunc, "Deduplicating image store");
+	diaghex(diagfunc, 0, hdr, sizeof(hdr), "Header");
+
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_creat(DSK_DRIVER *self, const char *filename)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	dsk_err_t err;
+
+	/* Sanity check: Is this meant for our driver? */
+	CHECK_CLASS(self);
+
+	ddself->dd_fp = fopen(filename, "w+b");
+	ddself->dd_readonly = 0;
+	if (!ddself->dd_fp) return DSK_ERR_SYSERR;
+
+	ddself->dd_hasgeom = 0;
+	ddself->dd_count = 0;
+	ddself->dd_index = dsk_malloc(sizeof(unsigned long));
+	if (!ddself->dd_index) err = DSK_ERR_NOMEM;
+	else err = dedup_put_header(ddself);
+	if (!err) err = dedup_store_open(filename, &ddself->dd_readonly,
+					&ddself->dd_store);
+	if (!err && ddself->dd_readonly)
+	{
+		dedup_store_close(ddself->dd_store);
+		ddself->dd_store = NULL;
+		err = DSK_ERR_RDONLY;
+	}
+	if (err)
+	{
+		if (ddself->dd_index) dsk_free(ddself->dd_index);
+		ddself->dd_index = NULL;
+		fclose(ddself->dd_fp);
+		ddself->dd_fp = NULL;
+	}
+	return err;
+}
+
+
+dsk_err_t dedup_close(DSK_DRIVER *self)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	dsk_err_t err = DSK_ERR_OK;
+
+	CHECK_CLASS(self);
+
+	if (ddself->dd_store)
+	{
+		err = dedup_store_close(ddself->dd_store);
+		ddself->dd_store = NULL;
+	}
+	if (ddself->dd_index)
+	{
+		dsk_free(ddself->dd_index);
+		ddself->dd_index = NULL;
+	}
+	if (ddself->dd_fp)
+	{
+		if (fclose(ddself->dd_fp) == EOF) err = DSK_ERR_SYSERR;
+		ddself->dd_fp = NULL;
+	}
+	return err;
+}
+
+
+dsk_err_t dedup_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                             void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	unsigned char chunk[DEDUP_CHUNK];
+	unsigned char *dest = buf;
+	unsigned long offset, id;
+	size_t len, pos, n;
+	dsk_err_t err;
+
+	if (!buf || !self || !geom) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	if (!ddself->dd_fp) return DSK_ERR_NOTRDY;
+	err = dedup_offset(geom, cylinder, head, sector, &offset);
+	if (err) return err;
+
+	for (len = geom->dg_secsize; len; len -= n, offset += n, dest += n)
+	{
+		pos = offset % DEDUP_CHUNK;
+		n   = DEDUP_CHUNK - pos;
+		if (n > len) n = len;
+
+		if (offset / DEDUP_CHUNK >= ddself->dd_count) return DSK_ERR_NOADDR;
+		id = ddself->dd_index[offset / DEDUP_CHUNK];
+		if (id == DEDUP_NONE)
+		{
+			memset(dest, 0xE5, n);
+		}
+		else if (n == DEDUP_CHUNK)
+		{
+			err = dedup_store_get(ddself->dd_store, id, dest);
+			if (err) return err;
+		}
+		else
+		{
+			err = dedup_store_get(ddself->dd_store, id, chunk);
+			if (err) return err;
+			memcpy(dest, chunk + pos, n);
+		}
+	}
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                             const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	unsigned char chunk[DEDUP_CHUNK];
+	unsigned char entry[4];
+	const unsigned char *src = buf;
+	unsigned long offset, idx, id, *index;
+	size_t len, pos, n;
+	dsk_err_t err;
+
+	if (!buf || !self || !geom) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	if (!ddself->dd_fp) return DSK_ERR_NOTRDY;
+	if (ddself->dd_readonly) return DSK_ERR_RDONLY;
+	err = dedup_offset(geom, cylinder, head, sector, &offset);
+	if (!err) err = dedup_set_geom(ddself, geom);
+	if (err) return err;
+
+	/* Grow the index up to the end of the sector, the gap stays
+	 * unwritten */
+	idx = (offset + geom->dg_secsize + DEDUP_CHUNK - 1) / DEDUP_CHUNK;
+	if (idx > ddself->dd_count)
+	{
+		index = dsk_malloc((idx + 1) * sizeof(unsigned long));
+		if (!index) return DSK_ERR_NOMEM;
+		memcpy(index, ddself->dd_index, ddself->dd_count * sizeof(unsigned long));
+		dsk_free(ddself->dd_index);
+		ddself->dd_index = index;
+
+		ldbs_poke4(entry, DEDUP_NONE);
+		if (fseek(ddself->dd_fp, DEDUP_HEADER + 4L * ddself->dd_count, SEEK_SET))
+			return DSK_ERR_SYSERR;
+		while (ddself->dd_count < idx)
+		{
+			if (fwrite(entry, 1, 4, ddself->dd_fp) < 4) return DSK_ERR_SYSERR;
+			ddself->dd_index[ddself->dd_count++] = DEDUP_NONE;
+		}
+		err = dedup_put_header(ddself);
+		if (err) return err;
+	}
+
+	for (len = geom->dg_secsize; len; len -= n, offset += n, src += n)
+	{
+		idx = offset / DEDUP_CHUNK;
+		pos = offset % DEDUP_CHUNK;
+		n   = DEDUP_CHUNK - pos;
+		if (n > len) n = len;
+
+		if (n == DEDUP_CHUNK)
+		{
+			err = dedup_store_put(ddself->dd_store, src, &id);
+		}
+		else
+		{
+			/* Part of a chunk: the rest comes from the old chunk */
+			if (ddself->dd_index[idx] == DEDUP_NONE)
+				memset(chunk, 0xE5, DEDUP_CHUNK);
+			else
+			{
+				err = dedup_store_get(ddself->dd_store,
+						ddself->dd_index[idx], chunk);
+				if (err) return err;
+			}
+			memcpy(chunk + pos, src, n);
+			err = dedup_store_put(ddself->dd_store, chunk, &id);
+		}
+		if (err) return err;
+		if (id == ddself->dd_index[idx]) continue;
+
+		ldbs_poke4(entry, id);
+		if (fseek(ddself->dd_fp, DEDUP_HEADER + 4L * idx, SEEK_SET) ||
+		    fwrite(entry, 1, 4, ddself->dd_fp) < 4)
+			return DSK_ERR_SYSERR;
+		ddself->dd_index[idx] = id;
+	}
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
+                                dsk_pcyl_t cylinder, dsk_phead_t head,
+                                const DSK_FORMAT *format, unsigned char filler)
+{
+/*
+ * Like a raw image, the store does not hold track headers, so the
+ * "format" parameter is ignored.
+ */
+	DEDUP_DSK_DRIVER *ddself;
+	unsigned char *buf;
+	dsk_psect_t sec;
+	dsk_err_t err = DSK_ERR_OK;
+
+	(void)format;
+	if (!self || !geom) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	if (!ddself->dd_fp) return DSK_ERR_NOTRDY;
+	if (ddself->dd_readonly) return DSK_ERR_RDONLY;
+
+	buf = dsk_malloc(geom->dg_secsize);
+	if (!buf) return DSK_ERR_NOMEM;
+	memset(buf, filler, geom->dg_secsize);
+	for (sec = 0; !err && sec < geom->dg_sectors; sec++)
+	{
+		err = dedup_write(self, geom, buf, cylinder, head,
+				sec + geom->dg_secbase);
+	}
+	dsk_free(buf);
+	return err;
+}
+
+
+dsk_err_t dedup_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
+{
+	DEDUP_DSK_DRIVER *ddself;
+
+	if (!geom || !self) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	/* Nothing written yet: let LibDsk probe the geometry */
+	if (!ddself->dd_hasgeom) return DSK_ERR_NOTME;
+	memcpy(geom, &ddself->dd_geom, sizeof(DSK_GEOMETRY));
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_xseek(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+			dsk_pcyl_t cylinder, dsk_phead_t head)
+{
+	if (!self || !geom) return DSK_ERR_BADPTR;
+	if (cylinder >= geom->dg_cylinders || head >= geom->dg_heads)
+		return DSK_ERR_SEEKFAIL;
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t dedup_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                      dsk_phead_t head, unsigned char *result)
+{
+        DEDUP_DSK_DRIVER *ddself;
+
+        if (!self || !geom) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+        if (!ddself->dd_fp) *result &= ~DSK_ST3_READY;
+        if (ddself->dd_readonly) *result |= DSK_ST3_RO;
+	return DSK_ERR_OK;
+}
+
+
+/* DEDUP:CHUNKS is the number of distinct chunks in the store,
+ * DEDUP:USED the number of chunks written to the image */
+dsk_err_t dedup_option_enum(DSK_DRIVER *self, int idx, char **optname)
+{
+	if (!self || self->dr_class != &dc_dedup) return DSK_ERR_BADPTR;
+
+	switch (idx)
+	{
+		case 0: if (optname) *optname = "DEDUP:CHUNKS";
+			return DSK_ERR_OK;
+		case 1: if (optname) *optname = "DEDUP:USED";
+			return DSK_ERR_OK;
+	}
+	return DSK_ERR_BADOPT;
+}
+
+
+dsk_err_t dedup_option_get(DSK_DRIVER *self, const char *optname, int *value)
+{
+	DEDUP_DSK_DRIVER *ddself;
+	unsigned long n, used = 0;
+
+	if (!self || !optname) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	if (!strcmp(optname, "DEDUP:CHUNKS"))
+	{
+		if (value) *value = (int)ddself->dd_store->ds_chunks;
+		return DSK_ERR_OK;
+	}
+	if (!strcmp(optname, "DEDUP:USED"))
+	{
+		for (n = 0; n < ddself->dd_count; n++)
+		{
+			if (ddself->dd_index[n] != DEDUP_NONE) ++used;
+		}
+		if (value) *value = (int)used;
+		return DSK_ERR_OK;
+	}
+	return DSK_ERR_BADOPT;
+}
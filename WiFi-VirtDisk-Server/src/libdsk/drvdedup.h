@@ -0,0 +1,85 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2025  Welzel-Online                                    *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Declarations for the deduplicating image store driver */
+
+#define DEDUP_MAGIC	"DEDUPDSK"	/* 8 bytes, no terminating 0 */
+#define DEDUP_VERSION	1
+#define DEDUP_CHUNK	512		/* Bytes per chunk */
+#define DEDUP_HEADER	32		/* Bytes in front of the index */
+#define DEDUP_NONE	0xFFFFFFFFUL	/* Index entry of an unwritten chunk */
+#define DEDUP_DATA	"chunks.dat"	/* Chunks of all images in the store */
+#define DEDUP_HASH	"chunks.hsh"	/* Hash of each chunk, 8 bytes */
+
+/* One slot of the hash table of a store */
+typedef struct
+{
+	unsigned long ds_hash1;
+	unsigned long ds_hash2;
+	unsigned long ds_id;		/* DEDUP_NONE if the slot is free */
+} DEDUP_SLOT;
+
+/* A store directory, shared by all open images in it */
+typedef struct dedup_store
+{
+	struct dedup_store *ds_next;
+	char          *ds_dir;
+	unsigned       ds_refcount;
+	FILE          *ds_data;
+	FILE          *ds_hash;
+	int            ds_readonly;
+	unsigned long  ds_chunks;	/* Chunks in the data file */
+	unsigned long  ds_tabsize;	/* Slots in ds_table, 0 until the first write */
+	DEDUP_SLOT    *ds_table;
+} DEDUP_STORE;
+
+typedef struct
+{
+        DSK_DRIVER dd_super;
+        FILE *dd_fp;
+	int   dd_readonly;
+	DEDUP_STORE  *dd_store;
+	DSK_GEOMETRY  dd_geom;		/* Geometry of the first write */
+	int           dd_hasgeom;
+	unsigned long dd_count;		/* Entries in dd_index */
+	unsigned long *dd_index;	/* Chunk number of each 512 bytes */
+} DEDUP_DSK_DRIVER;
+
+dsk_err_t dedup_open(DSK_DRIVER *self, const char *filename, DSK_REPORTFUNC diagfunc);
+dsk_err_t dedup_creat(DSK_DRIVER *self, const char *filename);
+dsk_err_t dedup_close(DSK_DRIVER *self);
+dsk_err_t dedup_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t dedup_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t dedup_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
+                                dsk_pcyl_t cylinder, dsk_phead_t head,
+                                const DSK_FORMAT *format, unsigned char filler);
+dsk_err_t dedup_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom);
+dsk_err_t dedup_xseek(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                                dsk_pcyl_t cylinder, dsk_phead_t head);
+dsk_err_t dedup_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                      dsk_phead_t head, unsigned char *result);
+dsk_err_t dedup_option_enum(DSK_DRIVER *self, int idx, char **optname);
+dsk_err_t dedup_option_get(DSK_DRIVER *self, const char *optname, int *value);
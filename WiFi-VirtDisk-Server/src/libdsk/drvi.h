@@ -28,6 +28,7 @@
 #include "config.h"
 #include "libdsk.h"
 #include "drv.h"
+#include "dsksimd.h"
 
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -55,6 +55,8 @@ DRV_CLASS dc_ldbsdisk =
 	NULL,			/* Read raw track, including sector headers */
 	ldbsdisk_to_ldbs,	/* Convert to LDBS format (trivially easy) */
 	ldbsdisk_from_ldbs,	/* Convert from LDBS format (ditto) */
+	ldbsdisk_mread,		/* Read several sectors */
+	ldbsdisk_mwrite,	/* Write several sectors */
 };
 
 
@@ -65,6 +67,149 @@ DRV_CLASS dc_ldbsdisk =
 
 
 
+/* Track header cache. Headers are written back before they go into the
+ * cache, so everything in it is clean and can be dropped at any time. */
+static void ldbsdisk_cache_track(LDBSDISK_DSK_DRIVER *self, 
+			dsk_pcyl_t cyl, dsk_phead_t head, LDBS_TRACKHEAD *t)
+{
+	int n, victim = 0;
+	LDBSDISK_TRACK_CACHE_ENTRY *tc = self->ld_track_cache;
+
+	for (n = 0; n < LDBSDISK_TRACK_CACHE; n++)
+	{
+		/* A stale copy of the same track (after a format) goes */
+		if (tc[n].tc_track && tc[n].tc_cyl == cyl && 
+		    tc[n].tc_head == head)
+		{
+			victim = n;
+			break;
+		}
+		if (!tc[n].tc_track || 
+		    (tc[victim].tc_track && tc[n].tc_used < tc[victim].tc_used))
+		{
+			victim = n;
+		}
+	}
+	if (tc[victim].tc_track) dsk_free(tc[victim].tc_track);
+	tc[victim].tc_cyl   = cyl;
+	tc[victim].tc_head  = head;
+	tc[victim].tc_track = t;
+	tc[victim].tc_used  = ++self->ld_cache_clock;
+}
+
+
+/* Take a track header out of the cache. Returns NULL if not there. */
+static LDBS_TRACKHEAD *ldbsdisk_uncache_track(LDBSDISK_DSK_DRIVER *self,
+			dsk_pcyl_t cyl, dsk_phead_t head)
+{
+	int n;
+	LDBS_TRACKHEAD *t;
+	LDBSDISK_TRACK_CACHE_ENTRY *tc = self->ld_track_cache;
+
+	for (n = 0; n < LDBSDISK_TRACK_CACHE; n++)
+	{
+		if (tc[n].tc_track && tc[n].tc_cyl == cyl && 
+		    tc[n].tc_head == head)
+		{
+			t = tc[n].tc_track;
+			tc[n].tc_track = NULL;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+
+/* Sector cache, keyed on block ID. Anything that rewrites or deletes a 
+ * sector block must call ldbsdisk_uncache_sector() for it. */
+static void ldbsdisk_uncache_sector(LDBSDISK_DSK_DRIVER *self, 
+			LDBLOCKID blockid)
+{
+	int n;
+	LDBSDISK_SECTOR_CACHE_ENTRY *sc = self->ld_sec_cache;
+
+	if (blockid == LDBLOCKID_NULL) return;
+	for (n = 0; n < LDBSDISK_SECTOR_CACHE; n++)
+	{
+		if (sc[n].sc_blockid == blockid)
+		{
+			ldbs_free(sc[n].sc_data);
+			sc[n].sc_data = NULL;
+			sc[n].sc_blockid = LDBLOCKID_NULL;
+		}
+	}
+}
+
+
+/* Look up a sector block, loading it from the blockstore on a miss. The
+ * returned buffer belongs to the cache. */
+static dsk_err_t ldbsdisk_get_sector(LDBSDISK_DSK_DRIVER *self,
+			LDBLOCKID blockid, unsigned char **data, size_t *len)
+{
+	int n, victim = 0;
+	char type[4];
+	unsigned char *buf;
+	size_t buflen = 0;
+	dsk_err_t err;
+	LDBSDISK_SECTOR_CACHE_ENTRY *sc = self->ld_sec_cache;
+
+	for (n = 0; n < LDBSDISK_SECTOR_CACHE; n++)
+	{
+		if (sc[n].sc_blockid == blockid)
+		{
+			sc[n].sc_used = ++self->ld_cache_clock;
+			*data = sc[n].sc_data;
+			*len  = sc[n].sc_len;
+			return DSK_ERR_OK;
+		}
+		if (sc[victim].sc_blockid != LDBLOCKID_NULL &&
+		    (sc[n].sc_blockid == LDBLOCKID_NULL ||
+		     sc[n].sc_used < sc[victim].sc_used))
+		{
+			victim = n;
+		}
+	}
+	err = ldbs_getblock_a(self->ld_store, blockid, type, (void **)&buf, 
+				&buflen);
+	if (err) return err;
+
+	if (sc[victim].sc_data) ldbs_free(sc[victim].sc_data);
+	sc[victim].sc_blockid = blockid;
+	sc[victim].sc_data = buf;
+	sc[victim].sc_len  = buflen;
+	sc[victim].sc_used = ++self->ld_cache_clock;
+	*data = buf;
+	*len  = buflen;
+	return DSK_ERR_OK;
+}
+
+
+/* Empty both caches. Must be done whenever the blockstore is changed 
+ * behind our back (detach / attach) */
+static void ldbsdisk_drop_cache(LDBSDISK_DSK_DRIVER *self)
+{
+	int n;
+
+	for (n = 0; n < LDBSDISK_TRACK_CACHE; n++)
+	{
+		if (self->ld_track_cache[n].tc_track) 
+		{
+			dsk_free(self->ld_track_cache[n].tc_track);
+		}
+		self->ld_track_cache[n].tc_track = NULL;
+	}
+	for (n = 0; n < LDBSDISK_SECTOR_CACHE; n++)
+	{
+		if (self->ld_sec_cache[n].sc_data) 
+		{
+			ldbs_free(self->ld_sec_cache[n].sc_data);
+		}
+		self->ld_sec_cache[n].sc_data = NULL;
+		self->ld_sec_cache[n].sc_blockid = LDBLOCKID_NULL;
+	}
+}
+
+
 static dsk_err_t ldbsdisk_flush_cur_track(LDBSDISK_DSK_DRIVER *self)
 {
 	dsk_err_t err = DSK_ERR_OK;
@@ -75,9 +220,19 @@ static dsk_err_t ldbsdisk_flush_cur_track(LDBSDISK_DSK_DRIVER *self)
 		{
 			err = ldbs_put_trackhead(self->ld_store, self->ld_cur_track,
 						self->ld_cur_cyl, self->ld_cur_head);
+			if (!err) self->ld_cur_track->dirty = 0;
+		}
+		/* Keep the header for next time, unless it couldn't be 
+		 * written back */
+		if (err || self->ld_cur_track->dirty)
+		{
+			dsk_free(self->ld_cur_track);
+		}
+		else
+		{
+			ldbsdisk_cache_track(self, self->ld_cur_cyl, 
+					self->ld_cur_head, self->ld_cur_track);
 		}
-
-		dsk_free(self->ld_cur_track);
 		self->ld_cur_track = NULL;
 		self->ld_cur_cyl = -1;
 		self->ld_cur_head = -1;
@@ -99,7 +254,8 @@ static dsk_err_t ldbsdisk_select_track(LDBSDISK_DSK_DRIVER *self,
 	err = ldbsdisk_flush_cur_track(self);
 	if (err) return err;
 
-	err = ldbs_get_trackhead(self->ld_store, &t, cyl, head);
+	t = ldbsdisk_uncache_track(self, cyl, head);
+	if (!t) err = ldbs_get_trackhead(self->ld_store, &t, cyl, head);
 	if (err) return err;
 
 	self->ld_cur_track = t;
@@ -527,6 +683,7 @@ dsk_err_t ldbsdisk_attach(DSK_DRIVER *pdriver)
 		dsk_free(self->ld_cur_track);
 	}
 	self->ld_cur_track = NULL;
+	ldbsdisk_drop_cache(self);
 
 	return DSK_ERR_OK;
 }
@@ -564,6 +721,7 @@ dsk_err_t ldbsdisk_creat(DSK_DRIVER *pdriver, const char *filename)
 	self->ld_cur_track = NULL;
 	self->ld_cur_cyl = -1;
 	self->ld_cur_head = -1;
+	ldbsdisk_drop_cache(self);
 	return DSK_ERR_OK;
 }
 
@@ -597,6 +755,8 @@ dsk_err_t ldbsdisk_detach(DSK_DRIVER *pdriver)
 	self = (LDBSDISK_DSK_DRIVER *)pdriver;
 
 	ldbsdisk_flush_cur_track(self);
+	/* The caller may be about to change the blockstore */
+	ldbsdisk_drop_cache(self);
 
 	/* If the DPB has been populated, record it. A valid CP/M DPB
 	 * must have at least SPT, DSM, DRM and AL0 populated */
@@ -808,15 +968,26 @@ dsk_err_t ldbsdisk_xread(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom, void *bu
 		}
 		else
 		{
-			/* Sector really exists. Load it. */
+			/* Sector really exists. Load it (or find it in the
+			 * cache; secbuf then belongs to the cache). */
 			unsigned char *secbuf;
 			size_t sblen;
 			size_t offset = 0;
 			char sbtype[4];
 			dsk_err_t err2;		
+			int cached = (cursec->copies == 1);
 	
-			err2 = ldbs_getblock_a(self->ld_store, cursec->blockid,
-					sbtype, (void **)&secbuf, &sblen);
+			if (cached)
+			{
+				err2 = ldbsdisk_get_sector(self, 
+					cursec->blockid, &secbuf, &sblen);
+			}
+			else
+			{
+				err2 = ldbs_getblock_a(self->ld_store, 
+					cursec->blockid, sbtype, 
+					(void **)&secbuf, &sblen);
+			}
 			if (err2) return err2;
 
 			/* Size on disk is smaller than expected size? */
@@ -838,7 +1009,7 @@ dsk_err_t ldbsdisk_xread(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom, void *bu
 			}	
 		
 			memcpy(result, secbuf + offset, size_actual);
-			ldbs_free(secbuf);	
+			if (!cached) ldbs_free(secbuf);	
 		}
 
 		/* LDBS disks, like CPCEMU disks, can record errors made at
@@ -885,7 +1056,6 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 {
 	dsk_err_t err;
 	LDBSDISK_DSK_DRIVER *self;
-	int n;
 	size_t size_actual = size_expect;
 	int allsame;
 	LDBS_SECTOR_ENTRY *cursec;
@@ -898,15 +1068,7 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 	if (self->ld_readonly) return DSK_ERR_RDONLY;
 
 	/* See if the requested sector contains all the same values */
-	allsame = 1;
-	for (n = 1; n < (int)size_expect; n++)
-	{
-		if (data[n] != data[0]) 
-		{
-			allsame = 0;
-			break;
-		}
-	}
+	allsame = dsk_simd_isfill(data, size_expect, data[0]);
 
 	/* See if the requested cylinder exists */
 	err = ldbsdisk_select_track(self, cylinder, head);
@@ -933,6 +1095,7 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 		cursec->copies = 0;
 		if (cursec->blockid != LDBLOCKID_NULL)
 		{
+			ldbsdisk_uncache_sector(self, cursec->blockid);
 			err = ldbs_delblock(self->ld_store, cursec->blockid);
 			cursec->blockid = LDBLOCKID_NULL;
 		}
@@ -953,8 +1116,10 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 		if (deleted)
 			cursec->st2 |= 0x40;
 		else	cursec->st2 &= ~0x40;
+		ldbsdisk_uncache_sector(self, cursec->blockid);
 		err = ldbs_putblock(self->ld_store, &cursec->blockid, type,
 				buf, size_expect);
+		ldbsdisk_uncache_sector(self, cursec->blockid);
 	}
 
 	self->ld_cur_track->dirty = 1;
@@ -962,6 +1127,64 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 }
 
 
+/* Read several sectors from one track */
+dsk_err_t ldbsdisk_mread(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			void *buf, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	dsk_err_t err;
+	LDBSDISK_DSK_DRIVER *self;
+	unsigned n;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (LDBSDISK_DSK_DRIVER *)pdriver;
+
+	err = ldbsdisk_select_track(self, cylinder, head);
+	if (err) return err;	
+
+	for (n = 0; n < count; n++)
+	{
+		err = ldbsdisk_xread(pdriver, geom, 
+				((unsigned char *)buf) + n * geom->dg_secsize,
+				cylinder, head, cylinder, dg_x_head(geom, head),
+				sector + n, geom->dg_secsize, 0);
+		if (err) return err;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Write several sectors to one track */
+dsk_err_t ldbsdisk_mwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			const void *buf, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	dsk_err_t err;
+	LDBSDISK_DSK_DRIVER *self;
+	unsigned n;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (LDBSDISK_DSK_DRIVER *)pdriver;
+	
+	if (self->ld_readonly) return DSK_ERR_RDONLY;
+
+	err = ldbsdisk_select_track(self, cylinder, head);
+	if (err) return err;	
+
+	for (n = 0; n < count; n++)
+	{
+		err = ldbsdisk_xwrite(pdriver, geom, 
+				((const unsigned char *)buf) + n * geom->dg_secsize,
+				cylinder, head, cylinder, dg_x_head(geom, head),
+				sector + n, geom->dg_secsize, 0);
+		if (err) return err;
+	}
+	return DSK_ERR_OK;
+}
+
+
 dsk_err_t ldbsdisk_wipe_track(LDBSDISK_DSK_DRIVER *self)
 {
 	int sector;
@@ -977,6 +1200,7 @@ dsk_err_t ldbsdisk_wipe_track(LDBSDISK_DSK_DRIVER *self)
 		blkid = self->ld_cur_track->sector[sector].blockid;
 		if (blkid != LDBLOCKID_NULL)
 		{
+			ldbsdisk_uncache_sector(self, blkid);
 			err = ldbs_delblock(self->ld_store, blkid);
 			if (err) return err;
 			self->ld_cur_track->sector[sector].copies = 0;
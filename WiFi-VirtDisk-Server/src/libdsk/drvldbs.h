@@ -24,6 +24,27 @@
 
 extern DRV_CLASS dc_ldbsdisk;
 
+/* Number of track headers and sector payloads kept in memory besides the
+ * current track */
+#define LDBSDISK_TRACK_CACHE	8
+#define LDBSDISK_SECTOR_CACHE	32
+
+typedef struct
+{
+	dsk_pcyl_t  tc_cyl;		/* Track cached in this slot */
+	dsk_phead_t tc_head;
+	LDBS_TRACKHEAD *tc_track;	/* NULL if slot is free */
+	unsigned long tc_used;		/* For least-recently-used eviction */
+} LDBSDISK_TRACK_CACHE_ENTRY;
+
+typedef struct
+{
+	LDBLOCKID sc_blockid;		/* LDBLOCKID_NULL if slot is free */
+	unsigned char *sc_data;		/* Block contents */
+	size_t sc_len;
+	unsigned long sc_used;		/* For least-recently-used eviction */
+} LDBSDISK_SECTOR_CACHE_ENTRY;
+
 typedef struct
 {
         DSK_DRIVER ld_super;		/* Base class */
@@ -37,6 +58,10 @@ typedef struct
 	LDBS_TRACKHEAD *ld_cur_track;	/* And the associated track */
 	DSK_GEOMETRY ld_lastgeom;	/* Last geometry written */
 	LDBS_DPB ld_dpb;		/* CP/M DPB */
+	/* Recently used track headers (all clean) and sector blocks */
+	LDBSDISK_TRACK_CACHE_ENTRY  ld_track_cache[LDBSDISK_TRACK_CACHE];
+	LDBSDISK_SECTOR_CACHE_ENTRY ld_sec_cache[LDBSDISK_SECTOR_CACHE];
+	unsigned long ld_cache_clock;
 
 } LDBSDISK_DSK_DRIVER;
 
@@ -73,6 +98,14 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom, const void
                               dsk_pcyl_t cylinder, dsk_phead_t head,
                               dsk_pcyl_t cyl_expected, dsk_phead_t head_expected,
                               dsk_psect_t sector, size_t sector_size, int deleted);
+dsk_err_t ldbsdisk_mread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count);
+dsk_err_t ldbsdisk_mwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count);
 dsk_err_t ldbsdisk_trackids(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
                             dsk_pcyl_t cylinder, dsk_phead_t head,
                             dsk_psect_t *count, DSK_FORMAT **result);
@@ -59,7 +59,9 @@ DRV_CLASS dc_posixalt =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs,/* import as LDBS */
+	posix_mread,	/* read several sectors */
+	posix_mwrite	/* write several sectors */
 };
 
 DRV_CLASS dc_posixoo = 
@@ -88,7 +90,9 @@ DRV_CLASS dc_posixoo =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs,/* import as LDBS */
+	posix_mread,	/* read several sectors */
+	posix_mwrite	/* write several sectors */
 };
 
 DRV_CLASS dc_posixob = 
@@ -117,7 +121,9 @@ DRV_CLASS dc_posixob =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs,/* import as LDBS */
+	posix_mread,	/* read several sectors */
+	posix_mwrite	/* write several sectors */
 };
 
 #define CHECK_CLASS(s) \
@@ -331,6 +337,74 @@ dsk_err_t posix_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 }
 
 
+/* Sectors within one track are stored contiguously in all three track
+ * orders, so a run of them is a single seek and a single transfer. */
+dsk_err_t posix_mread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                             void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count)
+{
+	POSIX_DSK_DRIVER *pxself;
+	unsigned long offset;
+	size_t len;
+
+	if (!buf || !self || !geom) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	if (!pxself->px_fp) return DSK_ERR_NOTRDY;
+	if (sector < geom->dg_secbase || 
+	    sector + count > geom->dg_secbase + geom->dg_sectors)
+		return DSK_ERR_NOADDR;
+
+	offset = posix_offset(pxself, geom, cylinder, head, sector);
+	len = (size_t)count * geom->dg_secsize;
+
+	if (fseek(pxself->px_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
+
+	if (fread(buf, 1, len, pxself->px_fp) < len)
+	{
+		return DSK_ERR_NOADDR;
+	}
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t posix_mwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                             const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count)
+{
+	POSIX_DSK_DRIVER *pxself;
+	unsigned long offset;
+	size_t len;
+	dsk_err_t err;
+
+	if (!buf || !self || !geom) return DSK_ERR_BADPTR;
+
+	CHECK_CLASS(self);
+
+	if (!pxself->px_fp) return DSK_ERR_NOTRDY;
+	if (pxself->px_readonly) return DSK_ERR_RDONLY;
+	if (sector < geom->dg_secbase || 
+	    sector + count > geom->dg_secbase + geom->dg_sectors)
+		return DSK_ERR_NOADDR;
+
+	offset = posix_offset(pxself, geom, cylinder, head, sector);
+	len = (size_t)count * geom->dg_secsize;
+
+	err = seekto(pxself, offset);
+	if (err) return err;
+
+	if (fwrite(buf, 1, len, pxself->px_fp) < len)
+	{
+		return DSK_ERR_NOADDR;
+	}
+	if (pxself->px_filesize < offset + len)
+		pxself->px_filesize = offset + len;
+	return DSK_ERR_OK;
+}
+
+
 dsk_err_t posix_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
                                 dsk_pcyl_t cylinder, dsk_phead_t head,
                                 const DSK_FORMAT *format, unsigned char filler)
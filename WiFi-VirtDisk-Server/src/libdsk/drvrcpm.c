@@ -149,7 +149,12 @@ DRV_CLASS dc_rcpmfs =
 	rcpmfs_option_enum,	/* List options */
 	rcpmfs_option_set,	/* Set option */
 	rcpmfs_option_get,	/* Get option */
-
+	NULL,		/* trackids */
+	NULL,		/* rtread */
+	NULL,		/* to_ldbs */
+	NULL,		/* from_ldbs */
+	rcpmfs_mread,	/* read several sectors */
+	rcpmfs_mwrite,	/* write several sectors */
 };
 
 
@@ -1745,9 +1750,10 @@ dsk_err_t rcpmfs_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 			{
 /* Pack the last 128-byte record of the file with 0x1A. This means text files
  * as seen from CP/M will be terminated with 0x1A rather than 0xE5. */
-				while (fr & 0x7F)
+				if (fr & 0x7F)
 				{
-					((unsigned char *)buf)[fr++] = 0x1A;
+					memset((unsigned char *)buf + fr, 0x1A, 
+						0x80 - (fr & 0x7F));
 				}
 			}
 			fclose(fp);
@@ -1758,6 +1764,75 @@ dsk_err_t rcpmfs_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 	return DSK_ERR_OK;
 }
 
+/* Read a run of sectors from one track. Consecutive sectors usually belong
+ * to the same file, so the host file is kept open across the run instead
+ * of being opened and closed for every sector. */
+dsk_err_t rcpmfs_mread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+			void *buf, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	RCPMFS_DSK_DRIVER *rcself;
+	long offset;
+	char *filename;
+	char curname[20];
+	unsigned char *buffer, *dest;
+	unsigned bufsize, n;
+	dsk_err_t err = DSK_ERR_OK;
+	dsk_lsect_t lsect;
+	FILE *fp = NULL;
+	int fr;
+
+	if (!buf || !self || !geom || self->dr_class != &dc_rcpmfs) return DSK_ERR_BADPTR;
+	rcself = (RCPMFS_DSK_DRIVER *)self;
+
+	if (geom->dg_datarate != rcself->rc_geom.dg_datarate)
+		return DSK_ERR_NOADDR;
+
+	curname[0] = 0;
+	for (n = 0; n < count; n++)
+	{
+		dest = ((unsigned char *)buf) + n * rcself->rc_geom.dg_secsize;
+
+		err = rcpmfs_psfind(rcself, cylinder, head, sector + n,
+				&filename, &offset, &buffer, &lsect, &bufsize);
+		if (err) break;
+
+		memset(dest, 0xE5, rcself->rc_geom.dg_secsize);
+		if (buffer)
+		{
+			memcpy(dest, buffer, rcself->rc_geom.dg_secsize);
+			continue;
+		}
+		if (!filename) continue;	/* Blank sector */
+
+		if (!fp || strcmp(curname, filename))
+		{
+			if (fp) fclose(fp);
+			strncpy(curname, filename, sizeof(curname) - 1);
+			curname[sizeof(curname) - 1] = 0;
+			fp = fopen(rcpmfs_mkname(rcself, curname), "rb");
+			if (!fp) continue;
+		}
+		if (fseek(fp, offset, SEEK_SET))
+		{
+			err = DSK_ERR_SYSERR;
+			break;
+		}
+/* As in rcpmfs_read(), a short read pads the last record with 0x1A */
+		fr = fread(dest, 1, rcself->rc_geom.dg_secsize, fp);
+		if (fr < (int)rcself->rc_geom.dg_secsize)
+		{
+			if (fr & 0x7F)
+			{
+				memset(dest + fr, 0x1A, 0x80 - (fr & 0x7F));
+			}
+		}
+	}
+	if (fp) fclose(fp);
+	return err;
+}
+
+
 static void dump_dirent(unsigned char *entry)
 {
 	int n;
@@ -2024,6 +2099,7 @@ dsk_err_t rcpmfs_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 	unsigned dir_entries;   /* Dir entries per sector */
 	unsigned dir_first;
 	unsigned entry;
+	unsigned long changed = 0;	/* Changed dir entries, 32 at a time */
 	unsigned char *new, *old;
 	unsigned bufsize;
 
@@ -2052,17 +2128,25 @@ dsk_err_t rcpmfs_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 		dir_entries  = (rcself->rc_geom.dg_secsize / 32);
 		dir_first	= lsect * dir_entries;
 
+		/* Find the changed entries 32 at a time, most directory
+		 * writes change only one of them */
 		for (entry = 0; entry < dir_entries; entry++)
 		{
+			if (!(entry & 31))
+			{
+				changed = dsk_simd_recdiff(
+					(unsigned char *)buffer + 32 * entry,
+					(unsigned char *)buf + 32 * entry,
+					dir_entries - entry);
+			}
+			if (!(changed & (1UL << (entry & 31)))) continue;
+
 			new = ((unsigned char *)buf) + 32 * entry;
 			old = ((unsigned char *)buffer) + 32 * entry;
 
-			if (memcmp(old, new, 32))
-			{
-				err = rcpmfs_chgdir(rcself, entry + dir_first,
-						old, new);
-				if (err) return err;
-			}
+			err = rcpmfs_chgdir(rcself, entry + dir_first,
+					old, new);
+			if (err) return err;
 		}
 		memcpy(buffer, buf, rcself->rc_geom.dg_secsize);
 	RTR_CHAIN("rcpmfs_write1", rcself->rc_bufhead);
@@ -2100,6 +2184,77 @@ dsk_err_t rcpmfs_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 
 
 
+/* Write a run of sectors to one track. Plain file data goes through one
+ * open host file; directory sectors, buffered sectors and sectors not yet
+ * owned by a file are handed to rcpmfs_write(), since they can change the
+ * mapping of the sectors that follow them. */
+dsk_err_t rcpmfs_mwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+			const void *buf, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	RCPMFS_DSK_DRIVER *rcself;
+	long offset;
+	char *filename;
+	char curname[20];
+	unsigned char *buffer;
+	const unsigned char *src;
+	unsigned bufsize, n;
+	unsigned long dir_sectors;
+	dsk_err_t err = DSK_ERR_OK;
+	dsk_lsect_t lsect;
+	FILE *fp = NULL;
+
+	if (!buf || !self || !geom || self->dr_class != &dc_rcpmfs) return DSK_ERR_BADPTR;
+	rcself = (RCPMFS_DSK_DRIVER *)self;
+
+	if (geom->dg_datarate != rcself->rc_geom.dg_datarate)
+		return DSK_ERR_NOADDR;
+
+	dir_sectors = rcpmfs_secperblock(rcself) * rcself->rc_dirblocks;
+	curname[0] = 0;
+	for (n = 0; n < count; n++)
+	{
+		src = ((const unsigned char *)buf) + n * rcself->rc_geom.dg_secsize;
+
+		err = rcpmfs_psfind(rcself, cylinder, head, sector + n,
+				&filename, &offset, &buffer, &lsect, &bufsize);
+		if (err) break;
+
+		if (buffer || !filename || lsect < dir_sectors ||
+		    bufsize < rcself->rc_geom.dg_secsize)
+		{
+			if (fp)
+			{
+				fclose(fp);
+				fp = NULL;
+			}
+			err = rcpmfs_write(self, geom, src, cylinder, head,
+					sector + n);
+			if (err) break;
+			continue;
+		}
+		if (!fp || strcmp(curname, filename))
+		{
+			if (fp) fclose(fp);
+			strncpy(curname, filename, sizeof(curname) - 1);
+			curname[sizeof(curname) - 1] = 0;
+			fp = fopen(rcpmfs_mkname(rcself, curname), "r+b");
+			if (!fp) fp = fopen(rcpmfs_mkname(rcself, curname), "wb");
+			if (!fp) continue;
+		}
+		err = rcpmfs_wrseek(fp, offset);
+		if (err) break;
+		if (fwrite(src, 1, bufsize, fp) < bufsize)
+		{
+			err = DSK_ERR_SYSERR;
+			break;
+		}
+	}
+	if (fp) fclose(fp);
+	return err;
+}
+
+
 dsk_err_t rcpmfs_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 			dsk_pcyl_t cylinder, dsk_phead_t head,
 			const DSK_FORMAT *format, unsigned char filler)
@@ -670,16 +670,16 @@ static dsk_err_t tele_datarate(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
  */
 static int type2_repeats(tele_byte *src, size_t remaining, size_t patlen)
 {
-	int count = 0;
-	int pos = patlen;	/* Start looking patlen bytes in */
+	size_t count;
 
-	for (pos = patlen; pos + patlen <= remaining; pos += patlen)
-	{
-		if (memcmp(src, src + pos, patlen)) break;
-		count++;
-		if (count == 0xFE) break;	/* Can't have > 255 repeats */
-	}
-	return count + 1;	
+	if (remaining < 2 * patlen) return 1;
+
+	/* The pattern repeats as long as each byte matches the byte patlen
+	 * bytes before it */
+	count = dsk_simd_mismatch(src, src + patlen, remaining - patlen) 
+		/ patlen;
+	if (count > 0xFE) count = 0xFE;	/* Can't have > 255 repeats */
+	return (int)count + 1;	
 }
 
 
@@ -28,7 +28,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pread(DSK_DRIVER *self, const DSK_GEOMETRY *
 {
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
-	unsigned n, m;
+	unsigned n;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -46,10 +46,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pread(DSK_DRIVER *self, const DSK_GEOMETRY *
 		/* If flagged to complement bytes, complement them */
 		if (geom->dg_fm & RECMODE_COMPLEMENT)
 		{
-			for (m = 0; m < geom->dg_secsize; m++)
-			{
-				((char *)buf)[m] = ~((char *)buf)[m];
-			}
+			dsk_simd_invert(buf, buf, geom->dg_secsize);
 		}	
 /* 		LDTRACE(("  err=%d\n", e)); */
 		if (!DSK_TRANSIENT_ERROR(e)) return e; 
@@ -79,7 +76,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 {
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
-	unsigned n, m;
+	unsigned n;
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
 	dc = self->dr_class;
@@ -98,10 +95,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 			/* If flagged to complement bytes, complement them */
 		if (geom->dg_fm & RECMODE_COMPLEMENT)
 		{
-			for (m = 0; m < sector_len; m++)
-			{
-				((char *)buf)[m] = ~((char *)buf)[m];
-			}
+			dsk_simd_invert(buf, buf, sector_len);
 		}
 		/* LDTRACE(("  err=%d\n", e)); */
 		if (!DSK_TRANSIENT_ERROR(e)) return e;
@@ -109,3 +103,90 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 	return e;
 }
 
+
+
+/* Multi-sector reads are only passed to a driver class that also provides
+ * the single-sector read in use; a subclass that overrides dc_read without
+ * overriding dc_mread must not be bypassed. */
+static DRV_CLASS *mread_class(DRV_CLASS *dc)
+{
+	DRV_CLASS *rc = dc;
+
+	WALK_VTABLE(rc, dc_read)
+	WALK_VTABLE(dc, dc_mread)
+	if (!dc->dc_mread || dc != rc) return NULL;
+	return dc;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pmread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count)
+{
+	DRV_CLASS *dc;
+	dsk_err_t e = DSK_ERR_UNKNOWN;
+	unsigned n;
+	size_t len;
+
+	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
+	if (!count) return DSK_ERR_OK;
+
+	dc = mread_class(self->dr_class);
+	if (!dc)
+	{
+		/* No multi-sector support; go one sector at a time */
+		for (n = 0; n < count; n++)
+		{
+			e = dsk_pread(self, geom, 
+				((char *)buf) + n * geom->dg_secsize,
+				cylinder, head, sector + n);
+			if (e) return e;
+		}
+		return DSK_ERR_OK;
+	}
+	len = (size_t)count * geom->dg_secsize;
+	for (n = 0; n < self->dr_retry_count; n++)
+	{
+		e = (dc->dc_mread)(self,geom,buf,cylinder,head,sector,count);
+		/* If flagged to complement bytes, complement them */
+		if (geom->dg_fm & RECMODE_COMPLEMENT)
+		{
+			dsk_simd_invert(buf, buf, len);
+		}	
+		if (!DSK_TRANSIENT_ERROR(e)) return e; 
+	}
+	return e;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_lmread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_lsect_t sector, unsigned count)
+{
+        dsk_pcyl_t  c;
+        dsk_phead_t h;
+        dsk_psect_t s;
+        dsk_err_t e;
+	unsigned run;
+
+	if (!geom) return DSK_ERR_BADPTR;
+	if (!geom->dg_sectors) return DSK_ERR_DIVZERO;
+
+	/* Split the request into runs that don't cross a track boundary */
+	while (count)
+	{
+		e = dg_ls2ps(geom, sector, &c, &h, &s);
+		if (e != DSK_ERR_OK) return e;
+
+		run = geom->dg_sectors - (unsigned)(sector % geom->dg_sectors);
+		if (run > count) run = count;
+
+		e = dsk_pmread(self, geom, buf, c, h, s, run);
+		if (e != DSK_ERR_OK) return e;
+
+		buf = ((char *)buf) + run * geom->dg_secsize;
+		sector += run;
+		count  -= run;
+	}
+	return DSK_ERR_OK;
+}
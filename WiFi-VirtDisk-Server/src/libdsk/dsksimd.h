@@ -0,0 +1,64 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2025  Welzel-Online                                    *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Kernels for whole sectors, with SSE2 and AVX2 versions. The fastest
+ * version the CPU supports is chosen on the first call; other CPUs and
+ * compilers use the plain C version. */
+
+#ifndef DSKSIMD_H
+#define DSKSIMD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSK_SIMD_SCALAR	0
+#define DSK_SIMD_SSE2	1
+#define DSK_SIMD_AVX2	2
+
+/* Version in use. dsk_simd_setlevel() limits it to what the CPU supports
+ * and returns the version actually used; for benchmarks and tests. */
+int dsk_simd_level(void);
+int dsk_simd_setlevel(int level);
+
+/* Copy len bytes from src to dest, complemented. src may equal dest. */
+void dsk_simd_invert(void *dest, const void *src, size_t len);
+
+/* Return 1 if all len bytes of buf are 'fill', else 0 */
+int dsk_simd_isfill(const void *buf, size_t len, unsigned char fill);
+
+/* Return the offset of the first byte where a and b differ, len if they
+ * are the same. With b = a + n this is the length of a repeating n-byte
+ * pattern at a, less n. */
+size_t dsk_simd_mismatch(const void *a, const void *b, size_t len);
+
+/* Compare 'records' 32-byte records (at most 32) of a and b. Bit n of the
+ * result is set if record n differs. */
+unsigned long dsk_simd_recdiff(const void *a, const void *b, unsigned records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSKSIMD_H */
@@ -44,11 +44,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_ptread(DSK_DRIVER *self, const DSK_GEOMETRY
 		 * complement will take place in dsk_pread() ) */
 		if (geom->dg_fm & RECMODE_COMPLEMENT)
 		{
-			for (sec = 0; sec < geom->dg_sectors * geom->dg_secsize;
-				sec++)
-			{
-				((char *)buf)[sec] = ~((char *)buf)[sec];
-			}
+			dsk_simd_invert(buf, buf, 
+				(size_t)geom->dg_sectors * geom->dg_secsize);
 		}
 
 		if (err != DSK_ERR_NOTIMPL) return err;
@@ -102,11 +99,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xtread(DSK_DRIVER *self, const DSK_GEOMETRY
 		 * complement will take place in dsk_pread() ) */
 		if (geom->dg_fm & RECMODE_COMPLEMENT)
 		{
-			for (sec = 0; sec < geom->dg_sectors * geom->dg_secsize;
-				sec++)
-			{
-				((char *)buf)[sec] = ~((char *)buf)[sec];
-			}
+			dsk_simd_invert(buf, buf, 
+				(size_t)geom->dg_sectors * geom->dg_secsize);
 		}
 
 		if (err != DSK_ERR_NOTIMPL) return err;
@@ -29,7 +29,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 {
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
-	unsigned n, m;
+	unsigned n;
 	unsigned char *inv_buf = NULL;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
@@ -48,8 +48,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 		inv_buf = dsk_malloc(geom->dg_secsize);
 	
 		if (!inv_buf) return DSK_ERR_NOMEM;
-		for (m = 0; m < geom->dg_secsize; m++) 
-			inv_buf[m] = ~((char *)buf)[m];
+		dsk_simd_invert(inv_buf, buf, geom->dg_secsize);
 		buf = inv_buf;
 	}
 
@@ -95,7 +94,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 {
         DRV_CLASS *dc;
 	dsk_err_t err = DSK_ERR_UNKNOWN;
-	unsigned n, m;
+	unsigned n;
 	unsigned char *inv_buf = NULL;
 
         if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
@@ -113,8 +112,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 		inv_buf = dsk_malloc(sector_len);
 	
 		if (!inv_buf) return DSK_ERR_NOMEM;
-		for (m = 0; m < sector_len; m++) 
-			inv_buf[m] = ~((char *)buf)[m];
+		dsk_simd_invert(inv_buf, buf, sector_len);
 		buf = inv_buf;
 	}
 	for (n = 0; n < self->dr_retry_count; n++)
@@ -132,3 +130,103 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 	return err;
 }
                                                                                         
+
+
+/* See mread_class() in dskread.c */
+static DRV_CLASS *mwrite_class(DRV_CLASS *dc)
+{
+	DRV_CLASS *wc = dc;
+
+	WALK_VTABLE(wc, dc_write)
+	WALK_VTABLE(dc, dc_mwrite)
+	if (!dc->dc_mwrite || dc != wc) return NULL;
+	return dc;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pmwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+			      unsigned count)
+{
+	DRV_CLASS *dc;
+	dsk_err_t e = DSK_ERR_UNKNOWN;
+	unsigned n;
+	size_t len;
+	unsigned char *inv_buf = NULL;
+
+	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
+
+	if (self && self->dr_compress && self->dr_compress->cd_readonly)
+		return DSK_ERR_RDONLY;
+	if (!count) return DSK_ERR_OK;
+
+	dc = mwrite_class(self->dr_class);
+	if (!dc)
+	{
+		/* No multi-sector support; go one sector at a time */
+		for (n = 0; n < count; n++)
+		{
+			e = dsk_pwrite(self, geom, 
+				((const char *)buf) + n * geom->dg_secsize,
+				cylinder, head, sector + n);
+			if (e) return e;
+		}
+		return DSK_ERR_OK;
+	}
+
+	len = (size_t)count * geom->dg_secsize;
+	/* If we are storing the complement, generate complemented sectors */
+	if (geom->dg_fm & RECMODE_COMPLEMENT)
+	{
+		inv_buf = dsk_malloc(len);
+	
+		if (!inv_buf) return DSK_ERR_NOMEM;
+		dsk_simd_invert(inv_buf, buf, len);
+		buf = inv_buf;
+	}
+
+	for (n = 0; n < self->dr_retry_count; n++)
+	{
+		e = (dc->dc_mwrite)(self,geom,buf,cylinder,head,sector,count); 
+		if (e == DSK_ERR_OK) self->dr_dirty = 1;
+		if (!DSK_TRANSIENT_ERROR(e)) break;
+	}
+	if (inv_buf != NULL) dsk_free(inv_buf);
+	return e;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_lmwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_lsect_t sector,
+			      unsigned count)
+{
+        dsk_pcyl_t  c;
+        dsk_phead_t h;
+        dsk_psect_t s;
+        dsk_err_t e;
+	unsigned run;
+
+        if (self && self->dr_compress && self->dr_compress->cd_readonly)
+                return DSK_ERR_RDONLY;
+	if (!geom) return DSK_ERR_BADPTR;
+	if (!geom->dg_sectors) return DSK_ERR_DIVZERO;
+
+	/* Split the request into runs that don't cross a track boundary */
+	while (count)
+	{
+		e = dg_ls2ps(geom, sector, &c, &h, &s);
+		if (e != DSK_ERR_OK) return e;
+
+		run = geom->dg_sectors - (unsigned)(sector % geom->dg_sectors);
+		if (run > count) run = count;
+
+		e = dsk_pmwrite(self, geom, buf, c, h, s, run);
+		if (e != DSK_ERR_OK) return e;
+
+		buf = ((const char *)buf) + run * geom->dg_secsize;
+		sector += run;
+		count  -= run;
+	}
+	return DSK_ERR_OK;
+}
@@ -136,13 +136,26 @@ typedef struct ldbs
 	int idmapmax;
 #endif
 	LDBS_TRACKDIR *dir;
+	/* In-memory index of the track directory, not persisted. Maps 
+	 * (cylinder, head) to 1 + the position of that track's entry in 
+	 * 'dir', or 0 if the track is not present. */
+	unsigned short *trackidx;
+	unsigned trackidx_cyls;
+	unsigned trackidx_heads;
+	int trackidx_ok;	/* Nonzero if trackidx can be trusted */
 } LDBS;
 
+/* Don't index directories with more than this many tracks; fall back to 
+ * searching the directory instead. */
+#define TRACKIDX_MAX 65536L
+
 static const unsigned char FREEBLOCK[4] = {0,0,0,0};
 static const unsigned char USEDBLOCK[4] = {0,1,0,1};
 
 static dsk_err_t ldbs_get_trackdir(PLDBS self, LDBS_TRACKDIR **pdir, LDBLOCKID blockid);
 static dsk_err_t ldbs_put_trackdir(PLDBS self, LDBS_TRACKDIR *dir, LDBLOCKID *blkid);
+static void ldbs_trackidx_build(PLDBS self);
+static void ldbs_trackidx_free(PLDBS self);
 
 
 #define TMPDIR "/tmp"
@@ -635,6 +648,7 @@ dsk_err_t ldbs_new(PLDBS *result, const char *filename, const char *type)
 			free(pres);
 			err = DSK_ERR_NOMEM;	
 		}
+		else temp.trackidx_ok = 1;
 	}
 
 	if (err)
@@ -726,6 +740,7 @@ dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type,
 	{
 		temp.version = temp.header.subtype[3];
 		err = ldbs_get_trackdir(&temp, &temp.dir, temp.header.trackdir);
+		if (!err) ldbs_trackidx_build(&temp);
 	}
 	if (err)
 	{
@@ -870,6 +885,7 @@ dsk_err_t ldbs_close(PLDBS *self)
 		}
 	}
 	if (self[0]->dir)   ldbs_free(self[0]->dir);
+	ldbs_trackidx_free(self[0]);
 #if LDBS_TEMP_IN_MEM
 	if (self[0]->idmap) ldbs_free(self[0]->idmap);
 #endif
@@ -1438,6 +1454,7 @@ dsk_err_t ldbs_clear(PLDBS self)
 		ldbs_free(self->dir);
 		self->dir = NULL;
 	}
+	ldbs_trackidx_free(self);
 	self->header.trackdir = 0;	
 	self->header.dirty = 1;
 	return err;
@@ -1606,6 +1623,7 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 			ldbs_free(dest->dir);
 			dest->dir = NULL;
 		}
+		ldbs_trackidx_free(dest);
 
 /* Remap the block IDs in the directory */
 		err = ldbs_get_trackdir(dest, &dest->dir, 
@@ -1643,7 +1661,7 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 				if (err) break;
 			}
 			dest->dir->dirty = 1;
-			
+			if (!err) ldbs_trackidx_build(dest);
 		}
 	}
 	if (!err)
@@ -1819,6 +1837,127 @@ static dsk_err_t ldbs_put_trackdir(PLDBS self, LDBS_TRACKDIR *dir, LDBLOCKID *bl
 	return err;
 }
 
+/* Discard the track index. Until it is rebuilt, lookups search the 
+ * track directory. */
+static void ldbs_trackidx_free(PLDBS self)
+{
+	if (self->trackidx) ldbs_free(self->trackidx);
+	self->trackidx = NULL;
+	self->trackidx_cyls = 0;
+	self->trackidx_heads = 0;
+	self->trackidx_ok = 0;
+}
+
+
+/* Record that the track directory entry at position 'slot' holds track
+ * (cylinder, head), growing the index if necessary. If the index would 
+ * become too big, or can't be grown, drop it. */
+static void ldbs_trackidx_set(PLDBS self, dsk_pcyl_t cylinder,
+		dsk_phead_t head, unsigned slot)
+{
+	unsigned short *idx;
+	unsigned cyls, heads, c, h;
+
+	if (!self->trackidx_ok) return;
+
+	if (cylinder >= self->trackidx_cyls || head >= self->trackidx_heads)
+	{
+		cyls  = self->trackidx_cyls;
+		heads = self->trackidx_heads;
+		if (cylinder >= cyls) cyls  = cylinder + 1;
+		if (head     >= heads) heads = head + 1;
+
+		idx = NULL;
+		if ((long)cyls * heads <= TRACKIDX_MAX)
+		{
+			idx = ldbs_malloc(cyls * heads * sizeof(unsigned short));
+		}
+		if (!idx)
+		{
+			ldbs_trackidx_free(self);
+			return;
+		}
+		memset(idx, 0, cyls * heads * sizeof(unsigned short));
+		for (c = 0; c < self->trackidx_cyls; c++)
+		{
+			for (h = 0; h < self->trackidx_heads; h++)
+			{
+				idx[c * heads + h] = 
+				self->trackidx[c * self->trackidx_heads + h];
+			}
+		}
+		if (self->trackidx) ldbs_free(self->trackidx);
+		self->trackidx = idx;
+		self->trackidx_cyls  = cyls;
+		self->trackidx_heads = heads;
+	}
+	self->trackidx[cylinder * self->trackidx_heads + head] = slot + 1;
+}
+
+
+/* (Re)build the track index from the track directory */
+static void ldbs_trackidx_build(PLDBS self)
+{
+	unsigned n;
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+
+	ldbs_trackidx_free(self);
+	if (!self->dir) return;
+
+	self->trackidx_ok = 1;
+	for (n = 0; n < self->dir->count && self->trackidx_ok; n++)
+	{
+		if (ldbs_decode_trackid(self->dir->entry[n].id, &c, &h))
+		{
+			ldbs_trackidx_set(self, c, h, n);
+		}
+	}
+}
+
+
+/* Find the position of a block type in the track directory, or -1 if it 
+ * isn't there. Tracks are looked up in the index; anything else, or any
+ * track if the index has been dropped, means a search of the directory. */
+static int ldbs_dir_slot(PLDBS self, const char type[4])
+{
+	unsigned n;
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+
+	if (self->trackidx_ok && ldbs_decode_trackid(type, &c, &h))
+	{
+		if (c >= self->trackidx_cyls || h >= self->trackidx_heads)
+			return -1;
+		n = self->trackidx[c * self->trackidx_heads + h];
+		/* The entry may since have been deleted */
+		if (n == 0 || memcmp(self->dir->entry[n - 1].id, type, 4))
+			return -1;
+		return n - 1;
+	}
+	for (n = 0; n < self->dir->count; n++)
+	{
+		if (!memcmp(self->dir->entry[n].id, type, 4)) return n;
+	}
+	return -1;
+}
+
+
+/* As ldbs_trackdir_find(), but for the blockstore's own directory, so that
+ * the track index can be used. */
+static dsk_err_t ldbs_dir_find(PLDBS self, const char type[4], 
+		LDBLOCKID *result)
+{
+	int slot;
+
+	if (!self->dir || !type || !result) return DSK_ERR_BADPTR;
+
+	slot = ldbs_dir_slot(self, type);
+	*result = (slot < 0) ? LDBLOCKID_NULL : self->dir->entry[slot].blockid;
+	return DSK_ERR_OK;
+}
+
+
 /* Treat secsize values of 9 and higher as though they were 8. This stops
  * libdsk crashing on disk images with funny PSH values, and matches how 
  * the real uPD765A handles sizes >= 8. */
@@ -1853,7 +1992,7 @@ dsk_err_t ldbs_get_trackhead(PLDBS self, LDBS_TRACKHEAD **trkh,
 	{
 		return DSK_ERR_NOTME;
 	}
-	err = ldbs_trackdir_find(self->dir, type, &blkid);
+	err = ldbs_dir_find(self, type, &blkid);
 	if (err) return err;
 
 	/* Not found */
@@ -2055,7 +2194,7 @@ dsk_err_t ldbs_getblock_d(PLDBS self, const char *type,
 	 * (there must be a directory) */
 	if (!self->dir) return DSK_ERR_NOTME;
 
-	err = ldbs_trackdir_find(self->dir, type, &blkid);
+	err = ldbs_dir_find(self, type, &blkid);
 	if (err) return err;
 
 	return ldbs_getblock(self, blkid, NULL, data, len);
@@ -2074,7 +2213,7 @@ dsk_err_t ldbs_getblock_da(PLDBS self, const char *type,
 	 * (there must be a directory) */
 	if (!self->dir) return DSK_ERR_NOTME;
 
-	err = ldbs_trackdir_find(self->dir, type, &blkid);
+	err = ldbs_dir_find(self, type, &blkid);
 	if (err) return err;
 
 	return ldbs_getblock_a(self, blkid, NULL, data, len);
@@ -2093,13 +2232,15 @@ dsk_err_t ldbs_putblock_d(PLDBS self, const char *type,
 	LDBLOCKID blkid = LDBLOCKID_NULL;
 	dsk_err_t err;
 	int n;
+	dsk_pcyl_t c;
+	dsk_phead_t h;
 
 	if (!self || !type) return DSK_ERR_BADPTR;
 	/* See if the object already exists in the directory 
 	 * (there must be a directory) */
 	if (!self->dir) return DSK_ERR_NOTME;
 
-	err = ldbs_trackdir_find(self->dir, type, &blkid);
+	err = ldbs_dir_find(self, type, &blkid);
 	if (err) return err;
 
 	if (data == NULL)
@@ -2114,28 +2255,39 @@ dsk_err_t ldbs_putblock_d(PLDBS self, const char *type,
 	if (err) return err;
 
 	/* Object updated. Keep the directory in sync. */
-	for (n = 0; n < self->dir->count; n++)
+	n = ldbs_dir_slot(self, type);
+	/* Is there an existing entry? */
+	if (n >= 0)
 	{
-		/* Is there an existing entry? */
-		if (!memcmp(self->dir->entry[n].id, type, 4))
+		if (self->dir->entry[n].blockid != blkid)
 		{
-			if (self->dir->entry[n].blockid != blkid)
-			{
-				self->dir->entry[n].blockid = blkid;
+			self->dir->entry[n].blockid = blkid;
 	/* If blockid has become 0 (block deleted) remove that directory 
 	 * entry */
-				if (blkid == LDBLOCKID_NULL)
-				{
-					memcpy(self->dir->entry[n].id, 
-							FREEBLOCK, 4);
-				}
-				self->dir->dirty = 1;	
+			if (blkid == LDBLOCKID_NULL)
+			{
+				memcpy(self->dir->entry[n].id, FREEBLOCK, 4);
 			}
-			return DSK_ERR_OK;
-		} 
-	}
+			self->dir->dirty = 1;	
+		}
+		return DSK_ERR_OK;
+	} 
 	/* No existing entry found. Add to directory */
-	return ldbs_trackdir_add(&self->dir, type, blkid);
+	err = ldbs_trackdir_add(&self->dir, type, blkid);
+	if (err) return err;
+	/* and to the index, if it's a track */
+	if (self->trackidx_ok && ldbs_decode_trackid(type, &c, &h))
+	{
+		for (n = 0; n < self->dir->count; n++)
+		{
+			if (!memcmp(self->dir->entry[n].id, type, 4))
+			{
+				ldbs_trackidx_set(self, c, h, n);
+				break;
+			}
+		}
+	}
+	return DSK_ERR_OK;
 }
 
 
@@ -2260,7 +2412,7 @@ dsk_err_t ldbs_get_asciiz(PLDBS self, const char type[4], char **buffer)
 	{
 		return DSK_ERR_NOTME;
 	}
-	err = ldbs_trackdir_find(self->dir, type, &blkid);
+	err = ldbs_dir_find(self, type, &blkid);
 	if (err) return err;
 
 	if (0 == blkid)
@@ -2328,7 +2480,7 @@ dsk_err_t ldbs_get_geometry(PLDBS self, DSK_GEOMETRY *dg)
 	{
 		return DSK_ERR_NOTME;
 	}
-	err = ldbs_trackdir_find(self->dir, LDBS_GEOM_TYPE, &blkid);
+	err = ldbs_dir_find(self, LDBS_GEOM_TYPE, &blkid);
 	if (err) return err;
 
 	if (0 == blkid)
@@ -2397,7 +2549,7 @@ dsk_err_t ldbs_get_dpb(PLDBS self, LDBS_DPB *dpb)
 	{
 		return DSK_ERR_NOTME;
 	}
-	err = ldbs_trackdir_find(self->dir, LDBS_DPB_TYPE, &blkid);
+	err = ldbs_dir_find(self, LDBS_DPB_TYPE, &blkid);
 	if (err) return err;
 
 	if (0 == blkid)
@@ -25,5 +25,6 @@
 #include "rpcwin32.h"	/* Win32 Serial API */
 #include "rpcfossl.h"	/* MSDOS FOSSIL */
 #include "rpcfork.h"	/* FORK/PIPE */
+#include "rpctcp.h"	/* TCP/IP sockets */
 
 
@@ -52,7 +52,11 @@ DRV_CLASS dc_remote =
 	remote_option_set,
 	remote_option_get,
 	remote_trackids,
-	remote_rtread
+	remote_rtread,
+	NULL,		/* to_ldbs */
+	NULL,		/* from_ldbs */
+	remote_mread,
+	remote_mwrite
 };
 
 /* All classes of remote driver */
@@ -448,6 +452,86 @@ dsk_err_t remote_trackids(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 			geom, cylinder, head, count, result);
 }
 
+/* Read several sectors. If the other end doesn't know RPC_DSK_PMREAD, fall
+ * back to one RPC per sector. */
+dsk_err_t remote_mread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count)
+{
+	RPCFUNC function;
+	unsigned run, maxrun;
+	dsk_err_t err;
+
+	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
+	function = self->dr_remote->rd_class->rc_call;
+
+	if (!implements(self, RPC_DSK_PMREAD))
+	{
+		for (; count; count--)
+		{
+			err = remote_read(self, geom, buf, cylinder, head, 
+					sector++);
+			if (err) return err;
+			buf = ((unsigned char *)buf) + geom->dg_secsize;
+		}
+		return DSK_ERR_OK;
+	}
+	maxrun = geom->dg_secsize ? RPC_MULTI_MAX / geom->dg_secsize : 0;
+	if (maxrun == 0) maxrun = 1;
+	while (count)
+	{
+		run = (count > maxrun) ? maxrun : count;
+		err = dsk_r_mread(self, function, self->dr_remote->rd_handle,
+			geom, buf, cylinder, head, sector, run);
+		if (err) return err;
+		buf = ((unsigned char *)buf) + run * geom->dg_secsize;
+		sector += run;
+		count  -= run;
+	}
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t remote_mwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count)
+{
+	RPCFUNC function;
+	unsigned run, maxrun;
+	dsk_err_t err;
+
+	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
+	function = self->dr_remote->rd_class->rc_call;
+
+	if (!implements(self, RPC_DSK_PMWRITE))
+	{
+		for (; count; count--)
+		{
+			err = remote_write(self, geom, buf, cylinder, head, 
+					sector++);
+			if (err) return err;
+			buf = ((const unsigned char *)buf) + geom->dg_secsize;
+		}
+		return DSK_ERR_OK;
+	}
+	maxrun = geom->dg_secsize ? RPC_MULTI_MAX / geom->dg_secsize : 0;
+	if (maxrun == 0) maxrun = 1;
+	while (count)
+	{
+		run = (count > maxrun) ? maxrun : count;
+		err = dsk_r_mwrite(self, function, self->dr_remote->rd_handle,
+			geom, buf, cylinder, head, sector, run);
+		if (err) return err;
+		buf = ((const unsigned char *)buf) + run * geom->dg_secsize;
+		sector += run;
+		count  -= run;
+	}
+	return DSK_ERR_OK;
+}
+
+
 /* Read raw track, including sector headers */
 dsk_err_t remote_rtread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 		       void *buf, dsk_pcyl_t cylinder,  dsk_phead_t head,
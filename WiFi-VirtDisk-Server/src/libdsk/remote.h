@@ -124,6 +124,16 @@ dsk_err_t remote_trackids(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 			  dsk_pcyl_t cylinder, dsk_phead_t head,
 			  dsk_psect_t *count, DSK_FORMAT **result);
 
+/* Read / write several sectors of one track */
+dsk_err_t remote_mread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count);
+dsk_err_t remote_mwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector,
+                              unsigned count);
+
 /* Read raw track, including sector headers */
 dsk_err_t remote_rtread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 		       void *buf, dsk_pcyl_t cylinder,  dsk_phead_t head,
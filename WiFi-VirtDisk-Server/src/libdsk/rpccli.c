@@ -105,7 +105,6 @@ dsk_err_t dsk_r_read (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, cons
 	int ilen = sizeof ibuf;
 	int olen = sizeof obuf;
 	dsk_err_t err2;
-	unsigned char *buf2;
 
 	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_PREAD);if (err) return err;
 	err = dsk_pack_i32   (&iptr, &ilen, nDriver);  if (err) return err;
@@ -116,12 +115,47 @@ dsk_err_t dsk_r_read (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, cons
 	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
 	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
 	if (err2 == DSK_ERR_UNKRPC) return err2;
-	err = dsk_unpack_bytes(&optr, &olen, &buf2);	   if (err) return err;
-	memcpy(buf, buf2, geom->dg_secsize);
+	err = dsk_unpack_copy (&optr, &olen, buf, geom->dg_secsize);
+	if (err) return (err2 != DSK_ERR_OK) ? err2 : err;
 	return err2;
 }
 
 
+dsk_err_t dsk_r_mread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	unsigned char ibuf[SMALLBUF], *iptr = ibuf;
+	unsigned char *obuf, *optr;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen;
+	dsk_err_t err2;
+	size_t len = (size_t)count * geom->dg_secsize;
+
+	if (len > RPC_MULTI_MAX) return DSK_ERR_BADPARM;
+	olen = (int)len + SMALLBUF;
+	obuf = optr = dsk_malloc(olen);
+	if (!obuf) return DSK_ERR_NOMEM;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_PMREAD);if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);  if (err) goto done;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);       if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, count);        if (err) goto done;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) goto done;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) goto done;
+	if (err2 == DSK_ERR_UNKRPC) { err = err2; goto done; }
+	err = dsk_unpack_copy (&optr, &olen, buf, len);
+	if (!err || err2 != DSK_ERR_OK) err = err2;
+done:
+	dsk_free(obuf);
+	return err;
+}
+
+
 dsk_err_t dsk_r_secid(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, const DSK_GEOMETRY *geom, dsk_pcyl_t cylinder, 
 					  dsk_phead_t head, DSK_FORMAT *result)
 {
@@ -170,6 +204,40 @@ dsk_err_t dsk_r_write(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, cons
 }
 
 
+dsk_err_t dsk_r_mwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector, unsigned count)
+{
+	unsigned char *ibuf, *iptr;
+	unsigned char obuf[SMALLBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+	size_t len = (size_t)count * geom->dg_secsize;
+
+	if (len > RPC_MULTI_MAX) return DSK_ERR_BADPARM;
+	ilen = (int)len + SMALLBUF;
+	ibuf = iptr = dsk_malloc(ilen);
+	if (!ibuf) return DSK_ERR_NOMEM;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_PMWRITE);if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) goto done;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);		   if (err) goto done;
+	err = dsk_pack_bytes (&iptr, &ilen, buf, len);     if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);       if (err) goto done;
+	err = dsk_pack_i32   (&iptr, &ilen, count);        if (err) goto done;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) goto done;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) goto done;
+	err = err2;
+done:
+	dsk_free(ibuf);
+	return err;
+}
+
+
 dsk_err_t dsk_r_format(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, DSK_GEOMETRY *geom, dsk_pcyl_t cylinder, 
 					  dsk_phead_t head, const DSK_FORMAT *format, unsigned char filler)
 {
@@ -279,7 +347,6 @@ dsk_err_t dsk_r_xread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver,
 	int ilen = sizeof ibuf;
 	int olen = sizeof obuf;
 	dsk_err_t err2;
-	unsigned char *buf2;
 	int32 del = deleted ? *deleted : 0;
 
 	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_XREAD);if (err) return err;
@@ -295,9 +362,9 @@ dsk_err_t dsk_r_xread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver,
 	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
 	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
 	if (err2 == DSK_ERR_UNKRPC) return err2;
-	err = dsk_unpack_bytes(&optr, &olen, &buf2);	   if (err) return err;
+	err = dsk_unpack_copy (&optr, &olen, buf, sector_size);
+	if (err) return (err2 != DSK_ERR_OK) ? err2 : err;
 	err = dsk_unpack_i32  (&optr, &olen, &del);        if (err) return err;
-	memcpy(buf, buf2, sector_size);
 	if (deleted) *deleted = del;
 	return err2;
 
@@ -343,7 +410,6 @@ dsk_err_t dsk_r_tread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
 	int ilen = sizeof ibuf;
 	int olen = sizeof obuf;
 	dsk_err_t err2;
-	unsigned char *buf2;
 
 	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_PTREAD);if (err) return err;
 	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) return err;
@@ -353,8 +419,8 @@ dsk_err_t dsk_r_tread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
 	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
 	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
 	if (err2 == DSK_ERR_UNKRPC) return err2;
-	err = dsk_unpack_bytes(&optr, &olen, &buf2);	   if (err) return err;
-	memcpy(buf, buf2, geom->dg_secsize * geom->dg_sectors);
+	err = dsk_unpack_copy (&optr, &olen, buf, geom->dg_secsize * geom->dg_sectors);
+	if (err) return (err2 != DSK_ERR_OK) ? err2 : err;
 	return err2;
 
 }
@@ -372,7 +438,6 @@ dsk_err_t dsk_r_xtread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
 	int ilen = sizeof ibuf;
 	int olen = sizeof obuf;
 	dsk_err_t err2;
-	unsigned char *buf2;
 
 	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_XTREAD);if (err) return err;
 	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) return err;
@@ -384,8 +449,8 @@ dsk_err_t dsk_r_xtread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
 	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
 	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
 	if (err2 == DSK_ERR_UNKRPC) return err2;
-	err = dsk_unpack_bytes(&optr, &olen, &buf2);	   if (err) return err;
-	memcpy(buf, buf2, geom->dg_secsize * geom->dg_sectors);
+	err = dsk_unpack_copy (&optr, &olen, buf, geom->dg_secsize * geom->dg_sectors);
+	if (err) return (err2 != DSK_ERR_OK) ? err2 : err;
 	return err2;
 }
 
@@ -577,7 +642,6 @@ dsk_err_t dsk_r_rtread(DSK_DRIVER *self, RPCFUNC func, unsigned nDriver,
 	int ilen = sizeof ibuf;
 	int olen = sizeof obuf;
 	dsk_err_t err2;
-	unsigned char *buf2;
 	int32 buflen;
 
 	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_RTREAD);if (err) return err;
@@ -590,8 +654,9 @@ dsk_err_t dsk_r_rtread(DSK_DRIVER *self, RPCFUNC func, unsigned nDriver,
 	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
 	if (err2 == DSK_ERR_UNKRPC) return err2;
 	err = dsk_unpack_i32  (&optr, &olen, &buflen);	   if (err) return err;
-	err = dsk_unpack_bytes(&optr, &olen, &buf2);	   if (err) return err;
-	memcpy(buf, buf2, buflen); 
+	if (buflen < 0) return DSK_ERR_RPC;
+	err = dsk_unpack_copy (&optr, &olen, buf, buflen);
+	if (err) return (err2 != DSK_ERR_OK) ? err2 : err;
 	*bufsize = buflen;
 	return err2;
 }
@@ -77,6 +77,14 @@ typedef unsigned long  int32;
 #define RPC_DSK_PROPERTIES      139
 #define RPC_DSK_GETCOMMENT	140
 #define RPC_DSK_SETCOMMENT	141
+/* Several consecutive sectors of one track in a single exchange, so that
+ * a whole-track transfer does not cost one round trip per sector */
+#define RPC_DSK_PMREAD		142
+#define RPC_DSK_PMWRITE		143
+
+/* Maximum amount of sector data carried by one RPC_DSK_PMREAD or 
+ * RPC_DSK_PMWRITE. Larger requests are split by the client. */
+#define RPC_MULTI_MAX		16384
 
 typedef dsk_err_t (*RPCFUNC)(DSK_PDRIVER pDriver,
 			unsigned char *input,  int inp_len,
@@ -103,6 +111,8 @@ dsk_err_t dsk_unpack_i32   (unsigned char **input, int *inp_len,
 				int32 *function);
 dsk_err_t dsk_unpack_bytes (unsigned char **input, int *inp_len, 
 				unsigned char **buf);
+dsk_err_t dsk_unpack_copy  (unsigned char **input, int *inp_len, 
+				void *buf, size_t len);
 dsk_err_t dsk_unpack_string(unsigned char **input, int *inp_len, char **buf);
 dsk_err_t dsk_unpack_geom  (unsigned char **input, int *inp_len, 
 				DSK_GEOMETRY *g);
@@ -120,6 +130,12 @@ dsk_err_t dsk_r_read (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver,
 dsk_err_t dsk_r_write(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
 		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
 		dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t dsk_r_mread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector, unsigned count);
+dsk_err_t dsk_r_mwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector, unsigned count);
 dsk_err_t dsk_r_format(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
 		DSK_GEOMETRY *geom, dsk_pcyl_t cylinder, dsk_phead_t head, 
 		const DSK_FORMAT *format, unsigned char filler);
@@ -92,6 +92,23 @@ dsk_err_t dsk_unpack_bytes(unsigned char **input, int *inp_len, unsigned char **
 	return DSK_ERR_OK;
 	}
 
+/* Copy a memory block of at least len bytes to buf. A shorter block (or
+ * the empty block sent with an error) is DSK_ERR_RPC and buf is not
+ * touched. */
+dsk_err_t dsk_unpack_copy(unsigned char **input, int *inp_len, void *buf, size_t len)
+	{
+	dsk_err_t err;
+	int16 blen;
+
+	err = dsk_unpack_i16(input, inp_len, &blen); if (err) return err;
+	if (blen < 0 || inp_len[0] < (int)blen) return DSK_ERR_RPC;
+	if ((size_t)blen >= len) memcpy(buf, *input, len);
+	(*input)   += blen;
+	(*inp_len) -= blen;
+
+	return ((size_t)blen >= len) ? DSK_ERR_OK : DSK_ERR_RPC;
+	}
+
 /* Strings are stored as memory blocks */
 dsk_err_t dsk_unpack_string(unsigned char **input, int *inp_len, char **buf)
 	{
@@ -47,6 +47,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 	dsk_psect_t rcount;
 	DSK_FORMAT *trkids;
 	unsigned int nDriver, n;
+	int blen;
 	unsigned char secbuf[8192], *pbuf;
 	unsigned char status;
 	int deleted, value;
@@ -96,15 +97,64 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 		case RPC_DSK_PWRITE:
 				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
 				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				blen = inp_len;
 				err = dsk_unpack_bytes(&input, &inp_len, &pbuf);  if (err) return err;
+				blen -= inp_len + 2;	/* Less the length word */
 				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
 				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
 				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
 				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				/* The driver reads dg_secsize bytes from pbuf */
+				if (blen < (int)geom.dg_secsize)
+				{
+					return dsk_pack_err(&output, out_len, DSK_ERR_BADPARM);
+				}
 				err2= dsk_pwrite(pDriver, &geom, pbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_psect_t)int3);
 				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
 				return DSK_ERR_OK;
 
+		case RPC_DSK_PMREAD:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int4);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (int4 < 0 || (long)int4 * geom.dg_secsize > RPC_MULTI_MAX)
+				{
+					err = dsk_pack_err(&output, out_len, DSK_ERR_BADPARM); if (err) return err;
+					err = dsk_pack_bytes(&output, out_len, NULL, 0); 
+					return err;
+				}
+				pbuf = dsk_malloc(int4 * geom.dg_secsize + 1);
+				if (!pbuf) return DSK_ERR_NOMEM;
+				err2= dsk_pmread(pDriver, &geom, pbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_psect_t)int3, (unsigned)int4);
+				err = dsk_pack_err(&output, out_len, err2);
+				if (!err) err = dsk_pack_bytes(&output, out_len, pbuf, int4 * geom.dg_secsize);
+				dsk_free(pbuf);
+				return err;
+		case RPC_DSK_PMWRITE:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				blen = inp_len;
+				err = dsk_unpack_bytes(&input, &inp_len, &pbuf);  if (err) return err;
+				blen -= inp_len + 2;	/* Less the length word */
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int4);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				/* The driver reads int4 sectors from pbuf */
+				if (int4 < 0 || (long)int4 * geom.dg_secsize > RPC_MULTI_MAX ||
+				    (long)blen < (long)int4 * geom.dg_secsize)
+				{
+					return dsk_pack_err(&output, out_len, DSK_ERR_BADPARM);
+				}
+				err2= dsk_pmwrite(pDriver, &geom, pbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_psect_t)int3, (unsigned)int4);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				return DSK_ERR_OK;
+
 		case RPC_DSK_PFORMAT:
 				pfmt = (DSK_FORMAT *)secbuf;
 				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
@@ -328,6 +378,9 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 				PROPCHECK(dc_option_set, RPC_DSK_OPTION_SET)
 				PROPCHECK(dc_trackids, RPC_DSK_TRACKIDS)
 				PROPCHECK(dc_rtread, RPC_DSK_RTREAD)
+/* dsk_pmread() / dsk_pmwrite() work with any driver that can read / write */
+				PROPCHECK(dc_read,    RPC_DSK_PMREAD)
+				PROPCHECK(dc_write,   RPC_DSK_PMWRITE)
 #undef PROPCHECK
 				props[int1++] = RPC_DSK_PROPERTIES;
 				err = dsk_pack_err(&output, out_len, DSK_ERR_OK);	  if (err) return err;
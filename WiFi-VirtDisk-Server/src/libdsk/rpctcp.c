@@ -0,0 +1,242 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2025  Welzel-Online                                    *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* TCP/IP transport for the remote driver. Filenames are of the form
+ * 
+ *   tcp:host:port,filename,type,compression
+ *
+ * host is a numeric IPv4 or IPv6 address (IPv6 with a port in brackets,
+ * "[::1]:12347") or "localhost". Host names are not resolved: getaddrinfo()
+ * would need the shared libraries of glibc at runtime in the statically
+ * linked server and tools.
+ *
+ * and each request is framed exactly as for rpcfork: a 2-byte length in
+ * network byte order followed by the packet, with the reply framed the
+ * same way. */
+
+#include "drvi.h"
+#include "remote.h"
+#include "rpctcp.h"
+
+#ifdef HAVE_SYS_SOCKET_H
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+REMOTE_CLASS rpc_tcp =
+{
+	sizeof(TCP_REMOTE_DATA),
+	"tcp",
+	"TCP/IP client",
+	tcp_open, 
+	tcp_close,
+	tcp_call
+};
+
+typedef unsigned short word16;
+typedef unsigned char byte;
+
+
+/* send() / recv() may transfer less than asked for; loop until the
+ * whole buffer has gone across */
+static dsk_err_t tcp_send_all(int sock, const byte *buf, int len)
+{
+	int n;
+
+	while (len > 0)
+	{
+		n = send(sock, buf, len, 0);
+		if (n <= 0) return DSK_ERR_SYSERR;
+		buf += n;
+		len -= n;
+	}
+	return DSK_ERR_OK;
+}
+
+
+static dsk_err_t tcp_recv_all(int sock, byte *buf, int len)
+{
+	int n;
+
+	while (len > 0)
+	{
+		n = recv(sock, buf, len, 0);
+		if (n <= 0) return DSK_ERR_SYSERR;
+		buf += n;
+		len -= n;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Fill addr with a numeric address or localhost and the port. Return 0 if
+ * the host is not a numeric address. */
+static socklen_t tcp_address(struct sockaddr_storage *addr, const char *host,
+		unsigned short port)
+{
+	struct sockaddr_in  *sin  = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+
+	memset(addr, 0, sizeof(*addr));
+	if (inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1)
+	{
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port   = htons(port);
+		return sizeof(*sin6);
+	}
+	if (!strcmp(host, "localhost")) host = "127.0.0.1";
+	if (inet_pton(AF_INET, host, &sin->sin_addr) == 1)
+	{
+		sin->sin_family = AF_INET;
+		sin->sin_port   = htons(port);
+		return sizeof(*sin);
+	}
+	return 0;
+}
+
+
+dsk_err_t tcp_open(DSK_PDRIVER pDriver, const char *name, char *nameout)
+{	
+	TCP_REMOTE_DATA *self;
+	struct sockaddr_storage addr;
+	socklen_t addrlen = 0;
+	char *comma, *host, *port, *end;
+	unsigned long portno;
+	int flag = 1;
+
+	self = (TCP_REMOTE_DATA *)pDriver->dr_remote;	
+	if (!self || self->super.rd_class != &rpc_tcp) return DSK_ERR_BADPTR;
+	if (strncmp(name, "tcp:", 4)) return DSK_ERR_NOTME;
+	name += 4;
+	self->sock = -1;
+	self->hostname = dsk_malloc_string(name);
+	if (!self->hostname) return DSK_ERR_NOMEM;
+	comma = strchr(self->hostname, ',');
+	if (comma) 
+	{
+		strcpy(nameout, comma + 1);
+		comma[0] = 0;
+	}
+	else	strcpy(nameout, "");
+
+	/* [IPv6]:port, IPv4:port or a plain address */
+	host = self->hostname;
+	if (host[0] == '[')
+	{
+		host++;
+		port = strchr(host, ']');
+		if (port) *port++ = 0;
+		if (port && *port == ':') port++;
+		else			  port = NULL;
+	}
+	else
+	{
+		port = strchr(host, ':');
+		if (port && strchr(port + 1, ':')) port = NULL;	/* IPv6 */
+		else if (port) *port++ = 0;
+	}
+	if (!port) port = TCP_DEFAULT_PORT;
+	portno = strtoul(port, &end, 10);
+	if (!*end && portno > 0 && portno <= 0xFFFF) 
+	{
+		addrlen = tcp_address(&addr, host, (unsigned short)portno);
+	}
+	if (addrlen)
+	{
+		self->sock = socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+		if (self->sock >= 0 && 
+		    connect(self->sock, (struct sockaddr *)&addr, addrlen))
+		{
+			close(self->sock);
+			self->sock = -1;
+		}
+	}
+	if (self->sock < 0)
+	{
+		dsk_free(self->hostname);
+		self->hostname = NULL;
+		return DSK_ERR_NOTRDY;
+	}
+/* Requests are small and strictly request/response, so don't let Nagle
+ * hold them back */
+	setsockopt(self->sock, IPPROTO_TCP, TCP_NODELAY, 
+			(char *)&flag, sizeof(flag));
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t tcp_close(DSK_PDRIVER pDriver)
+{
+	TCP_REMOTE_DATA *self = (TCP_REMOTE_DATA *)pDriver->dr_remote;	
+	if (!self || self->super.rd_class != &rpc_tcp) return DSK_ERR_BADPTR;
+	if (self->hostname) dsk_free(self->hostname);
+	self->hostname = NULL;
+	if (self->sock >= 0 && close(self->sock)) return DSK_ERR_SYSERR;
+	self->sock = -1;
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t tcp_call(DSK_PDRIVER pDriver, unsigned char *input, 
+		int inp_len, unsigned char *output, int *out_len)
+{
+	word16 wire_len;
+	byte wvar[2];
+	unsigned char *tmpbuf;
+	dsk_err_t err;
+
+	TCP_REMOTE_DATA *self = (TCP_REMOTE_DATA *)pDriver->dr_remote;	
+	if (!self || self->super.rd_class != &rpc_tcp) return DSK_ERR_BADPTR;
+	if (self->sock < 0) return DSK_ERR_NOTRDY;
+	if (inp_len > 0xFFFF) return DSK_ERR_RPC;
+
+	/* Write packet length (network byte order) */
+	wire_len = inp_len;
+	wvar[0] = wire_len >> 8;
+	wvar[1] = wire_len & 0xFF;
+	err = tcp_send_all(self->sock, wvar, 2);          if (err) return err;
+	err = tcp_send_all(self->sock, input, inp_len);   if (err) return err;
+
+	/* Outgoing packet sent. Await response */
+	err = tcp_recv_all(self->sock, wvar, 2);          if (err) return err;
+	wire_len = wvar[0];
+	wire_len = (wire_len << 8) | wvar[1];
+	tmpbuf = dsk_malloc(wire_len + 1);
+	if (!tmpbuf) return DSK_ERR_NOMEM;
+	err = tcp_recv_all(self->sock, tmpbuf, wire_len);
+	if (err)
+	{
+		dsk_free(tmpbuf);
+		return err;
+	}
+/* Copy packet to waiting output buffer */
+	if (wire_len < *out_len) *out_len = wire_len;
+	memcpy(output, tmpbuf, *out_len);
+	dsk_free(tmpbuf);
+	return DSK_ERR_OK;
+}
+
+#endif /* def HAVE_SYS_SOCKET_H */
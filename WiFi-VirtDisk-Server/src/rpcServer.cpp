@@ -0,0 +1,713 @@
+/***************************************************************************//**
+ * @file    rpcServer.cpp
+ *
+ * @brief   Serves the disk images to libdsk "remote" clients via TCP.
+ *
+ *          Every request is framed like libdsk's fork/pipe transport: a 16 bit
+ *          length in network byte order followed by the packet. The packet
+ *          itself is decoded by dsk_rpc_server().
+ *
+ *          Open and close requests are intercepted so that all clients share
+ *          one libdsk driver per image, including the image the emulated
+ *          drive currently has open. This avoids two drivers buffering and
+ *          locking the same file.
+ *
+ *          The server has no authentication. Clients can only open the
+ *          images of the emulated disks, by their diskEmuFilename or
+ *          diskEmuPath, and the server only listens on localhost unless
+ *          rpcBindAddress is configured.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <netinet/tcp.h>
+#endif
+
+#include "rpcServer.hpp"
+#include "diskNotify.hpp"
+#include "diskSnapshot.hpp"
+#include "imageTool.hpp"
+#include "serverStats.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+// RPC function codes, see libdsk/rpcfuncs.h
+#define RPC_DSK_OPEN    101
+#define RPC_DSK_CREAT   102
+#define RPC_DSK_CLOSE   103
+#define RPC_DSK_PWRITE  108
+#define RPC_DSK_LWRITE  109
+#define RPC_DSK_XWRITE  110
+#define RPC_DSK_PFORMAT 114
+#define RPC_DSK_LFORMAT 115
+#define RPC_DSK_APFORM  119
+#define RPC_DSK_ALFORM  120
+#define RPC_DSK_PMWRITE 143
+
+typedef struct
+{
+    DSK_PDRIVER     pDriver;    // Shared libdsk driver
+    unsigned int    handle;     // RPC handle (dsk_map index), 0 if not mapped yet
+    int             refCount;   // Number of opens by RPC clients
+    bool            owned;      // false while the emulated drive holds the driver
+} rpcImage_t;
+
+
+/********************************************************** Global Variables **/
+std::mutex gDskMutex;
+
+extern bool gSrvRunning;
+extern std::vector<std::string> diskEmuPath;
+extern std::vector<std::string> diskEmuFilename;
+
+// Open images, the key is the canonical path
+static std::map<std::string, rpcImage_t> rpcImages;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns the key of an image in the image cache.
+ *
+ * @param   name    The filename as given by the client.
+ *
+ * @return  The canonical path, or the name itself if it cannot be resolved.
+ ******************************************************************************/
+static std::string rpcImageKey( const std::string& name )
+{
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::weakly_canonical( name, ec );
+
+    return ec ? name : path.string();
+}
+
+
+/***************************************************************************//**
+ * @brief   Resolves the filename of an open or create request to the image of
+ *          an emulated disk. Other files of the host are not served.
+ *
+ * @param   name    The filename as given by the client, the diskEmuFilename
+ *                  or the diskEmuPath of an emulated disk.
+ * @param   path    Receives the diskEmuPath of the emulated disk.
+ *
+ * @return  true if the name is an emulated disk, otherwise false.
+ ******************************************************************************/
+static bool rpcResolveImage( const std::string& name, std::string& path )
+{
+    int disk = -1;
+
+
+    for( size_t i = 0; ( i < diskEmuFilename.size() ) && ( i < diskEmuPath.size() ); i++ )
+    {
+        if( name == diskEmuFilename[i] )
+        {
+            disk = (int)i;
+            break;
+        }
+    }
+
+    if( disk < 0 )
+    {
+        disk = dnImageDisk( name );
+    }
+
+    if( disk < 0 )
+    {
+        return false;
+    }
+
+    path = diskEmuPath[disk];
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Finds the image in the image cache which uses the given handle.
+ ******************************************************************************/
+static std::map<std::string, rpcImage_t>::iterator rpcFindHandle( unsigned int handle )
+{
+    for( auto it = rpcImages.begin(); it != rpcImages.end(); ++it )
+    {
+        if( ( it->second.handle != 0 ) && ( it->second.handle == handle ) )
+        {
+            return it;
+        }
+    }
+
+    return rpcImages.end();
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the RPC function changes the disk image.
+ ******************************************************************************/
+static bool rpcIsWrite( uint16_t function )
+{
+    switch( function )
+    {
+        case RPC_DSK_PWRITE:
+        case RPC_DSK_LWRITE:
+        case RPC_DSK_XWRITE:
+        case RPC_DSK_PFORMAT:
+        case RPC_DSK_LFORMAT:
+        case RPC_DSK_APFORM:
+        case RPC_DSK_ALFORM:
+        case RPC_DSK_PMWRITE:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Drops one reference of an RPC client to an image. The driver is
+ *          closed when the last client is gone, unless the emulated drive
+ *          still uses it.
+ *
+ * @param   handle  The RPC handle of the image.
+ *
+ * @return  The result of closing the driver.
+ ******************************************************************************/
+static dsk_err_t rpcReleaseImage( unsigned int handle )
+{
+    dsk_err_t err = DSK_ERR_OK;
+    auto      it  = rpcFindHandle( handle );
+
+
+    if( it == rpcImages.end() )
+    {
+        return DSK_ERR_BADPTR;
+    }
+
+    if( --it->second.refCount > 0 )
+    {
+        return DSK_ERR_OK;
+    }
+
+    if( it->second.owned )
+    {
+        err = dsk_close( &it->second.pDriver );
+        dsk_map_delete( handle );
+        rpcImages.erase( it );
+    }
+
+    return err;
+}
+
+
+/***************************************************************************//**
+ * @brief   Reads a big endian 16 bit value.
+ ******************************************************************************/
+static uint16_t rpcGet16( const unsigned char* data )
+{
+    return (uint16_t)( ( data[0] << 8 ) | data[1] );
+}
+
+
+/***************************************************************************//**
+ * @brief   Reads a big endian 32 bit value.
+ ******************************************************************************/
+static uint32_t rpcGet32( const unsigned char* data )
+{
+    return ( (uint32_t)rpcGet16( data ) << 16 ) | rpcGet16( data + 2 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Keeps the old sectors for the snapshot of an emulated disk, before
+ *          an RPC client writes to it.
+ *
+ *          The sectors of dsk_pwrite() and dsk_pmwrite() are decoded from the
+ *          request: handle, geometry (12 values of 16 bit), data, cylinder,
+ *          head, sector and for dsk_pmwrite() the number of sectors. Other
+ *          writes (formatting, dsk_xwrite()) are refused while the disk has a
+ *          snapshot.
+ *
+ * @return  DSK_ERR_OK if the request may be processed, otherwise the error
+ *          for the client.
+ ******************************************************************************/
+static dsk_err_t rpcBeforeWrite( uint16_t function, unsigned int handle, const unsigned char* input, int inpLen )
+{
+    auto         it = rpcFindHandle( handle );
+    int          disk;
+    DSK_GEOMETRY geom;
+    int          pos;
+    uint32_t     cyl, head, sec, count = 1;
+
+
+    if( ( it == rpcImages.end() ) || ( ( disk = dnImageDisk( it->first ) ) < 0 ) || !snActive( (size_t)disk ) )
+    {
+        return DSK_ERR_OK;
+    }
+
+    if( ( function != RPC_DSK_PWRITE ) && ( function != RPC_DSK_PMWRITE ) )
+    {
+        message( MsgType::WARN, "RPC: write refused, " + it->first + " has a snapshot" );
+        return DSK_ERR_RDONLY;
+    }
+
+    pos = 6 + 24;
+    if( inpLen < pos + 2 )
+    {
+        return DSK_ERR_RPC;
+    }
+    geom.dg_sidedness = (dsk_sides_t)rpcGet16( input + 6 );
+    geom.dg_cylinders = rpcGet16( input + 8 );
+    geom.dg_heads     = rpcGet16( input + 10 );
+    geom.dg_sectors   = rpcGet16( input + 12 );
+    geom.dg_secbase   = rpcGet16( input + 14 );
+    geom.dg_secsize   = rpcGet16( input + 16 );
+    geom.dg_datarate  = (dsk_rate_t)rpcGet16( input + 18 );
+    geom.dg_rwgap     = (dsk_gap_t)rpcGet16( input + 20 );
+    geom.dg_fmtgap    = (dsk_gap_t)rpcGet16( input + 22 );
+    geom.dg_fm        = rpcGet16( input + 24 );
+    geom.dg_nomulti   = rpcGet16( input + 26 );
+    geom.dg_noskip    = rpcGet16( input + 28 );
+
+    pos += 2 + rpcGet16( input + pos );     // Data of the sectors
+    if( inpLen < pos + ( ( function == RPC_DSK_PMWRITE ) ? 16 : 12 ) )
+    {
+        return DSK_ERR_RPC;
+    }
+    cyl  = rpcGet32( input + pos );
+    head = rpcGet32( input + pos + 4 );
+    sec  = rpcGet32( input + pos + 8 );
+    if( function == RPC_DSK_PMWRITE ) { count = rpcGet32( input + pos + 12 ); }
+
+    for( uint32_t i = 0; ( i < count ) && ( i < geom.dg_sectors ); i++ )
+    {
+        dsk_lsect_t sector;
+
+        // Without the old data the rollback would restore a mixed state
+        if( ( dg_ps2ls( &geom, cyl, head, sec + i, &sector ) == DSK_ERR_OK ) &&
+            !snSave( (size_t)disk, it->second.pDriver, &geom, sector ) )
+        {
+            return DSK_ERR_RDONLY;
+        }
+    }
+
+    return DSK_ERR_OK;
+}
+
+
+/***************************************************************************//**
+ * @brief   Appends a string parameter to a request, like dsk_pack_string().
+ *          nullptr is sent as empty parameter.
+ ******************************************************************************/
+static void rpcPutString( std::vector<unsigned char>& request, const char* str )
+{
+    uint16_t len = ( str == nullptr ) ? 0 : (uint16_t)( strlen( str ) + 1 );
+
+    request.push_back( (unsigned char)( len >> 8 ) );
+    request.push_back( (unsigned char)( len & 0xFF ) );
+    if( str != nullptr )
+    {
+        request.insert( request.end(), str, str + len );
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Packs an error code as answer to a request.
+ *
+ * @return  The length of the answer.
+ ******************************************************************************/
+static int rpcPackErr( unsigned char* output, dsk_err_t err )
+{
+    output[0] = (unsigned char)( ( (int16_t)err >> 8 ) & 0xFF );
+    output[1] = (unsigned char)( (int16_t)err & 0xFF );
+
+    return 2;
+}
+
+
+/***************************************************************************//**
+ * @brief   Packs an error code and a handle as answer to an open request.
+ *
+ * @return  The length of the answer.
+ ******************************************************************************/
+static int rpcPackOpen( unsigned char* output, dsk_err_t err, unsigned int handle )
+{
+    rpcPackErr( output, err );
+    output[2] = (unsigned char)( ( handle >> 24 ) & 0xFF );
+    output[3] = (unsigned char)( ( handle >> 16 ) & 0xFF );
+    output[4] = (unsigned char)( ( handle >>  8 ) & 0xFF );
+    output[5] = (unsigned char)( handle & 0xFF );
+
+    return 6;
+}
+
+
+/***************************************************************************//**
+ * @brief   Processes one RPC request.
+ *
+ * @param   input       The request packet.
+ * @param   inpLen      The length of the request.
+ * @param   output      The buffer for the answer, RPC_PACKET_MAX bytes.
+ * @param   handles     The handles opened by this client and their count.
+ *
+ * @return  The length of the answer.
+ ******************************************************************************/
+static int rpcProcess( unsigned char* input, int inpLen, unsigned char* output,
+                       std::map<unsigned int, int>& handles )
+{
+    uint64_t        lockStart = stNow();
+    stQueueEnter();
+    std::lock_guard<std::mutex> lock( gDskMutex );
+    stQueueLeave();
+    stRecordPhase( ST_PHASE_LOCK_WAIT, stNow() - lockStart );
+    int             outLen = RPC_PACKET_MAX;
+    uint16_t        function;
+    unsigned int    handle = 0;
+    dsk_err_t       err;
+
+
+    if( inpLen < 2 )
+    {
+        return rpcPackErr( output, DSK_ERR_RPC );
+    }
+    function = rpcGet16( input );
+
+    if( ( function == RPC_DSK_OPEN ) || ( function == RPC_DSK_CREAT ) )
+    {
+        // The first parameter is the filename: 16 bit length, then the string
+        uint16_t len = ( inpLen >= 4 ) ? rpcGet16( input + 2 ) : 0;
+        if( ( len == 0 ) || ( 4 + len > inpLen ) )
+        {
+            return rpcPackOpen( output, DSK_ERR_RPC, 0 );
+        }
+        std::string name = std::string( (const char*)input + 4, strnlen( (const char*)input + 4, len ) );
+        std::string path;
+        if( !rpcResolveImage( name, path ) )
+        {
+            message( MsgType::WARN, "RPC: open of " + name + " refused, not an emulated disk" );
+            return rpcPackOpen( output, DSK_ERR_NOTME, 0 );
+        }
+        std::string key = rpcImageKey( path );
+
+        auto it = rpcImages.find( key );
+        if( it != rpcImages.end() )
+        {
+            // Creating an image that is in use would pull it away under the other users
+            if( function == RPC_DSK_CREAT )
+            {
+                return rpcPackOpen( output, DSK_ERR_ACCESS, 0 );
+            }
+
+            if( it->second.handle == 0 )
+            {
+                dsk_map_dtoi( it->second.pDriver, &it->second.handle );
+            }
+            it->second.refCount++;
+            handles[it->second.handle]++;
+
+            return rpcPackOpen( output, DSK_ERR_OK, it->second.handle );
+        }
+
+        // Pass the path of the emulated disk to libdsk instead of the name. The
+        // driver is the one of the emulated drive, so the drive can adopt it.
+        std::vector<unsigned char> request( input, input + 2 );
+        rpcPutString( request, path.c_str() );
+        rpcPutString( request, itIsStoreImage( path ) ? IT_STORE_TYPE : "rcpmfs" );
+        rpcPutString( request, nullptr );   // No compression
+
+        err = dsk_rpc_server( request.data(), (int)request.size(), output, &outLen, NULL );
+        if( err != DSK_ERR_OK )
+        {
+            return rpcPackErr( output, err );
+        }
+
+        // Answer is the error code and the handle of the new driver
+        if( ( rpcGet16( output ) == DSK_ERR_OK ) && ( RPC_PACKET_MAX - outLen >= 6 ) )
+        {
+            rpcImage_t image;
+
+            handle = ( (unsigned int)rpcGet16( output + 2 ) << 16 ) | rpcGet16( output + 4 );
+            dsk_map_itod( handle, &image.pDriver );
+            image.handle   = handle;
+            image.refCount = 1;
+            image.owned    = true;
+            rpcImages[key] = image;
+            handles[handle]++;
+        }
+
+        return RPC_PACKET_MAX - outLen;
+    }
+
+    // All other image functions start with the handle. Only accept handles
+    // this client has opened, libdsk does not check them itself.
+    if( function > RPC_DSK_CREAT )
+    {
+        if( inpLen >= 6 )
+        {
+            handle = ( (unsigned int)rpcGet16( input + 2 ) << 16 ) | rpcGet16( input + 4 );
+        }
+
+        auto hit = handles.find( handle );
+        if( hit == handles.end() )
+        {
+            return rpcPackErr( output, DSK_ERR_BADPTR );
+        }
+
+        if( function == RPC_DSK_CLOSE )
+        {
+            if( --hit->second == 0 )
+            {
+                handles.erase( hit );
+            }
+
+            return rpcPackErr( output, rpcReleaseImage( handle ) );
+        }
+    }
+
+    // The snapshot of an emulated disk needs the old sectors
+    if( rpcIsWrite( function ) && ( snActiveDisks.load( std::memory_order_relaxed ) != 0 ) )
+    {
+        err = rpcBeforeWrite( function, handle, input, inpLen );
+        if( err != DSK_ERR_OK )
+        {
+            return rpcPackErr( output, err );
+        }
+    }
+
+    err = dsk_rpc_server( input, inpLen, output, &outLen, NULL );
+    if( err != DSK_ERR_OK )
+    {
+        return rpcPackErr( output, err );
+    }
+
+    // Notify the client of the emulated disk, the image changed under it
+    if( rpcIsWrite( function ) && ( RPC_PACKET_MAX - outLen >= 2 ) && ( rpcGet16( output ) == DSK_ERR_OK ) )
+    {
+        auto it = rpcFindHandle( handle );
+        if( it != rpcImages.end() )
+        {
+            dnImageChanged( it->first, "written by an RPC client" );
+        }
+    }
+
+    return RPC_PACKET_MAX - outLen;
+}
+
+
+/***************************************************************************//**
+ * @brief   Receives exactly the given number of bytes from the client.
+ *
+ * @return  true on success, false if the client disconnected or the server
+ *          is stopping.
+ ******************************************************************************/
+static bool rpcReceive( ASocket::Socket clientSocket, CTCPServer* server, unsigned char* buffer, int len )
+{
+    int received = 0;
+
+
+    while( ( received < len ) && gSrvRunning )
+    {
+        int ret = server->Receive( clientSocket, (char*)buffer + received, len - received, false );
+
+        if( ret > 0 )
+        {
+            received += ret;
+        }
+        else if( ret == 0 )
+        {
+            return false;   // Client closed the connection
+        }
+        else if( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) && ( errno != EINTR ) )
+        {
+            return false;   // Receive error, timeouts are expected
+        }
+    }
+
+    return received == len;
+}
+
+
+/***************************************************************************//**
+ * @brief   Process the requests of one libdsk RPC client.
+ *
+ * @param   clientSocket    The current client socket.
+ * @param   server          The TCPServer for communication.
+ * @param   clientInfo      IP address and port of the connected client.
+ ******************************************************************************/
+void rpcHandleClient( ASocket::Socket clientSocket, CTCPServer* server, std::string clientInfo )
+{
+    std::vector<unsigned char>  input( RPC_PACKET_MAX + 2 );
+    std::vector<unsigned char>  output( RPC_PACKET_MAX + 2 );
+    std::map<unsigned int, int> handles;
+    unsigned char               header[2];
+
+
+    int flag = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
+
+    server->SetRcvTimeout( clientSocket, 100 );
+
+    while( gSrvRunning )
+    {
+        if( !rpcReceive( clientSocket, server, header, 2 ) )
+        {
+            break;
+        }
+
+        int inpLen = rpcGet16( header );
+        if( !rpcReceive( clientSocket, server, input.data(), inpLen ) )
+        {
+            break;
+        }
+
+        int outLen = rpcProcess( input.data(), inpLen, output.data() + 2, handles );
+
+        output[0] = (unsigned char)( ( outLen >> 8 ) & 0xFF );
+        output[1] = (unsigned char)( outLen & 0xFF );
+        if( !server->Send( clientSocket, (const char*)output.data(), outLen + 2 ) )
+        {
+            break;
+        }
+    }
+
+    message( MsgType::INFO, "RPC client disconnected (" + clientInfo + ")" );
+
+    // Release the images the client did not close
+    {
+        std::lock_guard<std::mutex> lock( gDskMutex );
+        for( auto& h : handles )
+        {
+            while( h.second-- > 0 )
+            {
+                rpcReleaseImage( h.first );
+            }
+        }
+    }
+
+    // Close connection to client
+    server->Disconnect( clientSocket );
+}
+
+
+/***************************************************************************//**
+ * @brief   Hands the driver of an image that RPC clients have open over to
+ *          the emulated drive, so both use the same driver and cache.
+ *
+ * @param   name    The filename of the image.
+ *
+ * @return  The driver, NULL if no RPC client has the image open. The drive
+ *          then opens it itself and shares it with rpcShareImage().
+ ******************************************************************************/
+DSK_PDRIVER rpcAdoptImage( const std::string& name )
+{
+    auto it = rpcImages.find( rpcImageKey( name ) );
+
+
+    if( it == rpcImages.end() )
+    {
+        return NULL;
+    }
+
+    it->second.owned = false;
+    return it->second.pDriver;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the driver of an image in the image cache, NULL if neither
+ *          RPC clients nor the emulated drive have it open.
+ *
+ * @param   name    The filename of the image.
+ ******************************************************************************/
+DSK_PDRIVER rpcFindImage( const std::string& name )
+{
+    auto it = rpcImages.find( rpcImageKey( name ) );
+
+    return ( it == rpcImages.end() ) ? NULL : it->second.pDriver;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the driver is in the image cache. It must not be
+ *          closed then.
+ ******************************************************************************/
+bool rpcHoldsDriver( DSK_PDRIVER pDriver )
+{
+    for( const auto& image : rpcImages )
+    {
+        if( image.second.pDriver == pDriver )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/***************************************************************************//**
+ * @brief   Makes the driver of the emulated drive available to RPC clients.
+ *
+ * @param   pDriver The driver opened by the emulated drive.
+ * @param   name    The filename of the image.
+ ******************************************************************************/
+void rpcShareImage( DSK_PDRIVER pDriver, const std::string& name )
+{
+    rpcImage_t image;
+
+
+    if( pDriver == NULL )
+    {
+        return;
+    }
+
+    image.pDriver  = pDriver;
+    image.handle   = 0;
+    image.refCount = 0;
+    image.owned    = false;
+
+    // Opened by the drive itself, RPC clients had no driver, see rpcAdoptImage()
+    rpcImages.emplace( rpcImageKey( name ), image );
+}
+
+
+/***************************************************************************//**
+ * @brief   Withdraws the driver of the emulated drive from the RPC clients.
+ *
+ * @param   pDriver The driver opened by the emulated drive.
+ *
+ * @return  true if RPC clients still use the driver. The image cache then
+ *          takes it over and the caller must not close it.
+ ******************************************************************************/
+bool rpcUnshareImage( DSK_PDRIVER pDriver )
+{
+    for( auto it = rpcImages.begin(); it != rpcImages.end(); ++it )
+    {
+        if( ( it->second.pDriver == pDriver ) && !it->second.owned )
+        {
+            if( it->second.refCount > 0 )
+            {
+                it->second.owned = true;
+                return true;
+            }
+
+            if( it->second.handle != 0 )
+            {
+                dsk_map_delete( it->second.handle );
+            }
+            rpcImages.erase( it );
+            break;
+        }
+    }
+
+    return false;
+}
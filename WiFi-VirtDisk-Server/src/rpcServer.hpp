@@ -0,0 +1,45 @@
+/***************************************************************************//**
+ * @file    rpcServer.hpp
+ *
+ * @brief   Serves the disk images to libdsk "remote" clients via TCP.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef RPCSERVER_HPP
+#define RPCSERVER_HPP
+
+/****************************************************************** Includes **/
+#include <string>
+#include <mutex>
+
+// Socket-CPP
+#include "TCPServer.h"
+
+// LibDsk
+#include <stddef.h>      // Needed for libdisk.h
+#include <libdsk.h>
+
+
+/******************************************************************* Defines **/
+// Largest RPC packet; the length on the wire is 16 bit
+#define RPC_PACKET_MAX  0xFFFF
+
+
+/********************************************************** Global Variables **/
+// LibDsk is not thread safe, every call into it has to hold this mutex
+extern std::mutex gDskMutex;
+
+
+/******************************************************* Functions / Methods **/
+void rpcHandleClient( ASocket::Socket clientSocket, CTCPServer* server, std::string clientInfo );
+
+// The caller has to hold gDskMutex for the following functions
+DSK_PDRIVER rpcAdoptImage( const std::string& name );
+DSK_PDRIVER rpcFindImage( const std::string& name );
+bool rpcHoldsDriver( DSK_PDRIVER pDriver );
+void rpcShareImage( DSK_PDRIVER pDriver, const std::string& name );
+bool rpcUnshareImage( DSK_PDRIVER pDriver );
+
+
+#endif
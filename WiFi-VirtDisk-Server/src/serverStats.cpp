@@ -0,0 +1,576 @@
+/***************************************************************************//**
+ * @file    serverStats.cpp
+ *
+ * @brief   Latency histograms and counters of the WiFi-VirtDisk server.
+ *
+ *          Every command of the client and every step of it (waiting for
+ *          the disk lock, LibDsk, file and socket I/O) is timed into a
+ *          histogram with log-linear buckets like HdrHistogram. Recording
+ *          is a bucket index and a few additions, so it stays on in the
+ *          hot path. The gap between sending an answer and receiving the
+ *          next packet is the time spent in WiFi, ESP8266 and Z80, the
+ *          other phases are the time spent in the server.
+ *
+ *          The statistics are printed with the 'S' key and served as
+ *          Prometheus text on the stats port (server port + 3). A plain
+ *          TCP connection gets the text, an HTTP GET gets it with an HTTP
+ *          header, so Prometheus can scrape it directly. Every connection
+ *          is served on its own short-lived thread, a slow client does not
+ *          hold up the accept loop of the server.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <netinet/tcp.h>
+#endif
+
+#include "serverStats.hpp"
+#include "virtDisk.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+#define ST_MAX_CLOSED   8       // Closed sessions kept for the statistics
+
+typedef struct
+{
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    max;
+    uint64_t    bucket[ST_BUCKETS];
+} stHistogram_t;
+
+typedef struct
+{
+    uint64_t    sectorsRead;
+    uint64_t    sectorsWritten;
+    uint64_t    errors;
+} stDisk_t;
+
+typedef struct
+{
+    std::string clientInfo;
+    bool        active;
+    uint64_t    commands;
+    uint64_t    rxBytes;
+    uint64_t    txBytes;
+} stSession_t;
+
+typedef struct
+{
+    std::thread                        thread;
+    std::shared_ptr<std::atomic<bool>> done;    // Set by the thread when the client is served
+} stClient_t;
+
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuFilename;
+
+static const char* stCmdName[VD_CMD_COUNT] =
+{
+    "NONE", "STATUS", "SEL_FILE", "RD_FILE", "RD_NEXT", "WR_FILE",
+    "WR_NEXT", "SEEK_FILE", "SEL_TR_SEC", "RD_SECTOR", "WR_SECTOR", "RD_SEGMENT",
+    "ENCODING"
+};
+
+static const char* stPhaseName[ST_PHASE_COUNT] =
+{
+    "lock_wait", "disk_open", "dsk_read", "dsk_write", "file_io", "send", "gap"
+};
+
+static const char* stCacheName[ST_CACHE_COUNT] =
+{
+    "disk_check"
+};
+
+static std::mutex                  stMutex;
+static stHistogram_t               stCmd[VD_CMD_COUNT];
+static stHistogram_t               stPhase[ST_PHASE_COUNT];
+static std::vector<stDisk_t>       stDisks;
+static uint64_t                    stCacheHits[ST_CACHE_COUNT];
+static uint64_t                    stCacheMisses[ST_CACHE_COUNT];
+static int                         stQueueDepth = 0;
+static int                         stQueueMax   = 0;
+static std::map<int, stSession_t>  stSessions;
+static int                         stNextSession = 1;
+static std::vector<stClient_t>     stClients;   // Threads of the stats clients, only used by the main thread
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns the bucket of a value.
+ ******************************************************************************/
+static int stBucket( uint64_t value )
+{
+    int msb   = 63 - __builtin_clzll( value | 1 );
+    int shift = msb - ST_SUB_BITS;
+
+
+    if( shift < 0 )
+    {
+        return (int)value;      // Small values have a bucket of their own
+    }
+
+    int index = ST_SUB_BUCKETS + shift * ST_SUB_BUCKETS + (int)( ( value >> shift ) - ST_SUB_BUCKETS );
+
+    return std::min( index, ST_BUCKETS - 1 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the largest value of a bucket.
+ ******************************************************************************/
+static uint64_t stBucketMax( int index )
+{
+    if( index < ST_SUB_BUCKETS )
+    {
+        return index;
+    }
+
+    int shift = ( index - ST_SUB_BUCKETS ) / ST_SUB_BUCKETS;
+    int sub   = ( index - ST_SUB_BUCKETS ) % ST_SUB_BUCKETS;
+
+    return ( (uint64_t)( ST_SUB_BUCKETS + sub + 1 ) << shift ) - 1;
+}
+
+
+/***************************************************************************//**
+ * @brief   Adds a value to a histogram. The caller has to hold stMutex.
+ ******************************************************************************/
+static void stRecord( stHistogram_t& hist, uint64_t us )
+{
+    hist.count++;
+    hist.sum += us;
+    hist.max  = std::max( hist.max, us );
+    hist.bucket[stBucket( us )]++;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the value below which the given part of all values are.
+ *          The caller has to hold stMutex.
+ *
+ * @param   quantile    0.0 to 1.0, e.g. 0.99 for p99.
+ ******************************************************************************/
+static uint64_t stQuantile( const stHistogram_t& hist, double quantile )
+{
+    uint64_t rank = (uint64_t)( quantile * hist.count + 0.5 );
+    uint64_t seen = 0;
+
+
+    if( rank == 0 ) { rank = 1; }
+
+    for( int i = 0; i < ST_BUCKETS; i++ )
+    {
+        seen += hist.bucket[i];
+        if( seen >= rank )
+        {
+            return std::min( stBucketMax( i ), hist.max );
+        }
+    }
+
+    return hist.max;
+}
+
+
+/***************************************************************************//**
+ * @brief   Records the duration of a client command.
+ ******************************************************************************/
+void stRecordCmd( uint8_t cmd, uint64_t us )
+{
+    if( cmd >= VD_CMD_COUNT ) { return; }
+
+    std::lock_guard<std::mutex> lock( stMutex );
+    stRecord( stCmd[cmd], us );
+}
+
+
+/***************************************************************************//**
+ * @brief   Records the duration of a step of a command.
+ ******************************************************************************/
+void stRecordPhase( stPhase_t phase, uint64_t us )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+    stRecord( stPhase[phase], us );
+}
+
+
+/***************************************************************************//**
+ * @brief   Counts a sector of an emulated disk.
+ *
+ * @param   disk    Index of the emulated disk.
+ * @param   write   true for a written sector, false for a read one.
+ * @param   ok      false if LibDsk returned an error.
+ ******************************************************************************/
+void stCountSector( size_t disk, bool write, bool ok )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+
+    if( stDisks.size() <= disk ) { stDisks.resize( disk + 1, stDisk_t{} ); }
+
+    if( write ) { stDisks[disk].sectorsWritten++; }
+    else        { stDisks[disk].sectorsRead++; }
+    if( !ok )   { stDisks[disk].errors++; }
+}
+
+
+/***************************************************************************//**
+ * @brief   Counts a hit or miss of a cache.
+ ******************************************************************************/
+void stCountCache( stCache_t cache, bool hit )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+
+    if( hit ) { stCacheHits[cache]++; }
+    else      { stCacheMisses[cache]++; }
+}
+
+
+/***************************************************************************//**
+ * @brief   A thread starts waiting for gDskMutex.
+ ******************************************************************************/
+void stQueueEnter( void )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+
+    stQueueDepth++;
+    stQueueMax = std::max( stQueueMax, stQueueDepth );
+}
+
+
+/***************************************************************************//**
+ * @brief   A thread got gDskMutex.
+ ******************************************************************************/
+void stQueueLeave( void )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+
+    stQueueDepth--;
+}
+
+
+/***************************************************************************//**
+ * @brief   Starts the statistics of a client connection.
+ *
+ * @return  The session number for stSessionCount() and stSessionEnd().
+ ******************************************************************************/
+int stSessionStart( const std::string& clientInfo )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+    int session = stNextSession++;
+
+    stSessions[session] = stSession_t{ clientInfo, true, 0, 0, 0 };
+
+    return session;
+}
+
+
+/***************************************************************************//**
+ * @brief   Counts a command of a client connection.
+ ******************************************************************************/
+void stSessionCount( int session, uint64_t rxBytes, uint64_t txBytes )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+    auto it = stSessions.find( session );
+
+    if( it != stSessions.end() )
+    {
+        it->second.commands++;
+        it->second.rxBytes += rxBytes;
+        it->second.txBytes += txBytes;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Ends a client connection. Only the last closed sessions are kept.
+ ******************************************************************************/
+void stSessionEnd( int session )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+    int closed = 0;
+
+    auto it = stSessions.find( session );
+    if( it != stSessions.end() )
+    {
+        it->second.active = false;
+    }
+
+    // The map is sorted by session number, the oldest are dropped first
+    for( const auto& entry : stSessions )
+    {
+        if( !entry.second.active ) { closed++; }
+    }
+    for( auto dit = stSessions.begin(); ( dit != stSessions.end() ) && ( closed > ST_MAX_CLOSED ); )
+    {
+        if( !dit->second.active )
+        {
+            dit = stSessions.erase( dit );
+            closed--;
+        }
+        else
+        {
+            ++dit;
+        }
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the name of an emulated disk for the statistics.
+ ******************************************************************************/
+static std::string stDiskName( size_t disk )
+{
+    return ( disk < diskEmuFilename.size() ) ? diskEmuFilename[disk] : std::to_string(disk);
+}
+
+
+/***************************************************************************//**
+ * @brief   Prints one line of the latency table. The caller has to hold
+ *          stMutex.
+ ******************************************************************************/
+static void stPrintHistogram( const std::string& name, const stHistogram_t& hist )
+{
+    std::cout << "  " << std::left << std::setw(12) << name << std::right
+              << std::setw(9)  << hist.count
+              << std::setw(10) << ( hist.count ? hist.sum / hist.count : 0 )
+              << std::setw(10) << stQuantile( hist, 0.50 )
+              << std::setw(10) << stQuantile( hist, 0.90 )
+              << std::setw(10) << stQuantile( hist, 0.99 )
+              << std::setw(10) << hist.max << std::endl;
+}
+
+
+/***************************************************************************//**
+ * @brief   Prints the statistics to the console ('S' key).
+ ******************************************************************************/
+void stPrint( void )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+
+
+    if( isColorTerm() ) { std::cout << COLOR_GREEN; }
+
+    std::cout << "Latency [us]      count      mean       p50       p90       p99       max" << std::endl;
+    for( int cmd = 0; cmd < VD_CMD_COUNT; cmd++ )
+    {
+        if( stCmd[cmd].count ) { stPrintHistogram( stCmdName[cmd], stCmd[cmd] ); }
+    }
+    for( int phase = 0; phase < ST_PHASE_COUNT; phase++ )
+    {
+        if( stPhase[phase].count ) { stPrintHistogram( stPhaseName[phase], stPhase[phase] ); }
+    }
+
+    std::cout << "Disk lock queue: " << stQueueDepth << " waiting, " << stQueueMax << " max" << std::endl;
+
+    for( size_t disk = 0; disk < stDisks.size(); disk++ )
+    {
+        std::cout << "Disk " << stDiskName( disk ) << ": " << stDisks[disk].sectorsRead << " sectors read, "
+                  << stDisks[disk].sectorsWritten << " written, " << stDisks[disk].errors << " errors" << std::endl;
+    }
+
+    for( int cache = 0; cache < ST_CACHE_COUNT; cache++ )
+    {
+        uint64_t total = stCacheHits[cache] + stCacheMisses[cache];
+
+        std::cout << "Cache " << stCacheName[cache] << ": " << stCacheHits[cache] << "/" << total << " hits";
+        if( total ) { std::cout << " (" << ( 100 * stCacheHits[cache] / total ) << " %)"; }
+        std::cout << std::endl;
+    }
+
+    for( const auto& session : stSessions )
+    {
+        std::cout << "Session " << session.first << " (" << session.second.clientInfo
+                  << ( session.second.active ? "" : ", closed" ) << "): "
+                  << session.second.commands << " commands, " << session.second.rxBytes << " bytes received, "
+                  << session.second.txBytes << " bytes sent" << std::endl;
+    }
+
+    std::cout << std::endl;
+    if( isColorTerm() ) { std::cout << COLOR_NORM; }
+}
+
+
+/***************************************************************************//**
+ * @brief   Adds a histogram in the Prometheus text format. Empty buckets are
+ *          left out. The caller has to hold stMutex.
+ ******************************************************************************/
+static void stPromHistogram( std::ostringstream& out, const std::string& metric, const std::string& label, const stHistogram_t& hist )
+{
+    uint64_t cumulative = 0;
+
+
+    for( int i = 0; i < ST_BUCKETS; i++ )
+    {
+        if( hist.bucket[i] == 0 ) { continue; }
+
+        cumulative += hist.bucket[i];
+        out << metric << "_bucket{" << label << ",le=\"" << stBucketMax( i ) << "\"} " << cumulative << "\n";
+    }
+    out << metric << "_bucket{" << label << ",le=\"+Inf\"} " << hist.count << "\n";
+    out << metric << "_sum{" << label << "} " << hist.sum << "\n";
+    out << metric << "_count{" << label << "} " << hist.count << "\n";
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the statistics in the Prometheus text format.
+ ******************************************************************************/
+std::string stPrometheus( void )
+{
+    std::lock_guard<std::mutex> lock( stMutex );
+    std::ostringstream out;
+
+
+    out << "# HELP vd_command_latency_us Duration of the client commands in the server.\n";
+    out << "# TYPE vd_command_latency_us histogram\n";
+    for( int cmd = 0; cmd < VD_CMD_COUNT; cmd++ )
+    {
+        if( stCmd[cmd].count ) { stPromHistogram( out, "vd_command_latency_us", "cmd=\"" + std::string(stCmdName[cmd]) + "\"", stCmd[cmd] ); }
+    }
+
+    out << "# HELP vd_phase_latency_us Duration of the steps of the commands, gap is the time outside the server.\n";
+    out << "# TYPE vd_phase_latency_us histogram\n";
+    for( int phase = 0; phase < ST_PHASE_COUNT; phase++ )
+    {
+        if( stPhase[phase].count ) { stPromHistogram( out, "vd_phase_latency_us", "phase=\"" + std::string(stPhaseName[phase]) + "\"", stPhase[phase] ); }
+    }
+
+    out << "# HELP vd_disk_lock_queue Threads waiting for the disk lock.\n";
+    out << "# TYPE vd_disk_lock_queue gauge\n";
+    out << "vd_disk_lock_queue " << stQueueDepth << "\n";
+    out << "# TYPE vd_disk_lock_queue_max gauge\n";
+    out << "vd_disk_lock_queue_max " << stQueueMax << "\n";
+
+    out << "# HELP vd_disk_sectors_total Sectors of the emulated disks.\n";
+    out << "# TYPE vd_disk_sectors_total counter\n";
+    for( size_t disk = 0; disk < stDisks.size(); disk++ )
+    {
+        out << "vd_disk_sectors_total{disk=\"" << stDiskName( disk ) << "\",op=\"read\"} " << stDisks[disk].sectorsRead << "\n";
+        out << "vd_disk_sectors_total{disk=\"" << stDiskName( disk ) << "\",op=\"write\"} " << stDisks[disk].sectorsWritten << "\n";
+    }
+    out << "# TYPE vd_disk_errors_total counter\n";
+    for( size_t disk = 0; disk < stDisks.size(); disk++ )
+    {
+        out << "vd_disk_errors_total{disk=\"" << stDiskName( disk ) << "\"} " << stDisks[disk].errors << "\n";
+    }
+
+    out << "# TYPE vd_cache_requests_total counter\n";
+    for( int cache = 0; cache < ST_CACHE_COUNT; cache++ )
+    {
+        out << "vd_cache_requests_total{cache=\"" << stCacheName[cache] << "\",result=\"hit\"} " << stCacheHits[cache] << "\n";
+        out << "vd_cache_requests_total{cache=\"" << stCacheName[cache] << "\",result=\"miss\"} " << stCacheMisses[cache] << "\n";
+    }
+
+    out << "# TYPE vd_session_commands_total counter\n";
+    for( const auto& session : stSessions )
+    {
+        out << "vd_session_commands_total{session=\"" << session.first << "\",client=\"" << session.second.clientInfo << "\"} " << session.second.commands << "\n";
+    }
+    out << "# TYPE vd_session_bytes_total counter\n";
+    for( const auto& session : stSessions )
+    {
+        std::string label = "session=\"" + std::to_string(session.first) + "\",client=\"" + session.second.clientInfo + "\"";
+
+        out << "vd_session_bytes_total{" << label << ",dir=\"rx\"} " << session.second.rxBytes << "\n";
+        out << "vd_session_bytes_total{" << label << ",dir=\"tx\"} " << session.second.txBytes << "\n";
+    }
+
+    return out.str();
+}
+
+
+/***************************************************************************//**
+ * @brief   Answers one client of the stats port and closes the connection.
+ *
+ * @param   clientSocket    The current client socket.
+ * @param   server          The TCPServer for communication.
+ ******************************************************************************/
+static void stHandleClient( ASocket::Socket clientSocket, CTCPServer* server )
+{
+    char        request[512] = {};
+    std::string text;
+
+
+    int flag = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
+
+    // An HTTP client sends its request first, a plain TCP client sends nothing
+    server->SetRcvTimeout( clientSocket, 100 );
+    int received = server->Receive( clientSocket, request, sizeof(request) - 1, false );
+
+    text = stPrometheus();
+    if( ( received >= 3 ) && ( strncmp( request, "GET", 3 ) == 0 ) )
+    {
+        text = "HTTP/1.0 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: " + std::to_string(text.size()) + "\r\n"
+               "Connection: close\r\n\r\n" + text;
+    }
+
+    server->Send( clientSocket, text );
+    server->Disconnect( clientSocket );
+}
+
+
+/***************************************************************************//**
+ * @brief   Answers a client of the stats port on a new thread. The threads
+ *          of the clients served before are joined.
+ *
+ * @param   clientSocket    The accepted client socket.
+ * @param   server          The TCPServer for communication.
+ ******************************************************************************/
+void stStartClient( ASocket::Socket clientSocket, CTCPServer* server )
+{
+    auto done = std::make_shared<std::atomic<bool>>( false );
+
+
+    stJoinClients( false );
+
+    stClients.push_back( { std::thread( [clientSocket, server, done]()
+                                        {
+                                            stHandleClient( clientSocket, server );
+                                            done->store( true );
+                                        } ),
+                           done } );
+}
+
+
+/***************************************************************************//**
+ * @brief   Joins the threads of the stats clients.
+ *
+ * @param   all     Wait for all threads, otherwise only the finished ones
+ *                  are joined.
+ ******************************************************************************/
+void stJoinClients( bool all )
+{
+    for( auto it = stClients.begin(); it != stClients.end(); )
+    {
+        if( all || it->done->load() )
+        {
+            it->thread.join();
+            it = stClients.erase( it );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/***************************************************************************//**
+ * @file    serverStats.hpp
+ *
+ * @brief   Latency histograms and counters of the WiFi-VirtDisk server.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef SERVERSTATS_HPP
+#define SERVERSTATS_HPP
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+// Socket-CPP
+#include "TCPServer.h"
+
+
+/******************************************************************* Defines **/
+// Log-linear buckets like HdrHistogram: 2^ST_SUB_BITS buckets per power of
+// two, so every bucket is at most 12.5 % wide. Values are microseconds.
+#define ST_SUB_BITS     3
+#define ST_SUB_BUCKETS  ( 1 << ST_SUB_BITS )
+#define ST_MAGNITUDES   25                  // Up to 2^28 us (about 4.5 minutes)
+#define ST_BUCKETS      ( ST_SUB_BUCKETS * ( ST_MAGNITUDES + 1 ) )
+
+// Steps of a command, timed separately from the whole command
+typedef enum
+{
+    ST_PHASE_LOCK_WAIT = 0,     // Waiting for gDskMutex
+    ST_PHASE_DISK_OPEN,         // Opening the emulated disk (rcpmfs lookup)
+    ST_PHASE_DSK_READ,          // dsk_lread() of a sector
+    ST_PHASE_DSK_WRITE,         // dsk_lwrite() of a sector
+    ST_PHASE_FILE_IO,           // Reading or writing a plain file
+    ST_PHASE_SEND,              // Sending the answer to the client
+    ST_PHASE_GAP,               // Answer sent until the next packet received (WiFi, ESP8266 and Z80)
+    ST_PHASE_COUNT
+} stPhase_t;
+
+// Caches with a hit rate
+typedef enum
+{
+    ST_CACHE_DISK_CHECK = 0,    // Results of the file system check
+    ST_CACHE_COUNT
+} stCache_t;
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns the current time in microseconds for the latencies.
+ ******************************************************************************/
+static inline uint64_t stNow( void )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void stRecordCmd( uint8_t cmd, uint64_t us );
+void stRecordPhase( stPhase_t phase, uint64_t us );
+void stCountSector( size_t disk, bool write, bool ok );
+void stCountCache( stCache_t cache, bool hit );
+void stQueueEnter( void );
+void stQueueLeave( void );
+
+int  stSessionStart( const std::string& clientInfo );
+void stSessionCount( int session, uint64_t rxBytes, uint64_t txBytes );
+void stSessionEnd( int session );
+
+void        stPrint( void );
+std::string stPrometheus( void );
+void        stStartClient( ASocket::Socket clientSocket, CTCPServer* server );
+void        stJoinClients( bool all );
+
+
+#endif
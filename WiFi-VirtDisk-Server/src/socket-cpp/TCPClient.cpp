@@ -215,67 +215,49 @@ bool CTCPClient::Connect(const std::string& strServer, const std::string& strPor
       m_oLog(StringFormat("[TCPClient][Error] Unable to connect to server : %d", WSAGetLastError()));
 
    #else
-   memset(&m_HintsAddrInfo, 0, sizeof m_HintsAddrInfo);
-   m_HintsAddrInfo.ai_family = AF_INET; // AF_INET or AF_INET6 to force version or use AF_UNSPEC
-   m_HintsAddrInfo.ai_socktype = SOCK_STREAM;
-   //m_HintsAddrInfo.ai_flags = 0;
-   //m_HintsAddrInfo.ai_protocol = 0; /* Any protocol */
-
-   int iAddrInfoRet = getaddrinfo(strServer.c_str(), strPort.c_str(), &m_HintsAddrInfo, &m_pResultAddrInfo);
-   if (iAddrInfoRet != 0)
+   /* Only numeric IPv6 and IPv4 addresses and localhost are taken: getaddrinfo()
+    * would need the shared libraries of glibc at runtime in static programs. */
+   struct sockaddr_storage ServAddr;
+   struct sockaddr_in6* pAddr6 = reinterpret_cast<struct sockaddr_in6*>(&ServAddr);
+   struct sockaddr_in* pAddr4 = reinterpret_cast<struct sockaddr_in*>(&ServAddr);
+   const std::string strHost = (strServer == "localhost") ? "127.0.0.1" : strServer;
+   socklen_t uAddrLen = 0;
+   int iPort = atoi(strPort.c_str());
+
+   memset(&ServAddr, 0, sizeof(ServAddr));
+   if (iPort > 0 && iPort <= 0xFFFF && inet_pton(AF_INET6, strHost.c_str(), &pAddr6->sin6_addr) == 1)
    {
-      if (m_eSettingsFlags & ENABLE_LOG)
-         m_oLog(StringFormat("[TCPClient][Error] getaddrinfo failed : %s", gai_strerror(iAddrInfoRet)));
-
-      if (m_pResultAddrInfo != nullptr)
-      {
-         freeaddrinfo(m_pResultAddrInfo);
-         m_pResultAddrInfo = nullptr;
-      }
-
-      return false;
+      pAddr6->sin6_family = AF_INET6;
+      pAddr6->sin6_port = htons(iPort);
+      uAddrLen = sizeof(struct sockaddr_in6);
+   }
+   else if (iPort > 0 && iPort <= 0xFFFF && inet_pton(AF_INET, strHost.c_str(), &pAddr4->sin_addr) == 1)
+   {
+      pAddr4->sin_family = AF_INET;
+      pAddr4->sin_port = htons(iPort);
+      uAddrLen = sizeof(struct sockaddr_in);
    }
 
-   /* getaddrinfo() returns a list of address structures.
-    * Try each address until we successfully connect(2).
-    * If socket(2) (or connect(2)) fails, we (close the socket
-    * and) try the next address. */
-   struct addrinfo* pResPtr = m_pResultAddrInfo;
-   for (pResPtr = m_pResultAddrInfo; pResPtr != nullptr; pResPtr = pResPtr->ai_next)
+   if (uAddrLen != 0)
    {
-      // create socket
-      m_ConnectSocket = socket(pResPtr->ai_family, pResPtr->ai_socktype, pResPtr->ai_protocol);
-      if (m_ConnectSocket < 0) // or == -1
-         continue;
-
-      // connexion to the server
-      int iConRet = connect(m_ConnectSocket, pResPtr->ai_addr, pResPtr->ai_addrlen);
-      if (iConRet >= 0) // or != -1
+      // create socket and connect to the server
+      m_ConnectSocket = socket(ServAddr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+      if (m_ConnectSocket >= 0)
       {
-         /* Success */
-         m_eStatus = CONNECTED;
-         
-         if (m_pResultAddrInfo != nullptr)
+         if (connect(m_ConnectSocket, reinterpret_cast<struct sockaddr*>(&ServAddr), uAddrLen) >= 0)
          {
-            freeaddrinfo(m_pResultAddrInfo);
-            m_pResultAddrInfo = nullptr;
+            /* Success */
+            m_eStatus = CONNECTED;
+            return true;
          }
 
-         return true;
+         close(m_ConnectSocket);
       }
-
-      close(m_ConnectSocket);
-   }
-
-   if (m_pResultAddrInfo != nullptr)
-   {
-      freeaddrinfo(m_pResultAddrInfo); /* No longer needed */
-      m_pResultAddrInfo = nullptr;
    }
 
    /* No address succeeded */
    if (m_eSettingsFlags & ENABLE_LOG)
-      m_oLog("[TCPClient][Error] no such host.");
+      m_oLog("[TCPClient][Error] no such host or no connection.");
 
    #endif
 
@@ -6,59 +6,110 @@
 
 #include "TCPServer.h"
 
-CTCPServer::CTCPServer(const LogFnCallback oLogger,
-					   /*const std::string& strAddr,*/
-					   const std::string& strPort,
-					   const SettingsFlag eSettings /*= ALL_FLAGS*/)
-					   /*throw (EResolveError)*/ :
-		ASocket(oLogger, eSettings),
-		m_ListenSocket(INVALID_SOCKET),
+/* Resolves the bind address. An empty address binds to all interfaces with
+ * IPv6 and IPv4 (dual-stack), a host without IPv6 falls back to IPv4 in Bind(). */
 #ifdef WINDOWS
-		m_pResultAddrInfo(nullptr),
-#endif
-		//m_strHost(strAddr),
-		m_strPort(strPort) {
-#ifdef WINDOWS
-	// Resolve the server address and port
-	ZeroMemory(&m_HintsAddrInfo, sizeof(m_HintsAddrInfo));
-	/* AF_INET is used to specify the IPv4 address family. */
-	m_HintsAddrInfo.ai_family = AF_INET;
+static int ResolveBindAddr(const std::string& strAddr, const std::string& strPort,
+						   struct sockaddr_storage* pAddr, socklen_t* pAddrLen)
+{
+	struct addrinfo hints;
+	struct addrinfo* pResultAddrInfo = nullptr;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = strAddr.empty() ? AF_INET6 : AF_UNSPEC;
 	/* SOCK_STREAM is used to specify a stream socket. */
-	m_HintsAddrInfo.ai_socktype = SOCK_STREAM;
+	hints.ai_socktype = SOCK_STREAM;
 	/* IPPROTO_TCP is used to specify the TCP protocol. */
-	m_HintsAddrInfo.ai_protocol = IPPROTO_TCP;
+	hints.ai_protocol = IPPROTO_TCP;
 	/* AI_PASSIVE flag indicates the caller intends to use the returned socket
 	* address structure in a call to the bind function.*/
-	m_HintsAddrInfo.ai_flags = AI_PASSIVE;
+	hints.ai_flags = AI_PASSIVE;
 
-	int iResult = getaddrinfo(nullptr, strPort.c_str(), &m_HintsAddrInfo, &m_pResultAddrInfo);
-	if (iResult != 0)
+	int iResult = getaddrinfo(strAddr.empty() ? nullptr : strAddr.c_str(), strPort.c_str(), &hints, &pResultAddrInfo);
+	if (iResult != 0 && strAddr.empty())
 	{
-	   if (m_pResultAddrInfo != nullptr)
-	   {
-		  freeaddrinfo(m_pResultAddrInfo);
-		  m_pResultAddrInfo = nullptr;
-	   }
+		hints.ai_family = AF_INET;
+		iResult = getaddrinfo(nullptr, strPort.c_str(), &hints, &pResultAddrInfo);
+	}
 
-	   throw EResolveError(StringFormat("[TCPServer][Error] getaddrinfo failed : %d", iResult));
+	if (iResult == 0 && pResultAddrInfo != nullptr)
+	{
+		memcpy(pAddr, pResultAddrInfo->ai_addr, pResultAddrInfo->ai_addrlen);
+		*pAddrLen = static_cast<socklen_t>(pResultAddrInfo->ai_addrlen);
+	}
+	else if (iResult == 0)
+	{
+		iResult = -1;
 	}
-#else
-	// clear address structure
-	bzero((char*) &m_ServAddr, sizeof(m_ServAddr));
 
+	if (pResultAddrInfo != nullptr)
+	{
+		freeaddrinfo(pResultAddrInfo);
+	}
+
+	return iResult;
+}
+#else
+/* Only numeric IPv6 and IPv4 addresses are taken: getaddrinfo() would need
+ * the shared libraries of glibc at runtime in the statically linked server. */
+static int ResolveBindAddr(const std::string& strAddr, const std::string& strPort,
+						   struct sockaddr_storage* pAddr, socklen_t* pAddrLen)
+{
+	struct sockaddr_in6* pAddr6 = reinterpret_cast<struct sockaddr_in6*>(pAddr);
+	struct sockaddr_in* pAddr4 = reinterpret_cast<struct sockaddr_in*>(pAddr);
 	int iPort = atoi(strPort.c_str());
 
-	/* setup the host_addr structure for use in bind call */
-	// server byte order
-	m_ServAddr.sin_family = AF_INET;
+	if (iPort <= 0 || iPort > 0xFFFF)
+	{
+		return -1;
+	}
 
-	// automatically be filled with current host's IP address
-	m_ServAddr.sin_addr.s_addr = INADDR_ANY;
-	//m_ServAddr.sin_addr.s_addr = inet_addr(strAddr.c_str()); // doesn't work !
+	if (strAddr.empty())
+	{
+		pAddr6->sin6_family = AF_INET6;
+		pAddr6->sin6_addr = in6addr_any;
+		pAddr6->sin6_port = htons(iPort);
+		*pAddrLen = sizeof(struct sockaddr_in6);
+	}
+	else if (inet_pton(AF_INET6, strAddr.c_str(), &pAddr6->sin6_addr) == 1)
+	{
+		pAddr6->sin6_family = AF_INET6;
+		pAddr6->sin6_port = htons(iPort);
+		*pAddrLen = sizeof(struct sockaddr_in6);
+	}
+	else if (inet_pton(AF_INET, strAddr.c_str(), &pAddr4->sin_addr) == 1)
+	{
+		pAddr4->sin_family = AF_INET;
+		pAddr4->sin_port = htons(iPort);
+		*pAddrLen = sizeof(struct sockaddr_in);
+	}
+	else
+	{
+		return -1;
+	}
 
-	// convert short integer value for port must be converted into network byte order
-	m_ServAddr.sin_port = htons(iPort);
+	return 0;
+}
 #endif
+
+CTCPServer::CTCPServer(const LogFnCallback oLogger,
+					   const std::string& strPort,
+					   const SettingsFlag eSettings /*= ALL_FLAGS*/,
+					   const std::string& strAddr /*= ""*/)
+					   /*throw (EResolveError)*/ :
+		ASocket(oLogger, eSettings),
+		m_ListenSocket(INVALID_SOCKET),
+		m_strAddr(strAddr),
+		m_strPort(strPort),
+		m_ServAddrLen(0) {
+	memset(&m_ServAddr, 0, sizeof(m_ServAddr));
+
+	// Resolve the server address and port
+	int iResult = ResolveBindAddr(strAddr, strPort, &m_ServAddr, &m_ServAddrLen);
+	if (iResult != 0)
+	{
+	   throw EResolveError(StringFormat("[TCPServer][Error] cannot resolve the bind address '%s' : %d", strAddr.c_str(), iResult));
+	}
 }
 
 // Method for setting receive timeout. Can be called after Listen, using the previously created ClientSocket
@@ -133,188 +184,93 @@ bool CTCPServer::SetSndTimeout(ASocket::Socket& ClientSocket, struct timeval Tim
 }
 #endif
 
-// returns the socket of the accepted client
-// maxRcvTime and maxSendTime define timeouts in µs for receiving and sending over the socket. Using a negative value
-// will deactivate the timeout. 0 will set a zero timeout.
-bool CTCPServer::Listen(ASocket::Socket& ClientSocket, size_t msec /*= ACCEPT_WAIT_INF_DELAY*/) {
-	ClientSocket = INVALID_SOCKET;
-
-	// creates a socket to listen for incoming client connections if it doesn't already exist
-	if (m_ListenSocket == INVALID_SOCKET) {
-#ifdef WINDOWS
-		m_ListenSocket = socket(m_pResultAddrInfo->ai_family,
-								m_pResultAddrInfo->ai_socktype,
-								m_pResultAddrInfo->ai_protocol);
-
-		if (m_ListenSocket == INVALID_SOCKET)
-		{
-		   if (m_eSettingsFlags & ENABLE_LOG)
-			  m_oLog(StringFormat("[TCPServer][Error] socket failed : %d", WSAGetLastError()));
-		   freeaddrinfo(m_pResultAddrInfo);
-		   m_pResultAddrInfo = nullptr;
-		   return false;
-		}
-
-		// Allow the socket to be bound to an address that is already in use
-		int opt = 1;
-		int iErr = 0;
-
-		iErr = setsockopt(m_ListenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&opt), sizeof(int));
-		if (iErr < 0)
-		{
-		   if (m_eSettingsFlags & ENABLE_LOG)
-			  m_oLog("[TCPServer][Error] CTCPServer::Listen : Socket error in call to setsockopt.");
-
-		   closesocket(m_ListenSocket);
-		   freeaddrinfo(m_pResultAddrInfo); m_pResultAddrInfo = nullptr;
-
-		   m_ListenSocket = INVALID_SOCKET;
-
-		   return false;
-		}
-
-		// bind the listen socket to the host address:port
-		int iResult = bind(m_ListenSocket,
-						   m_pResultAddrInfo->ai_addr,
-						   static_cast<int>(m_pResultAddrInfo->ai_addrlen));
-
-		freeaddrinfo(m_pResultAddrInfo);	// free memory allocated by getaddrinfo
-		m_pResultAddrInfo = nullptr;
-
-		if (iResult == SOCKET_ERROR)
-		{
-		   if (m_eSettingsFlags & ENABLE_LOG)
-			  m_oLog(StringFormat("[TCPServer][Error] bind failed : %d", WSAGetLastError()));
-		   closesocket(m_ListenSocket);
-		   m_ListenSocket = INVALID_SOCKET;
-		   return false;
-		}
-#else
-
-		// create a socket
-		// socket(int domain, int type, int protocol)
-		m_ListenSocket = socket(AF_INET, SOCK_STREAM, 0/*IPPROTO_TCP*/);
-		if (m_ListenSocket < 0) {
-			if (m_eSettingsFlags & ENABLE_LOG)
-				m_oLog(StringFormat("[TCPServer][Error] opening socket : %s", strerror(errno)));
-
-			m_ListenSocket = INVALID_SOCKET;
-			return false;
-		}
-
-		// Allow the socket to be bound to an address that is already in use
-		int opt = 1;
-		int iErr = 0;
-
-		iErr = setsockopt(m_ListenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&opt), sizeof(int));
-		if (iErr < 0) {
-			if (m_eSettingsFlags & ENABLE_LOG)
-				m_oLog("[TCPServer][Error] CTCPServer::Listen : Socket error in SO_REUSEADDR call to setsockopt.");
-
-			close(m_ListenSocket);
-			m_ListenSocket = INVALID_SOCKET;
+// creates the socket, binds it to the address and starts listening, called by
+// Listen() if not done before
+bool CTCPServer::Bind() {
+	if (m_ListenSocket != INVALID_SOCKET) {
+		return true;
+	}
 
-			return false;
-		}
+	m_ListenSocket = socket(m_ServAddr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	if (m_ListenSocket == INVALID_SOCKET && m_ServAddr.ss_family == AF_INET6 && m_strAddr.empty()) {
+		// IPv6 is disabled, all interfaces with IPv4 only
+		unsigned short port = reinterpret_cast<struct sockaddr_in6*>(&m_ServAddr)->sin6_port;
+		struct sockaddr_in* pAddr4 = reinterpret_cast<struct sockaddr_in*>(&m_ServAddr);
 
-		/*
-		iErr = setsockopt(m_ListenSocket, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<char*>(&opt), sizeof(int));
-		if (iErr < 0)
-		{
-		   if (m_eSettingsFlags & ENABLE_LOG)
-			  m_oLog("[TCPServer][Error] CTCPServer::Listen : Socket error in SO_KEEPALIVE call to setsockopt.");
+		memset(&m_ServAddr, 0, sizeof(m_ServAddr));
+		pAddr4->sin_family = AF_INET;
+		pAddr4->sin_addr.s_addr = INADDR_ANY;
+		pAddr4->sin_port = port;
+		m_ServAddrLen = sizeof(struct sockaddr_in);
 
-		   close(m_ListenSocket);
-		   m_ListenSocket = INVALID_SOCKET;
-
-		   return false;
-		}
-		*/
-
-		// bind(int fd, struct sockaddr *local_addr, socklen_t addr_length)
-		// bind() passes file descriptor, the address structure,
-		// and the length of the address structure
-		// This bind() call will bind  the socket to the current IP address on port, portno
-		int iResult = bind(m_ListenSocket,
-						   reinterpret_cast<struct sockaddr*>(&m_ServAddr),
-						   sizeof(m_ServAddr));
-		if (iResult < 0) {
-			if (m_eSettingsFlags & ENABLE_LOG)
-				m_oLog(StringFormat("[TCPServer][Error] bind failed : %s", strerror(errno)));
-			return false;
-		}
-#endif
+		m_ListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	}
 
-#ifdef WINDOWS
-	sockaddr addrClient;
-	int iResult;
-	/* SOMAXCONN = allow max number of connexions in waiting */
-	iResult = listen(m_ListenSocket, SOMAXCONN);
-	if (iResult == SOCKET_ERROR)
-	{
-	   if (m_eSettingsFlags & ENABLE_LOG)
-		  m_oLog(StringFormat("[TCPServer][Error] listen failed : %d", WSAGetLastError()));
-	   closesocket(m_ListenSocket);
-	   m_ListenSocket = INVALID_SOCKET;
-	   return false;
-	}
+	if (m_ListenSocket == INVALID_SOCKET) {
+		if (m_eSettingsFlags & ENABLE_LOG)
+			m_oLog(StringFormat("[TCPServer][Error] opening socket : %s", strerror(errno)));
 
-	if (msec != ACCEPT_WAIT_INF_DELAY)
-	{
-	   int ret = SelectSocket(m_ListenSocket, msec);
-	   if (ret == 0)
-	   {
-		  if (m_eSettingsFlags & ENABLE_LOG)
-			 m_oLog("[TCPServer][Error] CTCPServer::Listen : Timed out.");
-
-		  return false;
-	   }
-
-	   if (ret == -1)
-	   {
-		  if (m_eSettingsFlags & ENABLE_LOG)
-			 m_oLog("[TCPServer][Error] CTCPServer::Listen : Error selecting socket.");
-
-		  return false;
-	   }
+		return false;
 	}
 
-	// accept client connection, the returned socket will be used for I/O operations
-	int iAddrLen = sizeof(addrClient);
-	ClientSocket = accept(m_ListenSocket, &addrClient, &iAddrLen);
-	if (ClientSocket == INVALID_SOCKET)
-	{
-	   if (m_eSettingsFlags & ENABLE_LOG)
-		  m_oLog(StringFormat("[TCPServer][Error] accept failed : %d", WSAGetLastError()));
+	// Allow the socket to be bound to an address that is already in use
+	int opt = 1;
+	int iErr = setsockopt(m_ListenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&opt), sizeof(int));
+	if (iErr < 0) {
+		if (m_eSettingsFlags & ENABLE_LOG)
+			m_oLog("[TCPServer][Error] CTCPServer::Bind : Socket error in SO_REUSEADDR call to setsockopt.");
 
-	   return false;
+		CloseListenSocket();
+		return false;
 	}
 
-	{
-	   if (m_eSettingsFlags & ENABLE_LOG)
-		  // TODO : a version that handles IPv6
-		  m_oLog( StringFormat("[TCPServer][Info] Incoming connection from '%s' port '%d'",
-			   (addrClient.sa_family == AF_INET) ? inet_ntoa(((struct sockaddr_in*)&addrClient)->sin_addr) : "",
-			   (addrClient.sa_family == AF_INET) ? ntohs(((struct sockaddr_in*)&addrClient)->sin_port) : 0));
+	// Dual-stack: IPv4 clients connect to an IPv6 socket with an IPv4-mapped address
+	if (m_ServAddr.ss_family == AF_INET6) {
+		int v6Only = 0;
+		setsockopt(m_ListenSocket, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<char*>(&v6Only), sizeof(int));
 	}
 
-	//char buf1[256];
-	//unsigned long len2 = 256UL;
-	//if (!WSAAddressToStringA(&addrClient, lenAddr, NULL, buf1, &len2))
-	   //if (m_eSettingsFlags & ENABLE_LOG)
-		  //m_oLog(StringFormat("[TCPServer][Info] Connection from %s", buf1));
+	// bind the listen socket to the host address:port
+	if (bind(m_ListenSocket, reinterpret_cast<struct sockaddr*>(&m_ServAddr), m_ServAddrLen) != 0) {
+		if (m_eSettingsFlags & ENABLE_LOG)
+			m_oLog(StringFormat("[TCPServer][Error] bind failed : %s", strerror(errno)));
+
+		CloseListenSocket();
+		return false;
+	}
 
-#else
 	// This listen() call tells the socket to listen to the incoming connections.
 	// The listen() function places all incoming connection into a backlog queue
 	// until accept() call accepts the connection.
 	// Here, we set the maximum size for the backlog queue to SOMAXCONN.
-	int iResult = listen(m_ListenSocket, SOMAXCONN);
-	if (iResult < 0) {
+	if (listen(m_ListenSocket, SOMAXCONN) != 0) {
 		if (m_eSettingsFlags & ENABLE_LOG)
 			m_oLog(StringFormat("[TCPServer][Error] listen failed : %s", strerror(errno)));
 
+		CloseListenSocket();
+		return false;
+	}
+
+	return true;
+}
+
+void CTCPServer::CloseListenSocket() {
+#ifdef WINDOWS
+	closesocket(m_ListenSocket);
+#else
+	close(m_ListenSocket);
+#endif
+	m_ListenSocket = INVALID_SOCKET;
+}
+
+// returns the socket of the accepted client
+// maxRcvTime and maxSendTime define timeouts in µs for receiving and sending over the socket. Using a negative value
+// will deactivate the timeout. 0 will set a zero timeout.
+bool CTCPServer::Listen(ASocket::Socket& ClientSocket, size_t msec /*= ACCEPT_WAIT_INF_DELAY*/) {
+	ClientSocket = INVALID_SOCKET;
+
+	// creates a socket to listen for incoming client connections if it doesn't already exist
+	if (!Bind()) {
 		return false;
 	}
 
@@ -335,8 +291,8 @@ bool CTCPServer::Listen(ASocket::Socket& ClientSocket, size_t msec /*= ACCEPT_WA
 		}
 	}
 
-	struct sockaddr_in ClientAddr;
-	// The accept() call actually accepts an incoming connection
+	// IPv4 or IPv6 address of the client
+	struct sockaddr_storage ClientAddr;
 	socklen_t uClientLen = sizeof(ClientAddr);
 
 	// This accept() function will write the connecting client's address info
@@ -349,17 +305,33 @@ bool CTCPServer::Listen(ASocket::Socket& ClientSocket, size_t msec /*= ACCEPT_WA
 						  reinterpret_cast<struct sockaddr*>(&ClientAddr),
 						  &uClientLen);
 
-	if (ClientSocket < 0) {
+	if (ClientSocket == INVALID_SOCKET) {
 		if (m_eSettingsFlags & ENABLE_LOG)
+#ifdef WINDOWS
+			m_oLog(StringFormat("[TCPServer][Error] accept failed : %d", WSAGetLastError()));
+#else
 			m_oLog(StringFormat("[TCPServer][Error] accept failed : %s", strerror(errno)));
+#endif
 
 		return false;
 	}
 
-	if (m_eSettingsFlags & ENABLE_LOG)
-		m_oLog(StringFormat("[TCPServer][Info] Incoming connection from '%s' port '%d'",
-							inet_ntoa(ClientAddr.sin_addr), ntohs(ClientAddr.sin_port)));
-#endif
+	if (m_eSettingsFlags & ENABLE_LOG) {
+		char szHost[INET6_ADDRSTRLEN] = "";
+		int iPort = 0;
+
+		if (ClientAddr.ss_family == AF_INET6) {
+			struct sockaddr_in6* pAddr6 = reinterpret_cast<struct sockaddr_in6*>(&ClientAddr);
+			inet_ntop(AF_INET6, &pAddr6->sin6_addr, szHost, sizeof(szHost));
+			iPort = ntohs(pAddr6->sin6_port);
+		} else if (ClientAddr.ss_family == AF_INET) {
+			struct sockaddr_in* pAddr4 = reinterpret_cast<struct sockaddr_in*>(&ClientAddr);
+			inet_ntop(AF_INET, &pAddr4->sin_addr, szHost, sizeof(szHost));
+			iPort = ntohs(pAddr4->sin_port);
+		}
+
+		m_oLog(StringFormat("[TCPServer][Info] Incoming connection from '%s' port '%d'", szHost, iPort));
+	}
 
 	return true;
 }
@@ -30,10 +30,12 @@
 class CTCPServer : public ASocket
 {
 public:
+   /* strAddr is the numeric local address to bind to, empty for all interfaces
+    * with IPv6 and IPv4 (dual-stack). Host names are only resolved on Windows. */
    explicit CTCPServer(const LogFnCallback oLogger,
-                       /*const std::string& strAddr,*/
                        const std::string& strPort,
-                       const SettingsFlag eSettings = ALL_FLAGS)
+                       const SettingsFlag eSettings = ALL_FLAGS,
+                       const std::string& strAddr = "")
                        /*throw (EResolveError)*/;
    
    ~CTCPServer() override;
@@ -42,9 +44,15 @@ public:
    CTCPServer(const CTCPServer&) = delete;
    CTCPServer& operator=(const CTCPServer&) = delete;
 
+   /* creates the listening socket, done by Listen() if not called before */
+   bool Bind();
+
    /* returns the socket of the accepted client, the waiting period can be set */
    bool Listen(Socket& ClientSocket, size_t msec = ACCEPT_WAIT_INF_DELAY);
 
+   /* the listening socket, e.g. to wait for several servers with SelectSockets() */
+   inline Socket GetListenSocket() const { return m_ListenSocket; }
+
    int Receive(const Socket ClientSocket,
                char* pData,
                const size_t uSize,
@@ -65,17 +73,15 @@ public:
 #endif
 
 protected:
+   void CloseListenSocket();
+
    Socket m_ListenSocket;
 
-   //std::string m_strHost;
+   std::string m_strAddr;
    std::string m_strPort;
 
-   #ifdef WINDOWS
-   struct addrinfo* m_pResultAddrInfo;
-   struct addrinfo  m_HintsAddrInfo;
-   #else
-   struct sockaddr_in m_ServAddr;
-   #endif
+   struct sockaddr_storage m_ServAddr;
+   socklen_t               m_ServAddrLen;
 
 };
 
@@ -0,0 +1,333 @@
+/***************************************************************************//**
+ * @file    tlsServer.cpp
+ *
+ * @brief   Optional TLS encryption of the VirtDisk and debug connections.
+ *
+ *          If a certificate and a key are configured, the VirtDisk and debug
+ *          ports only accept TLS connections. All connections share one
+ *          SSL_CTX, so a reconnecting client resumes its session with a
+ *          session ticket (TLS 1.3) or from the session cache (TLS 1.2)
+ *          instead of a full handshake.
+ *
+ *          Only AEAD ciphers are offered. AES-128-GCM is the fastest with
+ *          AES instructions, ChaCha20-Poly1305 without them. A client that
+ *          prefers ChaCha20 (e.g. a microcontroller) gets it, all others get
+ *          AES-GCM. The encryption of a 568 byte packet costs a few
+ *          microseconds, compared to milliseconds for a command.
+ *
+ *          The TLS layer is built with OpenSSL (VD_TLS defined by the CMake
+ *          option WIFI_VIRTDISK_TLS), otherwise all connections are in
+ *          cleartext.
+ *
+ *          The WiFi-VirtDisk client (ESP8266) has no TLS yet, so TLS is off
+ *          unless a certificate is configured. Its BearSSL stack can only
+ *          do TLS 1.2, which is why 1.2 is the default minimum. The RPC and
+ *          stats ports are always in cleartext; the RPC server only listens
+ *          on localhost by default.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstddef>
+#include <string>
+#include <chrono>
+
+#ifdef VD_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+#include "tlsServer.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+#define TL_HANDSHAKE_MS     5000            // Maximum duration of the handshake
+#define TL_SESSION_TIMEOUT  ( 24 * 3600 )   // Lifetime of a session for resumption in seconds
+
+// Ciphers of TLS 1.3 and TLS 1.2, fastest first
+#define TL_CIPHERSUITES     "TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_256_GCM_SHA384"
+#define TL_CIPHERS          "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:" \
+                            "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"  \
+                            "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384"
+
+
+/********************************************************** Global Variables **/
+#ifdef VD_TLS
+static SSL_CTX* tlCtx = nullptr;
+#endif
+
+
+/******************************************************* Functions / Methods **/
+#ifdef VD_TLS
+/***************************************************************************//**
+ * @brief   Prints an error message with the last error of OpenSSL.
+ ******************************************************************************/
+static void tlError( const std::string& msg )
+{
+    unsigned long err = ERR_get_error();
+    char          errStr[256];
+
+
+    if( err != 0 )
+    {
+        ERR_error_string_n( err, errStr, sizeof(errStr) );
+        message( MsgType::ERR, msg + ": " + errStr );
+    }
+    else
+    {
+        message( MsgType::ERR, msg );
+    }
+    ERR_clear_error();
+}
+#endif
+
+
+/***************************************************************************//**
+ * @brief   Enables TLS for the following connections.
+ *
+ * @param   certFile    Certificate of the server (PEM), optionally followed
+ *                      by the intermediate certificates.
+ * @param   keyFile     Private key of the server (PEM).
+ * @param   minVersion  Lowest TLS version, "1.3" or "1.2".
+ *
+ * @return  true if TLS is enabled, otherwise false.
+ ******************************************************************************/
+bool tlInit( const std::string& certFile, const std::string& keyFile, const std::string& minVersion )
+{
+#ifdef VD_TLS
+    static const char sessionContext[] = "WiFi-VirtDisk";
+    int               version = TLS1_2_VERSION;
+
+
+    if( minVersion == "1.3" )
+    {
+        version = TLS1_3_VERSION;
+    }
+    else if( minVersion != "1.2" )
+    {
+        message( MsgType::WARN, "Unknown TLS version " + minVersion + ", using 1.2" );
+    }
+
+    tlCtx = SSL_CTX_new( TLS_server_method() );
+    if( tlCtx == nullptr )
+    {
+        tlError( "Cannot create the TLS context" );
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version( tlCtx, version );
+    SSL_CTX_set_ciphersuites( tlCtx, TL_CIPHERSUITES );
+    SSL_CTX_set_cipher_list( tlCtx, TL_CIPHERS );
+    SSL_CTX_set_options( tlCtx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_PRIORITIZE_CHACHA |
+                                SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION );
+
+    // Session resumption, shared by all connections of the context
+    SSL_CTX_set_session_id_context( tlCtx, (const unsigned char*)sessionContext, sizeof(sessionContext) - 1 );
+    SSL_CTX_set_session_cache_mode( tlCtx, SSL_SESS_CACHE_SERVER );
+    SSL_CTX_set_timeout( tlCtx, TL_SESSION_TIMEOUT );
+
+    if( ( SSL_CTX_use_certificate_chain_file( tlCtx, certFile.c_str() ) != 1 ) ||
+        ( SSL_CTX_use_PrivateKey_file( tlCtx, keyFile.c_str(), SSL_FILETYPE_PEM ) != 1 ) ||
+        ( SSL_CTX_check_private_key( tlCtx ) != 1 ) )
+    {
+        tlError( "Cannot load the TLS certificate " + certFile + " and key " + keyFile );
+        SSL_CTX_free( tlCtx );
+        tlCtx = nullptr;
+        return false;
+    }
+
+    message( MsgType::INFO, "TLS enabled (TLS " + std::string( version == TLS1_3_VERSION ? "1.3" : "1.2" ) +
+                            " or newer), certificate: " + certFile );
+
+    return true;
+#else
+    (void)certFile;
+    (void)keyFile;
+    (void)minVersion;
+
+    message( MsgType::ERR, "TLS is not available, the server was built without OpenSSL" );
+
+    return false;
+#endif
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the connections are encrypted.
+ ******************************************************************************/
+bool tlEnabled( void )
+{
+#ifdef VD_TLS
+    return tlCtx != nullptr;
+#else
+    return false;
+#endif
+}
+
+
+/***************************************************************************//**
+ * @brief   Frees the TLS context, after all connections are closed.
+ ******************************************************************************/
+void tlCleanup( void )
+{
+#ifdef VD_TLS
+    if( tlCtx != nullptr )
+    {
+        SSL_CTX_free( tlCtx );
+        tlCtx = nullptr;
+    }
+#endif
+}
+
+
+/***************************************************************************//**
+ * @brief   Starts the encryption of an accepted connection. Nothing happens
+ *          if TLS is not enabled.
+ *
+ *          The receive timeout of the socket has to be set, the handshake is
+ *          repeated until it is finished or TL_HANDSHAKE_MS have passed.
+ *
+ * @param   conn        The connection, conn.ssl is set.
+ * @param   clientInfo  IP address and port of the client for the log.
+ *
+ * @return  true if the connection can be used, otherwise false.
+ ******************************************************************************/
+bool tlAccept( tlConn_t& conn, const std::string& clientInfo )
+{
+    conn.ssl = nullptr;
+
+#ifdef VD_TLS
+    if( tlCtx == nullptr )
+    {
+        return true;
+    }
+
+    conn.ssl = SSL_new( tlCtx );
+    if( ( conn.ssl == nullptr ) || ( SSL_set_fd( conn.ssl, (int)conn.socket ) != 1 ) )
+    {
+        tlError( "Cannot create the TLS connection (" + clientInfo + ")" );
+        SSL_free( conn.ssl );
+        conn.ssl = nullptr;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int  ret;
+
+    ERR_clear_error();
+    while( ( ret = SSL_accept( conn.ssl ) ) != 1 )
+    {
+        int err = SSL_get_error( conn.ssl, ret );
+
+        if( ( ( err != SSL_ERROR_WANT_READ ) && ( err != SSL_ERROR_WANT_WRITE ) ) ||
+            ( std::chrono::steady_clock::now() - start > std::chrono::milliseconds( TL_HANDSHAKE_MS ) ) )
+        {
+            tlError( "TLS handshake failed (" + clientInfo + ")" );
+            SSL_free( conn.ssl );
+            conn.ssl = nullptr;
+            return false;
+        }
+    }
+
+    message( MsgType::INFO, "TLS connection (" + clientInfo + "): " + SSL_get_version( conn.ssl ) + ", " +
+                            SSL_get_cipher_name( conn.ssl ) + ( SSL_session_reused( conn.ssl ) ? ", session resumed" : "" ) );
+#else
+    (void)clientInfo;
+#endif
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Receives data like CTCPServer::Receive() without reading fully.
+ *
+ * @return  Number of bytes received, 0 if the client closed the connection,
+ *          negative if nothing was received within the receive timeout.
+ ******************************************************************************/
+int tlReceive( tlConn_t& conn, char* buffer, size_t size )
+{
+#ifdef VD_TLS
+    if( conn.ssl != nullptr )
+    {
+        ERR_clear_error();
+        int ret = SSL_read( conn.ssl, buffer, (int)size );
+
+        if( ret > 0 )
+        {
+            return ret;
+        }
+
+        switch( SSL_get_error( conn.ssl, ret ) )
+        {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                return -1;          // Timeout
+
+#if defined(_WIN32)
+            case SSL_ERROR_SYSCALL:
+                if( WSAGetLastError() == WSAETIMEDOUT ) { return -1; }
+                return 0;
+#endif
+
+            default:
+                return 0;           // Closed or broken
+        }
+    }
+#endif
+
+    return conn.server->Receive( conn.socket, buffer, size, false );
+}
+
+
+/***************************************************************************//**
+ * @brief   Sends data over the connection.
+ *
+ * @return  true if all data was sent, otherwise false.
+ ******************************************************************************/
+bool tlSend( tlConn_t& conn, const char* buffer, size_t size )
+{
+#ifdef VD_TLS
+    if( conn.ssl != nullptr )
+    {
+        size_t total = 0;
+
+        ERR_clear_error();
+        while( total < size )
+        {
+            int ret = SSL_write( conn.ssl, buffer + total, (int)( size - total ) );
+
+            if( ret <= 0 )
+            {
+                return false;
+            }
+            total += ret;
+        }
+
+        return true;
+    }
+#endif
+
+    return conn.server->Send( conn.socket, buffer, size );
+}
+
+
+/***************************************************************************//**
+ * @brief   Ends the encryption and closes the connection.
+ ******************************************************************************/
+void tlDisconnect( tlConn_t& conn )
+{
+#ifdef VD_TLS
+    if( conn.ssl != nullptr )
+    {
+        SSL_shutdown( conn.ssl );       // Sends close_notify, the session stays resumable
+        SSL_free( conn.ssl );
+        conn.ssl = nullptr;
+    }
+#endif
+
+    conn.server->Disconnect( conn.socket );
+}
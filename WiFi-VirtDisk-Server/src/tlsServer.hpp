@@ -0,0 +1,43 @@
+/***************************************************************************//**
+ * @file    tlsServer.hpp
+ *
+ * @brief   Optional TLS encryption of the VirtDisk and debug connections.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef TLSSERVER_HPP
+#define TLSSERVER_HPP
+
+/****************************************************************** Includes **/
+#include <cstddef>
+#include <string>
+
+// Socket-CPP
+#include "TCPServer.h"
+
+
+/******************************************************************* Defines **/
+// A client connection, encrypted if ssl is set
+typedef struct
+{
+    ASocket::Socket socket;
+    CTCPServer*     server;
+    struct ssl_st*  ssl;        // OpenSSL SSL, only used by tlsServer.cpp
+} tlConn_t;
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+bool tlInit( const std::string& certFile, const std::string& keyFile, const std::string& minVersion );
+bool tlEnabled( void );
+void tlCleanup( void );
+
+bool tlAccept( tlConn_t& conn, const std::string& clientInfo );
+int  tlReceive( tlConn_t& conn, char* buffer, size_t size );
+bool tlSend( tlConn_t& conn, const char* buffer, size_t size );
+void tlDisconnect( tlConn_t& conn );
+
+
+#endif
@@ -0,0 +1,1408 @@
+/***************************************************************************//**
+ * @file    vdBench.cpp
+ *
+ * @brief   Load generator and benchmark for the WiFi-VirtDisk protocol.
+ *
+ *          vd-bench takes the place of the ESP8266 and sends vdPacket_t
+ *          packets to a running server. It replays CP/M like workloads:
+ *
+ *          - boot:   warm boot, reads the system track
+ *          - pip:    PIP of a 64 KB file, reads the source and writes the
+ *                    destination, updating the directory every extent
+ *          - dir:    directory scan, reads all directory sectors
+ *          - random: random record I/O, one write for every three reads
+ *
+ *          The workloads only write back the data they have read before,
+ *          so the disk content does not change. The operations come from a
+ *          seeded random generator and are the same on every run.
+ *
+ *          The server serves one client and one open file, so several Z80
+ *          boards are emulated on one connection. Their operations are
+ *          interleaved and every board selects its file again when it is
+ *          its turn, like several boards taking turns on the server.
+ *
+ *          For every workload the sectors/s, the p50 and p99 latency of an
+ *          operation and the CPU time per sector are reported. The CPU time
+ *          of the server is read from /proc if its process id is given.
+ *
+ *          With --replay, a trace of the server (see vdTrace.cpp) is replayed
+ *          instead of the workloads, as fast as possible or with the recorded
+ *          timing. The commands are sent to a server or, with --libdsk, are
+ *          executed directly through LibDsk on the emulated disks of a
+ *          configuration file. The latencies of the replay are reported next
+ *          to the recorded ones, so cache and prefetch policies can be
+ *          compared offline with the access pattern of real CP/M sessions.
+ *          The trace has no data, a traced write is replayed as a write of
+ *          the data read before.
+ *
+ *          With --compact, the compact frames of vdWire.h are negotiated like
+ *          the client does. The bytes on the wire per sector show the saving.
+ *
+ *          With --kernels, the sector kernels of LibDsk (dsksimd.c) are timed
+ *          in every version the CPU supports, no server is needed. The
+ *          results of the SSE2 and AVX2 versions are checked against the C
+ *          versions.
+ *
+ *          With --ldbs, the track lookups of LDBS images (ldbs.c) are timed
+ *          with the track index and with the search of the track directory
+ *          it replaced, no server is needed.
+ *
+ *          With --cpmfs, a z80mbc2-d0 image in a temporary directory is packed
+ *          with about 8 MB of files, which are then copied out with cpmOpen()
+ *          and cpmRead() like cpmcp does. LibDsk must find the geometry
+ *          z80mbc2-d0 (LIBDSK environment variable), no server is needed.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <filesystem>
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Socket-CPP
+#include "TCPClient.h"
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+
+// LibDsk
+#include <stddef.h>
+#include <libdsk.h>
+#include "dsksimd.h"
+extern "C" {
+#include "ldbs.h"
+}
+
+// SimpleIni
+#include "SimpleIni/SimpleIni.h"
+
+// ArgParse
+#include "argparse.h"
+
+#include "virtDisk.hpp"
+#include "vdFrame.h"
+#include "vdWire.h"
+#include "vdTrace.hpp"
+#include "version.h"
+
+
+/******************************************************************* Defines **/
+#define VB_SECTOR       512
+#define VB_SYSTEM_SECS  32          // Boot track of z80mbc2-d0
+#define VB_DIR_SECTOR   32          // First directory sector of z80mbc2-d0
+#define VB_DIR_SECS     32          // 512 entries of 32 bytes
+#define VB_EXTENT_SECS  32          // Sectors of a 16 KB extent
+#define VB_PIP_SECS     128         // 64 KB file
+#define VB_KERNEL_LOOPS 200000      // Sectors per kernel and version
+#define VB_LDBS_LOOPS   200000      // Track lookups per image and method
+#define VB_CPMFS_FORMAT "z80mbc2-d0"
+#define VB_CPMFS_IMAGE  "vd-bench.img"
+#define VB_CPMFS_TRACKS 512         // 8 MB image
+#define VB_CPMFS_FILES  63          // 63 files of 128 KB, 7.9 MB of 8 MB
+#define VB_CPMFS_SIZE   ( 128 * 1024 )
+#define VB_CPMFS_BUFFER 4096        // Bytes per cpmRead()
+#define VB_CPMFS_PASSES 5           // Timed passes after the one that checks the data
+
+auto LogPrinter = [](const std::string& strLogMsg) { std::cerr << strLogMsg << std::endl; };
+
+// One sector access of a board, a write is a read-modify-write
+typedef struct
+{
+    int         board;
+    uint32_t    sector;
+    bool        write;
+} vbOp_t;
+
+typedef struct
+{
+    CTCPClient* tcp;
+    std::string selected;   // File selected on the server
+    int64_t     position;   // File position on the server, -1 if unknown
+    uint64_t    commands;   // Packets sent
+    uint64_t    sectors;    // Sectors transferred
+    uint64_t    errors;     // Commands with an error status
+    uint8_t     wireEnc;    // Negotiated compact frames (VD_WIRE_...), 0: full packets
+    uint64_t    bytes;      // Bytes sent and received
+} vbClient_t;
+
+typedef struct
+{
+    std::string name;
+    uint64_t    ops;
+    uint64_t    sectors;
+    uint64_t    errors;
+    double      seconds;
+    uint64_t    p50;
+    uint64_t    p99;
+    double      clientCpu;  // CPU microseconds per sector
+    double      serverCpu;  // CPU microseconds per sector, negative if unknown
+    double      wireBytes;  // Bytes on the wire per sector
+} vbResult_t;
+
+// Emulated disks of a configuration file, for the replay through LibDsk
+typedef struct
+{
+    std::vector<std::string> filename;
+    std::vector<std::string> path;
+    std::vector<std::string> format;
+    struct Device            dev;
+    int                      disk;      // Opened disk, -1 if none
+} vbLibDsk_t;
+
+typedef struct
+{
+    uint64_t              ops;          // Replayed commands
+    uint64_t              sectors;      // Replayed reads and writes
+    uint64_t              extra;        // Additional commands for positioning and read-modify-write
+    uint64_t              skipped;      // Commands without an equivalent in the replay
+    uint64_t              differ;       // Status differs from the trace
+    std::vector<uint64_t> recorded;     // Latencies of the trace
+    std::vector<uint64_t> replayed;     // Latencies of the replay
+} vbReplay_t;
+
+// Command line arguments
+struct vbArgs : public argparse::Args
+{
+    std::string& host     = kwarg( "host", "Address of the WiFi-VirtDisk server (numeric or localhost)" ).set_default( "127.0.0.1" );
+    std::string& port     = kwarg( "port", "Port of the WiFi-VirtDisk server" ).set_default( "12345" );
+    std::vector<std::string>& targets = kwarg( "targets", "Emulated disks (e.g. DS0N00.DSK) or plain files of the server" ).multi_argument().set_default( std::vector<std::string>{ "DS0N00.DSK" } );
+    std::vector<std::string>& workloads = kwarg( "workloads", "boot, pip, dir and/or random" ).multi_argument().set_default( std::vector<std::string>{ "boot", "pip", "dir", "random" } );
+    int& boards           = kwarg( "boards", "Number of emulated Z80 boards" ).set_default( 1 );
+    int& repeat           = kwarg( "repeat", "Repetitions of boot, pip and dir per board" ).set_default( 4 );
+    int& randomOps        = kwarg( "random-ops", "Operations of the random workload per board" ).set_default( 256 );
+    int& span             = kwarg( "span", "Sectors used by the random workload" ).set_default( 1024 );
+    int& seed             = kwarg( "seed", "Seed of the random workload" ).set_default( 1 );
+    int& serverPid        = kwarg( "server-pid", "Process id of the server for its CPU time (Linux)" ).set_default( 0 );
+    std::optional<std::string>& replay = kwarg( "replay", "Replay the trace <file> instead of the workloads" );
+    std::optional<std::string>& libdsk = kwarg( "libdsk", "Replay through LibDsk on the emulated disks of the configuration <file>, without a server" );
+    bool& realtime        = flag( "realtime", "Replay with the recorded timing instead of as fast as possible" );
+    bool& compact         = flag( "compact", "Negotiate compact frames with the server, like the client" );
+    bool& kernels         = flag( "kernels", "Benchmark the sector kernels of LibDsk instead of the workloads" );
+    bool& ldbs            = flag( "ldbs", "Benchmark the track lookups of LDBS images instead of the workloads" );
+    bool& cpmfs           = flag( "cpmfs", "Benchmark copying 8 MB of files out of a z80mbc2-d0 image instead of the workloads" );
+};
+
+
+/********************************************************** Global Variables **/
+const char cmd[] = "vd-bench";     // Program name in the messages of the CP/M tools
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Returns the CPU time of a process in microseconds.
+ *
+ * @param   pid     Process id, 0 for this process.
+ *
+ * @return  The CPU time, negative if it is not available.
+ ******************************************************************************/
+static double vbCpuTime( int pid )
+{
+    if( pid == 0 )
+    {
+        return 1e6 * (double)std::clock() / CLOCKS_PER_SEC;
+    }
+
+#if defined(__linux__)
+    std::ifstream stat( "/proc/" + std::to_string(pid) + "/stat" );
+    std::string   line;
+
+    if( std::getline( stat, line ) )
+    {
+        // utime and stime are field 14 and 15, counted after the command name
+        std::istringstream fields( line.substr( line.rfind( ')' ) + 2 ) );
+        std::string        field;
+        unsigned long long utime = 0, stime = 0;
+
+        for( int i = 3; i <= 15 && ( fields >> field ); i++ )
+        {
+            if( i == 14 ) { utime = std::stoull( field ); }
+            if( i == 15 ) { stime = std::stoull( field ); }
+        }
+
+        return 1e6 * (double)( utime + stime ) / sysconf( _SC_CLK_TCK );
+    }
+#endif
+
+    return -1.0;
+}
+
+
+/***************************************************************************//**
+ * @brief   Sends a packet and receives the answer of the server.
+ *
+ * @return  true if the answer was received and its status is OK.
+ ******************************************************************************/
+static bool vbTransfer( vbClient_t& client, vdPacket_t& packet )
+{
+    uint8_t frame[VD_WIRE_MAX_LEN];
+    int     sent;
+    int     len;
+
+
+    client.commands++;
+
+    if( client.wireEnc != 0 )
+    {
+        // Only a write has data
+        sent = vdWirePack( (uint8_t*)packet.rawData, packet.packet.cmd == VD_CMD_WR_FILE, client.wireEnc, frame );
+        if( !client.tcp->Send( (char*)frame, sent ) )
+        {
+            return false;
+        }
+
+        if( client.tcp->Receive( (char*)frame, VD_WIRE_HEAD_LEN, true ) != VD_WIRE_HEAD_LEN )
+        {
+            return false;
+        }
+        len = vdWireFrameLen( frame, VD_WIRE_HEAD_LEN );
+        if( ( len == 0 ) ||
+            ( ( len > VD_WIRE_HEAD_LEN ) &&
+              ( client.tcp->Receive( (char*)frame + VD_WIRE_HEAD_LEN, len - VD_WIRE_HEAD_LEN, true ) != len - VD_WIRE_HEAD_LEN ) ) ||
+            !vdWireUnpack( frame, (uint8_t*)packet.rawData ) )
+        {
+            return false;
+        }
+        client.bytes += sent + len;
+    }
+    else
+    {
+        if( !client.tcp->Send( packet.rawData, sizeof(packet.rawData) ) )
+        {
+            return false;
+        }
+
+        if( client.tcp->Receive( packet.rawData, sizeof(packet.rawData), true ) != (int)sizeof(packet.rawData) )
+        {
+            return false;
+        }
+        client.bytes += 2 * sizeof(packet.rawData);
+    }
+
+    if( packet.packet.status != VD_STATUS_OK )
+    {
+        client.errors++;
+        return false;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Prepares a packet for a command on a file.
+ ******************************************************************************/
+static void vbPacket( vdPacket_t& packet, uint8_t cmd, const std::string& name )
+{
+    memset( &packet, 0, sizeof(packet) );
+    packet.packet.cmd = cmd;
+    strncpy( packet.packet.filename, name.c_str(), sizeof(packet.packet.filename) - 1 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Prepares a write of the data of a read, with the CRC-16 of every
+ *          segment.
+ ******************************************************************************/
+static void vbWriteBack( vdPacket_t& packet, const std::string& name, const vdPacket_t& data )
+{
+    vbPacket( packet, VD_CMD_WR_FILE, name );
+    memcpy( packet.packet.data, data.packet.data, sizeof(packet.packet.data) );
+    packet.packet.dataLen = VB_SECTOR;
+
+    for( int seg = 0; seg < VD_SEGMENTS; seg++ )
+    {
+        packet.packet.segCrc[seg] = vdCrc16( packet.packet.data + seg * VD_SEGMENT_SIZE, VD_SEGMENT_SIZE );
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Offers the compact frames to the server, like the client after the
+ *          connect. An older server does not answer VD_CMD_ENCODING, then
+ *          the full packets are kept.
+ ******************************************************************************/
+static void vbNegotiate( vbClient_t& client )
+{
+    vdPacket_t packet;
+
+
+    vbPacket( packet, VD_CMD_ENCODING, "" );
+    packet.packet.data[0] = VD_WIRE_ALL;
+
+    if( vbTransfer( client, packet ) && ( packet.packet.data[0] & VD_WIRE_COMPACT ) )
+    {
+        client.wireEnc = packet.packet.data[0];
+    }
+
+    std::cout << "Encoding: " << ( client.wireEnc ? "compact frames" : "full packets" )
+              << ( ( client.wireEnc & VD_WIRE_FILL ) ? ", fill" : "" )
+              << ( ( client.wireEnc & VD_WIRE_RLE )  ? ", RLE" : "" ) << std::endl;
+}
+
+
+/***************************************************************************//**
+ * @brief   Selects the file and moves to the file position, if not done
+ *          already.
+ ******************************************************************************/
+static bool vbPosition( vbClient_t& client, const std::string& name, uint32_t offset )
+{
+    vdPacket_t packet;
+
+
+    if( client.selected != name )
+    {
+        vbPacket( packet, VD_CMD_SEL_FILE, name );
+        if( !vbTransfer( client, packet ) ) { return false; }
+
+        client.selected = name;
+        client.position = 0;
+    }
+
+    if( client.position != (int64_t)offset )
+    {
+        vbPacket( packet, VD_CMD_SEEK_FILE, name );
+        packet.packet.fileOffset = offset;
+        if( !vbTransfer( client, packet ) ) { return false; }
+
+        client.position = offset;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Executes one operation: reads the sector and for a write writes
+ *          the same data back.
+ ******************************************************************************/
+static bool vbExecute( vbClient_t& client, const std::string& name, const vbOp_t& op )
+{
+    vdPacket_t packet;
+    vdPacket_t data;
+
+
+    if( !vbPosition( client, name, op.sector * VB_SECTOR ) ) { return false; }
+
+    vbPacket( data, VD_CMD_RD_FILE, name );
+    if( !vbTransfer( client, data ) )
+    {
+        client.position = -1;
+        return false;
+    }
+    client.position = ( data.packet.dataLen == VB_SECTOR ) ? client.position + VB_SECTOR : -1;
+    client.sectors++;
+
+    if( op.write )
+    {
+        if( !vbPosition( client, name, op.sector * VB_SECTOR ) ) { return false; }
+
+        vbWriteBack( packet, name, data );
+        if( !vbTransfer( client, packet ) )
+        {
+            client.position = -1;
+            return false;
+        }
+        client.position += VB_SECTOR;
+        client.sectors++;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Creates the operations of one board for a workload.
+ ******************************************************************************/
+static std::vector<vbOp_t> vbWorkload( const std::string& workload, int board, const vbArgs& args, std::mt19937& rng )
+{
+    std::vector<vbOp_t> ops;
+
+
+    if( workload == "boot" )
+    {
+        for( int r = 0; r < args.repeat; r++ )
+        {
+            for( uint32_t sec = 0; sec < VB_SYSTEM_SECS; sec++ )
+            {
+                ops.push_back( { board, sec, false } );
+            }
+        }
+    }
+    else if( workload == "pip" )
+    {
+        // Source and destination file behind the directory
+        uint32_t src = VB_DIR_SECTOR + VB_DIR_SECS;
+        uint32_t dst = src + VB_PIP_SECS;
+
+        for( int r = 0; r < args.repeat; r++ )
+        {
+            for( uint32_t sec = 0; sec < VB_PIP_SECS; sec++ )
+            {
+                ops.push_back( { board, src + sec, false } );
+            }
+            for( uint32_t sec = 0; sec < VB_PIP_SECS; sec++ )
+            {
+                ops.push_back( { board, dst + sec, true } );
+
+                // The BDOS writes the directory entry at the end of every extent
+                if( ( sec % VB_EXTENT_SECS ) == VB_EXTENT_SECS - 1 )
+                {
+                    ops.push_back( { board, VB_DIR_SECTOR, true } );
+                }
+            }
+        }
+    }
+    else if( workload == "dir" )
+    {
+        for( int r = 0; r < args.repeat; r++ )
+        {
+            for( uint32_t sec = 0; sec < VB_DIR_SECS; sec++ )
+            {
+                ops.push_back( { board, VB_DIR_SECTOR + sec, false } );
+            }
+        }
+    }
+    else if( workload == "random" )
+    {
+        std::uniform_int_distribution<uint32_t> sector( 0, std::max( 1, args.span ) - 1 );
+
+        for( int i = 0; i < args.randomOps; i++ )
+        {
+            uint32_t sec = sector( rng );
+            ops.push_back( { board, sec, ( rng() % 4 ) == 0 } );
+        }
+    }
+
+    return ops;
+}
+
+
+/***************************************************************************//**
+ * @brief   Runs a workload on a target and measures it.
+ ******************************************************************************/
+static vbResult_t vbRun( vbClient_t& client, const std::string& target, const std::string& workload, const vbArgs& args )
+{
+    std::mt19937                     rng( args.seed );
+    std::vector<std::vector<vbOp_t>> boards;
+    std::vector<uint64_t>            latency;
+    vbResult_t                       result = {};
+    size_t                           longest = 0;
+
+
+    for( int board = 0; board < args.boards; board++ )
+    {
+        boards.push_back( vbWorkload( workload, board, args, rng ) );
+        longest = std::max( longest, boards.back().size() );
+    }
+
+    uint64_t sectors   = client.sectors;
+    uint64_t errors    = client.errors;
+    uint64_t bytes     = client.bytes;
+    double   clientCpu = vbCpuTime( 0 );
+    double   serverCpu = args.serverPid ? vbCpuTime( args.serverPid ) : -1.0;
+    auto     start     = std::chrono::steady_clock::now();
+
+    // Round robin over the boards, one operation each
+    for( size_t i = 0; i < longest; i++ )
+    {
+        for( int board = 0; board < args.boards; board++ )
+        {
+            if( i >= boards[board].size() ) { continue; }
+
+            // Another board had the server, it selects its file again
+            if( args.boards > 1 ) { client.selected.clear(); }
+
+            auto opStart = std::chrono::steady_clock::now();
+            if( !vbExecute( client, target, boards[board][i] ) )
+            {
+                client.selected.clear();
+                client.position = -1;
+                if( !client.tcp->IsConnected() ) { break; }
+            }
+            latency.push_back( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - opStart ).count() );
+        }
+    }
+
+    result.name    = workload;
+    result.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    result.ops     = latency.size();
+    result.sectors = client.sectors - sectors;
+    result.errors  = client.errors - errors;
+
+    std::sort( latency.begin(), latency.end() );
+    if( !latency.empty() )
+    {
+        result.p50 = latency[( latency.size() - 1 ) * 50 / 100];
+        result.p99 = latency[( latency.size() - 1 ) * 99 / 100];
+    }
+
+    double sectorsDiv = result.sectors ? (double)result.sectors : 1.0;
+    result.clientCpu  = ( vbCpuTime( 0 ) - clientCpu ) / sectorsDiv;
+    result.serverCpu  = ( serverCpu >= 0.0 ) ? ( vbCpuTime( args.serverPid ) - serverCpu ) / sectorsDiv : -1.0;
+    result.wireBytes  = ( client.bytes - bytes ) / sectorsDiv;
+
+    return result;
+}
+
+/***************************************************************************//**
+ * @brief   Reads a trace of the server.
+ *
+ * @return  true if the trace was read, otherwise false.
+ ******************************************************************************/
+static bool vbReadTrace( const std::string& path, std::vector<trRecord_t>& records )
+{
+    std::ifstream file( path, std::ios::binary );
+    trHeader_t    header;
+    trRecord_t    record;
+
+
+    if( !file.read( (char*)&header, sizeof(header) ) ||
+        ( memcmp( header.magic, TR_MAGIC, sizeof(header.magic) ) != 0 ) || ( header.version != TR_VERSION ) )
+    {
+        std::cerr << "No trace of version " << TR_VERSION << ": " << path << std::endl;
+        return false;
+    }
+
+    while( file.read( (char*)&record, sizeof(record) ) )
+    {
+        records.push_back( record );
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Reads the emulated disks of a configuration file of the server.
+ *
+ * @return  true if at least one emulated disk was found, otherwise false.
+ ******************************************************************************/
+static bool vbReadConfig( const std::string& path, vbLibDsk_t& dsk )
+{
+    CSimpleIniA ini;
+
+
+    ini.SetUnicode();
+    if( ini.LoadFile( path.c_str() ) < 0 )
+    {
+        std::cerr << "Cannot read the configuration file: " << path << std::endl;
+        return false;
+    }
+
+    for( int diskNum = 0; diskNum < 4; diskNum++ )
+    {
+        std::string section  = "EmuDisk" + std::to_string(diskNum);
+        const char* filename = ini.GetValue( section.c_str(), "diskEmuFilename", nullptr );
+        const char* diskPath = ini.GetValue( section.c_str(), "diskEmuPath", nullptr );
+        const char* format   = ini.GetValue( section.c_str(), "diskEmuFormat", nullptr );
+
+        if( filename != nullptr && diskPath != nullptr && format != nullptr )
+        {
+            dsk.filename.push_back( filename );
+            dsk.path.push_back( diskPath );
+            dsk.format.push_back( format );
+        }
+    }
+
+    if( dsk.filename.empty() )
+    {
+        std::cerr << "No emulated disks in the configuration file: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Replays a command of the trace on the server.
+ *
+ * @param   client      Connection to the server.
+ * @param   record      The command of the trace.
+ * @param   latency     Receives the latency of the command in microseconds.
+ *
+ * @return  Status of the command, -1 if the connection failed.
+ ******************************************************************************/
+static int vbReplayServer( vbClient_t& client, const trRecord_t& record, uint64_t& latency )
+{
+    std::string name = trUnpackName( record.name );
+    vdPacket_t  packet;
+    vdPacket_t  data;
+    bool        positioned = true;
+
+
+    // A command that failed in the trace is sent as it is, otherwise the
+    // file and position of the server are corrected first
+    if( ( record.status == VD_STATUS_OK ) && ( ( record.cmd == VD_CMD_RD_FILE ) || ( record.cmd == VD_CMD_WR_FILE ) ) )
+    {
+        positioned = vbPosition( client, name, record.offset );
+    }
+
+    // The data of a write is unknown, the sector is written back unchanged
+    if( positioned && ( record.status == VD_STATUS_OK ) && ( record.cmd == VD_CMD_WR_FILE ) )
+    {
+        vbPacket( data, VD_CMD_RD_FILE, name );
+        positioned = vbTransfer( client, data );
+
+        client.position = -1;       // Seek back to the sector
+        positioned = positioned && vbPosition( client, name, record.offset );
+        vbWriteBack( packet, name, data );
+    }
+    else
+    {
+        vbPacket( packet, record.cmd, name );
+        packet.packet.fileOffset = record.offset;
+    }
+
+    if( !positioned && !client.tcp->IsConnected() )
+    {
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok    = vbTransfer( client, packet );
+    latency    = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    if( !ok && !client.tcp->IsConnected() )
+    {
+        return -1;
+    }
+
+    // Follow the file and position of the server
+    switch( record.cmd )
+    {
+        case VD_CMD_SEL_FILE:
+            client.selected = ok ? name : "";
+            client.position = 0;
+        break;
+
+        case VD_CMD_SEEK_FILE:
+            client.position = ok ? (int64_t)record.offset : -1;
+        break;
+
+        case VD_CMD_RD_FILE:
+            client.position = ok ? client.position + packet.packet.dataLen : -1;
+        break;
+
+        case VD_CMD_WR_FILE:
+            client.position = ok ? client.position + VB_SECTOR : -1;
+        break;
+    }
+
+    return packet.packet.status;
+}
+
+
+/***************************************************************************//**
+ * @brief   Replays a command of the trace directly through LibDsk, like the
+ *          server does for an emulated disk.
+ *
+ * @param   dsk         The emulated disks.
+ * @param   record      The command of the trace.
+ * @param   latency     Receives the latency of the command in microseconds.
+ *
+ * @return  Status of the command, -1 if the command has no equivalent.
+ ******************************************************************************/
+static int vbReplayLibDsk( vbLibDsk_t& dsk, const trRecord_t& record, uint64_t& latency )
+{
+    std::string   name   = trUnpackName( record.name );
+    int           status = VD_STATUS_OK;
+    unsigned char sector[VB_SECTOR];
+    dsk_err_t     err;
+
+
+    auto start = std::chrono::steady_clock::now();
+
+    switch( record.cmd )
+    {
+        case VD_CMD_SEL_FILE:
+        {
+            if( dsk.dev.opened )
+            {
+                Device_close( &dsk.dev );
+            }
+            dsk.disk = -1;
+
+            auto it = std::find( dsk.filename.begin(), dsk.filename.end(), name );
+            if( it == dsk.filename.end() )
+            {
+                return -1;      // Plain file
+            }
+
+            // The server opens the disk on every selection
+            size_t      disk  = it - dsk.filename.begin();
+            std::string opts  = "rcpmfs," + dsk.format[disk];
+            const char* error = Device_open( &dsk.dev, dsk.path[disk].c_str(), O_RDWR, opts.c_str() );
+
+            if( ( dsk.dev.opened == 0 ) || ( error != NULL ) )
+            {
+                std::cerr << "Cannot open " << dsk.path[disk] << ": " << ( error ? error : "" ) << std::endl;
+            }
+            else
+            {
+                dsk.disk = (int)disk;
+            }
+        }
+        break;
+
+        case VD_CMD_RD_FILE:
+        case VD_CMD_WR_FILE:
+            if( ( dsk.disk < 0 ) || ( dsk.filename[dsk.disk] != name ) )
+            {
+                return -1;      // Plain file or not selected
+            }
+
+            err = dsk_lread( dsk.dev.dev, &dsk.dev.geom, sector, record.offset / VB_SECTOR );
+
+            if( record.cmd == VD_CMD_RD_FILE )
+            {
+                status = err ? VD_STATUS_SEC_RD_ERROR : VD_STATUS_OK;
+            }
+            else
+            {
+                // The data of a write is unknown, the sector is written back unchanged
+                start  = std::chrono::steady_clock::now();
+                err    = err ? err : dsk_lwrite( dsk.dev.dev, &dsk.dev.geom, sector, record.offset / VB_SECTOR );
+                status = err ? VD_STATUS_SEC_WR_ERROR : VD_STATUS_OK;
+            }
+        break;
+
+        default:
+            return -1;          // No disk access
+    }
+
+    latency = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    return status;
+}
+
+
+/***************************************************************************//**
+ * @brief   Replays a trace on the server or through LibDsk.
+ *
+ * @param   client  Connection to the server, NULL for LibDsk.
+ * @param   dsk     The emulated disks for LibDsk.
+ *
+ * @return  The counters and latencies of the replay.
+ ******************************************************************************/
+static vbReplay_t vbReplay( vbClient_t* client, vbLibDsk_t& dsk, const std::vector<trRecord_t>& records, bool realtime )
+{
+    vbReplay_t replay = {};
+    auto       start  = std::chrono::steady_clock::now();
+
+
+    for( const auto& record : records )
+    {
+        uint64_t latency  = 0;
+        uint64_t commands = client ? client->commands : 0;
+        int      status;
+
+        // Retransmitted writes are not replayed, the data did not arrive
+        if( record.status == VD_STATUS_CHKSUM_ERROR )
+        {
+            replay.skipped++;
+            continue;
+        }
+
+        if( realtime )
+        {
+            std::this_thread::sleep_until( start + std::chrono::microseconds( record.time - records.front().time ) );
+        }
+
+        status = client ? vbReplayServer( *client, record, latency ) : vbReplayLibDsk( dsk, record, latency );
+
+        if( status < 0 )
+        {
+            if( client ) { break; }     // Connection lost
+
+            replay.skipped++;
+            continue;
+        }
+
+        replay.ops++;
+        replay.extra += client ? client->commands - commands - 1 : 0;
+        if( ( record.cmd == VD_CMD_RD_FILE ) || ( record.cmd == VD_CMD_WR_FILE ) ) { replay.sectors++; }
+        if( status != record.status ) { replay.differ++; }
+
+        replay.recorded.push_back( record.latency );
+        replay.replayed.push_back( latency );
+    }
+
+    if( dsk.dev.opened )
+    {
+        Device_close( &dsk.dev );
+    }
+
+    return replay;
+}
+
+
+/***************************************************************************//**
+ * @brief   Prints a line of the replay report.
+ ******************************************************************************/
+static void vbPrintLatency( const std::string& name, std::vector<uint64_t> latency, uint64_t sectors )
+{
+    uint64_t total = 0;
+
+
+    std::sort( latency.begin(), latency.end() );
+    for( auto us : latency ) { total += us; }
+
+    std::cout << "  " << std::left << std::setw(10) << name << std::right
+              << std::setw(8)  << latency.size()
+              << std::setw(9)  << sectors
+              << std::setw(12) << std::fixed << std::setprecision(1) << ( total ? sectors * 1e6 / total : 0.0 )
+              << std::setw(11) << ( latency.empty() ? 0 : latency[( latency.size() - 1 ) * 50 / 100] )
+              << std::setw(11) << ( latency.empty() ? 0 : latency[( latency.size() - 1 ) * 99 / 100] )
+              << std::setw(13) << total / 1000 << std::endl;
+}
+
+
+/***************************************************************************//**
+ * @brief   Replays a trace and prints the recorded and replayed latencies.
+ *
+ * @return  0 if the replay had the same status as the trace, otherwise 1.
+ ******************************************************************************/
+static int vbRunReplay( const vbArgs& args )
+{
+    std::vector<trRecord_t> records;
+    CTCPClient              tcp( LogPrinter );
+    vbClient_t              client = { &tcp, "", -1, 0, 0, 0, 0, 0 };
+    vbLibDsk_t              dsk    = {};
+    std::vector<uint16_t>   sessions;
+
+
+    if( !vbReadTrace( *args.replay, records ) )
+    {
+        return 1;
+    }
+    if( records.empty() )
+    {
+        std::cerr << "The trace is empty" << std::endl;
+        return 1;
+    }
+
+    for( const auto& record : records )
+    {
+        if( std::find( sessions.begin(), sessions.end(), record.session ) == sessions.end() )
+        {
+            sessions.push_back( record.session );
+        }
+    }
+    std::cout << "Trace " << *args.replay << ": " << records.size() << " commands, " << sessions.size() << " session(s), "
+              << std::fixed << std::setprecision(1) << ( records.back().time - records.front().time ) / 1e6 << " s" << std::endl;
+
+    dsk.disk = -1;
+    if( args.libdsk.has_value() )
+    {
+        if( !vbReadConfig( *args.libdsk, dsk ) ) { return 1; }
+        std::cout << "Replay through LibDsk, " << dsk.filename.size() << " emulated disk(s)";
+    }
+    else
+    {
+        if( !tcp.Connect( args.host, args.port ) )
+        {
+            std::cerr << "Cannot connect to " << args.host << ":" << args.port << std::endl;
+            return 1;
+        }
+        tcp.SetRcvTimeout( 5000 );
+        if( args.compact ) { vbNegotiate( client ); }
+        std::cout << "Replay on server " << args.host << ":" << args.port;
+    }
+    std::cout << ( args.realtime ? ", recorded timing" : ", as fast as possible" ) << std::endl << std::endl;
+
+    auto       start  = std::chrono::steady_clock::now();
+    vbReplay_t replay = vbReplay( args.libdsk.has_value() ? nullptr : &client, dsk, records, args.realtime );
+    double     wall   = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    std::cout << "  latency        ops  sectors   sectors/s   p50 [us]   p99 [us]  total [ms]" << std::endl;
+    vbPrintLatency( "recorded", replay.recorded, replay.sectors );
+    vbPrintLatency( "replayed", replay.replayed, replay.sectors );
+    std::cout << std::endl;
+    std::cout << "Wall time " << std::setprecision(2) << wall << " s, " << replay.extra << " additional command(s), "
+              << replay.skipped << " skipped, " << replay.differ << " with a different status" << std::endl;
+
+    if( !args.libdsk.has_value() )
+    {
+        if( !tcp.IsConnected() )
+        {
+            std::cerr << "Connection to the server lost" << std::endl;
+            return 1;
+        }
+        tcp.Disconnect();
+    }
+
+    return ( replay.differ || ( replay.ops == 0 ) ) ? 1 : 0;
+}
+
+
+/***************************************************************************//**
+ * @brief   Times the sector kernels of LibDsk in every version the CPU
+ *          supports, with the sector contents of their call sites.
+ *
+ * @return  0 if all versions return the same results, otherwise 1.
+ ******************************************************************************/
+static int vbRunKernels( void )
+{
+    static const char* levelName[] = { "C", "SSE2", "AVX2" };
+    static const char* kernelName[] = { "invert", "isfill", "mismatch", "recdiff" };
+    const int          kernels = sizeof(kernelName) / sizeof(kernelName[0]);
+    const int          maxLevel = dsk_simd_setlevel( DSK_SIMD_AVX2 );
+    std::mt19937       rng( 1 );
+    uint8_t            sector[VB_SECTOR];
+    uint8_t            fill[VB_SECTOR];
+    uint8_t            pattern[VB_SECTOR + 2];
+    uint8_t            dirOld[VB_SECTOR];
+    uint8_t            dirNew[VB_SECTOR];
+    uint64_t           expect[kernels] = {};
+    int                retVal = 0;
+
+
+    // Data of a complemented read, an unused sector for the fill check, a
+    // 2 byte pattern for Teledisk and a directory sector with one change
+    for( int i = 0; i < VB_SECTOR; i++ ) { sector[i] = (uint8_t)rng(); }
+    memset( fill, 0xE5, sizeof(fill) );
+    for( int i = 0; i < VB_SECTOR + 2; i++ ) { pattern[i] = ( i & 1 ) ? 0xF6 : 0xE5; }
+    for( int i = 0; i < VB_SECTOR; i++ ) { dirOld[i] = ( ( i & 31 ) < 12 ) ? (uint8_t)( 'A' + ( i >> 5 ) ) : (uint8_t)( i & 31 ); }
+    memcpy( dirNew, dirOld, sizeof(dirNew) );
+    dirNew[7 * 32 + 16] ^= 0x01;
+
+    std::cout << "Sector kernels, " << VB_SECTOR << " bytes, " << VB_KERNEL_LOOPS << " sectors per kernel" << std::endl;
+    std::cout << "  kernel    version   ns/sector      GB/s" << std::endl;
+
+    for( int kernel = 0; kernel < kernels; kernel++ )
+    {
+        for( int level = DSK_SIMD_SCALAR; level <= maxLevel; level++ )
+        {
+            uint64_t result = 0;
+
+            dsk_simd_setlevel( level );
+            auto start = std::chrono::steady_clock::now();
+
+            for( int loop = 0; loop < VB_KERNEL_LOOPS; loop++ )
+            {
+                switch( kernel )
+                {
+                    case 0:  dsk_simd_invert( sector, sector, VB_SECTOR ); result += sector[loop & ( VB_SECTOR - 1 )]; break;
+                    case 1:  result += dsk_simd_isfill( fill, VB_SECTOR, fill[0] ); break;
+                    case 2:  result += dsk_simd_mismatch( pattern, pattern + 2, VB_SECTOR ); break;
+                    default: result += dsk_simd_recdiff( dirOld, dirNew, VB_SECTOR / 32 ); break;
+                }
+            }
+
+            double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / VB_KERNEL_LOOPS;
+
+            std::cout << "  " << std::left << std::setw(10) << kernelName[kernel] << std::setw(6) << levelName[level] << std::right
+                      << std::setw(12) << std::fixed << std::setprecision(1) << ns
+                      << std::setw(10) << std::setprecision(2) << VB_SECTOR / ns;
+
+            if( level == DSK_SIMD_SCALAR ) { expect[kernel] = result; }
+            if( result != expect[kernel] )
+            {
+                std::cout << "  wrong result";
+                retVal = 1;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    dsk_simd_setlevel( maxLevel );
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Times the track lookups of in-memory LDBS images of several sizes,
+ *          through the track index (ldbs_getblock_da()) and through the
+ *          search of a copy of the track directory (ldbs_trackdir_find())
+ *          that was used before the index.
+ *
+ * @return  0 if both lookups load the same blocks, otherwise 1.
+ ******************************************************************************/
+static int vbRunLdbs( void )
+{
+    static const int tracks[] = { 80, 512, 4096 };  // Cylinders of 2 heads
+    static const char* methodName[] = { "index", "search" };
+    std::mt19937     rng( 1 );
+    int              retVal = 0;
+
+
+    std::cout << "LDBS track lookups, " << VB_LDBS_LOOPS << " random lookups per image and method" << std::endl;
+    std::cout << "  tracks  method   ns/lookup" << std::endl;
+
+    for( int cyls : tracks )
+    {
+        PLDBS              store = NULL;
+        LDBS_TRACKDIR*     dir   = NULL;
+        std::vector<int>   order( VB_LDBS_LOOPS );
+        char               trackid[4];
+        uint64_t           expect = 0;
+        bool               ok;
+
+
+        // One block per track with its cylinder and head as content
+        ok = ( ldbs_new( &store, NULL, LDBS_DSK_TYPE ) == DSK_ERR_OK );
+        for( int t = 0; ok && ( t < cyls * 2 ); t++ )
+        {
+            uint32_t content = (uint32_t)t;
+
+            ldbs_encode_trackid( trackid, t / 2, t % 2 );
+            ok = ( ldbs_putblock_d( store, trackid, &content, sizeof(content) ) == DSK_ERR_OK );
+        }
+        ok = ok && ( ldbs_trackdir_copy( store, &dir ) == DSK_ERR_OK );
+        if( !ok )
+        {
+            std::cerr << "Cannot create an LDBS image with " << cyls * 2 << " tracks" << std::endl;
+            if( store ) { ldbs_close( &store ); }
+            return 1;
+        }
+        for( auto& t : order ) { t = (int)( rng() % ( cyls * 2 ) ); }
+
+        for( int method = 0; method < 2; method++ )
+        {
+            uint64_t result = 0;
+
+            auto start = std::chrono::steady_clock::now();
+
+            for( int t : order )
+            {
+                LDBLOCKID blockid = LDBLOCKID_NULL;
+                char      type[4];
+                void*     data = NULL;
+                size_t    len  = 0;
+                uint32_t  content;
+
+                ldbs_encode_trackid( trackid, t / 2, t % 2 );
+                if( method == 0 )
+                {
+                    ldbs_getblock_da( store, trackid, &data, &len );
+                }
+                else if( ( ldbs_trackdir_find( dir, trackid, &blockid ) == DSK_ERR_OK ) && ( blockid != LDBLOCKID_NULL ) )
+                {
+                    ldbs_getblock_a( store, blockid, type, &data, &len );
+                }
+                if( ( data != NULL ) && ( len == sizeof(content) ) )
+                {
+                    memcpy( &content, data, sizeof(content) );
+                    result += ( content == (uint32_t)t ) ? content + 1 : 0;
+                }
+                if( data != NULL ) { ldbs_free( data ); }
+            }
+
+            double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / VB_LDBS_LOOPS;
+
+            std::cout << "  " << std::setw(6) << cyls * 2 << "  " << std::left << std::setw(7) << methodName[method] << std::right
+                      << std::setw(12) << std::fixed << std::setprecision(1) << ns;
+
+            // Every lookup must find its own track
+            if( method == 0 )
+            {
+                for( int t : order ) { expect += (uint64_t)t + 1; }
+            }
+            if( result != expect )
+            {
+                std::cout << "  wrong result";
+                retVal = 1;
+            }
+            std::cout << std::endl;
+        }
+
+        ldbs_free( dir );
+        ldbs_close( &store );
+    }
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns a byte of a file of the cpmfs benchmark.
+ ******************************************************************************/
+static char vbCpmfsByte( int file, size_t pos )
+{
+    return (char)( ( pos * 7 ) ^ ( pos >> 9 ) ^ ( file * 13 ) );
+}
+
+
+/***************************************************************************//**
+ * @brief   Mounts the image of the cpmfs benchmark in the working directory.
+ *
+ * @return  true if the image is mounted, otherwise false.
+ ******************************************************************************/
+static bool vbCpmfsMount( struct cpmSuperBlock& super, struct cpmInode& root )
+{
+    const char* error;
+
+
+    memset( &super, 0, sizeof(super) );
+    error = Device_open( &super.dev, VB_CPMFS_IMAGE, O_RDWR, "raw," VB_CPMFS_FORMAT );
+    if( error != NULL )
+    {
+        std::cerr << "Cannot open " VB_CPMFS_IMAGE ": " << error << std::endl;
+        return false;
+    }
+    if( cpmReadSuper( &super, &root, VB_CPMFS_FORMAT, 0 ) == -1 )
+    {
+        std::cerr << "Cannot read the superblock of " VB_CPMFS_IMAGE ": " << boo << std::endl;
+        Device_close( &super.dev );
+        return false;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Creates the diskdefs file and the image of the cpmfs benchmark in
+ *          the working directory and packs it with the files.
+ *
+ * @return  true if all files are written, otherwise false.
+ ******************************************************************************/
+static bool vbCpmfsPack( void )
+{
+    struct cpmSuperBlock super;
+    struct cpmInode      root;
+    std::vector<char>    data( VB_CPMFS_SIZE );
+    std::vector<char>    track( VB_SYSTEM_SECS * VB_SECTOR, (char)0xE5 );
+    bool                 ok;
+
+
+    {
+        std::ofstream defs( "diskdefs", std::ios::trunc );
+        std::ofstream image( VB_CPMFS_IMAGE, std::ios::binary | std::ios::trunc );
+
+        defs << "diskdef " VB_CPMFS_FORMAT "\n  seclen 512\n  tracks 512\n  sectrk 32\n  blocksize 4096\n"
+                "  maxdir 512\n  skew 0\n  boottrk 1\n  os 2.2\nend\n";
+        for( int i = 0; image && ( i < VB_CPMFS_TRACKS ); i++ )
+        {
+            image.write( track.data(), track.size() );
+        }
+        ok = defs.good() && image.good();
+    }
+
+    if( !ok || !vbCpmfsMount( super, root ) )
+    {
+        return false;
+    }
+
+    for( int file = 0; ok && ( file < VB_CPMFS_FILES ); file++ )
+    {
+        std::string     name = "00file" + std::to_string( file ) + ".dat";
+        struct cpmInode ino;
+        struct cpmFile  cpmFile;
+
+        for( size_t pos = 0; pos < data.size(); pos++ ) { data[pos] = vbCpmfsByte( file, pos ); }
+
+        ok = ( cpmCreat( &root, name.c_str(), &ino, 0666 ) != -1 ) && ( cpmOpen( &ino, &cpmFile, O_WRONLY ) != -1 );
+        if( ok )
+        {
+            ok = ( cpmWrite( &cpmFile, data.data(), data.size() ) == (ssize_t)data.size() );
+            ok = ( cpmClose( &cpmFile ) != -1 ) && ok;
+        }
+        if( !ok )
+        {
+            std::cerr << "Cannot write " << name << ": " << boo << std::endl;
+        }
+    }
+
+    return ( cpmUmount( &super ) != -1 ) && ok;
+}
+
+
+/***************************************************************************//**
+ * @brief   Times copying the files out of a z80mbc2-d0 image with the CP/M
+ *          tools, like cpmcp does. The image and its diskdefs are created in
+ *          a temporary directory, which is removed afterwards.
+ *
+ * @return  0 if all files were read back unchanged, otherwise 1.
+ ******************************************************************************/
+static int vbRunCpmfs( void )
+{
+    std::filesystem::path oldDir = std::filesystem::current_path();
+    std::filesystem::path dir    = std::filesystem::temp_directory_path() /
+                                   ( "vd-bench-" + std::to_string( std::chrono::steady_clock::now().time_since_epoch().count() ) );
+    std::vector<char>     buffer( VB_CPMFS_BUFFER );
+    std::error_code       ec;
+    int                   retVal = 0;
+
+
+    // cpmReadSuper() reads the diskdefs of the working directory
+    if( !std::filesystem::create_directory( dir, ec ) || ( std::filesystem::current_path( dir, ec ), ec ) )
+    {
+        std::cerr << "Cannot create the directory " << dir.string() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Copy out of a " VB_CPMFS_FORMAT " image, " << VB_CPMFS_FILES << " files of " << VB_CPMFS_SIZE / 1024
+              << " KB, " << VB_CPMFS_BUFFER << " bytes per cpmRead()" << std::endl;
+
+    if( !vbCpmfsPack() )
+    {
+        retVal = 1;
+    }
+
+    for( int pass = 0; ( retVal == 0 ) && ( pass <= VB_CPMFS_PASSES ); pass++ )
+    {
+        struct cpmSuperBlock super;
+        struct cpmInode      root;
+        uint64_t             bytes = 0;
+        bool                 same  = true;
+
+        if( !vbCpmfsMount( super, root ) )
+        {
+            retVal = 1;
+            break;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        for( int file = 0; file < VB_CPMFS_FILES; file++ )
+        {
+            std::string     name = "00file" + std::to_string( file ) + ".dat";
+            struct cpmInode ino;
+            struct cpmFile  cpmFile;
+            size_t          pos = 0;
+            ssize_t         got;
+
+            if( ( cpmNamei( &root, name.c_str(), &ino ) == -1 ) || ( cpmOpen( &ino, &cpmFile, O_RDONLY ) == -1 ) )
+            {
+                same = false;
+                continue;
+            }
+            while( ( got = cpmRead( &cpmFile, buffer.data(), buffer.size() ) ) > 0 )
+            {
+                // The first pass also checks the data
+                for( ssize_t i = 0; ( pass == 0 ) && ( i < got ); i++ )
+                {
+                    same = same && ( buffer[i] == vbCpmfsByte( file, pos + i ) );
+                }
+                pos += got;
+            }
+            cpmClose( &cpmFile );
+
+            same   = same && ( pos == VB_CPMFS_SIZE );
+            bytes += pos;
+        }
+
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        cpmUmount( &super );
+
+        if( pass == 0 ) { std::cout << "  check    " << ( same ? "passed" : "" ); }
+        else            { std::cout << "  pass " << pass << std::setw(10) << std::fixed << std::setprecision(1) << bytes / 1e6 / seconds << " MB/s"; }
+        if( !same )
+        {
+            std::cout << "  wrong result";
+            retVal = 1;
+        }
+        std::cout << std::endl;
+    }
+
+    std::filesystem::current_path( oldDir, ec );
+    std::filesystem::remove_all( dir, ec );
+
+    return retVal;
+}
+
+
+/***************************************************************************//**
+ * @brief   The main function of vd-bench.
+ *
+ * @return  0 if all workloads ran without errors, otherwise 1.
+ ******************************************************************************/
+int main( int argc, char* argv[] )
+{
+    vbArgs     args = argparse::parse<vbArgs>( argc, argv );
+    CTCPClient tcp( LogPrinter );
+    vbClient_t client = { &tcp, "", -1, 0, 0, 0, 0, 0 };
+    int        retVal = 0;
+
+
+    std::cout << "vd-bench for WiFi-VirtDisk Server v" << WIFI_VIRTDISK_SERVER_REVISION << std::endl;
+
+    if( args.kernels )
+    {
+        return vbRunKernels();
+    }
+
+    if( args.ldbs )
+    {
+        return vbRunLdbs();
+    }
+
+    if( args.cpmfs )
+    {
+        return vbRunCpmfs();
+    }
+
+    if( args.replay.has_value() )
+    {
+        return vbRunReplay( args );
+    }
+
+    std::cout << args.boards << " board(s), seed " << args.seed << ", server " << args.host << ":" << args.port << std::endl << std::endl;
+
+    if( !tcp.Connect( args.host, args.port ) )
+    {
+        std::cerr << "Cannot connect to " << args.host << ":" << args.port << std::endl;
+        return 1;
+    }
+    tcp.SetRcvTimeout( 5000 );
+    if( args.compact ) { vbNegotiate( client ); std::cout << std::endl; }
+
+    for( const auto& target : args.targets )
+    {
+        std::cout << "Target " << target << std::endl;
+        std::cout << "  workload       ops  sectors  errors   sectors/s   p50 [us]   p99 [us]  cpu/sec [us]  server cpu/sec [us]  wire/sec [B]" << std::endl;
+
+        for( const auto& workload : args.workloads )
+        {
+            vbResult_t r = vbRun( client, target, workload, args );
+
+            std::cout << "  " << std::left << std::setw(10) << r.name << std::right
+                      << std::setw(8)  << r.ops
+                      << std::setw(9)  << r.sectors
+                      << std::setw(8)  << r.errors
+                      << std::setw(12) << std::fixed << std::setprecision(1) << ( r.seconds > 0.0 ? r.sectors / r.seconds : 0.0 )
+                      << std::setw(11) << r.p50
+                      << std::setw(11) << r.p99
+                      << std::setw(14) << std::setprecision(2) << r.clientCpu;
+            if( r.serverCpu >= 0.0 ) { std::cout << std::setw(21) << r.serverCpu; }
+            else                     { std::cout << std::setw(21) << "-"; }
+            std::cout << std::setw(14) << std::setprecision(0) << r.wireBytes << std::endl;
+
+            if( r.errors || ( r.ops == 0 ) ) { retVal = 1; }
+            if( !tcp.IsConnected() )
+            {
+                std::cerr << "Connection to the server lost" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    tcp.Disconnect();
+
+    return retVal;
+}
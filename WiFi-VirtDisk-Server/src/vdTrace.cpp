@@ -0,0 +1,155 @@
+/***************************************************************************//**
+ * @file    vdTrace.cpp
+ *
+ * @brief   Trace of the VirtDisk commands, for replaying real Z80 sessions.
+ *
+ *          When the trace is started, every packet handled by vdProcessCmd()
+ *          is written to the trace file as a trRecord_t of 32 bytes: time,
+ *          session, command, selected file, file position, status and the
+ *          latency of the command. The data of the sectors is not traced.
+ *
+ *          vd-bench --replay feeds a trace back through a server or directly
+ *          through LibDsk, so cache and prefetch policies can be compared with
+ *          the access pattern of real CP/M sessions.
+ *
+ *          The file is written buffered and flushed when the trace is
+ *          stopped, a command only costs a copy of 32 bytes.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+
+#include "vdTrace.hpp"
+#include "serverStats.hpp"
+#include "message.h"
+
+
+/******************************************************************* Defines **/
+
+/********************************************************** Global Variables **/
+extern std::vector<std::string> diskEmuFilename;
+
+static std::mutex    trMutex;
+static std::ofstream trStream;
+static std::string   trPath;
+static uint64_t      trStartTime;   // stNow() at the start of the trace
+static uint64_t      trRecords;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Starts the trace. A running trace is stopped first.
+ *
+ * @param   path    The trace file, an existing file is overwritten.
+ *
+ * @return  true if the trace file was created, otherwise false.
+ ******************************************************************************/
+bool trStart( const std::string& path )
+{
+    trHeader_t header = {};
+
+
+    trStop();
+
+    std::lock_guard<std::mutex> lock( trMutex );
+
+    trStream.open( path, std::ios::out | std::ios::binary | std::ios::trunc );
+    if( !trStream.is_open() )
+    {
+        message( MsgType::ERR, "Cannot create trace file: " + path );
+        return false;
+    }
+
+    memcpy( header.magic, TR_MAGIC, sizeof(header.magic) );
+    header.version = TR_VERSION;
+    header.start   = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+    trStream.write( (const char*)&header, sizeof(header) );
+
+    trPath      = path;
+    trStartTime = stNow();
+    trRecords   = 0;
+
+    message( MsgType::INFO, "Trace started: " + path );
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Stops the trace and closes the trace file.
+ ******************************************************************************/
+void trStop( void )
+{
+    std::lock_guard<std::mutex> lock( trMutex );
+
+    if( trStream.is_open() )
+    {
+        trStream.close();
+        message( MsgType::INFO, "Trace stopped: " + trPath + ", " + std::to_string(trRecords) + " commands" );
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns true if the trace is running.
+ ******************************************************************************/
+bool trActive( void )
+{
+    std::lock_guard<std::mutex> lock( trMutex );
+
+    return trStream.is_open();
+}
+
+
+/***************************************************************************//**
+ * @brief   Writes a command to the trace, if the trace is running.
+ *
+ * @param   session     Client connection, see stSessionStart().
+ * @param   cmd         Command of the packet.
+ * @param   status      Status of the answer.
+ * @param   filename    The selected file after the command.
+ * @param   offset      File position of the command, for a read or write the
+ *                      position before the command.
+ * @param   latency     Duration of the command in microseconds.
+ ******************************************************************************/
+void trRecord( int session, uint8_t cmd, uint8_t status, const std::string& filename, uint32_t offset, uint64_t latency )
+{
+    std::lock_guard<std::mutex> lock( trMutex );
+    trRecord_t record = {};
+
+
+    if( !trStream.is_open() )
+    {
+        return;
+    }
+
+    record.time    = stNow() - trStartTime;
+    record.latency = (uint32_t)latency;
+    record.offset  = offset;
+    record.session = (uint16_t)session;
+    record.cmd     = cmd;
+    record.status  = status;
+    record.disk    = TR_NO_DISK;
+    trPackName( record.name, filename );
+
+    for( size_t disk = 0; disk < diskEmuFilename.size(); disk++ )
+    {
+        if( diskEmuFilename[disk] == filename )
+        {
+            record.disk = (uint8_t)disk;
+            break;
+        }
+    }
+
+    trStream.write( (const char*)&record, sizeof(record) );
+    trRecords++;
+}
@@ -0,0 +1,92 @@
+/***************************************************************************//**
+ * @file    vdTrace.hpp
+ *
+ * @brief   Trace of the VirtDisk commands, for replaying real Z80 sessions.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef VDTRACE_HPP
+#define VDTRACE_HPP
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+/******************************************************************* Defines **/
+// A trace file starts with a trHeader_t, followed by one trRecord_t for every
+// command. All values are little endian.
+#define TR_MAGIC        "VDTRACE"
+#define TR_VERSION      1
+#define TR_NO_DISK      0xFF        // trRecord_t.disk of a plain file
+#define TR_NAME_LEN     11          // 8.3 name without the dot, padded with spaces
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char        magic[7];           // TR_MAGIC without the terminating 0
+    uint8_t     version;            // TR_VERSION
+    uint64_t    start;              // Start of the trace, microseconds since 1970
+} trHeader_t;
+
+typedef struct
+{
+    uint64_t    time;               // Microseconds since the start of the trace
+    uint32_t    latency;            // Duration of vdProcessCmd() in microseconds
+    uint32_t    offset;             // File position of the command
+    uint16_t    session;            // Client connection
+    uint8_t     cmd;                // VD_CMD_xxx
+    uint8_t     status;             // VD_STATUS_xxx of the answer
+    uint8_t     disk;               // Index of the emulated disk or TR_NO_DISK
+    char        name[TR_NAME_LEN];  // Selected file, e.g. "DS0N00  DSK"
+} trRecord_t;
+#pragma pack(pop)
+
+static_assert( sizeof(trHeader_t) == 16, "trHeader_t must be 16 bytes" );
+static_assert( sizeof(trRecord_t) == 32, "trRecord_t must be 32 bytes" );
+
+
+/********************************************************** Global Variables **/
+
+/******************************************************* Functions / Methods **/
+bool trStart( const std::string& path );
+void trStop( void );
+bool trActive( void );
+void trRecord( int session, uint8_t cmd, uint8_t status, const std::string& filename, uint32_t offset, uint64_t latency );
+
+
+/***************************************************************************//**
+ * @brief   Converts a file name to the 8.3 form of the trace ("NAME    EXT").
+ ******************************************************************************/
+static inline void trPackName( char* name, const std::string& filename )
+{
+    size_t      dot  = filename.find( '.' );
+    std::string base = filename.substr( 0, dot );
+    std::string ext  = ( dot == std::string::npos ) ? "" : filename.substr( dot + 1 );
+
+    base.resize( 8, ' ' );
+    ext.resize( 3, ' ' );
+
+    memcpy( name, ( base + ext ).c_str(), TR_NAME_LEN );
+}
+
+
+/***************************************************************************//**
+ * @brief   Converts the 8.3 form of the trace back to a file name.
+ ******************************************************************************/
+static inline std::string trUnpackName( const char* name )
+{
+    std::string base( name, 8 );
+    std::string ext( name + 8, 3 );
+
+
+    base.erase( base.find_last_not_of( ' ' ) + 1 );
+    ext.erase( ext.find_last_not_of( ' ' ) + 1 );
+
+    return ext.empty() ? base : base + "." + ext;
+}
+
+
+#endif
@@ -0,0 +1,330 @@
+/***************************************************************************//**
+ * @file    vdWire.h
+ *
+ * @brief   Compact frames of the TCP protocol between the WiFi-VirtDisk
+ *          client (ESP8266) and the server.
+ *
+ *          The same file is used by the client sketch and the server and has
+ *          no Arduino dependencies.
+ *
+ *          Without negotiation every packet is a complete vdPacket_t of 568
+ *          bytes, most of it the data buffer. After the client sent
+ *          VD_CMD_ENCODING and the server accepted VD_WIRE_COMPACT, both sides
+ *          send compact frames instead: the fields in front of the data, the
+ *          length of the valid data, the encoding and the length of the
+ *          payload. A frame with data adds the CRC-16 of the segments and the
+ *          encoded data.
+ *
+ *          Only the packets with data carry it, the read answers of the
+ *          server and the write requests of the client. A sector of one
+ *          repeated byte (0xE5 of unused blocks, 0x1A at the end of a text
+ *          file, 0x00) is sent as the encoding and this byte. With RLE other
+ *          sectors are sent PackBits compressed, if that is shorter.
+ *
+ *          The segment CRCs stay in the frame, so the data is still checked
+ *          end to end after decoding.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+#ifndef VDWIRE_H
+#define VDWIRE_H
+
+/****************************************************************** Includes **/
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/******************************************************************* Defines **/
+// Layout of vdPacket_t
+#define VD_PKT_HEAD_LEN     22    // cmd, status, filename, fileOffset, track, sector
+#define VD_PKT_DATA_LEN     512
+#define VD_PKT_DATALEN_OFS  534   // dataLen
+#define VD_PKT_CRC_OFS      536   // segCrc
+#define VD_PKT_CRC_LEN      32
+#define VD_PKT_LEN          568
+
+// Compact frame: head, dataLen, encoding, payload length (low byte first),
+// for a frame with data then the segment CRCs and the payload
+#define VD_WIRE_HEAD_LEN    27
+#define VD_WIRE_MAX_LEN     ( VD_WIRE_HEAD_LEN + VD_PKT_CRC_LEN + VD_PKT_DATA_LEN )
+
+// Capabilities of VD_CMD_ENCODING, in data[0] of the request and the answer
+#define VD_WIRE_COMPACT     0x01  // Compact frames with raw data
+#define VD_WIRE_FILL        0x02  // Sectors of one repeated byte
+#define VD_WIRE_RLE         0x04  // PackBits compressed data
+#define VD_WIRE_ALL         ( VD_WIRE_COMPACT | VD_WIRE_FILL | VD_WIRE_RLE )
+
+// Encoding of a compact frame
+enum vdEncodings
+{
+  VD_ENC_NONE = 0,    // No data, the data buffer is not changed
+  VD_ENC_RAW,         // 512 bytes
+  VD_ENC_FILL,        // 1 byte, repeated 512 times
+  VD_ENC_RLE,         // PackBits, less than 512 bytes
+  VD_ENC_COUNT
+};
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Checks if all bytes of a data block are the same.
+ *
+ * @param   data    The data, the length must be a multiple of 16.
+ * @param   len     Length of the data.
+ *
+ * @return  1 if all bytes are data[0], otherwise 0.
+ ******************************************************************************/
+static inline uint8_t vdWireUniform( const uint8_t* data, uint16_t len )
+{
+#if defined(__SSE2__)
+  const __m128i fill = _mm_set1_epi8( (char)data[0] );
+  __m128i       diff = _mm_setzero_si128();
+
+  // OR of all differences, only one test at the end
+  for( uint16_t pos = 0; pos < len; pos += 16 )
+  {
+    diff = _mm_or_si128( diff, _mm_xor_si128( _mm_loadu_si128( (const __m128i*)( data + pos ) ), fill ) );
+  }
+
+  return _mm_movemask_epi8( _mm_cmpeq_epi8( diff, _mm_setzero_si128() ) ) == 0xFFFF;
+#else
+  uint32_t fill = data[0] * 0x01010101UL;
+  uint32_t diff = 0;
+  uint32_t word;
+
+  for( uint16_t pos = 0; pos < len; pos += 4 )
+  {
+    memcpy( &word, data + pos, sizeof(word) );
+    diff |= word ^ fill;
+  }
+
+  return diff == 0;
+#endif
+}
+
+
+/***************************************************************************//**
+ * @brief   Compresses a data block with PackBits: a control byte n of 0..127
+ *          is followed by n + 1 bytes, a control byte n of 129..255 by one
+ *          byte that is repeated 257 - n times.
+ *
+ * @param   data    The data.
+ * @param   len     Length of the data.
+ * @param   out     Receives the compressed data.
+ * @param   max     Size of out.
+ *
+ * @return  Length of the compressed data, 0 if it does not fit into out.
+ ******************************************************************************/
+static inline uint16_t vdWireRle( const uint8_t* data, uint16_t len, uint8_t* out, uint16_t max )
+{
+  uint16_t pos = 0;
+  uint16_t outLen = 0;
+  uint16_t run;
+  uint16_t start;
+
+
+  while( pos < len )
+  {
+    run = 1;
+    while( ( pos + run < len ) && ( run < 128 ) && ( data[pos + run] == data[pos] ) ) { run++; }
+
+    if( run >= 3 )
+    {
+      if( outLen + 2 > max ) { return 0; }
+      out[outLen++] = (uint8_t)( 257 - run );
+      out[outLen++] = data[pos];
+      pos += run;
+    }
+    else
+    {
+      // Literal bytes up to the next run of three
+      start = pos;
+      while( ( pos < len ) && ( pos - start < 128 ) )
+      {
+        if( ( pos + 2 < len ) && ( data[pos] == data[pos + 1] ) && ( data[pos] == data[pos + 2] ) ) { break; }
+        pos++;
+      }
+
+      if( outLen + 1 + ( pos - start ) > max ) { return 0; }
+      out[outLen++] = (uint8_t)( pos - start - 1 );
+      memcpy( out + outLen, data + start, pos - start );
+      outLen += pos - start;
+    }
+  }
+
+  return outLen;
+}
+
+
+/***************************************************************************//**
+ * @brief   Expands data compressed with vdWireRle().
+ *
+ * @return  1 if the data expands to exactly len bytes, otherwise 0.
+ ******************************************************************************/
+static inline uint8_t vdWireUnRle( const uint8_t* in, uint16_t inLen, uint8_t* data, uint16_t len )
+{
+  uint16_t pos = 0;
+  uint16_t inPos = 0;
+  uint16_t count;
+  uint8_t  ctrl;
+
+
+  while( inPos < inLen )
+  {
+    ctrl = in[inPos++];
+
+    if( ctrl < 128 )
+    {
+      count = ctrl + 1;
+      if( ( inPos + count > inLen ) || ( pos + count > len ) ) { return 0; }
+      memcpy( data + pos, in + inPos, count );
+      inPos += count;
+    }
+    else if( ctrl > 128 )
+    {
+      count = 257 - ctrl;
+      if( ( inPos >= inLen ) || ( pos + count > len ) ) { return 0; }
+      memset( data + pos, in[inPos++], count );
+    }
+    else
+    {
+      count = 0;
+    }
+    pos += count;
+  }
+
+  return pos == len;
+}
+
+
+/***************************************************************************//**
+ * @brief   Builds the compact frame of a packet.
+ *
+ * @param   packet      The packet (vdPacket_t.rawData).
+ * @param   withData    1 if the data buffer is sent, otherwise 0.
+ * @param   encodings   Negotiated capabilities (VD_WIRE_...).
+ * @param   frame       Receives the frame, VD_WIRE_MAX_LEN bytes.
+ *
+ * @return  Length of the frame.
+ ******************************************************************************/
+static inline uint16_t vdWirePack( const uint8_t* packet, uint8_t withData, uint8_t encodings, uint8_t* frame )
+{
+  const uint8_t* data = packet + VD_PKT_HEAD_LEN;
+  uint8_t*       payload = frame + VD_WIRE_HEAD_LEN + VD_PKT_CRC_LEN;
+  uint16_t       payloadLen = 0;
+  uint8_t        encoding = VD_ENC_NONE;
+
+
+  if( withData )
+  {
+    if( ( encodings & VD_WIRE_FILL ) && vdWireUniform( data, VD_PKT_DATA_LEN ) )
+    {
+      encoding   = VD_ENC_FILL;
+      payload[0] = data[0];
+      payloadLen = 1;
+    }
+    else if( ( encodings & VD_WIRE_RLE ) &&
+             ( ( payloadLen = vdWireRle( data, VD_PKT_DATA_LEN, payload, VD_PKT_DATA_LEN - 1 ) ) != 0 ) )
+    {
+      encoding = VD_ENC_RLE;
+    }
+    else
+    {
+      encoding   = VD_ENC_RAW;
+      memcpy( payload, data, VD_PKT_DATA_LEN );
+      payloadLen = VD_PKT_DATA_LEN;
+    }
+
+    memcpy( frame + VD_WIRE_HEAD_LEN, packet + VD_PKT_CRC_OFS, VD_PKT_CRC_LEN );
+  }
+
+  memcpy( frame, packet, VD_PKT_HEAD_LEN );
+  memcpy( frame + VD_PKT_HEAD_LEN, packet + VD_PKT_DATALEN_OFS, 2 );
+  frame[VD_PKT_HEAD_LEN + 2] = encoding;
+  frame[VD_PKT_HEAD_LEN + 3] = (uint8_t)( payloadLen & 0xFF );
+  frame[VD_PKT_HEAD_LEN + 4] = (uint8_t)( payloadLen >> 8 );
+
+  return ( encoding == VD_ENC_NONE ) ? VD_WIRE_HEAD_LEN : VD_WIRE_HEAD_LEN + VD_PKT_CRC_LEN + payloadLen;
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the length of a compact frame from its head.
+ *
+ * @param   frame   The start of the frame.
+ * @param   len     Bytes of the frame received so far.
+ *
+ * @return  Length of the frame, 0 if the head is not complete yet or the
+ *          frame is invalid.
+ ******************************************************************************/
+static inline uint16_t vdWireFrameLen( const uint8_t* frame, uint16_t len )
+{
+  uint16_t payloadLen;
+
+
+  if( len < VD_WIRE_HEAD_LEN ) { return 0; }
+
+  payloadLen = frame[VD_PKT_HEAD_LEN + 3] | ( (uint16_t)frame[VD_PKT_HEAD_LEN + 4] << 8 );
+
+  if( ( frame[VD_PKT_HEAD_LEN + 2] >= VD_ENC_COUNT ) || ( payloadLen > VD_PKT_DATA_LEN ) ) { return 0; }
+
+  return ( frame[VD_PKT_HEAD_LEN + 2] == VD_ENC_NONE ) ? VD_WIRE_HEAD_LEN : VD_WIRE_HEAD_LEN + VD_PKT_CRC_LEN + payloadLen;
+}
+
+
+/***************************************************************************//**
+ * @brief   Copies a complete compact frame into a packet. Without data the
+ *          data buffer and the segment CRCs of the packet stay unchanged.
+ *
+ * @param   frame   The frame, vdWireFrameLen() bytes.
+ * @param   packet  Receives the packet (vdPacket_t.rawData).
+ *
+ * @return  1 if the frame was decoded, otherwise 0.
+ ******************************************************************************/
+static inline uint8_t vdWireUnpack( const uint8_t* frame, uint8_t* packet )
+{
+  const uint8_t* payload = frame + VD_WIRE_HEAD_LEN + VD_PKT_CRC_LEN;
+  uint8_t*       data = packet + VD_PKT_HEAD_LEN;
+  uint16_t       payloadLen = frame[VD_PKT_HEAD_LEN + 3] | ( (uint16_t)frame[VD_PKT_HEAD_LEN + 4] << 8 );
+  uint8_t        ok = 1;
+
+
+  memcpy( packet, frame, VD_PKT_HEAD_LEN );
+  memcpy( packet + VD_PKT_DATALEN_OFS, frame + VD_PKT_HEAD_LEN, 2 );
+
+  switch( frame[VD_PKT_HEAD_LEN + 2] )
+  {
+    case VD_ENC_NONE:
+      return 1;
+
+    case VD_ENC_RAW:
+      ok = ( payloadLen == VD_PKT_DATA_LEN );
+      if( ok ) { memcpy( data, payload, VD_PKT_DATA_LEN ); }
+      break;
+
+    case VD_ENC_FILL:
+      ok = ( payloadLen == 1 );
+      if( ok ) { memset( data, payload[0], VD_PKT_DATA_LEN ); }
+      break;
+
+    case VD_ENC_RLE:
+      ok = vdWireUnRle( payload, payloadLen, data, VD_PKT_DATA_LEN );
+      break;
+
+    default:
+      ok = 0;
+      break;
+  }
+
+  memcpy( packet + VD_PKT_CRC_OFS, frame + VD_WIRE_HEAD_LEN, VD_PKT_CRC_LEN );
+
+  return ok;
+}
+
+
+#endif
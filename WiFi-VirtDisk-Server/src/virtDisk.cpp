@@ -23,15 +23,28 @@
 #include <libdsk.h>
 
 #include "virtDisk.hpp"
+#include "vdFrame.h"
+#include "vdWire.h"
+#include "rpcServer.hpp"
+#include "diskNotify.hpp"
+#include "diskOverlay.hpp"
+#include "imageTool.hpp"
+#include "serverStats.hpp"
 #include "message.h"
 
 
 /******************************************************************* Defines **/
+// vdWire.h has its own copy of the packet layout, it is shared with the client
+static_assert( offsetof(vdPacketInt_t, data)    == VD_PKT_HEAD_LEN,    "vdWire.h: wrong packet layout" );
+static_assert( offsetof(vdPacketInt_t, dataLen) == VD_PKT_DATALEN_OFS, "vdWire.h: wrong packet layout" );
+static_assert( offsetof(vdPacketInt_t, segCrc)  == VD_PKT_CRC_OFS,     "vdWire.h: wrong packet layout" );
+static_assert( sizeof(vdPacket_t)               == VD_PKT_LEN,         "vdWire.h: wrong packet layout" );
 
 /********************************************************** Global Variables **/
 vdData_t vdData;
 
 extern std::string filePath;
+extern bool        wireEncoding;
 
 extern std::vector<std::string> diskEmuPath;
 extern std::vector<std::string> diskEmuFilename;
@@ -80,6 +93,85 @@ std::string devopts;    // = "rcpmfs," + format;
 // }
 
 
+/***************************************************************************//**
+ * @brief   Opens the disk image of the emulated drive and shares it with the
+ *          RPC clients. If RPC clients have the image open, their driver is
+ *          used.
+ *
+ * @return  NULL on success, otherwise the error message.
+ ******************************************************************************/
+static const char* vdOpenDrive( void )
+{
+    DSK_PDRIVER shared = rpcAdoptImage( diskPath );
+
+    if( shared != NULL )
+    {
+        return Device_attach( &drive.dev, shared, devopts.c_str() );
+    }
+
+    const char* ret = Device_open( &drive.dev, diskPath.c_str(), O_RDWR, devopts.c_str() );
+
+    if( ( drive.dev.opened == 1 ) && ( ret == NULL ) )
+    {
+        rpcShareImage( drive.dev.dev, diskPath );
+    }
+
+    return ret;
+}
+
+
+/***************************************************************************//**
+ * @brief   Closes the disk image of the emulated drive. If RPC clients still
+ *          use the image, the driver is left open for them.
+ *
+ * @return  NULL on success, otherwise the error message.
+ ******************************************************************************/
+static const char* vdCloseDrive( void )
+{
+    if( rpcUnshareImage( drive.dev.dev ) )
+    {
+        drive.dev.opened = 0;
+        drive.dev.dev    = NULL;
+        return NULL;
+    }
+
+    return Device_close( &drive.dev );
+}
+
+
+/***************************************************************************//**
+ * @brief   Sets the CRC-16 of every segment of the data. Checked by the client
+ *          and again by IOS, so a corrupted segment is read again.
+ ******************************************************************************/
+static void vdSetSegmentCrc( vdPacketInt_t* packet )
+{
+    for( int seg = 0; seg < VD_SEGMENTS; seg++ )
+    {
+        packet->segCrc[seg] = vdCrc16( packet->data + seg * VD_SEGMENT_SIZE, VD_SEGMENT_SIZE );
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks the CRC-16 of every segment of the data, set by IOS.
+ *
+ * @return  true if all segments are correct, otherwise false.
+ ******************************************************************************/
+static bool vdCheckSegmentCrc( const vdPacketInt_t* packet )
+{
+    for( int seg = 0; seg < VD_SEGMENTS; seg++ )
+    {
+        if( vdCrc16( packet->data + seg * VD_SEGMENT_SIZE, VD_SEGMENT_SIZE ) != packet->segCrc[seg] )
+        {
+            message( MsgType::WARN, "VirtDisk Command: CRC error in segment " + std::to_string(seg) );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
 /***************************************************************************//**
  * @brief   Process the client command.
  *
@@ -91,10 +183,15 @@ int vdProcessCmd( char* buffer )
     bool        emuDiskFound = false;
     vdPacket_t  vd;
     std::string tempFilename;
+    uint64_t    cmdStart = stNow();
+    uint64_t    phaseStart;
+    uint8_t     cmd;
+    uint8_t     encodings;
 
 
     // Copy the packet for command processing
     memcpy( vd.rawData, buffer, sizeof(vd.rawData) );
+    cmd = vd.packet.cmd;
 
     switch( vd.packet.cmd )
     {
@@ -117,7 +214,7 @@ int vdProcessCmd( char* buffer )
                 {
                     diskPath = diskEmuPath[i];
                     format   = diskEmuFormat[i];
-                    devopts  = "rcpmfs," + format;
+                    devopts  = std::string( itIsStoreImage( diskPath ) ? IT_STORE_TYPE "," : "rcpmfs," ) + format;
                     emuDiskFound = true;
                     break;
                 }
@@ -128,7 +225,7 @@ int vdProcessCmd( char* buffer )
                 // Check for previous open file
                 if( drive.dev.opened == 1 )
                 {
-                    errStr = Device_close( &drive.dev );
+                    errStr = vdCloseDrive();
                     if( errStr != NULL )
                     {
                         // Device_close failed
@@ -144,7 +241,9 @@ int vdProcessCmd( char* buffer )
                 // std::cout << "Disk path: " << diskPath << std::endl;
 
                 // Open the disk image
-                errStr = Device_open( &drive.dev, diskPath.c_str(), O_RDWR, devopts.c_str() );
+                phaseStart = stNow();
+                errStr = vdOpenDrive();
+                stRecordPhase( ST_PHASE_DISK_OPEN, stNow() - phaseStart );
                 if( ( drive.dev.opened == 0 ) || ( errStr != NULL ) )
                 {
                     // Device_open failed
@@ -204,7 +303,11 @@ int vdProcessCmd( char* buffer )
                 if( it != diskEmuFilename.end() )
                 {
                     dsk_lsect_t secNum = (vdData.filePos / 512);
-                    err = dsk_lread( drive.dev.dev, &drive.dev.geom, sector, secNum );
+                    ((vdPacket_t*)buffer)->packet.fileOffset = (uint32_t)vdData.filePos;
+                    phaseStart = stNow();
+                    err = ovRead( it - diskEmuFilename.begin(), drive.dev.dev, &drive.dev.geom, sector, secNum );
+                    stRecordPhase( ST_PHASE_DSK_READ, stNow() - phaseStart );
+                    stCountSector( it - diskEmuFilename.begin(), false, err == DSK_ERR_OK );
                     if( err )
                     {
                         message( MsgType::ERR, "Error reading sector: " + std::string(dsk_strerror(err)) );
@@ -214,6 +317,7 @@ int vdProcessCmd( char* buffer )
                     memcpy( (char*)((vdPacket_t*)buffer)->packet.data, sector, sizeof(vd.packet.data) );
                     ((vdPacket_t*)buffer)->packet.dataLen = 512;
                     ((vdPacket_t*)buffer)->packet.status  = VD_STATUS_OK;
+                    vdSetSegmentCrc( &((vdPacket_t*)buffer)->packet );
 
                     vdData.filePos += 512;
 
@@ -225,10 +329,14 @@ int vdProcessCmd( char* buffer )
 
                     std::streamsize rdCount;
 
+                    ((vdPacket_t*)buffer)->packet.fileOffset = (uint32_t)vdData.fileStream.tellg();
+                    phaseStart = stNow();
                     vdData.fileStream.read( (char*)((vdPacket_t*)buffer)->packet.data, sizeof(vd.packet.data) );
                     rdCount = vdData.fileStream.gcount();
+                    stRecordPhase( ST_PHASE_FILE_IO, stNow() - phaseStart );
                     ((vdPacket_t*)buffer)->packet.dataLen = rdCount;
                     ((vdPacket_t*)buffer)->packet.status  = VD_STATUS_OK;
+                    vdSetSegmentCrc( &((vdPacket_t*)buffer)->packet );
 
                     if( rdCount == sizeof(vd.packet.data) )
                     {
@@ -258,8 +366,17 @@ int vdProcessCmd( char* buffer )
 
             tempFilename.assign( vd.packet.filename );
 
-            if( vdData.filename == tempFilename )
+            if( vdCheckSegmentCrc( &vd.packet ) == false )
+            {
+                // Not written, the client sends the data again
+                ((vdPacket_t*)buffer)->packet.status = VD_STATUS_CHKSUM_ERROR;
+
+                retVal = 0;
+            }
+            else if( vdData.filename == tempFilename )
             {
+                ((vdPacket_t*)buffer)->packet.status = VD_STATUS_OK;
+
                 // if( vdData.filename == diskEmuFilename )
                 auto it = std::find( diskEmuFilename.begin(), diskEmuFilename.end(), vdData.filename );
 
@@ -267,10 +384,14 @@ int vdProcessCmd( char* buffer )
                 {
                     dsk_lsect_t secNum = (vdData.filePos / 512);
                     memcpy( sector, (char*)((vdPacket_t*)buffer)->packet.data, sizeof(vd.packet.data) );
-                    err = dsk_lwrite( drive.dev.dev, &drive.dev.geom, sector, secNum );
+                    phaseStart = stNow();
+                    err = ovWrite( it - diskEmuFilename.begin(), drive.dev.dev, &drive.dev.geom, sector, secNum );
+                    stRecordPhase( ST_PHASE_DSK_WRITE, stNow() - phaseStart );
+                    stCountSector( it - diskEmuFilename.begin(), true, err == DSK_ERR_OK );
                     if( err )
                     {
                         message( MsgType::ERR, "Error writing sector: " + std::string(dsk_strerror( err )) );
+                        ((vdPacket_t*)buffer)->packet.status = VD_STATUS_SEC_WR_ERROR;
                         retVal = 0;
                     }
 
@@ -283,8 +404,11 @@ int vdProcessCmd( char* buffer )
                     // Write the data to file
                     if( vdData.fileStream.is_open() == true )
                     {
+                        phaseStart = stNow();
                         vdData.fileStream.write( (char*)((vdPacket_t*)buffer)->packet.data, sizeof(vd.packet.data) );
                         vdData.fileStream.flush();
+                        stRecordPhase( ST_PHASE_FILE_IO, stNow() - phaseStart );
+                        vdData.filePos = vdData.fileStream.tellp();     // Save the current file position
 
                         retVal = 0;
                     }
@@ -357,11 +481,30 @@ int vdProcessCmd( char* buffer )
             vd.packet.cmd = VD_CMD_NONE;
         break;
 
+        case VD_CMD_ENCODING:
+            // Compact frames of vdWire.h, the answer is the last full packet
+            encodings = wireEncoding ? ( vd.packet.data[0] & VD_WIRE_ALL ) : 0;
+            if( !( encodings & VD_WIRE_COMPACT ) ) { encodings = 0; }
+
+            ((vdPacket_t*)buffer)->packet.data[0] = encodings;
+            ((vdPacket_t*)buffer)->packet.status  = VD_STATUS_OK;
+
+            message( MsgType::INFO, std::string("VirtDisk Command: Encoding: ") +
+                                    ( ( encodings == 0 )           ? "full packets" : "compact frames" ) +
+                                    ( ( encodings & VD_WIRE_FILL ) ? ", fill" : "" ) +
+                                    ( ( encodings & VD_WIRE_RLE )  ? ", RLE" : "" ) );
+
+            retVal = 0;
+            vd.packet.cmd = VD_CMD_NONE;
+        break;
+
         default:
             vd.packet.cmd = VD_CMD_NONE;
         break;
     }
 
+    stRecordCmd( cmd, stNow() - cmdStart );
+
     return retVal;
 }
 
@@ -379,7 +522,7 @@ bool vdReloadDiskImage( void )
     // Check for previous open file
     if( drive.dev.opened == 1 )
     {
-        errStr = Device_close( &drive.dev );
+        errStr = vdCloseDrive();
         if( errStr != NULL )
         {
             // Device_close failed
@@ -389,13 +532,95 @@ bool vdReloadDiskImage( void )
     }
 
     // Open the disk image
-    errStr = Device_open( &drive.dev, diskPath.c_str(), O_RDWR, devopts.c_str() );
+    errStr = vdOpenDrive();
     if( ( drive.dev.opened == 0 ) || ( errStr != NULL ) )
     {
         // Device_open failed
         message( MsgType::ERR, "Cannot open rcpmfs: " + diskPath + "(" + std::string(errStr) + ")" );
         retVal = false;
     }
+    else
+    {
+        // The client may hold data of the old image
+        dnImageChanged( diskPath, "re-loaded" );
+    }
 
     return retVal;
 }
+
+
+/***************************************************************************//**
+ * @brief   Close the virtual disk image
+ *****************************************************************************/
+void vdCloseDiskImage( void )
+{
+    if( drive.dev.opened == 1 )
+    {
+        vdCloseDrive();
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Opens an emulated disk for writing outside of the client commands.
+ *          The drive of the client is used if it has the image open, then
+ *          the driver of the RPC clients, otherwise the image is opened in
+ *          temp. The caller has to hold gDskMutex.
+ *
+ * @param   disk    Index of the emulated disk (order of the configuration).
+ * @param   temp    Device for the temporary open, see vdCloseEmuDisk().
+ * @param   dev     Set to the device to use.
+ *
+ * @return  NULL on success, otherwise the error message.
+ *****************************************************************************/
+const char* vdOpenEmuDisk( size_t disk, struct Device* temp, struct Device** dev )
+{
+    const char* ret;
+    DSK_PDRIVER shared;
+    std::string opts;
+
+
+    if( ( drive.dev.opened == 1 ) && ( diskPath == diskEmuPath[disk] ) )
+    {
+        *dev = &drive.dev;
+        return NULL;
+    }
+
+    *dev   = temp;
+    opts   = std::string( itIsStoreImage( diskEmuPath[disk] ) ? IT_STORE_TYPE "," : "rcpmfs," ) + diskEmuFormat[disk];
+    shared = rpcFindImage( diskEmuPath[disk] );
+    if( shared != NULL )
+    {
+        return Device_attach( temp, shared, opts.c_str() );
+    }
+
+    ret  = Device_open( temp, diskEmuPath[disk].c_str(), O_RDWR, opts.c_str() );
+    if( ( ret == NULL ) && ( temp->opened == 0 ) )
+    {
+        ret = "not opened";
+    }
+
+    return ret;
+}
+
+
+/***************************************************************************//**
+ * @brief   Closes an emulated disk opened by vdOpenEmuDisk(). The drive of
+ *          the client and the driver of the RPC clients stay open.
+ *
+ * @return  NULL on success, otherwise the error message.
+ *****************************************************************************/
+const char* vdCloseEmuDisk( struct Device* temp, struct Device* dev )
+{
+    if( ( dev == temp ) && ( temp->opened == 1 ) )
+    {
+        if( rpcHoldsDriver( temp->dev ) )
+        {
+            temp->opened = 0;
+            return NULL;
+        }
+        return Device_close( temp );
+    }
+
+    return NULL;
+}
@@ -28,6 +28,7 @@ typedef struct
     uint8_t     sector;         // Sector of the track
     uint8_t     data[512];      // Data buffer
     uint16_t    dataLen;        // Length of the valid data in buffer
+    uint16_t    segCrc[16];     // CRC-16 of every 32 byte segment of data
 } vdPacketInt_t;
 #pragma pack()
 
@@ -53,6 +54,8 @@ enum vdCommands
     VD_CMD_SEL_TR_SEC,
     VD_CMD_RD_SECTOR,
     VD_CMD_WR_SECTOR,
+    VD_CMD_RD_SEGMENT,
+    VD_CMD_ENCODING,
     VD_CMD_COUNT
 };
 
@@ -66,6 +69,7 @@ enum vdStatus
     VD_STATUS_TR_SEC_ERROR,
     VD_STATUS_SEC_RD_ERROR,
     VD_STATUS_SEC_WR_ERROR,
+    VD_STATUS_CHKSUM_ERROR,
     VD_STATUS_COUNT
 };
 
@@ -85,6 +89,11 @@ typedef struct
 int vdProcessCmd( char* buffer );
 
 bool vdReloadDiskImage( void );
+void vdCloseDiskImage( void );
+
+// The caller has to hold gDskMutex for the following functions
+const char* vdOpenEmuDisk( size_t disk, struct Device* temp, struct Device** dev );
+const char* vdCloseEmuDisk( struct Device* temp, struct Device* dev );
 
 
 #endif
@@ -0,0 +1,280 @@
+/***************************************************************************//**
+ * @file    testCpmWrite.cpp
+ *
+ * @brief   Host test of cpmWrite() across extent boundaries.
+ *
+ *          A file of 40000 bytes on z80mbc2-d0 (4 KB blocks, two logical
+ *          extents of 16 KB per directory entry) is written in one call,
+ *          in 128 byte records like CP/M does and in two calls, the second
+ *          one crossing the 16 KB and the 32 KB boundary. All three files
+ *          must get the same directory entries: the first entry holds the
+ *          logical extents 0 and 1 and has the extent number 1, the second
+ *          entry has the extent number 2. The data is read back before and
+ *          after the image is mounted again.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// CP/M Tools
+#include "config.h"
+#include "cpmtools/cpmfs.h"
+#include "cpmtools/cpmdir.h"
+
+
+/******************************************************************* Defines **/
+#define CHECK( cond )   check( ( cond ), #cond, __LINE__ )
+
+#define TEST_FORMAT     "z80mbc2-d0"
+#define TEST_IMAGE      "testCpmWrite.img"
+#define TEST_IMAGE_SIZE ( 512 * 32 * 512 )  // Tracks * sectors * sector size
+#define FILE_SIZE       40000               // Two directory entries, three logical extents
+
+// Directory entry of a file: extent number, record count, last record bytes
+typedef struct
+{
+    int extent;
+    int blkcnt;
+    int lrc;
+} extEntry_t;
+
+
+/********************************************************** Global Variables **/
+extern "C" const char cmd[] = "testCpmWrite";
+
+static int failures = 0;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Counts and prints a failed check.
+ ******************************************************************************/
+static void check( bool ok, const char* cond, int line )
+{
+    if( !ok )
+    {
+        std::cerr << "Line " << line << ": " << cond << " failed" << std::endl;
+        failures++;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Creates the diskdefs file and an empty image in the working
+ *          directory.
+ ******************************************************************************/
+static bool createImage( void )
+{
+    std::ofstream     defs( "diskdefs", std::ios::trunc );
+    std::ofstream     image( TEST_IMAGE, std::ios::binary | std::ios::trunc );
+    std::vector<char> track( 32 * 512, (char)0xE5 );
+
+
+    defs << "diskdef " TEST_FORMAT "\n  seclen 512\n  tracks 512\n  sectrk 32\n  blocksize 4096\n"
+            "  maxdir 512\n  skew 0\n  boottrk 1\n  os 2.2\nend\n";
+
+    for( int i = 0; image && ( i < TEST_IMAGE_SIZE / (int)track.size() ); i++ )
+    {
+        image.write( track.data(), track.size() );
+    }
+
+    return defs.good() && image.good();
+}
+
+
+/***************************************************************************//**
+ * @brief   Mounts the test image.
+ ******************************************************************************/
+static bool mount( struct cpmSuperBlock* super, struct cpmInode* root )
+{
+    const char* errStr;
+
+
+    memset( super, 0, sizeof(*super) );
+    errStr = Device_open( &super->dev, TEST_IMAGE, O_RDWR, "raw," TEST_FORMAT );
+    if( errStr != NULL )
+    {
+        std::cerr << "Cannot open " TEST_IMAGE ": " << errStr << std::endl;
+        return false;
+    }
+    if( cpmReadSuper( super, root, TEST_FORMAT, 0 ) == -1 )
+    {
+        std::cerr << "Cannot read the superblock: " << boo << std::endl;
+        Device_close( &super->dev );
+        return false;
+    }
+
+    return true;
+}
+
+
+/***************************************************************************//**
+ * @brief   Creates a file and writes data in calls of the given sizes.
+ ******************************************************************************/
+static bool writeFile( struct cpmInode* root, const char* name, const std::vector<char>& data,
+                       const std::vector<size_t>& calls )
+{
+    struct cpmInode ino;
+    struct cpmFile  file;
+    size_t          pos = 0;
+    bool            ok;
+
+
+    if( ( cpmCreat( root, name, &ino, 0666 ) == -1 ) || ( cpmOpen( &ino, &file, O_WRONLY ) == -1 ) )
+    {
+        std::cerr << "Cannot create " << name << ": " << boo << std::endl;
+        return false;
+    }
+
+    ok = true;
+    for( size_t i = 0; ok && ( pos < data.size() ); i++ )
+    {
+        size_t len = std::min( calls[i % calls.size()], data.size() - pos );
+
+        ok   = ( cpmWrite( &file, data.data() + pos, len ) == (ssize_t)len );
+        pos += len;
+    }
+    cpmClose( &file );
+
+    return ok;
+}
+
+
+/***************************************************************************//**
+ * @brief   Reads a file in one call and compares it with data.
+ ******************************************************************************/
+static bool readFile( struct cpmInode* root, const char* name, const std::vector<char>& data )
+{
+    struct cpmInode   ino;
+    struct cpmFile    file;
+    std::vector<char> buffer( data.size() + 1024, 0 );
+    ssize_t           got;
+
+
+    if( ( cpmNamei( root, name, &ino ) == -1 ) || ( cpmOpen( &ino, &file, O_RDONLY ) == -1 ) )
+    {
+        std::cerr << "Cannot open " << name << ": " << boo << std::endl;
+        return false;
+    }
+    got = cpmRead( &file, buffer.data(), buffer.size() );
+    cpmClose( &file );
+
+    return ( got == (ssize_t)data.size() ) && ( memcmp( buffer.data(), data.data(), data.size() ) == 0 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Returns the directory entries of a file (user 0, 8.3 name with
+ *          blanks) in the order of the directory.
+ ******************************************************************************/
+static std::vector<extEntry_t> dirEntries( const struct cpmSuperBlock* super, const char* name83 )
+{
+    std::vector<extEntry_t> entries;
+
+
+    for( int i = 0; i < super->maxdir; i++ )
+    {
+        const struct PhysDirectoryEntry* ent = &super->dir[i];
+
+        if( ( ent->status == 0 ) && ( memcmp( ent->name, name83, 8 ) == 0 ) && ( memcmp( ent->ext, name83 + 8, 3 ) == 0 ) )
+        {
+            entries.push_back( { EXTENT( ent->extnol, ent->extnoh ), (unsigned char)ent->blkcnt, (unsigned char)ent->lrc } );
+        }
+    }
+
+    return entries;
+}
+
+
+/***************************************************************************//**
+ * @brief   Checks the directory entries of a 40000 byte file.
+ ******************************************************************************/
+static void checkEntries( const struct cpmSuperBlock* super, const char* name83 )
+{
+    std::vector<extEntry_t> entries = dirEntries( super, name83 );
+
+
+    CHECK( entries.size() == 2 );
+    if( entries.size() != 2 )
+    {
+        return;
+    }
+
+    // Logical extents 0 and 1 are full, the entry has the number of the last one
+    CHECK( entries[0].extent == 1 );
+    CHECK( entries[0].blkcnt == 0x80 );
+
+    // Logical extent 2 holds the remaining 7232 bytes
+    CHECK( entries[1].extent == 2 );
+    CHECK( entries[1].blkcnt == ( ( FILE_SIZE - 1 ) % 16384 ) / 128 + 1 );
+    CHECK( entries[0].lrc == 0 );
+    CHECK( entries[1].lrc == FILE_SIZE % 128 );
+}
+
+
+/***************************************************************************//**
+ * @brief   Runs the test.
+ *
+ * @return  0 if all checks passed, otherwise 1.
+ ******************************************************************************/
+int main( void )
+{
+    struct cpmSuperBlock super;
+    struct cpmInode      root;
+    std::vector<char>    data( FILE_SIZE );
+
+
+    for( size_t i = 0; i < data.size(); i++ )
+    {
+        data[i] = (char)( ( i * 7 ) ^ ( i >> 8 ) );
+    }
+
+    if( !createImage() || !mount( &super, &root ) )
+    {
+        std::cerr << "cpmWrite: cannot create the test image" << std::endl;
+        return 1;
+    }
+
+    CHECK( writeFile( &root, "00single.dat", data, { FILE_SIZE } ) );
+    CHECK( writeFile( &root, "00records.dat", data, { 128 } ) );
+    CHECK( writeFile( &root, "00split.dat", data, { 10000, 30000 } ) );
+
+    checkEntries( &super, "SINGLE  DAT" );
+    checkEntries( &super, "RECORDS DAT" );
+    checkEntries( &super, "SPLIT   DAT" );
+
+    CHECK( readFile( &root, "00single.dat", data ) );
+    CHECK( readFile( &root, "00records.dat", data ) );
+    CHECK( readFile( &root, "00split.dat", data ) );
+    CHECK( cpmUmount( &super ) == 0 );
+
+    // The directory on the disk is the same
+    if( mount( &super, &root ) )
+    {
+        checkEntries( &super, "SINGLE  DAT" );
+        CHECK( readFile( &root, "00single.dat", data ) );
+        CHECK( readFile( &root, "00split.dat", data ) );
+        cpmUmount( &super );
+    }
+    else
+    {
+        CHECK( false );
+    }
+
+    remove( TEST_IMAGE );
+    remove( "diskdefs" );
+
+    std::cout << "cpmWrite: " << ( failures == 0 ? "passed" : std::to_string(failures) + " checks failed" ) << std::endl;
+
+    return ( failures == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+/***************************************************************************//**
+ * @file    testSpiRing.cpp
+ *
+ * @brief   Host test of the SPI frame ring of the WiFi-VirtDisk Client.
+ *
+ *          Checks the empty and full ring, the wraparound of the slots and
+ *          of the 8 bit indices, the zero fill of short frames and the
+ *          order of the frames with a producer and a consumer thread.
+ *
+ * @copyright   Copyright (c) 2025 by Welzel-Online
+ ******************************************************************************/
+
+
+/****************************************************************** Includes **/
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "spiRing.h"
+
+
+/******************************************************************* Defines **/
+#define CHECK( cond )   check( ( cond ), #cond, __LINE__ )
+
+#define THREAD_FRAMES   100000      // Frames of the producer/consumer test
+
+
+/********************************************************** Global Variables **/
+static int failures = 0;
+static spiRing_t ring;
+
+
+/******************************************************* Functions / Methods **/
+/***************************************************************************//**
+ * @brief   Counts and prints a failed check.
+ ******************************************************************************/
+static void check( bool ok, const char* cond, int line )
+{
+    if( !ok )
+    {
+        std::cerr << "Line " << line << ": " << cond << " failed" << std::endl;
+        failures++;
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief   Pushes a frame filled with value.
+ ******************************************************************************/
+static bool pushValue( uint8_t value )
+{
+    uint8_t data[SPI_RING_FRAME_SIZE];
+
+    memset( data, value, sizeof(data) );
+    return spiRingPush( &ring, data, sizeof(data) );
+}
+
+
+/***************************************************************************//**
+ * @brief   An empty ring has no front, a pushed frame is returned unchanged.
+ ******************************************************************************/
+static void testEmpty( void )
+{
+    spiRingReset( &ring );
+    CHECK( spiRingFront( &ring ) == nullptr );
+
+    CHECK( pushValue( 0x5A ) );
+    const uint8_t* frame = spiRingFront( &ring );
+    CHECK( frame != nullptr );
+    CHECK( ( frame != nullptr ) && ( frame[0] == 0x5A ) && ( frame[SPI_RING_FRAME_SIZE - 1] == 0x5A ) );
+
+    // Front does not remove the frame
+    CHECK( spiRingFront( &ring ) == frame );
+    spiRingPop( &ring );
+    CHECK( spiRingFront( &ring ) == nullptr );
+}
+
+
+/***************************************************************************//**
+ * @brief   A full ring drops further frames and counts them, a popped slot
+ *          can be used again.
+ ******************************************************************************/
+static void testFull( void )
+{
+    spiRingReset( &ring );
+    for( int i = 0; i < SPI_RING_FRAMES; i++ )
+    {
+        CHECK( pushValue( (uint8_t)i ) );
+    }
+    CHECK( !pushValue( 0xFF ) );
+    CHECK( !pushValue( 0xFF ) );
+    CHECK( ring.overruns == 2 );
+
+    // The oldest frame is still the first one
+    CHECK( spiRingFront( &ring )[0] == 0 );
+    spiRingPop( &ring );
+    CHECK( pushValue( 0x80 ) );
+    CHECK( !pushValue( 0xFF ) );
+    CHECK( ring.overruns == 3 );
+
+    for( int i = 1; i < SPI_RING_FRAMES; i++ )
+    {
+        CHECK( spiRingFront( &ring )[0] == i );
+        spiRingPop( &ring );
+    }
+    CHECK( spiRingFront( &ring )[0] == 0x80 );
+    spiRingPop( &ring );
+    CHECK( spiRingFront( &ring ) == nullptr );
+}
+
+
+/***************************************************************************//**
+ * @brief   The slots and the 8 bit indices wrap around, the fill level stays
+ *          right across the overflow of head and tail.
+ ******************************************************************************/
+static void testWraparound( void )
+{
+    spiRingReset( &ring );
+
+    // 3 frames in the ring while head and tail pass 255 several times
+    for( int i = 0; i < 3; i++ ) { CHECK( pushValue( (uint8_t)i ) ); }
+    for( int i = 3; i < 1000; i++ )
+    {
+        CHECK( pushValue( (uint8_t)i ) );
+        CHECK( spiRingFront( &ring )[0] == (uint8_t)( i - 3 ) );
+        spiRingPop( &ring );
+        CHECK( (uint8_t)( ring.head.load() - ring.tail.load() ) == 3 );
+    }
+
+    // Full and empty right at the overflow of the indices
+    spiRingReset( &ring );
+    ring.head.store( 252 );
+    ring.tail.store( 252 );
+    for( int i = 0; i < SPI_RING_FRAMES; i++ )
+    {
+        CHECK( pushValue( (uint8_t)i ) );
+    }
+    CHECK( ring.head.load() == (uint8_t)( 252 + SPI_RING_FRAMES ) );
+    CHECK( !pushValue( 0xFF ) );
+    for( int i = 0; i < SPI_RING_FRAMES; i++ )
+    {
+        CHECK( spiRingFront( &ring )[0] == i );
+        spiRingPop( &ring );
+    }
+    CHECK( spiRingFront( &ring ) == nullptr );
+}
+
+
+/***************************************************************************//**
+ * @brief   Short frames are filled with zeros, long ones are cut.
+ ******************************************************************************/
+static void testLength( void )
+{
+    uint8_t data[SPI_RING_FRAME_SIZE + 8];
+
+
+    spiRingReset( &ring );
+    CHECK( pushValue( 0xAA ) );
+    spiRingPop( &ring );
+
+    // Same slot as before after a full round
+    for( int i = 1; i < SPI_RING_FRAMES; i++ )
+    {
+        CHECK( pushValue( 0xAA ) );
+        spiRingPop( &ring );
+    }
+    memset( data, 0x11, sizeof(data) );
+    CHECK( spiRingPush( &ring, data, 4 ) );
+    const uint8_t* frame = spiRingFront( &ring );
+    CHECK( ( frame[3] == 0x11 ) && ( frame[4] == 0 ) && ( frame[SPI_RING_FRAME_SIZE - 1] == 0 ) );
+    spiRingPop( &ring );
+
+    CHECK( spiRingPush( &ring, data, sizeof(data) ) );
+    frame = spiRingFront( &ring );
+    CHECK( frame[SPI_RING_FRAME_SIZE - 1] == 0x11 );
+    spiRingPop( &ring );
+}
+
+
+/***************************************************************************//**
+ * @brief   A producer thread pushes numbered frames, the consumer must get
+ *          them complete and in order.
+ ******************************************************************************/
+static void testThreads( void )
+{
+    uint32_t expected = 0;
+    uint32_t number;
+    bool     ordered  = true;
+
+
+    spiRingReset( &ring );
+
+    std::thread producer( []()
+    {
+        uint8_t data[SPI_RING_FRAME_SIZE];
+
+        for( uint32_t i = 0; i < THREAD_FRAMES; )
+        {
+            for( size_t n = 0; n < sizeof(data); n += sizeof(i) ) { memcpy( data + n, &i, sizeof(i) ); }
+            if( spiRingPush( &ring, data, sizeof(data) ) ) { i++; }
+            else                                           { std::this_thread::yield(); }
+        }
+    } );
+
+    while( expected < THREAD_FRAMES )
+    {
+        const uint8_t* frame = spiRingFront( &ring );
+
+        if( frame == nullptr )
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for( size_t n = 0; n < SPI_RING_FRAME_SIZE; n += sizeof(number) )
+        {
+            memcpy( &number, frame + n, sizeof(number) );
+            ordered = ordered && ( number == expected );
+        }
+        spiRingPop( &ring );
+        expected++;
+    }
+    producer.join();
+
+    CHECK( ordered );
+    CHECK( spiRingFront( &ring ) == nullptr );
+}
+
+
+/***************************************************************************//**
+ * @brief   Runs all tests.
+ *
+ * @return  0 if all checks passed, otherwise 1.
+ ******************************************************************************/
+int main( void )
+{
+    testEmpty();
+    testFull();
+    testWraparound();
+    testLength();
+    testThreads();
+
+    std::cout << "spiRing: " << ( failures == 0 ? "passed" : std::to_string(failures) + " checks failed" ) << std::endl;
+
+    return ( failures == 0 ) ? 0 : 1;
+}